@@ -0,0 +1,408 @@
+#ifndef __BoundedQueue_h__
+#define __BoundedQueue_h__
+
+/** @file BoundedQueue.h
+        Lock-free, fixed capacity, multi-producer multi-consumer queue.
+*/
+
+#include "Exception.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/// Helper macro that will throw an exception before accessing a closed queue
+#define AssertBoundedQueueNotClosed                                            \
+  if (_closed.load(std::memory_order_acquire)) {                               \
+    throw Closed("Queue Already Closed", __FILE__, __LINE__);                  \
+  } else                                                                       \
+    msg::noop()
+
+namespace exec {
+
+/** A thread-safe, lock-free queue with a fixed number of slots.
+        Each slot in the ring carries a sequence number that tells producers
+   and consumers whose turn it is to use the slot, so the only shared writes
+   are a single compare-and-swap on the enqueue or dequeue position. The
+   positions are kept on separate cache lines so producers and consumers do
+   not contend with each other.
+        The blocking calls spin, then yield, then sleep while the queue is full
+   or empty. Use exec::Queue if waiters are expected to block for long periods.
+        Elements are copied before a slot is claimed and only moved once it
+   is, so a throwing copy leaves the queue untouched. T's move constructor
+   must not throw.
+        @tparam T The type of the elements
+        @tparam Capacity The number of elements the queue can hold. Must be a
+   power of two.
+*/
+template <class T, size_t Capacity> class BoundedQueue {
+public:
+  /// Exception that is thrown when attempting to operate on a closed queue
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Get a message
+    explicit Closed(const std::string &message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /// Create a new, empty queue.
+  BoundedQueue();
+  /// Destroys any elements left in the queue.
+  ~BoundedQueue();
+  /** Is the queue empty.
+        @return true if there are no elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  bool empty();
+  /** Is the queue full.
+        @return true if any more elements added to the queue would block.
+        @throws Closed if the queue has been closed
+  */
+  bool full();
+  /** The number of elements in the queue.
+        This is a snapshot and may be stale by the time it is returned.
+        @return The count of all elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  int size();
+  /** Puts an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to add to the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  BoundedQueue &enqueue(const T &value);
+  /** Puts an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to add to the queue.
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     full.
+        @return true if the element was successfully added, false if the
+     operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool enqueue(const T &value, double timeoutInSeconds);
+  /** Puts an element into the queue if there is room, without waiting.
+        @param value The value to add to the queue.
+        @return true if the element was added, false if the queue was full
+        @throws Closed if the queue has been closed
+  */
+  bool tryEnqueue(const T &value);
+  /** Moves an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to move into the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  BoundedQueue &enqueue(T &&value);
+  /** Moves an element into the queue if there is room, without waiting.
+        @param value The value to move into the queue, left alone if full
+        @return true if the element was added, false if the queue was full
+        @throws Closed if the queue has been closed
+  */
+  bool tryEnqueue(T &&value);
+  /** Retrieves that oldest value in the queue.
+        This call will block if the queue is empty.
+        @return The oldest value in the queue
+        @throws Closed if the queue has been closed
+  */
+  T dequeue();
+  /** Retrieves that oldest value in the queue.
+        @param value receives the value from the queue
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     empty.
+        @return true if value was filled in, false if the operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value, double timeoutInSeconds);
+  /** Retrieves that oldest value in the queue if there is one, without waiting.
+        @param value receives the value from the queue
+        @return true if value was filled in, false if the queue was empty
+        @throws Closed if the queue has been closed
+  */
+  bool tryDequeue(T &value);
+  /// Closes the queue, preventing further operations on the queue.
+  void close();
+
+private:
+  enum {
+    CacheLineSize = 64, ///< Separation to prevent false sharing
+    SpinCount = 64,     ///< Times to retry before yielding
+    YieldCount = 64     ///< Times to yield before sleeping
+  };
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type
+      Storage; ///< Uninitialized space for one element
+  /// One entry in the ring
+  struct Slot {
+    std::atomic<size_t> sequence; ///< Whose turn it is to use this slot
+    Storage storage;              ///< The element, if one is present
+  };
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timeouts
+
+  static_assert((Capacity >= 2) && ((Capacity & (Capacity - 1)) == 0),
+                "Capacity must be a power of two");
+  static_assert(std::is_nothrow_move_constructible<T>::value,
+                "a claimed slot must always be filled or emptied");
+  static const size_t Mask = Capacity - 1; ///< Position to slot index
+
+  alignas(CacheLineSize) std::atomic<size_t> _enqueuePosition; ///< Next write
+  alignas(CacheLineSize) std::atomic<size_t> _dequeuePosition; ///< Next read
+  alignas(CacheLineSize) std::atomic<bool> _closed; ///< Has close been called
+  Slot *_slots;                                     ///< The ring
+
+  /// Get the element stored in a slot
+  static T *_value(Slot &slot) { return reinterpret_cast<T *>(&slot.storage); }
+  /** Move value into the next slot, if there is one.
+        @param value moved from only if true is returned
+        @return true if the element was added, false if the queue was full
+  */
+  bool _tryEnqueue(T &value);
+  /** Move the oldest element out of its slot, if there is one.
+        @param value The space to move construct the element into
+        @return true if value was constructed, false if the queue was empty
+  */
+  bool _tryDequeue(Storage &value);
+  /** Wait a little longer each time the queue is not ready.
+        @param attempt The number of times we have waited so far, incremented
+  */
+  static void _backoff(int &attempt);
+  BoundedQueue(const BoundedQueue &);            ///< prevent usage
+  BoundedQueue &operator=(const BoundedQueue &); ///< prevent usage
+};
+
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::Closed::Closed(const char *message,
+                                                 const char *file,
+                                                 int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::Closed::Closed(const std::string &message,
+                                                 const char *file,
+                                                 int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::Closed::~Closed() throw() {}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::BoundedQueue()
+    : _enqueuePosition(0), _dequeuePosition(0), _closed(false),
+      _slots(new Slot[Capacity]) {
+  for (size_t i = 0; i < Capacity; ++i) {
+    _slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity>::~BoundedQueue() {
+  size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+  const size_t end = _enqueuePosition.load(std::memory_order_relaxed);
+
+  for (; position != end; ++position) {
+    _value(_slots[position & Mask])->~T();
+  }
+  delete[] _slots;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::empty() {
+  return size() == 0;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::full() {
+  return size() >= static_cast<int>(Capacity);
+}
+template <class T, size_t Capacity>
+inline int BoundedQueue<T, Capacity>::size() {
+  AssertBoundedQueueNotClosed;
+  const size_t dequeued = _dequeuePosition.load(std::memory_order_acquire);
+  const size_t enqueued = _enqueuePosition.load(std::memory_order_acquire);
+
+  return enqueued > dequeued ? static_cast<int>(enqueued - dequeued) : 0;
+}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity> &
+BoundedQueue<T, Capacity>::enqueue(const T &value) {
+  T copy(value);
+
+  return enqueue(std::move(copy));
+}
+template <class T, size_t Capacity>
+inline BoundedQueue<T, Capacity> &
+BoundedQueue<T, Capacity>::enqueue(T &&value) {
+  int attempt = 0;
+
+  while (!_tryEnqueue(value)) {
+    _backoff(attempt);
+  }
+  return *this;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::enqueue(const T &value,
+                                               double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  T copy(value);
+  int attempt = 0;
+
+  while (!_tryEnqueue(copy)) {
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    _backoff(attempt);
+  }
+  return true;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::tryEnqueue(const T &value) {
+  T copy(value);
+
+  return _tryEnqueue(copy);
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::tryEnqueue(T &&value) {
+  return _tryEnqueue(value);
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::_tryEnqueue(T &value) {
+  size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+  Slot *slot;
+
+  AssertBoundedQueueNotClosed;
+  while (true) {
+    slot = &_slots[position & Mask];
+
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t difference =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+    if (0 == difference) {
+      if (_enqueuePosition.compare_exchange_weak(position, position + 1,
+                                                 std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return false;
+    } else {
+      position = _enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+  new (&slot->storage) T(std::move(value));
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+template <class T, size_t Capacity>
+inline T BoundedQueue<T, Capacity>::dequeue() {
+  Storage storage;
+  int attempt = 0;
+
+  while (!_tryDequeue(storage)) {
+    _backoff(attempt);
+  }
+
+  T *moved = reinterpret_cast<T *>(&storage);
+  T value(std::move(*moved));
+
+  moved->~T();
+  return value;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::dequeue(T &value,
+                                               double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  int attempt = 0;
+
+  while (!tryDequeue(value)) {
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    _backoff(attempt);
+  }
+  return true;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::tryDequeue(T &value) {
+  Storage storage;
+
+  if (!_tryDequeue(storage)) {
+    return false;
+  }
+
+  T *moved = reinterpret_cast<T *>(&storage);
+
+  // the slot is already released, so a throwing assignment cannot wedge it
+  try {
+    value = std::move(*moved);
+  } catch (...) {
+    moved->~T();
+    throw;
+  }
+  moved->~T();
+  return true;
+}
+template <class T, size_t Capacity>
+inline bool BoundedQueue<T, Capacity>::_tryDequeue(Storage &value) {
+  size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+  Slot *slot;
+
+  AssertBoundedQueueNotClosed;
+  while (true) {
+    slot = &_slots[position & Mask];
+
+    const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    const intptr_t difference =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+    if (0 == difference) {
+      if (_dequeuePosition.compare_exchange_weak(position, position + 1,
+                                                 std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      return false;
+    } else {
+      position = _dequeuePosition.load(std::memory_order_relaxed);
+    }
+  }
+  new (&value) T(std::move(*_value(*slot)));
+  _value(*slot)->~T();
+  slot->sequence.store(position + Capacity, std::memory_order_release);
+  return true;
+}
+template <class T, size_t Capacity>
+inline void BoundedQueue<T, Capacity>::close() {
+  _closed.store(true, std::memory_order_release);
+}
+template <class T, size_t Capacity>
+inline void BoundedQueue<T, Capacity>::_backoff(int &attempt) {
+  if (attempt < SpinCount) {
+    // busy wait, the other side is likely mid-operation
+  } else if (attempt < SpinCount + YieldCount) {
+    std::this_thread::yield();
+  } else {
+    const int exponent = attempt - SpinCount - YieldCount;
+
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(exponent < 10 ? (1 << exponent) : 1000));
+  }
+  ++attempt;
+}
+
+#undef AssertBoundedQueueNotClosed // this macro is not valid outside the
+                                   // scope of this file
+
+}; // namespace exec
+
+#endif // __BoundedQueue_h__
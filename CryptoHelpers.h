@@ -112,7 +112,7 @@ T *handleOpenSSLResult(T *pointer, const std::string &call, const char *file,
 class OpenSSLContext {
 public:
   OpenSSLContext() : _context(__crypto_OSSLHandle(EVP_CIPHER_CTX_new())) {}
-  ~OpenSSLContext() { __crypto_OSSLHandle(EVP_CIPHER_CTX_cleanup(_context)); }
+  ~OpenSSLContext() { EVP_CIPHER_CTX_free(_context); }
   operator const EVP_CIPHER_CTX *() const { return _context; }
   operator EVP_CIPHER_CTX *() const { return _context; }
 
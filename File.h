@@ -3,6 +3,7 @@
 
 #include "Exception.h"
 #include "POSIXErrno.h"
+#include "TextSearch.h"
 #include <string>
 
 #if _DEBUG_FILE // Debug
@@ -322,35 +323,32 @@ inline void File::write(Int number, Endian endian, off_t offset,
 inline std::string &File::readline(std::string &buffer, off_t offset,
                                    Relative relative, size_t bufferSize) const {
   std::string partial;
-  std::string::size_type lf, cr, eol;
+  size_t eol = std::string::npos;
   off_t left;
-  bool foundCR = false, foundLF = false;
 
   buffer.clear();
   _goto(offset, relative);
   left = size() - location();
-  while (!foundCR && !foundLF && (left > 0)) {
+  while ((std::string::npos == eol) && (left > 0)) {
     bufferSize = bufferSize > static_cast<size_t>(left)
                      ? static_cast<size_t>(left)
                      : bufferSize;
     read(partial, bufferSize, 0, FromHere);
     left -= partial.size();
-    cr = partial.find('\r');
-    foundCR = (cr != std::string::npos);
-    if (foundCR && (cr == partial.size() - 1) && (left > 0)) {
-      char character;
+    eol = text::findLineBreak(partial.data(), partial.size());
+    if (eol == partial.size()) {
+      eol = std::string::npos;
+    } else if ('\r' == partial[eol]) {
+      if ((eol == partial.size() - 1) && (left > 0)) {
+        char character;
 
-      read(&character, 1, 0, FromHere);
-      partial.append(1, character);
-      left -= 1;
-    }
-    lf = partial.find('\n');
-    foundLF = (lf != std::string::npos);
-    eol = std::string::npos;
-    if (foundCR && foundLF) {
-      eol = ((cr + 1 == lf) || (lf < cr)) ? lf : cr;
-    } else if (foundLF || foundCR) {
-      eol = foundLF ? lf : cr;
+        read(&character, 1, 0, FromHere);
+        partial.append(1, character);
+        left -= 1;
+      }
+      if ((eol + 1 < partial.size()) && ('\n' == partial[eol + 1])) {
+        eol += 1; // \r\n
+      }
     }
     if (eol != std::string::npos) {
       const off_t rewindTo = (partial.size() - eol - 1);
@@ -0,0 +1,46 @@
+#ifndef __FileHash_h__
+#define __FileHash_h__
+
+/** @file FileHash.h
+        Hashes of files, read a chunk at a time on the calling thread.
+*/
+
+#include "File.h"
+#include "Hash.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace hash {
+
+/** Hash a file a chunk at a time, on this thread.
+        Memory use does not depend on the size of the file.
+        @tparam Value The SpecificHash to make, ie hash::sha256
+        @param path The file to hash
+        @param chunkSize The number of bytes to read at a time
+        @return The same hash as Value of the whole file's contents
+*/
+template <class Value>
+Value hashFile(const std::string &path, size_t chunkSize = 1024 * 1024);
+
+template <class Value>
+inline Value hashFile(const std::string &path, size_t chunkSize) {
+  io::File file(path, io::File::Binary, io::File::ReadOnly);
+  typename Value::Incremental hasher;
+  off_t left = file.size();
+  std::vector<char> buffer(
+      std::max(size_t(1), std::min(chunkSize, static_cast<size_t>(left))));
+
+  while (left > 0) {
+    const size_t count = std::min(buffer.size(), static_cast<size_t>(left));
+
+    file.read(buffer.data(), count);
+    hasher.update(buffer.data(), count);
+    left -= count;
+  }
+  return hasher.finish();
+}
+
+} // namespace hash
+
+#endif // __FileHash_h__
@@ -2,13 +2,16 @@
 #define __Hash_h__
 
 /** @file Hash.h
-        @todo evaluate the ability to do partial hashes so not all the data
-   needs to be in memory.
+        Fixed size hashes of data and strings. Data may be hashed all at once
+   or in pieces with SpecificHash::Incremental. FileHash.h hashes files.
 */
 
 #include "Exception.h"
 #include "Text.h"
+#include <algorithm>
 #include <ctype.h>
+#include <functional>
+#include <random>
 #include <string.h>
 #include <string>
 
@@ -17,10 +20,18 @@
 #endif
 
 #if OpenSSLAvailable
+#include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <openssl/sha.h>
 #endif
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define __Hash_crc32c_sse42__ 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 /** Hashing support.
  */
 namespace hash {
@@ -73,16 +84,83 @@ public:
   /// The name of the hashing function.
   virtual const char *name() const = 0;
 };
+template <class Hasher> class IncrementalHash;
+
+/** A hash value with no vtable and no heap, for storing many of them.
+        Digest is trivially copyable and exactly N bytes, so it can be kept in
+   arrays, used as a key in ordered or hashed containers, or written to disk
+   as is. The text forms are written to caller buffers.
+        @tparam N The number of bytes in the hash
+*/
+template <size_t N> struct Digest {
+  enum {
+    Size = N,                       ///< Bytes in the hash
+    HexSize = 2 * N,                ///< Characters in toHex, without the null
+    Base64Size = 4 * ((N + 2) / 3), ///< Most characters toBase64 writes
+  };
+  uint8_t bytes[N]; ///< The hash, as the hasher wrote it
+  /// The number of bytes in the hash
+  static constexpr size_t size() { return N; }
+  /** Parse a hash from hex.
+        @param hex Exactly HexSize hex digits, upper or lower case
+        @return The hash
+        @throws msg::Exception if hex is not HexSize characters or has a
+   character that is not a hex digit
+  */
+  static Digest fromHex(const char *hex);
+  /// Is any byte non-zero. An all zero digest is treated as no hash.
+  bool valid() const;
+  /** Write the hash as lowercase hex.
+        @param buffer Receives HexSize characters and a null terminator
+        @return buffer
+  */
+  char *toHex(char *buffer) const;
+  /** Write the hash as base64.
+        @param buffer Receives up to Base64Size characters and a null
+     terminator
+        @param style The base64 alphabet and padding to use
+        @return buffer
+  */
+  char *toBase64(char *buffer,
+                 text::Base64Style style = text::Base64URLNoPadding) const;
+  /// Compare the bytes of two digests
+  bool operator==(const Digest &other) const {
+    return memcmp(bytes, other.bytes, N) == 0;
+  }
+  /// Compare the bytes of two digests
+  bool operator!=(const Digest &other) const { return !(*this == other); }
+  /// Order by the bytes of the digests
+  bool operator<(const Digest &other) const {
+    return memcmp(bytes, other.bytes, N) < 0;
+  }
+  /// Order by the bytes of the digests
+  bool operator>(const Digest &other) const { return other < *this; }
+  /// Order by the bytes of the digests
+  bool operator<=(const Digest &other) const { return !(other < *this); }
+  /// Order by the bytes of the digests
+  bool operator>=(const Digest &other) const { return !(*this < other); }
+};
+
 /** The specific instantiation of a Hash.
         @tparam Hasher	See CommonCryptoSHA256Hasher below as an example.
                                         Must implement name(), hash() and have a
-   member Size.
+   member Size and a nested Context class.
 */
 template <class Hasher> class SpecificHash : public Hash {
 public:
   enum {
     Size = Hasher::Size ///< The number of bytes in the hash.
   };
+  /// Hashes data that arrives in pieces
+  typedef IncrementalHash<Hasher> Incremental;
+  /// The compact value of this kind of hash
+  typedef hash::Digest<Size> Digest;
+  /** Hash data straight into a Digest, with no heap use.
+        @param data The data to hash
+        @param count The number of bytes in data
+        @return The hash of data
+  */
+  static Digest digest(const void *data, size_t count);
   /// Create a hash object from raw hash data
   static SpecificHash<Hasher> fromData(const void *buffer, uint32_t size);
   /// Create a hash object from hex hash
@@ -102,15 +180,17 @@ public:
   /// Assign another hasher's data to us.
   SpecificHash &operator=(const SpecificHash &other);
   /// Determine if our current hash is the same as another.
-  bool operator==(const SpecificHash &other);
+  bool operator==(const SpecificHash &other) const;
   /// Determine if we are different than another hash.
-  bool operator!=(const SpecificHash &other);
+  bool operator!=(const SpecificHash &other) const;
   /// Determine if the hash is valid
   bool valid() const;
   /// Determine if the hashes represent the same value
-  bool same(const SpecificHash &other);
+  bool same(const SpecificHash &other) const;
   /// Determine if the hash is valid
   operator bool() const;
+  /// Get the compact value of the hash
+  Digest value() const;
   /// Get a pointer to the hash data
   uint8_t *buffer();
   /// Get a const pointer to the hash data
@@ -159,22 +239,98 @@ private:
   uint8_t _hash[Size]; ///< The hash value binary data
 };
 
+/** Calculates a SpecificHash from data given a piece at a time.
+        Hashing a file or stream this way only needs memory for one piece.
+        @tparam Hasher The same Hasher the SpecificHash uses
+*/
+template <class Hasher> class IncrementalHash {
+public:
+  /// Start hashing
+  IncrementalHash() : _context() {}
+  /// Nothing to do in destructor.
+  ~IncrementalHash() {}
+  /** Add the next piece of data.
+        @param data The data to add to the hash
+        @param count The number of bytes in data
+        @return a reference to this
+  */
+  IncrementalHash &update(const void *data, size_t count);
+  /** Add the next piece of data.
+        @param data The data to add to the hash
+        @return a reference to this
+  */
+  IncrementalHash &update(const std::string &data);
+  /** Get the hash of all the data added, and start over.
+        @return The hash of all the data passed to update since construction or
+     the last finish()
+  */
+  SpecificHash<Hasher> finish();
+  /** Get the hash of all the data added, and start over.
+        @param digest Receives the hash of all the data passed to update since
+     construction or the last finish()
+        @return digest
+  */
+  Digest<Hasher::Size> &finish(Digest<Hasher::Size> &digest);
+
+private:
+  typename Hasher::Context _context;                 ///< The running hash
+  IncrementalHash(const IncrementalHash &);            ///< prevent usage
+  IncrementalHash &operator=(const IncrementalHash &); ///< prevent usage
+};
+
 #if OpenSSLAvailable
 
+/** The running state of an OpenSSL digest.
+        @tparam Algorithm The EVP function that names the digest, ie EVP_sha256
+*/
+template <const EVP_MD *(*Algorithm)()> class OpenSSLContext {
+public:
+  /// Start a new digest
+  OpenSSLContext() : _context(EVP_MD_CTX_new()) {
+    AssertMessageException(NULL != _context);
+    _start();
+  }
+  /// Release the digest
+  ~OpenSSLContext() { EVP_MD_CTX_free(_context); }
+  /// Add data to the digest
+  void update(const void *data, size_t dataSize) {
+    AssertMessageException(1 == EVP_DigestUpdate(_context, data, dataSize));
+  }
+  /// Write the digest to hash and start a new digest
+  void finish(void *hash) {
+    AssertMessageException(
+        1 == EVP_DigestFinal_ex(_context,
+                                reinterpret_cast<unsigned char *>(hash), NULL));
+    _start();
+  }
+
+private:
+  EVP_MD_CTX *_context; ///< The OpenSSL digest state
+  /// Initialize the digest
+  void _start() {
+    AssertMessageException(1 == EVP_DigestInit_ex(_context, Algorithm(), NULL));
+  }
+  OpenSSLContext(const OpenSSLContext &);            ///< prevent usage
+  OpenSSLContext &operator=(const OpenSSLContext &); ///< prevent usage
+};
+
 /// Open SSL version of MD5 Hasher
 struct OpenSLLMD5Hasher {
   enum { Size = MD5_DIGEST_LENGTH };
+  typedef OpenSSLContext<EVP_md5> Context;
   static const char *name() { return "md5"; }
   static void hash(const void *data, size_t dataSize,
                    void *hash) { /// @too test
-    MD5(reinterpret_cast<const unsigned char *>(data), dataSize,
-        reinterpret_cast<unsigned char *>(hash));
+    AssertMessageException(
+        1 == EVP_Digest(data, dataSize, reinterpret_cast<unsigned char *>(hash),
+                        NULL, EVP_md5(), NULL));
   }
 };
 
 /// Open SLL version of SHA256 Hasher
 struct OpenSSLSHA256Hasher {
   enum { Size = SHA256_DIGEST_LENGTH };
+  typedef OpenSSLContext<EVP_sha256> Context;
   static const char *name() { return "sha256"; }
   static void hash(const void *data, size_t dataSize, void *hash) {
     SHA256(reinterpret_cast<const unsigned char *>(data), dataSize,
@@ -218,11 +374,527 @@ struct CommonCryptoSHA256Hasher {
   static void hash(const void *data, size_t dataSize, void *hash) {
     CC_SHA256(data, dataSize, reinterpret_cast<unsigned char *>(hash));
   }
+  /** Every SpecificHash hasher must have a Context class. This holds the state
+     of a hash that is being given data a piece at a time.
+  */
+  class Context {
+  public:
+    /// Start a new hash
+    Context() : _context() { CC_SHA256_Init(&_context); }
+    /// Add data to the hash
+    void update(const void *data, size_t dataSize) {
+      while (dataSize > 0) { // CC_LONG is 32 bits
+        const CC_LONG count = static_cast<CC_LONG>(
+            std::min(dataSize, static_cast<size_t>(0x40000000)));
+
+        CC_SHA256_Update(&_context, data, count);
+        data = reinterpret_cast<const uint8_t *>(data) + count;
+        dataSize -= count;
+      }
+    }
+    /// Write the hash to hash and start a new hash
+    void finish(void *hash) {
+      CC_SHA256_Final(reinterpret_cast<unsigned char *>(hash), &_context);
+      CC_SHA256_Init(&_context);
+    }
+
+  private:
+    CC_SHA256_CTX _context;              ///< The CommonCrypto hash state
+    Context(const Context &);            ///< prevent usage
+    Context &operator=(const Context &); ///< prevent usage
+  };
 };
 
 typedef SpecificHash<CommonCryptoSHA256Hasher> sha256;
 #endif
 
+/// Read a little endian 64 bit integer from unaligned memory
+inline uint64_t _littleEndian64(const uint8_t *bytes) {
+  uint64_t value;
+
+  memcpy(&value, bytes, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+/// Read a little endian 32 bit integer from unaligned memory
+inline uint32_t _littleEndian32(const uint8_t *bytes) {
+  uint32_t value;
+
+  memcpy(&value, bytes, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+/// Rotate a 64 bit integer left
+inline uint64_t _rotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+/// Write an integer to memory, most significant byte first
+template <class Int> inline void _bigEndian(Int value, void *buffer) {
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(buffer);
+
+  for (int byte = sizeof(Int) - 1; byte >= 0; --byte) {
+    bytes[byte] = static_cast<uint8_t>(value);
+    value >>= 8;
+  }
+}
+
+/** XXH64, a fast non-cryptographic hash for hash tables and change detection.
+        The 8 byte hash is in canonical (big endian) order, so hex() matches
+   the xxhsum tool.
+*/
+struct XXH64Hasher {
+  enum { Size = 8 };
+  static const char *name() { return "xxh64"; }
+  static void hash(const void *data, size_t dataSize, void *hash) {
+    Context context;
+
+    context.update(data, dataSize);
+    context.finish(hash);
+  }
+  /// The running state of an XXH64 hash
+  class Context {
+  public:
+    /// Start a new hash
+    Context() : _lanes(), _buffer(), _buffered(0), _total(0) { _start(); }
+    /// Add data to the hash
+    void update(const void *data, size_t dataSize);
+    /// Write the hash to hash and start a new hash
+    void finish(void *hash);
+
+  private:
+    static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL; ///< xxHash constant
+    static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL; ///< xxHash constant
+    static const uint64_t Prime3 = 0x165667B19E3779F9ULL; ///< xxHash constant
+    static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL; ///< xxHash constant
+    static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL; ///< xxHash constant
+    uint64_t _lanes[4];  ///< Accumulators for 32 byte stripes
+    uint8_t _buffer[32]; ///< Data waiting for a full stripe
+    size_t _buffered;    ///< Bytes in _buffer
+    uint64_t _total;     ///< Bytes hashed so far
+    /// Reset to the empty hash with seed 0
+    void _start();
+    /// Mix one 8 byte input into an accumulator
+    static uint64_t _round(uint64_t accumulator, uint64_t input) {
+      return _rotateLeft(accumulator + input * Prime2, 31) * Prime1;
+    }
+    /// Fold an accumulator into the result
+    static uint64_t _merge(uint64_t result, uint64_t accumulator) {
+      return (result ^ _round(0, accumulator)) * Prime1 + Prime4;
+    }
+    /// Consume one 32 byte stripe
+    void _stripe(const uint8_t *stripe);
+  };
+};
+
+/** CRC-32C (Castagnoli), as used by iSCSI, ext4 and many storage formats.
+        Uses the SSE 4.2 crc32 instruction when the processor has it, the
+   ARMv8 CRC instructions when built for them, and a table otherwise. The 4
+   byte hash is the CRC, most significant byte first.
+*/
+struct CRC32CHasher {
+  enum { Size = 4 };
+  static const char *name() { return "crc32c"; }
+  static void hash(const void *data, size_t dataSize, void *hash) {
+    _bigEndian(~update(~uint32_t(0), data, dataSize), hash);
+  }
+  /** Continue a CRC. Starts at ~0, and the final CRC is the complement.
+        @param crc The CRC so far
+        @param data The next data
+        @param dataSize The number of bytes in data
+        @return The CRC including data
+  */
+  static uint32_t update(uint32_t crc, const void *data, size_t dataSize);
+  /// The running state of a CRC-32C
+  class Context {
+  public:
+    /// Start a new CRC
+    Context() : _crc(~uint32_t(0)) {}
+    /// Add data to the CRC
+    void update(const void *data, size_t dataSize) {
+      _crc = CRC32CHasher::update(_crc, data, dataSize);
+    }
+    /// Write the CRC to hash and start a new CRC
+    void finish(void *hash) {
+      _bigEndian(~_crc, hash);
+      _crc = ~uint32_t(0);
+    }
+
+  private:
+    uint32_t _crc; ///< The CRC so far, not yet complemented
+  };
+
+private:
+  /// CRC one byte at a time from a table
+  static uint32_t _table(uint32_t crc, const uint8_t *data, size_t dataSize);
+  /// CRC with the SSE 4.2 or ARMv8 CRC instructions
+  static uint32_t _instructions(uint32_t crc, const uint8_t *data,
+                                size_t dataSize);
+};
+
+/** SipHash-2-4, a keyed hash that resists collisions chosen by an attacker,
+   for hash tables holding untrusted keys.
+        The key is given at runtime, and should be secret and random, like
+   SipHash24RandomHasher::key(). The 8 byte hash is the 64 bit result, least
+   significant byte first, as in the reference implementation's test vectors.
+*/
+class SipHash24 {
+public:
+  /** Start a new hash with a key.
+        @param key0 The first 8 bytes of the key, read as little endian
+        @param key1 The last 8 bytes of the key, read as little endian
+  */
+  SipHash24(uint64_t key0, uint64_t key1)
+      : _key{key0, key1}, _state(), _buffer(), _buffered(0), _total(0) {
+    _start();
+  }
+  /** Hash data all at once.
+        @param key0 The first 8 bytes of the key, read as little endian
+        @param key1 The last 8 bytes of the key, read as little endian
+        @param data The data to hash
+        @param dataSize The number of bytes in data
+        @return The 64 bit hash
+  */
+  static uint64_t hash(uint64_t key0, uint64_t key1, const void *data,
+                       size_t dataSize);
+  /// Add data to the hash
+  void update(const void *data, size_t dataSize);
+  /// Write the hash to hash and start a new hash with the same key
+  void finish(void *hash);
+
+private:
+  uint64_t _key[2];   ///< The key
+  uint64_t _state[4]; ///< v0 through v3
+  uint8_t _buffer[8]; ///< Data waiting for a full word
+  size_t _buffered;   ///< Bytes in _buffer
+  uint64_t _total;    ///< Bytes hashed so far
+  /// Reset to the empty hash
+  void _start();
+  /// One SipRound
+  void _round();
+  /// Mix in one 8 byte word with two SipRounds
+  void _word(uint64_t word);
+};
+
+/** SipHash-2-4 with a random key chosen once per process.
+        Hashes differ between runs, so they must not be stored or sent.
+*/
+struct SipHash24RandomHasher {
+  enum { Size = 8 };
+  static const char *name() { return "siphash24"; }
+  static void hash(const void *data, size_t dataSize, void *hash) {
+    Context context;
+
+    context.update(data, dataSize);
+    context.finish(hash);
+  }
+  /** The key of this process.
+        @return Two words read from std::random_device the first time
+  */
+  static const uint64_t *key();
+  /// The running state of a SipHash with the process key
+  class Context : public SipHash24 {
+  public:
+    /// Start a new hash
+    Context() : SipHash24(key()[0], key()[1]) {}
+  };
+};
+
+/** SipHash-2-4 with a key fixed at compile time, for known test vectors or
+   hashes that must match between runs. Anyone who knows the key can choose
+   colliding data, so prefer SipHash24RandomHasher for untrusted keys.
+        @tparam Key0 The first 8 bytes of the key, read as little endian
+        @tparam Key1 The last 8 bytes of the key, read as little endian
+*/
+template <uint64_t Key0, uint64_t Key1> struct SipHash24Hasher {
+  enum { Size = 8 };
+  static const char *name() { return "siphash24"; }
+  static void hash(const void *data, size_t dataSize, void *hash) {
+    Context context;
+
+    context.update(data, dataSize);
+    context.finish(hash);
+  }
+  /// The running state of a SipHash with the fixed key
+  class Context : public SipHash24 {
+  public:
+    /// Start a new hash
+    Context() : SipHash24(Key0, Key1) {}
+  };
+};
+
+typedef SpecificHash<XXH64Hasher> xxh64;   ///< Fast hash
+typedef SpecificHash<CRC32CHasher> crc32c; ///< Checksum
+/// Keyed hash for untrusted keys, with a random key for this process
+typedef SpecificHash<SipHash24RandomHasher> siphash24random;
+/// Keyed hash with a fixed key
+template <uint64_t Key0, uint64_t Key1>
+using siphash24 = SpecificHash<SipHash24Hasher<Key0, Key1>>;
+
+inline void XXH64Hasher::Context::update(const void *data, size_t dataSize) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+  _total += dataSize;
+  if (_buffered > 0) {
+    const size_t count = std::min(dataSize, sizeof(_buffer) - _buffered);
+
+    memcpy(_buffer + _buffered, bytes, count);
+    _buffered += count;
+    bytes += count;
+    dataSize -= count;
+    if (_buffered < sizeof(_buffer)) {
+      return;
+    }
+    _stripe(_buffer);
+    _buffered = 0;
+  }
+  for (; dataSize >= sizeof(_buffer);
+       dataSize -= sizeof(_buffer), bytes += sizeof(_buffer)) {
+    _stripe(bytes);
+  }
+  memcpy(_buffer, bytes, dataSize);
+  _buffered = dataSize;
+}
+inline void XXH64Hasher::Context::finish(void *hash) {
+  const uint8_t *bytes = _buffer;
+  size_t left = _buffered;
+  uint64_t result;
+
+  if (_total >= sizeof(_buffer)) {
+    result = _rotateLeft(_lanes[0], 1) + _rotateLeft(_lanes[1], 7) +
+             _rotateLeft(_lanes[2], 12) + _rotateLeft(_lanes[3], 18);
+    for (int lane = 0; lane < 4; ++lane) {
+      result = _merge(result, _lanes[lane]);
+    }
+  } else {
+    result = Prime5; // seed 0
+  }
+  result += _total;
+  for (; left >= 8; left -= 8, bytes += 8) {
+    result ^= _round(0, _littleEndian64(bytes));
+    result = _rotateLeft(result, 27) * Prime1 + Prime4;
+  }
+  if (left >= 4) {
+    result ^= uint64_t(_littleEndian32(bytes)) * Prime1;
+    result = _rotateLeft(result, 23) * Prime2 + Prime3;
+    left -= 4;
+    bytes += 4;
+  }
+  for (; left > 0; --left, ++bytes) {
+    result ^= (*bytes) * Prime5;
+    result = _rotateLeft(result, 11) * Prime1;
+  }
+  result ^= result >> 33;
+  result *= Prime2;
+  result ^= result >> 29;
+  result *= Prime3;
+  result ^= result >> 32;
+  _bigEndian(result, hash);
+  _start();
+}
+inline void XXH64Hasher::Context::_start() {
+  _lanes[0] = Prime1 + Prime2;
+  _lanes[1] = Prime2;
+  _lanes[2] = 0;
+  _lanes[3] = 0 - Prime1;
+  _buffered = 0;
+  _total = 0;
+}
+inline void XXH64Hasher::Context::_stripe(const uint8_t *stripe) {
+  for (int lane = 0; lane < 4; ++lane) {
+    _lanes[lane] = _round(_lanes[lane], _littleEndian64(stripe + 8 * lane));
+  }
+}
+
+inline uint32_t CRC32CHasher::update(uint32_t crc, const void *data,
+                                     size_t dataSize) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+#if __Hash_crc32c_sse42__
+  static const bool hasInstructions = __builtin_cpu_supports("sse4.2");
+#elif defined(__ARM_FEATURE_CRC32)
+  static const bool hasInstructions = true;
+#else
+  static const bool hasInstructions = false;
+#endif
+
+  return hasInstructions ? _instructions(crc, bytes, dataSize)
+                         : _table(crc, bytes, dataSize);
+}
+inline uint32_t CRC32CHasher::_table(uint32_t crc, const uint8_t *data,
+                                     size_t dataSize) {
+  struct Table {
+    uint32_t entries[256];
+    Table() : entries() {
+      for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t value = byte;
+
+        for (int bit = 0; bit < 8; ++bit) {
+          value = (value >> 1) ^ ((value & 1) ? 0x82F63B78 : 0);
+        }
+        entries[byte] = value;
+      }
+    }
+  };
+  static const Table table;
+
+  for (; dataSize > 0; --dataSize, ++data) {
+    crc = table.entries[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+#if __Hash_crc32c_sse42__
+__attribute__((target("sse4.2")))
+#endif
+inline uint32_t
+CRC32CHasher::_instructions(uint32_t crc, const uint8_t *data,
+                            size_t dataSize) {
+#if __Hash_crc32c_sse42__
+  uint64_t crc64 = crc;
+
+  for (; dataSize >= 8; dataSize -= 8, data += 8) {
+    crc64 = _mm_crc32_u64(crc64, _littleEndian64(data));
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; dataSize > 0; --dataSize, ++data) {
+    crc = _mm_crc32_u8(crc, *data);
+  }
+  return crc;
+#elif defined(__ARM_FEATURE_CRC32)
+  for (; dataSize >= 8; dataSize -= 8, data += 8) {
+    crc = __crc32cd(crc, _littleEndian64(data));
+  }
+  for (; dataSize > 0; --dataSize, ++data) {
+    crc = __crc32cb(crc, *data);
+  }
+  return crc;
+#else
+  return _table(crc, data, dataSize);
+#endif
+}
+
+inline uint64_t SipHash24::hash(uint64_t key0, uint64_t key1, const void *data,
+                                size_t dataSize) {
+  SipHash24 context(key0, key1);
+  uint8_t hash[8];
+
+  context.update(data, dataSize);
+  context.finish(hash);
+  return _littleEndian64(hash);
+}
+inline void SipHash24::update(const void *data, size_t dataSize) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+  _total += dataSize;
+  if (_buffered > 0) {
+    const size_t count = std::min(dataSize, sizeof(_buffer) - _buffered);
+
+    memcpy(_buffer + _buffered, bytes, count);
+    _buffered += count;
+    bytes += count;
+    dataSize -= count;
+    if (_buffered < sizeof(_buffer)) {
+      return;
+    }
+    _word(_littleEndian64(_buffer));
+    _buffered = 0;
+  }
+  for (; dataSize >= 8; dataSize -= 8, bytes += 8) {
+    _word(_littleEndian64(bytes));
+  }
+  memcpy(_buffer, bytes, dataSize);
+  _buffered = dataSize;
+}
+inline void SipHash24::finish(void *hash) {
+  uint64_t last = _total << 56;
+  uint8_t *output = reinterpret_cast<uint8_t *>(hash);
+
+  for (size_t byte = 0; byte < _buffered; ++byte) {
+    last |= uint64_t(_buffer[byte]) << (8 * byte);
+  }
+  _word(last);
+  _state[2] ^= 0xFF;
+  for (int round = 0; round < 4; ++round) {
+    _round();
+  }
+  last = _state[0] ^ _state[1] ^ _state[2] ^ _state[3];
+  for (int byte = 0; byte < 8; ++byte) {
+    output[byte] = static_cast<uint8_t>(last >> (8 * byte));
+  }
+  _start();
+}
+inline void SipHash24::_start() {
+  _state[0] = _key[0] ^ 0x736f6d6570736575ULL;
+  _state[1] = _key[1] ^ 0x646f72616e646f6dULL;
+  _state[2] = _key[0] ^ 0x6c7967656e657261ULL;
+  _state[3] = _key[1] ^ 0x7465646279746573ULL;
+  _buffered = 0;
+  _total = 0;
+}
+inline void SipHash24::_round() {
+  _state[0] += _state[1];
+  _state[1] = _rotateLeft(_state[1], 13) ^ _state[0];
+  _state[0] = _rotateLeft(_state[0], 32);
+  _state[2] += _state[3];
+  _state[3] = _rotateLeft(_state[3], 16) ^ _state[2];
+  _state[0] += _state[3];
+  _state[3] = _rotateLeft(_state[3], 21) ^ _state[0];
+  _state[2] += _state[1];
+  _state[1] = _rotateLeft(_state[1], 17) ^ _state[2];
+  _state[2] = _rotateLeft(_state[2], 32);
+}
+inline void SipHash24::_word(uint64_t word) {
+  _state[3] ^= word;
+  _round();
+  _round();
+  _state[0] ^= word;
+}
+
+inline const uint64_t *SipHash24RandomHasher::key() {
+  struct Key {
+    Key() : words() {
+      std::random_device device;
+
+      for (uint64_t &word : words) {
+        word = (uint64_t(device()) << 32) ^ device();
+      }
+    }
+    uint64_t words[2];
+  };
+  static const Key key; // initialized once, even with several threads
+
+  return key.words;
+}
+
+template <size_t N> inline Digest<N> Digest<N>::fromHex(const char *hex) {
+  Digest result;
+
+  AssertMessageException(strnlen(hex, HexSize + 1) == HexSize);
+  text::fromHex(hex, HexSize, result.bytes);
+  return result;
+}
+template <size_t N> inline bool Digest<N>::valid() const {
+  for (size_t byte = 0; byte < N; ++byte) {
+    if (bytes[byte] != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+template <size_t N> inline char *Digest<N>::toHex(char *buffer) const {
+  *text::toHex(bytes, N, buffer) = '\0';
+  return buffer;
+}
+template <size_t N>
+inline char *Digest<N>::toBase64(char *buffer, text::Base64Style style) const {
+  text::Base64Encoder encoder(style);
+
+  *encoder.finish(encoder.update(bytes, N, buffer)) = '\0';
+  return buffer;
+}
+
 /** Copy the raw hash data into the hasher.
         @param buffer The hash to copy
         @param size The size of the hash
@@ -236,6 +908,14 @@ inline SpecificHash<Hasher> SpecificHash<Hasher>::fromData(const void *buffer,
   memcpy(result._hash, buffer, Size);
   return result;
 }
+template <class Hasher>
+inline typename SpecificHash<Hasher>::Digest
+SpecificHash<Hasher>::digest(const void *data, size_t count) {
+  Digest result;
+
+  Hasher::hash(data, count, result.bytes);
+  return result;
+}
 /// Create a hash object from hex string
 template <class Hasher>
 inline SpecificHash<Hasher>
@@ -300,7 +980,7 @@ SpecificHash<Hasher>::operator=(const SpecificHash<Hasher> &other) {
 */
 template <class Hasher>
 inline bool
-SpecificHash<Hasher>::operator==(const SpecificHash<Hasher> &other) {
+SpecificHash<Hasher>::operator==(const SpecificHash<Hasher> &other) const {
   return same(other);
 }
 /** Comparison operator, compares the binary of the hashes.
@@ -309,7 +989,7 @@ SpecificHash<Hasher>::operator==(const SpecificHash<Hasher> &other) {
 */
 template <class Hasher>
 inline bool
-SpecificHash<Hasher>::operator!=(const SpecificHash<Hasher> &other) {
+SpecificHash<Hasher>::operator!=(const SpecificHash<Hasher> &other) const {
   return !same(other);
 }
 /** Hash a hash been calculated or assigned, or is this still an invalid,
@@ -330,7 +1010,8 @@ template <class Hasher> inline bool SpecificHash<Hasher>::valid() const {
         @return false if the binary representation of each hash is identical.
 */
 template <class Hasher>
-inline bool SpecificHash<Hasher>::same(const SpecificHash<Hasher> &other) {
+inline bool
+SpecificHash<Hasher>::same(const SpecificHash<Hasher> &other) const {
   return (memcmp(_hash, other._hash, sizeof(_hash)) == 0);
 }
 /** Operator typecast to bool, returns true if this hash has been initialized.
@@ -339,6 +1020,14 @@ inline bool SpecificHash<Hasher>::same(const SpecificHash<Hasher> &other) {
 template <class Hasher> inline SpecificHash<Hasher>::operator bool() const {
   return valid();
 }
+template <class Hasher>
+inline typename SpecificHash<Hasher>::Digest
+SpecificHash<Hasher>::value() const {
+  Digest result;
+
+  memcpy(result.bytes, _hash, Size);
+  return result;
+}
 /** The pointer to the actual data buffer of this hash.
         @return the address of the buffer used to store the binary hash.
 */
@@ -363,27 +1052,25 @@ template <class Hasher> inline uint32_t SpecificHash<Hasher>::size() const {
 */
 template <class Hasher>
 inline std::string &SpecificHash<Hasher>::hex(std::string &value) const {
-  value.clear();
-  return text::toHex(
-      std::string(reinterpret_cast<const char *>(_hash), sizeof(_hash)), value);
+  value.resize(2 * sizeof(_hash));
+  text::toHex(_hash, sizeof(_hash), &value[0]);
+  return value;
 }
 template <class Hasher>
 inline std::string &
 SpecificHash<Hasher>::base64(std::string &value,
                              text::Base64Style style) const {
-  value.clear();
-  return text::base64Encode(
-      std::string(reinterpret_cast<const char *>(_hash), sizeof(_hash)), value,
-      style);
+  return text::base64Encode(_hash, sizeof(_hash), value, style);
 }
-/** Make the value of this hash be the given lowercase hex value.
+/** Make the value of this hash be the given hex value.
  */
 template <class Hasher>
 inline void SpecificHash<Hasher>::assignFromHex(const std::string &hex) {
-  std::string buffer;
-  text::fromHex(hex, buffer)
-      .copy(reinterpret_cast<char *>(_hash), sizeof(_hash));
-  AssertMessageException(buffer.size() == sizeof(_hash));
+  uint8_t buffer[sizeof(_hash)];
+
+  AssertMessageException(hex.size() == 2 * sizeof(_hash));
+  text::fromHex(hex.data(), hex.size(), buffer);
+  memcpy(_hash, buffer, sizeof(_hash));
 }
 template <class Hasher>
 inline void SpecificHash<Hasher>::assignFromBase64(const std::string &base64) {
@@ -410,6 +1097,51 @@ inline void SpecificHash<Hasher>::reset(const std::string &data) {
 template <class Hasher> inline const char *SpecificHash<Hasher>::name() const {
   return Hasher::name();
 }
+template <class Hasher>
+inline IncrementalHash<Hasher> &
+IncrementalHash<Hasher>::update(const void *data, size_t count) {
+  _context.update(data, count);
+  return *this;
+}
+template <class Hasher>
+inline IncrementalHash<Hasher> &
+IncrementalHash<Hasher>::update(const std::string &data) {
+  _context.update(data.data(), data.size());
+  return *this;
+}
+template <class Hasher>
+inline SpecificHash<Hasher> IncrementalHash<Hasher>::finish() {
+  SpecificHash<Hasher> result;
+
+  _context.finish(result.buffer());
+  return result;
+}
+template <class Hasher>
+inline Digest<Hasher::Size> &
+IncrementalHash<Hasher>::finish(Digest<Hasher::Size> &digest) {
+  _context.finish(digest.bytes);
+  return digest;
+}
 } // namespace hash
 
+namespace std {
+/// Lets hash::Digest be the key of unordered containers
+template <size_t N> struct hash<::hash::Digest<N>> {
+  size_t operator()(const ::hash::Digest<N> &digest) const {
+    size_t value = 0;
+
+    if (N >= sizeof(value)) { // digests are already well mixed
+      memcpy(&value, digest.bytes, sizeof(value));
+      return value;
+    }
+    for (size_t byte = 0; byte < N; ++byte) {
+      value = (value << 8) | digest.bytes[byte];
+    }
+    return std::hash<size_t>()(value);
+  }
+};
+} // namespace std
+
+#undef __Hash_crc32c_sse42__
+
 #endif // __Hash_h__
@@ -0,0 +1,605 @@
+#ifndef __HashMany_h__
+#define __HashMany_h__
+
+/** @file HashMany.h
+        Hash many independent messages in one call.
+        SHA-256 batches can be hashed with multi-buffer AVX2 (eight messages at
+   a time, one per 32 bit lane), the SHA extensions or portable code. Other
+   hashers, and SHA-256 when no engine was timed faster than the platform
+   library on this processor, call Hasher::hash for each message.
+*/
+
+#include "Hash.h"
+#include <algorithm>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define __HashMany_x86__ 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define __HashMany_x86__ 0
+#endif
+
+namespace hash {
+
+/// A message to hash, the data is not copied
+struct Span {
+  const void *data; ///< The first byte of the message
+  size_t size;      ///< The number of bytes in the message
+};
+
+/** Is a hasher SHA-256, so that hashMany may use the SHA-256 engines for it.
+        Specialize this for other SHA-256 hashers.
+*/
+template <class Hasher> struct IsSHA256 : std::false_type {};
+#if OpenSSLAvailable
+template <> struct IsSHA256<OpenSSLSHA256Hasher> : std::true_type {};
+#endif
+#if __APPLE_CC__ || __APPLE__
+template <> struct IsSHA256<CommonCryptoSHA256Hasher> : std::true_type {};
+#endif
+
+/// The ways a batch of SHA-256 messages can be hashed
+enum SHA256Engine {
+  SHA256Automatic,  ///< Hasher::hash, or another engine timed faster
+  SHA256Portable,   ///< Plain C++, one message at a time
+  SHA256AVX2,       ///< Eight messages at a time in AVX2 registers
+  SHA256Extensions, ///< One message at a time with the x86 SHA instructions
+};
+
+/** Can this processor use an engine.
+        @param engine The engine to check
+        @return true if hashMany can use engine on this processor
+*/
+bool supported(SHA256Engine engine);
+
+/** Hash a batch of messages.
+        @param spans The messages to hash
+        @param count The number of messages in spans
+        @param digests Receives the hash of each message, count entries
+        @param engine For SHA-256 hashers, how to hash the messages
+*/
+template <class Hasher>
+void hashMany(const Span *spans, size_t count, SpecificHash<Hasher> *digests,
+              SHA256Engine engine = SHA256Automatic);
+
+/** Hash a batch of messages.
+        @param spans The messages to hash
+        @param digests Resized to receive the hash of each message
+        @param engine For SHA-256 hashers, how to hash the messages
+        @return a reference to digests
+*/
+template <class Hasher>
+std::vector<SpecificHash<Hasher>> &
+hashMany(const std::vector<Span> &spans,
+         std::vector<SpecificHash<Hasher>> &digests,
+         SHA256Engine engine = SHA256Automatic);
+
+/// Round constants
+static const uint32_t _SHA256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/// Initial hash value
+static const uint32_t _SHA256IV[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                      0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                      0x1f83d9ab, 0x5be0cd19};
+
+/** The 64 byte blocks of one message: its whole blocks are read in place and
+   the padded tail is built in a small buffer.
+*/
+class _SHA256Message {
+public:
+  _SHA256Message() : _data(NULL), _whole(0), _blocks(0), _tail() {}
+  /// Prepare to hash a message
+  void start(const Span &span);
+  /// The number of blocks, including padding
+  size_t blocks() const { return _blocks; }
+  /// The 64 bytes of block index
+  const uint8_t *block(size_t index) const {
+    return index < _whole ? _data + 64 * index : _tail + 64 * (index - _whole);
+  }
+  /// The number of blocks that are in the message's memory
+  size_t whole() const { return _whole; }
+
+private:
+  const uint8_t *_data; ///< The message
+  size_t _whole;        ///< Blocks that are entirely message data
+  size_t _blocks;       ///< All blocks including the padded tail
+  uint8_t _tail[128];   ///< Remaining message data, padding and bit length
+};
+
+/// Hash whole blocks one at a time in plain C++
+void _sha256Portable(uint32_t state[8], const uint8_t *data, size_t blocks);
+/// Hash whole blocks one at a time with the SHA instructions
+void _sha256Extensions(uint32_t state[8], const uint8_t *data, size_t blocks);
+/// Load eight words from each block, transposed to one word per register
+void _sha256Transpose(const uint8_t *const blocks[8], size_t offset,
+                      void *words);
+/** Hash one block from each of eight messages.
+        @param state state[word][lane] for each of the eight lanes
+        @param blocks The next block of each lane
+*/
+void _sha256AVX2(uint32_t state[8][8], const uint8_t *const blocks[8]);
+/** Hash messages one at a time with a single block engine.
+        @param digest digest(i) is where the 32 byte digest of message i goes
+*/
+template <class Digest>
+void _sha256Each(const Span *spans, size_t count, Digest digest,
+                 bool extensions);
+/** Hash messages eight at a time with AVX2.
+        @param digest digest(i) is where the 32 byte digest of message i goes
+*/
+template <class Digest>
+void _sha256Lanes(const Span *spans, size_t count, Digest digest);
+/** The fastest of Hasher::hash, the AVX2 lanes and the SHA instructions.
+        Each is timed on a sample batch the first time this is called.
+        @return SHA256Automatic when Hasher::hash is the fastest
+*/
+template <class Hasher> SHA256Engine _fastestEngine();
+/// Write a state as a big endian digest
+void _sha256Digest(const uint32_t state[8], uint8_t *digest);
+
+/// Rotate a word right
+inline uint32_t _rotate(uint32_t value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+/// Read a big endian word
+inline uint32_t _bigEndian32(const uint8_t *bytes) {
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+         (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+inline bool supported(SHA256Engine engine) {
+  switch (engine) {
+  case SHA256Automatic:
+  case SHA256Portable:
+    return true;
+#if __HashMany_x86__
+  case SHA256AVX2:
+    return __builtin_cpu_supports("avx2");
+  case SHA256Extensions: {
+    unsigned int eax, ebx, ecx, edx;
+
+    return __builtin_cpu_supports("sse4.1") &&
+           __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+           (ebx & (1u << 29)) != 0;
+  }
+#endif
+  default:
+    return false;
+  }
+}
+template <class Hasher>
+inline void hashMany(const Span *spans, size_t count,
+                     SpecificHash<Hasher> *digests, SHA256Engine engine) {
+  // each digest is written through its own buffer, whatever its layout
+  auto digest = [digests](size_t index) { return digests[index].buffer(); };
+
+  if (SHA256Automatic == engine) {
+    // the platform libraries are faster than the portable code and usually
+    // use the SHA instructions themselves, so only pick another engine where
+    // timing on this processor says it is faster
+    engine = IsSHA256<Hasher>::value ? _fastestEngine<Hasher>()
+                                     : SHA256Automatic;
+  }
+  if (!IsSHA256<Hasher>::value || (SHA256Automatic == engine)) {
+    for (size_t i = 0; i < count; ++i) {
+      Hasher::hash(spans[i].data, spans[i].size, digests[i].buffer());
+    }
+    return;
+  }
+  AssertMessageException(supported(engine));
+  if (SHA256AVX2 == engine) {
+    _sha256Lanes(spans, count, digest);
+  } else {
+    _sha256Each(spans, count, digest, SHA256Extensions == engine);
+  }
+}
+template <class Hasher>
+inline std::vector<SpecificHash<Hasher>> &
+hashMany(const std::vector<Span> &spans,
+         std::vector<SpecificHash<Hasher>> &digests, SHA256Engine engine) {
+  digests.resize(spans.size());
+  hashMany(spans.data(), spans.size(), digests.data(), engine);
+  return digests;
+}
+
+inline void _SHA256Message::start(const Span &span) {
+  const size_t left = span.size % 64;
+  const uint64_t bits = uint64_t(span.size) * 8;
+  const size_t tailSize = left + 9 <= 64 ? 64 : 128;
+
+  _data = reinterpret_cast<const uint8_t *>(span.data);
+  _whole = span.size / 64;
+  _blocks = _whole + tailSize / 64;
+  memset(_tail, 0, sizeof(_tail));
+  if (left > 0) {
+    memcpy(_tail, _data + 64 * _whole, left);
+  }
+  _tail[left] = 0x80;
+  for (int byte = 0; byte < 8; ++byte) {
+    _tail[tailSize - 1 - byte] = static_cast<uint8_t>(bits >> (8 * byte));
+  }
+}
+inline void _sha256Portable(uint32_t state[8], const uint8_t *data,
+                            size_t blocks) {
+  for (; blocks > 0; --blocks, data += 64) {
+    uint32_t w[64];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t < 16; ++t) {
+      w[t] = _bigEndian32(data + 4 * t);
+    }
+    for (int t = 16; t < 64; ++t) {
+      const uint32_t s0 =
+          _rotate(w[t - 15], 7) ^ _rotate(w[t - 15], 18) ^ (w[t - 15] >> 3);
+      const uint32_t s1 =
+          _rotate(w[t - 2], 17) ^ _rotate(w[t - 2], 19) ^ (w[t - 2] >> 10);
+
+      w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    for (int t = 0; t < 64; ++t) {
+      const uint32_t t1 = h +
+                          (_rotate(e, 6) ^ _rotate(e, 11) ^ _rotate(e, 25)) +
+                          ((e & f) ^ (~e & g)) + _SHA256K[t] + w[t];
+      const uint32_t t2 = (_rotate(a, 2) ^ _rotate(a, 13) ^ _rotate(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+#if __HashMany_x86__
+/// Based on the instruction sequence in Intel's SHA extensions white paper
+__attribute__((target("sha,sse4.1,ssse3"))) inline void
+_sha256Extensions(uint32_t state[8], const uint8_t *data, size_t blocks) {
+  const __m128i byteSwap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i state0, state1, message, words[4];
+  __m128i temp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+
+  state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+  temp = _mm_shuffle_epi32(temp, 0xB1);          // CDAB
+  state1 = _mm_shuffle_epi32(state1, 0x1B);      // EFGH
+  state0 = _mm_alignr_epi8(temp, state1, 8);     // ABEF
+  state1 = _mm_blend_epi16(state1, temp, 0xF0);  // CDGH
+  for (; blocks > 0; --blocks, data += 64) {
+    const __m128i saved0 = state0, saved1 = state1;
+
+    for (int group = 0; group < 16; ++group) {
+      __m128i &current = words[group & 3];
+
+      if (group < 4) {
+        current = _mm_shuffle_epi8(
+            _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(data + 16 * group)),
+            byteSwap);
+      } else { // current holds the words from four groups ago
+        const __m128i &previous = words[(group - 1) & 3];
+
+        current = _mm_sha256msg2_epu32(
+            _mm_add_epi32(
+                _mm_sha256msg1_epu32(current, words[(group - 3) & 3]),
+                _mm_alignr_epi8(previous, words[(group - 2) & 3], 4)),
+            previous);
+      }
+      const __m128i *constants =
+          reinterpret_cast<const __m128i *>(_SHA256K + 4 * group);
+
+      message = _mm_add_epi32(current, _mm_loadu_si128(constants));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+      message = _mm_shuffle_epi32(message, 0x0E);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+    }
+    state0 = _mm_add_epi32(state0, saved0);
+    state1 = _mm_add_epi32(state1, saved1);
+  }
+  temp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);      // DCHG
+  state0 = _mm_blend_epi16(temp, state1, 0xF0);  // DCBA
+  state1 = _mm_alignr_epi8(state1, temp, 8);     // ABEF
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+}
+/// An 8x8 transpose of 32 bit words, then a byte swap to big endian
+__attribute__((target("avx2"))) inline void
+_sha256Transpose(const uint8_t *const blocks[8], size_t offset, void *words) {
+  const __m256i byteSwap = _mm256_set_epi8(
+      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8,
+      9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m256i *out = reinterpret_cast<__m256i *>(words);
+  __m256i rows[8], pairs[8], quads[8];
+
+  for (int lane = 0; lane < 8; ++lane) {
+    rows[lane] = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(blocks[lane] + offset));
+  }
+  for (int lane = 0; lane < 8; lane += 2) { // words 0,1 4,5 and 2,3 6,7
+    pairs[lane] = _mm256_unpacklo_epi32(rows[lane], rows[lane + 1]);
+    pairs[lane + 1] = _mm256_unpackhi_epi32(rows[lane], rows[lane + 1]);
+  }
+  for (int half = 0; half < 8; half += 4) { // words 0 4, 1 5, 2 6, 3 7
+    quads[half] = _mm256_unpacklo_epi64(pairs[half], pairs[half + 2]);
+    quads[half + 1] = _mm256_unpackhi_epi64(pairs[half], pairs[half + 2]);
+    quads[half + 2] = _mm256_unpacklo_epi64(pairs[half + 1], pairs[half + 3]);
+    quads[half + 3] = _mm256_unpackhi_epi64(pairs[half + 1], pairs[half + 3]);
+  }
+  for (int word = 0; word < 4; ++word) {
+    out[word] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(quads[word], quads[word + 4], 0x20),
+        byteSwap);
+    out[word + 4] = _mm256_shuffle_epi8(
+        _mm256_permute2x128_si256(quads[word], quads[word + 4], 0x31),
+        byteSwap);
+  }
+}
+/// Rotate each lane right
+#define __HashMany_rotr(x, n)                                                  \
+  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+/// Add in each lane
+#define __HashMany_add(x, y) _mm256_add_epi32(x, y)
+/** Round t, which only changes d and h. The caller rotates the names of the
+   working variables instead of moving every one of them each round.
+*/
+#define __HashMany_round(a, b, c, d, e, f, g, h, t)                            \
+  do {                                                                         \
+    const __m256i sum1 = _mm256_xor_si256(                                     \
+        _mm256_xor_si256(__HashMany_rotr(e, 6), __HashMany_rotr(e, 11)),       \
+        __HashMany_rotr(e, 25));                                               \
+    const __m256i choose =                                                     \
+        _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));   \
+    const __m256i t1 = __HashMany_add(                                         \
+        __HashMany_add(h, sum1),                                               \
+        __HashMany_add(choose, __HashMany_add(_mm256_set1_epi32(_SHA256K[t]),  \
+                                              w[(t) & 15])));                  \
+    const __m256i sum0 = _mm256_xor_si256(                                     \
+        _mm256_xor_si256(__HashMany_rotr(a, 2), __HashMany_rotr(a, 13)),       \
+        __HashMany_rotr(a, 22));                                               \
+    const __m256i majority = _mm256_xor_si256(                                 \
+        _mm256_and_si256(a, _mm256_xor_si256(b, c)), _mm256_and_si256(b, c));  \
+                                                                               \
+    d = __HashMany_add(d, t1);                                                 \
+    h = __HashMany_add(t1, __HashMany_add(sum0, majority));                    \
+  } while (false)
+__attribute__((target("avx2"))) inline void
+_sha256AVX2(uint32_t state[8][8], const uint8_t *const blocks[8]) {
+  __m256i w[16], s[8];
+
+  _sha256Transpose(blocks, 0, w);
+  _sha256Transpose(blocks, 32, w + 8);
+  for (int word = 0; word < 8; ++word) {
+    s[word] = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[word]));
+  }
+
+  __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+  __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+  for (int t = 0; t < 64; t += 8) {
+    for (int i = t; (i >= 16) && (i < t + 8); ++i) { // w[i & 15] is w[i - 16]
+      const __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+      const __m256i s0 =
+          _mm256_xor_si256(_mm256_xor_si256(__HashMany_rotr(w15, 7),
+                                            __HashMany_rotr(w15, 18)),
+                           _mm256_srli_epi32(w15, 3));
+      const __m256i s1 =
+          _mm256_xor_si256(_mm256_xor_si256(__HashMany_rotr(w2, 17),
+                                            __HashMany_rotr(w2, 19)),
+                           _mm256_srli_epi32(w2, 10));
+
+      w[i & 15] = __HashMany_add(__HashMany_add(w[i & 15], s0),
+                                 __HashMany_add(w[(i - 7) & 15], s1));
+    }
+    __HashMany_round(a, b, c, d, e, f, g, h, t);
+    __HashMany_round(h, a, b, c, d, e, f, g, t + 1);
+    __HashMany_round(g, h, a, b, c, d, e, f, t + 2);
+    __HashMany_round(f, g, h, a, b, c, d, e, t + 3);
+    __HashMany_round(e, f, g, h, a, b, c, d, t + 4);
+    __HashMany_round(d, e, f, g, h, a, b, c, t + 5);
+    __HashMany_round(c, d, e, f, g, h, a, b, t + 6);
+    __HashMany_round(b, c, d, e, f, g, h, a, t + 7);
+  }
+  s[0] = __HashMany_add(s[0], a);
+  s[1] = __HashMany_add(s[1], b);
+  s[2] = __HashMany_add(s[2], c);
+  s[3] = __HashMany_add(s[3], d);
+  s[4] = __HashMany_add(s[4], e);
+  s[5] = __HashMany_add(s[5], f);
+  s[6] = __HashMany_add(s[6], g);
+  s[7] = __HashMany_add(s[7], h);
+  for (int word = 0; word < 8; ++word) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[word]), s[word]);
+  }
+}
+#undef __HashMany_round
+#undef __HashMany_add
+#undef __HashMany_rotr
+#else
+inline void _sha256Extensions(uint32_t state[8], const uint8_t *data,
+                              size_t blocks) {
+  _sha256Portable(state, data, blocks);
+}
+inline void _sha256AVX2(uint32_t state[8][8], const uint8_t *const blocks[8]) {
+  for (int lane = 0; lane < 8; ++lane) {
+    uint32_t single[8];
+
+    for (int word = 0; word < 8; ++word) {
+      single[word] = state[word][lane];
+    }
+    _sha256Portable(single, blocks[lane], 1);
+    for (int word = 0; word < 8; ++word) {
+      state[word][lane] = single[word];
+    }
+  }
+}
+#endif
+template <class Digest>
+inline void _sha256Each(const Span *spans, size_t count, Digest digest,
+                        bool extensions) {
+  void (*const hashBlocks)(uint32_t *, const uint8_t *, size_t) =
+      extensions ? _sha256Extensions : _sha256Portable;
+  _SHA256Message message;
+
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t state[8];
+
+    memcpy(state, _SHA256IV, sizeof(state));
+    message.start(spans[i]);
+    hashBlocks(state, message.block(0), message.whole());
+    hashBlocks(state, message.block(message.whole()),
+               message.blocks() - message.whole());
+    _sha256Digest(state, digest(i));
+  }
+}
+/**
+        Each lane works through its own message a block at a time. When a lane
+   finishes it writes its digest and picks up the next message, so messages of
+   different lengths keep all eight lanes busy until the batch runs out. Idle
+   lanes hash a dummy block.
+*/
+template <class Digest>
+inline void _sha256Lanes(const Span *spans, size_t count, Digest digest) {
+  static const uint8_t idle[64] = {0};
+  const size_t none = static_cast<size_t>(-1);
+  _SHA256Message messages[8];
+  size_t current[8], position[8], next = 0, active = 0;
+  uint32_t state[8][8];
+  const uint8_t *blocks[8];
+
+  for (int lane = 0; lane < 8; ++lane) {
+    current[lane] = none;
+    position[lane] = 0;
+  }
+  do {
+    for (int lane = 0; lane < 8; ++lane) {
+      if ((none == current[lane]) && (next < count)) {
+        current[lane] = next;
+        position[lane] = 0;
+        messages[lane].start(spans[next++]);
+        for (int word = 0; word < 8; ++word) {
+          state[word][lane] = _SHA256IV[word];
+        }
+        ++active;
+      }
+      blocks[lane] = none == current[lane]
+                         ? idle
+                         : messages[lane].block(position[lane]);
+    }
+    if (0 == active) {
+      break;
+    }
+    _sha256AVX2(state, blocks);
+    for (int lane = 0; lane < 8; ++lane) {
+      if ((none != current[lane]) &&
+          (++position[lane] == messages[lane].blocks())) {
+        uint32_t single[8];
+
+        for (int word = 0; word < 8; ++word) {
+          single[word] = state[word][lane];
+        }
+        _sha256Digest(single, digest(current[lane]));
+        current[lane] = none;
+        --active;
+      }
+    }
+  } while (true);
+}
+template <class Hasher> inline SHA256Engine _fastestEngine() {
+  typedef std::chrono::steady_clock Clock;
+  enum { Messages = 32, Size = 2048, Candidates = 3 };
+  static const SHA256Engine fastest = [] {
+    const SHA256Engine candidates[Candidates] = {
+        SHA256Automatic, SHA256AVX2, SHA256Extensions};
+    std::vector<uint8_t> data(Messages * Size, 0x5a);
+    std::vector<uint8_t> digests(Messages * 32);
+    auto digest = [&digests](size_t i) { return &digests[32 * i]; };
+    Span spans[Messages];
+    double best[Candidates];
+    SHA256Engine winner = SHA256Automatic;
+
+    for (int i = 0; i < Messages; ++i) {
+      spans[i].data = data.data() + i * Size;
+      spans[i].size = Size;
+    }
+    for (int run = 0; run < 5; ++run) { // the best of each, interleaved
+      for (int candidate = 0; candidate < Candidates; ++candidate) {
+        const SHA256Engine engine = candidates[candidate];
+        const Clock::time_point start = Clock::now();
+
+        if (!supported(engine)) {
+          best[candidate] = 0.0;
+          continue;
+        }
+        if (SHA256Automatic == engine) {
+          for (int i = 0; i < Messages; ++i) {
+            Hasher::hash(spans[i].data, spans[i].size, digest(i));
+          }
+        } else if (SHA256AVX2 == engine) {
+          _sha256Lanes(spans, Messages, digest);
+        } else {
+          _sha256Each(spans, Messages, digest, true);
+        }
+
+        const double seconds =
+            std::chrono::duration<double>(Clock::now() - start).count();
+
+        best[candidate] =
+            0 == run ? seconds : std::min(best[candidate], seconds);
+      }
+    }
+    for (int candidate = 1; candidate < Candidates; ++candidate) {
+      if (supported(candidates[candidate]) && (best[candidate] < best[0])) {
+        best[0] = best[candidate];
+        winner = candidates[candidate];
+      }
+    }
+    return winner;
+  }();
+
+  return fastest;
+}
+inline void _sha256Digest(const uint32_t state[8], uint8_t *digest) {
+  for (int word = 0; word < 8; ++word) {
+    digest[4 * word] = static_cast<uint8_t>(state[word] >> 24);
+    digest[4 * word + 1] = static_cast<uint8_t>(state[word] >> 16);
+    digest[4 * word + 2] = static_cast<uint8_t>(state[word] >> 8);
+    digest[4 * word + 3] = static_cast<uint8_t>(state[word]);
+  }
+}
+
+} // namespace hash
+
+#undef __HashMany_x86__
+
+#endif // __HashMany_h__
@@ -83,7 +83,7 @@ inline MemoryMappedFile::operator void *() {
   }
   return _address;
 }
-void MemoryMappedFile::close() {
+inline void MemoryMappedFile::close() {
   if (nullptr != _address) {
     ErrnoOnNegative(::munmap(_address, _size));
   }
@@ -0,0 +1,464 @@
+#ifndef __NonBlockingQueue_h__
+#define __NonBlockingQueue_h__
+
+/** @file NonBlockingQueue.h
+        Unbounded lock-free multi-producer multi-consumer queue.
+*/
+
+#include "Exception.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Helper macro that will throw an exception before accessing a closed queue
+#define AssertNonBlockingQueueNotClosed                                        \
+  if (_closed.load(std::memory_order_acquire)) {                               \
+    throw Closed("Queue Already Closed", __FILE__, __LINE__);                  \
+  } else                                                                       \
+    msg::noop()
+
+namespace exec {
+
+/** A thread-safe, lock-free, unbounded queue.
+        This is the Michael-Scott queue: a singly linked list with a dummy node
+   at the head, where enqueue links a node after the tail and dequeue swings
+   the head forward with compare-and-swap.
+        Nodes removed from the list are reclaimed with hazard pointers. Each
+   operation publishes the nodes it is about to touch in a hazard record, and
+   removed nodes are only deleted once no record refers to them.
+        @tparam T The type of elements in the queue
+*/
+template <class T> class NonBlockingQueue {
+public:
+  /// Exception that is thrown when attempting to operate on a closed queue
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Get a message
+    explicit Closed(const std::string &message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /// Create a new, empty queue.
+  NonBlockingQueue();
+  /// Destroys any elements left in the queue.
+  ~NonBlockingQueue();
+  /** Is the queue empty.
+        @return true if there are no elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  bool empty();
+  /** Puts an element into the queue.
+        The queue is unbounded, so this never waits.
+        @param value The value to add to the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  NonBlockingQueue &enqueue(const T &value);
+  /** Retrieves that oldest value in the queue.
+        This call will wait if the queue is empty.
+        @return The oldest value in the queue
+        @throws Closed if the queue has been closed
+  */
+  T dequeue();
+  /** Retrieves that oldest value in the queue if there is one, without waiting.
+        @param value receives the value from the queue
+        @return true if value was filled in, false if the queue was empty
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value);
+  /** Retrieves that oldest value in the queue.
+        @param value receives the value from the queue
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     empty.
+        @return true if value was filled in, false if the operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value, double timeoutInSeconds);
+  /// Closes the queue, preventing further operations on the queue.
+  void close();
+
+private:
+  enum {
+    SpinCount = 64,       ///< Times to retry before yielding
+    YieldCount = 64,      ///< Times to yield before sleeping
+    HazardsPerRecord = 2, ///< Nodes an operation may need protected
+    RetireThreshold = 64  ///< Retired nodes to collect before reclaiming
+  };
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type
+      Storage; ///< Uninitialized space for one element
+  /// An element in the linked list
+  struct _Node {
+    _Node() : next(nullptr), retired(nullptr), storage() {}
+    std::atomic<_Node *> next; ///< The next newer node
+    _Node *retired;            ///< Link in the retired list
+    Storage storage;           ///< The value, unless this is the dummy node
+    /// The value stored in the node
+    T *value() { return reinterpret_cast<T *>(&storage); }
+  };
+  /// The nodes a single in-flight operation has claimed
+  struct _HazardRecord {
+    _HazardRecord() : active(true), next(nullptr) {
+      for (int i = 0; i < HazardsPerRecord; ++i) {
+        hazard[i].store(nullptr);
+      }
+    }
+    std::atomic<_Node *> hazard[HazardsPerRecord]; ///< Protected nodes
+    std::atomic<bool> active; ///< Is an operation using this record
+    _HazardRecord *next;      ///< All records ever allocated
+  };
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timeouts
+
+  std::atomic<_Node *> _head;            ///< The dummy node
+  std::atomic<_Node *> _tail;            ///< The last node, or close to it
+  std::atomic<_HazardRecord *> _hazards; ///< All hazard records
+  std::atomic<_Node *> _retired;         ///< Removed, but maybe in use
+  std::atomic<int> _retiredCount;        ///< Approximate size of _retired
+  std::atomic<bool> _closed;             ///< Has close been called
+
+  /// Find an unused hazard record, or create one
+  _HazardRecord *_acquire();
+  /// Clear the hazards and return the record for reuse
+  static void _release(_HazardRecord *record);
+  /** Read a shared pointer and publish it as a hazard.
+        @param source The pointer to read
+        @param record The record to publish in
+        @param index Which hazard in the record to use
+        @return The value of source that is now protected
+  */
+  static _Node *_protect(std::atomic<_Node *> &source, _HazardRecord *record,
+                         int index);
+  /// Put a node on the list to be deleted when no longer hazardous
+  void _retire(_Node *node);
+  /// Delete the retired nodes that no operation is using
+  void _reclaim();
+  /// Try to remove the oldest value
+  bool _dequeue(T &value);
+  /// Remove the oldest value, constructing it in the caller's storage
+  bool _take(Storage &value);
+  /** Wait a little longer each time the queue is not ready.
+        @param attempt The number of times we have waited so far, incremented
+  */
+  static void _backoff(int &attempt);
+  NonBlockingQueue(const NonBlockingQueue &);            ///< prevent usage
+  NonBlockingQueue &operator=(const NonBlockingQueue &); ///< prevent usage
+};
+
+template <class T>
+inline NonBlockingQueue<T>::Closed::Closed(const char *message,
+                                           const char *file, int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T>
+inline NonBlockingQueue<T>::Closed::Closed(const std::string &message,
+                                           const char *file, int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T>
+inline NonBlockingQueue<T>::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+template <class T> inline NonBlockingQueue<T>::Closed::~Closed() throw() {}
+template <class T>
+inline NonBlockingQueue<T>::NonBlockingQueue()
+    : _head(nullptr), _tail(nullptr), _hazards(nullptr), _retired(nullptr),
+      _retiredCount(0), _closed(false) {
+  _Node *dummy = new _Node();
+
+  _head.store(dummy);
+  _tail.store(dummy);
+}
+template <class T> inline NonBlockingQueue<T>::~NonBlockingQueue() {
+  _Node *node = _head.load();
+
+  // the first node is the dummy, every node after it holds a value
+  for (_Node *next = node->next.load(); nullptr != next;
+       node = next, next = next->next.load()) {
+    next->value()->~T();
+    delete node;
+  }
+  delete node;
+  for (node = _retired.load(); nullptr != node;) {
+    _Node *retired = node->retired;
+
+    delete node;
+    node = retired;
+  }
+  for (_HazardRecord *record = _hazards.load(); nullptr != record;) {
+    _HazardRecord *next = record->next;
+
+    delete record;
+    record = next;
+  }
+}
+template <class T> inline bool NonBlockingQueue<T>::empty() {
+  AssertNonBlockingQueueNotClosed;
+  _HazardRecord *record = _acquire();
+  const bool isEmpty = nullptr == _protect(_head, record, 0)->next.load();
+
+  _release(record);
+  return isEmpty;
+}
+template <class T>
+inline NonBlockingQueue<T> &NonBlockingQueue<T>::enqueue(const T &value) {
+  AssertNonBlockingQueueNotClosed;
+  _Node *node = new _Node();
+  _HazardRecord *record;
+
+  try {
+    new (&node->storage) T(value);
+  } catch (...) {
+    delete node;
+    throw;
+  }
+  try {
+    record = _acquire();
+  } catch (...) {
+    node->value()->~T();
+    delete node;
+    throw;
+  }
+  while (true) {
+    _Node *tail = _protect(_tail, record, 0);
+    _Node *next = tail->next.load();
+
+    if (tail != _tail.load()) {
+      continue;
+    }
+    if (nullptr != next) {
+      _tail.compare_exchange_strong(tail, next); // help a stalled enqueue
+      continue;
+    }
+    _Node *expected = nullptr;
+
+    if (tail->next.compare_exchange_strong(expected, node)) {
+      _tail.compare_exchange_strong(tail, node);
+      break;
+    }
+  }
+  _release(record);
+  return *this;
+}
+template <class T> inline T NonBlockingQueue<T>::dequeue() {
+  Storage storage;
+  int attempt = 0;
+
+  while (!_take(storage)) {
+    _backoff(attempt);
+  }
+
+  T *stored = reinterpret_cast<T *>(&storage);
+
+  try {
+    T value(std::move(*stored));
+
+    stored->~T();
+    return value;
+  } catch (...) {
+    stored->~T();
+    throw;
+  }
+}
+template <class T> inline bool NonBlockingQueue<T>::dequeue(T &value) {
+  return _dequeue(value);
+}
+template <class T>
+inline bool NonBlockingQueue<T>::dequeue(T &value, double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  int attempt = 0;
+
+  while (!_dequeue(value)) {
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    _backoff(attempt);
+  }
+  return true;
+}
+template <class T> inline void NonBlockingQueue<T>::close() {
+  _closed.store(true, std::memory_order_release);
+}
+template <class T>
+inline typename NonBlockingQueue<T>::_HazardRecord *
+NonBlockingQueue<T>::_acquire() {
+  for (_HazardRecord *record = _hazards.load(); nullptr != record;
+       record = record->next) {
+    bool expected = false;
+
+    if (!record->active.load(std::memory_order_relaxed) &&
+        record->active.compare_exchange_strong(expected, true)) {
+      return record;
+    }
+  }
+
+  _HazardRecord *record = new _HazardRecord();
+
+  record->next = _hazards.load();
+  while (!_hazards.compare_exchange_weak(record->next, record)) {
+  }
+  return record;
+}
+template <class T>
+inline void NonBlockingQueue<T>::_release(_HazardRecord *record) {
+  for (int i = 0; i < HazardsPerRecord; ++i) {
+    record->hazard[i].store(nullptr, std::memory_order_release);
+  }
+  record->active.store(false, std::memory_order_release);
+}
+template <class T>
+inline typename NonBlockingQueue<T>::_Node *
+NonBlockingQueue<T>::_protect(std::atomic<_Node *> &source,
+                              _HazardRecord *record, int index) {
+  _Node *value = source.load();
+  _Node *check;
+
+  while (true) {
+    record->hazard[index].store(value);
+    check = source.load();
+    if (check == value) {
+      return value;
+    }
+    value = check;
+  }
+}
+template <class T> inline void NonBlockingQueue<T>::_retire(_Node *node) {
+  node->retired = _retired.load();
+  while (!_retired.compare_exchange_weak(node->retired, node)) {
+  }
+  if (_retiredCount.fetch_add(1) + 1 >= RetireThreshold) {
+    _reclaim();
+  }
+}
+template <class T> inline void NonBlockingQueue<T>::_reclaim() {
+  _Node *node = _retired.exchange(nullptr);
+  std::vector<_Node *> hazards;
+  int kept = 0;
+  int examined = 0;
+
+  if (nullptr == node) {
+    return;
+  }
+  for (_HazardRecord *record = _hazards.load(); nullptr != record;
+       record = record->next) {
+    for (int i = 0; i < HazardsPerRecord; ++i) {
+      _Node *hazard = record->hazard[i].load();
+
+      if (nullptr != hazard) {
+        hazards.push_back(hazard);
+      }
+    }
+  }
+  std::sort(hazards.begin(), hazards.end());
+
+  _Node *keep = nullptr;
+  _Node *keepTail = nullptr;
+
+  while (nullptr != node) {
+    _Node *retired = node->retired;
+
+    ++examined;
+    if (std::binary_search(hazards.begin(), hazards.end(), node)) {
+      node->retired = keep;
+      keep = node;
+      if (nullptr == keepTail) {
+        keepTail = node;
+      }
+      ++kept;
+    } else {
+      delete node;
+    }
+    node = retired;
+  }
+  _retiredCount.fetch_sub(examined - kept);
+  if (nullptr != keep) {
+    keepTail->retired = _retired.load();
+    while (!_retired.compare_exchange_weak(keepTail->retired, keep)) {
+    }
+  }
+}
+template <class T> inline bool NonBlockingQueue<T>::_dequeue(T &value) {
+  Storage storage;
+
+  if (!_take(storage)) {
+    return false;
+  }
+
+  T *stored = reinterpret_cast<T *>(&storage);
+
+  try {
+    value = std::move(*stored);
+  } catch (...) {
+    stored->~T();
+    throw;
+  }
+  stored->~T();
+  return true;
+}
+template <class T> inline bool NonBlockingQueue<T>::_take(Storage &value) {
+  AssertNonBlockingQueueNotClosed;
+  _HazardRecord *record = _acquire();
+
+  while (true) {
+    _Node *head = _protect(_head, record, 0);
+    _Node *tail = _tail.load();
+    _Node *next = head->next.load();
+
+    record->hazard[1].store(next);
+    if (head != _head.load()) {
+      continue;
+    }
+    if (nullptr == next) {
+      _release(record);
+      return false;
+    }
+    if (head == tail) {
+      _tail.compare_exchange_strong(tail, next); // help a stalled enqueue
+      continue;
+    }
+    if (_head.compare_exchange_strong(head, next)) {
+      // next is now the dummy and we are the only reader of its value
+      try {
+        new (&value) T(std::move(*next->value()));
+      } catch (...) {
+        // the element is lost, but the queue stays usable
+        next->value()->~T();
+        _release(record);
+        _retire(head);
+        throw;
+      }
+      next->value()->~T();
+      _release(record);
+      _retire(head);
+      return true;
+    }
+  }
+}
+template <class T> inline void NonBlockingQueue<T>::_backoff(int &attempt) {
+  if (attempt < SpinCount) {
+    // busy wait, a producer is likely mid-operation
+  } else if (attempt < SpinCount + YieldCount) {
+    std::this_thread::yield();
+  } else {
+    const int exponent = attempt - SpinCount - YieldCount;
+
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(exponent < 10 ? (1 << exponent) : 1000));
+  }
+  ++attempt;
+}
+
+#undef AssertNonBlockingQueueNotClosed // this macro is not valid outside the
+                                       // scope of this file
+
+}; // namespace exec
+
+#endif // __NonBlockingQueue_h__
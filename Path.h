@@ -4,6 +4,7 @@
 #include "os/DateTime.h"
 #include "os/File.h"
 #include "os/POSIXErrno.h"
+#include "os/TextSearch.h"
 #include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -426,19 +427,16 @@ inline Path Path::relativeTo(const Path &other) const {
     return you.substr(me.length() + (you[me.length()] == separator ? 1 : 0));
   }
 
-  for (String::size_type position = 0;
-       position < std::min(me.length(), you.length()) &&
-       (me[position] == you[position]);
-       ++position) {
-    if (separator == me[position]) {
-      matchSeparator = position;
-    }
-  }
+  const size_t matched =
+      text::matching(me.data(), me.size(), you.data(), you.size());
 
-  for (auto position = matchSeparator + 1; position < me.length(); ++position) {
-    if (separator == me[position]) {
-      result = result + String("..");
-    }
+  if (matched > 0) {
+    matchSeparator = me.rfind(separator, matched - 1);
+  }
+  for (auto parents = text::count(me.data() + matchSeparator + 1,
+                                  me.size() - matchSeparator - 1, separator);
+       parents > 0; --parents) {
+    result = result + String("..");
   }
 
   return result + you.substr(matchSeparator + 1);
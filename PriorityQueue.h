@@ -0,0 +1,543 @@
+#ifndef __PriorityQueue_h__
+#define __PriorityQueue_h__
+
+/** @file PriorityQueue.h
+        Thread-safe queues that release elements by priority or by deadline.
+*/
+
+#include "DateTime.h"
+#include "Exception.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/// Helper macro that will throw an exception before accessing a closed queue
+#define AssertPriorityQueueNotClosed                                           \
+  if (-1 == _max) {                                                            \
+    throw Closed("Queue Already Closed", __FILE__, __LINE__);                  \
+  } else                                                                       \
+    msg::noop()
+
+namespace exec {
+
+/** A heap where every node has Arity children, stored in a flat array.
+        A 4-ary heap is half as deep as a binary heap and the children of a
+   node are adjacent, so sifting touches fewer cache lines.
+        @tparam T The type of the elements
+        @tparam Compare Compare(a, b) is true if a should come out after b
+        @tparam Arity The number of children per node
+*/
+template <class T, class Compare, int Arity = 4> class DaryHeap {
+public:
+  /// Create an empty heap
+  explicit DaryHeap(const Compare &compare = Compare())
+      : _elements(), _compare(compare) {}
+  /// Is the heap empty
+  bool empty() const { return _elements.empty(); }
+  /// The number of elements in the heap
+  size_t size() const { return _elements.size(); }
+  /// Reserve space for elements
+  void reserve(size_t count) { _elements.reserve(count); }
+  /// The element that will be popped next
+  const T &top() const { return _elements.front(); }
+  /// Add an element
+  void push(T &&value);
+  /// Remove and return the top element
+  T pop();
+
+private:
+  std::vector<T> _elements; ///< Heap ordered elements
+  Compare _compare;         ///< Ordering of elements
+};
+
+/** A thread-safe queue that releases the highest priority element first.
+        The API matches exec::Queue.
+        @tparam T The type of the elements
+        @tparam Compare Compare(a, b) is true if a has lower priority than b,
+   like std::priority_queue. Defaults to std::less, so the largest element is
+   dequeued first.
+*/
+template <class T, class Compare = std::less<T>> class PriorityQueue {
+public:
+  /// Exception that is thrown when attempting to operate on a closed queue
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /** Create a new queue.
+        @param max The maximum number of items in the queue. If enqueue is
+     attempted, it blocks until there is room. default 0 which means there is no
+     limit.
+        @param reserve The guess at how many items will be in the queue at peak.
+     default 0 which means no space reserved.
+        @param compare The ordering of elements
+  */
+  PriorityQueue(int max = 0, int reserve = 0,
+                const Compare &compare = Compare());
+  /** Is the queue empty.
+        @return true if there are no elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  bool empty();
+  /** Is the queue full.
+        @return true if any more elements added to the queue would block.
+        @throws Closed if the queue has been closed
+  */
+  bool full();
+  /** The number of elements in the queue.
+        @return The count of all elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  int size();
+  /** Puts an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to add to the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  PriorityQueue &enqueue(const T &value);
+  /** Puts an element into the queue.
+        @param value The value to add to the queue.
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     full.
+        @return true if the element was successfully added, false if the
+     operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool enqueue(const T &value, double timeoutInSeconds);
+  /** Retrieves the highest priority value in the queue.
+        This call will block if the queue is empty.
+        @return The highest priority value in the queue
+        @throws Closed if the queue has been closed
+  */
+  T dequeue();
+  /** Retrieves the highest priority value in the queue.
+        @param value receives the value from the queue
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     empty.
+        @return true if value was filled in, false if the operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value, double timeoutInSeconds);
+  /// Closes the queue, preventing further operations on the queue.
+  void close();
+
+private:
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timeouts
+  std::mutex _lock;                        ///< Protection on _heap
+  std::condition_variable _full;  ///< Used to wait if the queue is full
+  std::condition_variable _empty; ///< Used to wait if the queue is empty
+  DaryHeap<T, Compare> _heap;     ///< The elements
+  int _max;                       ///< The maximum number of elements
+  PriorityQueue(const PriorityQueue &);            ///< prevent usage
+  PriorityQueue &operator=(const PriorityQueue &); ///< prevent usage
+};
+
+/** A thread-safe queue that holds each element until its deadline passes.
+        Elements come out in deadline order, and elements with the same
+   deadline come out in the order they were added. Waiting consumers sleep
+   until the earliest deadline instead of polling.
+        @tparam T The type of the elements
+*/
+template <class T> class DelayQueue {
+public:
+  /// Exception that is thrown when attempting to operate on a closed queue
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /** Create a new queue.
+        @param reserve The guess at how many items will be in the queue at peak.
+     default 0 which means no space reserved.
+  */
+  explicit DelayQueue(int reserve = 0);
+  /** Is the queue empty.
+        @return true if there are no elements in the queue, ready or not.
+        @throws Closed if the queue has been closed
+  */
+  bool empty();
+  /** The number of elements in the queue.
+        @return The count of all elements in the queue, ready or not.
+        @throws Closed if the queue has been closed
+  */
+  int size();
+  /** Is there an element whose deadline has passed.
+        @return true if dequeue would not wait
+        @throws Closed if the queue has been closed
+  */
+  bool ready();
+  /** Puts an element into the queue.
+        @param value The value to add to the queue.
+        @param when The value will not be dequeued before this time.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  DelayQueue &enqueue(const T &value, const dt::DateTime &when);
+  /** Puts an element into the queue.
+        @param value The value to add to the queue.
+        @param delayInSeconds The value will not be dequeued for this long.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  DelayQueue &enqueue(const T &value, double delayInSeconds);
+  /** Retrieves the value with the earliest deadline once it has passed.
+        This call will block until a deadline passes.
+        @return The value
+        @throws Closed if the queue has been closed
+  */
+  T dequeue();
+  /** Retrieves the value with the earliest deadline once it has passed.
+        @param value receives the value from the queue
+        @param timeoutInSeconds The number of seconds to wait for a deadline.
+        @return true if value was filled in, false if the operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value, double timeoutInSeconds);
+  /// Closes the queue, preventing further operations on the queue.
+  void close();
+
+private:
+  /// An element and when it is released
+  struct _Entry {
+    double when;       ///< The deadline, in seconds since the epoch
+    uint64_t sequence; ///< The order the element was added
+    T value;           ///< The element
+  };
+  /// Orders entries so the earliest deadline is on top
+  struct _Later {
+    bool operator()(const _Entry &a, const _Entry &b) const {
+      return (a.when > b.when) ||
+             ((a.when == b.when) && (a.sequence > b.sequence));
+    }
+  };
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timeouts
+  std::mutex _lock;                        ///< Protection on _heap
+  std::condition_variable _changed; ///< Signaled when the earliest changes
+  DaryHeap<_Entry, _Later> _heap;   ///< The elements
+  uint64_t _sequence;               ///< The next sequence number
+  int _max;                         ///< -1 when the queue is closed
+  /** Wait until the earliest deadline, or the timeout.
+        @param lock The lock on _lock
+        @param deadline Do not wait past this point
+        @return true if the top element is ready
+  */
+  bool _wait(std::unique_lock<std::mutex> &lock,
+             const Clock::time_point &deadline);
+  DelayQueue(const DelayQueue &);            ///< prevent usage
+  DelayQueue &operator=(const DelayQueue &); ///< prevent usage
+};
+
+template <class T, class Compare, int Arity>
+inline void DaryHeap<T, Compare, Arity>::push(T &&value) {
+  size_t hole = _elements.size();
+
+  _elements.push_back(std::move(value));
+
+  T moving(std::move(_elements.back()));
+
+  while (hole > 0) {
+    const size_t parent = (hole - 1) / Arity;
+
+    if (!_compare(_elements[parent], moving)) {
+      break;
+    }
+    _elements[hole] = std::move(_elements[parent]);
+    hole = parent;
+  }
+  _elements[hole] = std::move(moving);
+}
+template <class T, class Compare, int Arity>
+inline T DaryHeap<T, Compare, Arity>::pop() {
+  T result(std::move(_elements.front()));
+  T moving(std::move(_elements.back()));
+  const size_t size = _elements.size() - 1;
+  size_t hole = 0;
+
+  _elements.pop_back();
+  if (size == 0) {
+    return result;
+  }
+  while (true) {
+    const size_t first = hole * Arity + 1;
+    const size_t last = first + Arity < size ? first + Arity : size;
+    size_t best = first;
+
+    if (first >= size) {
+      break;
+    }
+    for (size_t child = first + 1; child < last; ++child) {
+      if (_compare(_elements[best], _elements[child])) {
+        best = child;
+      }
+    }
+    if (!_compare(moving, _elements[best])) {
+      break;
+    }
+    _elements[hole] = std::move(_elements[best]);
+    hole = best;
+  }
+  _elements[hole] = std::move(moving);
+  return result;
+}
+
+template <class T, class Compare>
+inline PriorityQueue<T, Compare>::Closed::Closed(const char *message,
+                                                 const char *file,
+                                                 int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T, class Compare>
+inline PriorityQueue<T, Compare>::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+template <class T, class Compare>
+inline PriorityQueue<T, Compare>::Closed::~Closed() throw() {}
+template <class T, class Compare>
+inline PriorityQueue<T, Compare>::PriorityQueue(int max, int reserve,
+                                                const Compare &compare)
+    : _lock(), _full(), _empty(), _heap(compare),
+      _max(0 == max ? std::numeric_limits<int>::max() : max) {
+  if (reserve > 0) {
+    _heap.reserve(reserve);
+  } else if (max > 0) {
+    _heap.reserve(max);
+  }
+}
+template <class T, class Compare>
+inline bool PriorityQueue<T, Compare>::empty() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return _heap.empty();
+}
+template <class T, class Compare>
+inline bool PriorityQueue<T, Compare>::full() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return _heap.size() >= static_cast<size_t>(_max);
+}
+template <class T, class Compare>
+inline int PriorityQueue<T, Compare>::size() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return static_cast<int>(_heap.size());
+}
+template <class T, class Compare>
+inline PriorityQueue<T, Compare> &
+PriorityQueue<T, Compare>::enqueue(const T &value) {
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while ((static_cast<int>(_heap.size()) >= _max) && (-1 != _max)) {
+    _full.wait(lock);
+  }
+  AssertPriorityQueueNotClosed;
+  _heap.push(T(value));
+  _empty.notify_one();
+  return *this;
+}
+template <class T, class Compare>
+inline bool PriorityQueue<T, Compare>::enqueue(const T &value,
+                                               double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while ((static_cast<int>(_heap.size()) >= _max) && (-1 != _max)) {
+    if ((std::cv_status::timeout == _full.wait_until(lock, deadline)) &&
+        (static_cast<int>(_heap.size()) >= _max) && (-1 != _max)) {
+      return false;
+    }
+  }
+  AssertPriorityQueueNotClosed;
+  _heap.push(T(value));
+  _empty.notify_one();
+  return true;
+}
+template <class T, class Compare>
+inline T PriorityQueue<T, Compare>::dequeue() {
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while (_heap.empty() && (-1 != _max)) {
+    _empty.wait(lock);
+  }
+  AssertPriorityQueueNotClosed;
+
+  T value(_heap.pop());
+
+  _full.notify_one();
+  return value;
+}
+template <class T, class Compare>
+inline bool PriorityQueue<T, Compare>::dequeue(T &value,
+                                               double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while (_heap.empty() && (-1 != _max)) {
+    if ((std::cv_status::timeout == _empty.wait_until(lock, deadline)) &&
+        _heap.empty() && (-1 != _max)) {
+      return false;
+    }
+  }
+  AssertPriorityQueueNotClosed;
+  value = _heap.pop();
+  _full.notify_one();
+  return true;
+}
+template <class T, class Compare>
+inline void PriorityQueue<T, Compare>::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _max = -1;
+  }
+  _empty.notify_all();
+  _full.notify_all();
+}
+
+template <class T>
+inline DelayQueue<T>::Closed::Closed(const char *message, const char *file,
+                                     int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T>
+inline DelayQueue<T>::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+template <class T> inline DelayQueue<T>::Closed::~Closed() throw() {}
+template <class T>
+inline DelayQueue<T>::DelayQueue(int reserve)
+    : _lock(), _changed(), _heap(), _sequence(0), _max(0) {
+  if (reserve > 0) {
+    _heap.reserve(reserve);
+  }
+}
+template <class T> inline bool DelayQueue<T>::empty() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return _heap.empty();
+}
+template <class T> inline int DelayQueue<T>::size() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return static_cast<int>(_heap.size());
+}
+template <class T> inline bool DelayQueue<T>::ready() {
+  std::lock_guard<std::mutex> lock(_lock);
+
+  AssertPriorityQueueNotClosed;
+  return !_heap.empty() && (_heap.top().when <= dt::DateTime().seconds());
+}
+template <class T>
+inline DelayQueue<T> &DelayQueue<T>::enqueue(const T &value,
+                                             const dt::DateTime &when) {
+  std::lock_guard<std::mutex> lock(_lock);
+  _Entry entry = {when.seconds(), _sequence++, value};
+
+  AssertPriorityQueueNotClosed;
+  _heap.push(std::move(entry));
+  _changed.notify_all(); // waiters may need to shorten their sleep
+  return *this;
+}
+template <class T>
+inline DelayQueue<T> &DelayQueue<T>::enqueue(const T &value,
+                                             double delayInSeconds) {
+  return enqueue(value, dt::DateTime() + delayInSeconds);
+}
+template <class T> inline T DelayQueue<T>::dequeue() {
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while (!_wait(lock, Clock::time_point::max())) {
+  }
+  AssertPriorityQueueNotClosed;
+
+  T value(std::move(_heap.pop().value));
+
+  if (!_heap.empty()) {
+    _changed.notify_one(); // another consumer may be waiting for the next
+  }
+  return value;
+}
+template <class T>
+inline bool DelayQueue<T>::dequeue(T &value, double timeoutInSeconds) {
+  const Clock::time_point deadline =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(timeoutInSeconds));
+  std::unique_lock<std::mutex> lock(_lock);
+
+  while (!_wait(lock, deadline)) {
+    if (Clock::now() >= deadline) {
+      AssertPriorityQueueNotClosed;
+      return false;
+    }
+  }
+  AssertPriorityQueueNotClosed;
+  value = std::move(_heap.pop().value);
+  if (!_heap.empty()) {
+    _changed.notify_one();
+  }
+  return true;
+}
+template <class T> inline void DelayQueue<T>::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _max = -1;
+  }
+  _changed.notify_all();
+}
+template <class T>
+inline bool DelayQueue<T>::_wait(std::unique_lock<std::mutex> &lock,
+                                 const Clock::time_point &deadline) {
+  if (-1 == _max) {
+    return true;
+  }
+  if (_heap.empty()) {
+    if (Clock::time_point::max() == deadline) {
+      _changed.wait(lock);
+    } else {
+      _changed.wait_until(lock, deadline);
+    }
+    return false;
+  }
+
+  const double remaining = _heap.top().when - dt::DateTime().seconds();
+
+  if (remaining <= 0.0) {
+    return true;
+  }
+
+  const Clock::time_point due =
+      Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                         std::chrono::duration<double>(remaining));
+
+  _changed.wait_until(lock, due < deadline ? due : deadline);
+  return false;
+}
+
+#undef AssertPriorityQueueNotClosed // this macro is not valid outside the
+                                    // scope of this file
+
+}; // namespace exec
+
+#endif // __PriorityQueue_h__
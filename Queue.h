@@ -4,8 +4,11 @@
 #include "Exception.h"
 #include <condition_variable>
 #include <deque>
+#include <chrono>
 #include <limits>
 #include <mutex>
+#include <stdint.h>
+#include <utility>
 
 /// Helper macro that will throw an exception before accessing a closed queue
 #define AssertQueueNotClosed                                                   \
@@ -33,6 +36,41 @@ public:
     /// destructs _message
     virtual ~Closed() throw();
   };
+  /** A snapshot of how the queue has been used.
+        Waits for room or elements are measured from when the lock was taken
+     until the element could be added or removed, and only calls that had to
+     wait are counted. Time spent taking the lock is counted separately, for
+     every call, so contention on the lock shows up in lockWaits.
+  */
+  struct Stats {
+    enum {
+      Buckets = 24 ///< Wait histogram buckets, the last one is open-ended
+    };
+    uint64_t enqueues;         ///< Elements added to the queue
+    uint64_t dequeues;         ///< Elements removed from the queue
+    int size;                  ///< Elements in the queue at the snapshot
+    int highWaterMark;         ///< The most elements that have been queued
+    double elapsedSeconds;     ///< Time covered by these statistics
+    double lockHeldSeconds;    ///< Time queue operations held the lock
+    double lockWaitSeconds;    ///< Time queue operations waited for the lock
+    double enqueueWaitSeconds; ///< Time enqueues waited for room
+    double dequeueWaitSeconds; ///< Time dequeues waited for elements
+    /// enqueueWaits[i] counts waits for room under 2^i microseconds
+    uint64_t enqueueWaits[Buckets];
+    /// dequeueWaits[i] counts waits for elements under 2^i microseconds
+    uint64_t dequeueWaits[Buckets];
+    /// lockWaits[i] counts operations that took the lock in under 2^i
+    /// microseconds
+    uint64_t lockWaits[Buckets];
+    /// Elements added per second
+    double enqueueRate() const {
+      return elapsedSeconds > 0.0 ? enqueues / elapsedSeconds : 0.0;
+    }
+    /// Elements removed per second
+    double dequeueRate() const {
+      return elapsedSeconds > 0.0 ? dequeues / elapsedSeconds : 0.0;
+    }
+  };
   /** Create a new queue.
         @param max The maximum number of items in the queue. If enqueue is
      attempted, it blocks until there is room. default 0 which means there is no
@@ -74,6 +112,30 @@ public:
         @throws Closed if the queue has been closed
   */
   bool enqueue(const T &value, double timeoutInSeconds);
+  /** Moves an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to move into the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  Queue &enqueue(T &&value);
+  /** Constructs an element in place in the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param args The arguments to pass to the constructor of T.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  template <class... Args> Queue &emplace(Args &&...args);
+  /** Puts a range of elements into the queue, taking the lock once.
+        Use std::make_move_iterator to move the elements instead of copying.
+        This call will block if the queue is full until all elements have been
+     added.
+        @param first The first element to add.
+        @param last Just past the last element to add.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  template <class Iterator> Queue &enqueueBatch(Iterator first, Iterator last);
   /** Retrieves that oldest value in the queue.
         @return The oldest value in the queue
         @throws Closed if the queue has been closed
@@ -87,16 +149,54 @@ public:
         @throws Closed if the queue has been closed
   */
   bool dequeue(T &value, double timeoutInSeconds);
+  /** Retrieves up to max of the oldest values in the queue, taking the lock
+     once.
+        Waits until at least one value is available or the timeout expires.
+        @param out receives the values, oldest first
+        @param max The maximum number of values to dequeue, at least 1.
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     empty.
+        @return The number of values written to out, 0 if the operation timed
+     out
+        @throws msg::Exception if max is not positive
+        @throws Closed if the queue has been closed
+  */
+  template <class OutputIterator>
+  int dequeueBatch(OutputIterator out, int max, double timeoutInSeconds);
+  /** A snapshot of the queue's usage, available even after close().
+        @param reset true to start counting again after the snapshot
+        @return the usage since the queue was created or last reset
+  */
+  Stats stats(bool reset = false);
   /// Closes the queue, preventing further operations on the queue.
   void close();
 
 private:
-  typedef std::deque<T> List;      ///< A list of elements
-  std::mutex _lock;                ///< Protection on _queue
-  std::condition_variable _full;   ///< Used to wait if the queue is full
-  std::condition_variable _empty;  ///< Used to wait if the queue is empty
-  List _queue;                     ///< The queue of elements
-  int _max;                        ///< The maximum number of elements
+  typedef std::deque<T> List;              ///< A list of elements
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timing
+  std::mutex _lock;                        ///< Protection on _queue
+  std::condition_variable _full;  ///< Used to wait if the queue is full
+  std::condition_variable _empty; ///< Used to wait if the queue is empty
+  List _queue;                    ///< The queue of elements
+  int _max;                       ///< The maximum number of elements
+  Stats _stats;                   ///< Usage since _started
+  Clock::time_point _started;     ///< When _stats started counting
+  /// The time timeoutInSeconds from now
+  static Clock::time_point _deadline(double timeoutInSeconds);
+  /// The seconds between start and end
+  static double _seconds(Clock::time_point start, Clock::time_point end);
+  /// Start counting _stats again from now
+  void _resetStats();
+  /// Count a wait in the histogram bucket for its length
+  static void _record(uint64_t *histogram, double seconds);
+  /// Record how long it took to take _lock
+  Clock::time_point _locked(Clock::time_point start);
+  /// Record a wait for room or for elements
+  void _waited(bool enqueuing, Clock::time_point start, Clock::time_point now);
+  /// Record elements added and how long _lock was held
+  void _added(int count, Clock::time_point acquired);
+  /// Record elements removed and how long _lock was held
+  void _removed(int count, Clock::time_point acquired);
   Queue(const Queue &);            ///< prevent usage
   Queue &operator=(const Queue &); ///< prevent usage
 };
@@ -115,7 +215,9 @@ template <class T> inline Queue<T>::Closed::~Closed() throw() {}
 template <class T>
 inline Queue<T>::Queue(int max, int reserve)
     : _lock(), _full(), _empty(), _queue(),
-      _max(0 == max ? std::numeric_limits<int>::max() : max) {
+      _max(0 == max ? std::numeric_limits<int>::max() : max), _stats(),
+      _started() {
+  _resetStats();
   if (reserve > 0) {
     //_queue.reserve(reserve);
   } else if (max > 0) {
@@ -143,81 +245,285 @@ template <class T> inline int Queue<T>::size() {
   return _queue.size();
 }
 template <class T> inline Queue<T> &Queue<T>::enqueue(const T &value) {
+  const Clock::time_point start = Clock::now();
   std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
 
-  while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
-    _full.wait(lock);
+  if ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+    while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+      _full.wait(lock);
+    }
+    acquired = Clock::now();
+    _waited(true, locked, acquired);
   }
   AssertQueueNotClosed;
   //_queue.insert(_queue.begin(), value);
   _queue.push_front(value);
-  _empty.notify_all();
+  _added(1, acquired);
+  _empty.notify_one();
   return *this;
 }
-/**
-        @todo decrement timeoutInSeconds for contention on enqueues
-*/
 template <class T>
 inline bool Queue<T>::enqueue(const T &value, double timeoutInSeconds) {
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point deadline = _deadline(timeoutInSeconds);
   std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
 
-  while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
-    if (std::cv_status::timeout ==
-        _full.wait_for(lock, std::chrono::seconds(uint64_t(
-                                 timeoutInSeconds * 1000 * 1000 * 1000)))) {
-      return false;
-    } else {
-      AssertQueueNotClosed;
+  if ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+    while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+      if (std::cv_status::timeout == _full.wait_until(lock, deadline)) {
+        AssertQueueNotClosed;
+        if (static_cast<int>(_queue.size()) >= _max) {
+          _waited(true, locked, Clock::now());
+          return false;
+        }
+      }
     }
+    acquired = Clock::now();
+    _waited(true, locked, acquired);
   }
   AssertQueueNotClosed;
   //_queue.insert(_queue.begin(), value);
   _queue.push_front(value);
-  _empty.notify_all();
+  _added(1, acquired);
+  _empty.notify_one();
   return true;
 }
+template <class T> inline Queue<T> &Queue<T>::enqueue(T &&value) {
+  return emplace(std::move(value));
+}
+template <class T>
+template <class... Args>
+inline Queue<T> &Queue<T>::emplace(Args &&...args) {
+  const Clock::time_point start = Clock::now();
+  std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
+
+  if ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+    while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+      _full.wait(lock);
+    }
+    acquired = Clock::now();
+    _waited(true, locked, acquired);
+  }
+  AssertQueueNotClosed;
+  _queue.emplace_front(std::forward<Args>(args)...);
+  _added(1, acquired);
+  _empty.notify_one();
+  return *this;
+}
+template <class T>
+template <class Iterator>
+inline Queue<T> &Queue<T>::enqueueBatch(Iterator first, Iterator last) {
+  const Clock::time_point start = Clock::now();
+  std::unique_lock<std::mutex> lock(_lock);
+  Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
+
+  while (first != last) {
+    int added = 0;
+
+    if ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+      while ((static_cast<int>(_queue.size()) >= _max) && (-1 != _max)) {
+        _full.wait(lock);
+      }
+      acquired = Clock::now();
+      _waited(true, locked, acquired);
+    }
+    AssertQueueNotClosed;
+    while ((first != last) && (static_cast<int>(_queue.size()) < _max)) {
+      _queue.emplace_front(*first);
+      ++first;
+      ++added;
+    }
+    _added(added, acquired);
+    locked = Clock::now();
+    _empty.notify_all(); // wakes consumers to make room for the rest
+  }
+  return *this;
+}
 template <class T> inline T Queue<T>::dequeue() {
+  const Clock::time_point start = Clock::now();
   std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
 
-  while ((_queue.size() == 0) && (-1 != _max)) {
-    _empty.wait(lock);
+  if ((_queue.size() == 0) && (-1 != _max)) {
+    while ((_queue.size() == 0) && (-1 != _max)) {
+      _empty.wait(lock);
+    }
+    acquired = Clock::now();
+    _waited(false, locked, acquired);
   }
   AssertQueueNotClosed;
 
-  T value = _queue.back();
+  T value(std::move(_queue.back()));
 
   _queue.pop_back();
-  _full.notify_all();
+  _removed(1, acquired);
+  _full.notify_one();
   return value;
 }
-/**
-        @todo decrement timeoutInSeconds for contention on enqueues
-*/
 template <class T>
 inline bool Queue<T>::dequeue(T &value, double timeoutInSeconds) {
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point deadline = _deadline(timeoutInSeconds);
   std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
 
-  while ((_queue.size() == 0) && (-1 != _max)) {
-    if (std::cv_status::timeout ==
-        _empty.wait_for(lock, std::chrono::nanoseconds(uint64_t(
-                                  timeoutInSeconds * 1000 * 1000 * 1000)))) {
-      return false;
-    } else {
-      AssertQueueNotClosed;
+  if ((_queue.size() == 0) && (-1 != _max)) {
+    while ((_queue.size() == 0) && (-1 != _max)) {
+      if (std::cv_status::timeout == _empty.wait_until(lock, deadline)) {
+        AssertQueueNotClosed;
+        if (_queue.size() == 0) {
+          _waited(false, locked, Clock::now());
+          return false;
+        }
+      }
     }
+    acquired = Clock::now();
+    _waited(false, locked, acquired);
   }
   AssertQueueNotClosed;
-  value = _queue.back();
+  value = std::move(_queue.back());
   _queue.pop_back();
-  _full.notify_all();
+  _removed(1, acquired);
+  _full.notify_one();
   return true;
 }
+template <class T>
+template <class OutputIterator>
+inline int Queue<T>::dequeueBatch(OutputIterator out, int max,
+                                  double timeoutInSeconds) {
+  AssertMessageException(max > 0);
+  const Clock::time_point start = Clock::now();
+  const Clock::time_point deadline = _deadline(timeoutInSeconds);
+  std::unique_lock<std::mutex> lock(_lock);
+  const Clock::time_point locked = _locked(start);
+  Clock::time_point acquired = locked;
+  int count = 0;
+
+  if ((_queue.size() == 0) && (-1 != _max)) {
+    while ((_queue.size() == 0) && (-1 != _max)) {
+      if (std::cv_status::timeout == _empty.wait_until(lock, deadline)) {
+        AssertQueueNotClosed;
+        if (_queue.size() == 0) {
+          _waited(false, locked, Clock::now());
+          return 0;
+        }
+      }
+    }
+    acquired = Clock::now();
+    _waited(false, locked, acquired);
+  }
+  AssertQueueNotClosed;
+  while ((count < max) && (_queue.size() > 0)) {
+    *out = std::move(_queue.back());
+    ++out;
+    _queue.pop_back();
+    ++count;
+  }
+  _removed(count, acquired);
+  if (count > 0) {
+    _full.notify_all();
+  }
+  return count;
+}
+template <class T>
+inline typename Queue<T>::Stats Queue<T>::stats(bool reset) {
+  std::lock_guard<std::mutex> lock(_lock);
+  Stats snapshot(_stats);
+
+  snapshot.size = _queue.size();
+  snapshot.elapsedSeconds = _seconds(_started, Clock::now());
+  if (reset) {
+    _resetStats();
+  }
+  return snapshot;
+}
 template <class T> inline void Queue<T>::close() {
-  _max = -1;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _max = -1;
+  }
   _empty.notify_all();
   _full.notify_all();
 }
 
+template <class T>
+inline typename Queue<T>::Clock::time_point
+Queue<T>::_deadline(double timeoutInSeconds) {
+  return Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(timeoutInSeconds));
+}
+template <class T>
+inline double Queue<T>::_seconds(Clock::time_point start,
+                                 Clock::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+/// Must be called with _lock held
+template <class T> inline void Queue<T>::_resetStats() {
+  _stats = Stats();
+  _stats.highWaterMark = _queue.size();
+  _started = Clock::now();
+}
+/// Count a wait in the histogram bucket for its length
+template <class T>
+inline void Queue<T>::_record(uint64_t *histogram, double seconds) {
+  int bucket = 0;
+
+  for (double limit = 1e-6;
+       (bucket < Stats::Buckets - 1) && (seconds >= limit); limit *= 2.0) {
+    ++bucket;
+  }
+  histogram[bucket] += 1;
+}
+/** Must be called as soon as _lock is taken.
+        @param start When the call started to take the lock
+        @return When the lock was acquired
+*/
+template <class T>
+inline typename Queue<T>::Clock::time_point
+Queue<T>::_locked(Clock::time_point start) {
+  const Clock::time_point now = Clock::now();
+  const double seconds = _seconds(start, now);
+
+  _record(_stats.lockWaits, seconds);
+  _stats.lockWaitSeconds += seconds;
+  return now;
+}
+/// Must be called with _lock held
+template <class T>
+inline void Queue<T>::_waited(bool enqueuing, Clock::time_point start,
+                              Clock::time_point now) {
+  const double seconds = _seconds(start, now);
+
+  _record(enqueuing ? _stats.enqueueWaits : _stats.dequeueWaits, seconds);
+  (enqueuing ? _stats.enqueueWaitSeconds : _stats.dequeueWaitSeconds) +=
+      seconds;
+}
+/// Must be called with _lock held
+template <class T>
+inline void Queue<T>::_added(int count, Clock::time_point acquired) {
+  _stats.enqueues += count;
+  if (static_cast<int>(_queue.size()) > _stats.highWaterMark) {
+    _stats.highWaterMark = _queue.size();
+  }
+  _stats.lockHeldSeconds += _seconds(acquired, Clock::now());
+}
+/// Must be called with _lock held
+template <class T>
+inline void Queue<T>::_removed(int count, Clock::time_point acquired) {
+  _stats.dequeues += count;
+  _stats.lockHeldSeconds += _seconds(acquired, Clock::now());
+}
+
 #undef AssertQueueNotClosed // this macro is not valid outside the scope of this
                             // file
 
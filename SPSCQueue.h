@@ -0,0 +1,471 @@
+#ifndef __SPSCQueue_h__
+#define __SPSCQueue_h__
+
+/** @file SPSCQueue.h
+        Wait-free, fixed capacity, single-producer single-consumer queue.
+*/
+
+#include "Exception.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/// Helper macro that will throw an exception before accessing a closed queue
+#define AssertSPSCQueueNotClosed                                               \
+  if (_closed.load(std::memory_order_acquire)) {                               \
+    throw Closed("Queue Already Closed", __FILE__, __LINE__);                  \
+  } else                                                                       \
+    msg::noop()
+
+namespace exec {
+
+/** A queue for handing elements from exactly one thread to exactly one other.
+        The producer only writes the tail and the consumer only writes the
+   head, so tryEnqueue and tryDequeue are wait-free: a load of the other
+   side's index (usually served from a cached copy), a copy of the element
+   and a store. There are no compare-and-swaps and no locks.
+        The blocking calls spin briefly and then sleep. On Linux they sleep on a
+   futex, elsewhere on a condition variable. Either way the other side only
+   makes a system call to wake a sleeper when one is actually sleeping.
+        Only one thread may enqueue and only one thread may dequeue at a time.
+   Use exec::BoundedQueue if there are several producers or consumers.
+        @tparam T The type of the elements
+        @tparam Capacity The number of elements the queue can hold. Must be a
+   power of two.
+*/
+template <class T, size_t Capacity> class SPSCQueue {
+public:
+  /// Exception that is thrown when attempting to operate on a closed queue
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Get a message
+    explicit Closed(const std::string &message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /// Create a new, empty queue.
+  SPSCQueue();
+  /// Destroys any elements left in the queue.
+  ~SPSCQueue();
+  /** Is the queue empty.
+        @return true if there are no elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  bool empty();
+  /** Is the queue full.
+        @return true if any more elements added to the queue would block.
+        @throws Closed if the queue has been closed
+  */
+  bool full();
+  /** The number of elements in the queue.
+        This is a snapshot and may be stale by the time it is returned.
+        @return The count of all elements in the queue.
+        @throws Closed if the queue has been closed
+  */
+  int size();
+  /** Puts an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to add to the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  SPSCQueue &enqueue(const T &value);
+  /** Moves an element into the queue.
+        This call will block if the queue is full until an element is dequeued.
+        @param value The value to move into the queue.
+        @return a reference to this queue
+        @throws Closed if the queue has been closed
+  */
+  SPSCQueue &enqueue(T &&value);
+  /** Puts an element into the queue.
+        @param value The value to add to the queue.
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     full.
+        @return true if the element was successfully added, false if the
+     operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool enqueue(const T &value, double timeoutInSeconds);
+  /** Puts an element into the queue if there is room, without waiting.
+        @param value The value to add to the queue.
+        @return true if the element was added, false if the queue was full
+        @throws Closed if the queue has been closed
+  */
+  bool tryEnqueue(const T &value);
+  /** Retrieves that oldest value in the queue.
+        This call will block if the queue is empty.
+        @return The oldest value in the queue
+        @throws Closed if the queue has been closed
+  */
+  T dequeue();
+  /** Retrieves that oldest value in the queue.
+        @param value receives the value from the queue
+        @param timeoutInSeconds The number of seconds to wait if the queue is
+     empty.
+        @return true if value was filled in, false if the operation timed out
+        @throws Closed if the queue has been closed
+  */
+  bool dequeue(T &value, double timeoutInSeconds);
+  /** Retrieves that oldest value in the queue if there is one, without waiting.
+        @param value receives the value from the queue
+        @return true if value was filled in, false if the queue was empty
+        @throws Closed if the queue has been closed
+  */
+  bool tryDequeue(T &value);
+  /// Closes the queue, waking and failing any waiting producer or consumer.
+  void close();
+
+private:
+  enum {
+    CacheLineSize = 64, ///< Separation to prevent false sharing
+    SpinCount = 128     ///< Times to retry before sleeping
+  };
+  typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type
+      Storage;                             ///< Uninitialized space for element
+  typedef std::chrono::steady_clock Clock; ///< Clock used for timeouts
+
+  static_assert((Capacity >= 2) && ((Capacity & (Capacity - 1)) == 0),
+                "Capacity must be a power of two");
+  static const size_t Mask = Capacity - 1; ///< Position to slot index
+
+  alignas(CacheLineSize) std::atomic<size_t> _head; ///< Next read position
+  size_t _tailCache; ///< Consumer's last view of _tail
+  alignas(CacheLineSize) std::atomic<size_t> _tail; ///< Next write position
+  size_t _headCache; ///< Producer's last view of _head
+  alignas(CacheLineSize) std::atomic<uint32_t> _epoch; ///< Bumped to wake
+  std::atomic<bool> _producerSleeping; ///< The producer is waiting for room
+  std::atomic<bool> _consumerSleeping; ///< The consumer is waiting for data
+  std::atomic<bool> _closed; ///< Has close been called
+  Storage *_slots;           ///< The ring
+#if !defined(__linux__)
+  std::mutex _sleepLock;           ///< Protects sleeping on _wakeup
+  std::condition_variable _wakeup; ///< Signalled when _epoch changes
+#endif
+
+  /// Get the element stored in a slot
+  T *_value(size_t position) {
+    return reinterpret_cast<T *>(&_slots[position & Mask]);
+  }
+  /// Deadline for a timeout in seconds
+  static Clock::time_point _deadline(double timeoutInSeconds);
+  /// Producer: is there room for another element
+  bool _hasRoom();
+  /// Consumer: is there an element to dequeue
+  bool _hasData();
+  /** Wait for the other side.
+        @param producing true to wait for room, false to wait for an element
+        @param deadline when to give up, Clock::time_point::max() to never
+        @return true if ready, false if the deadline passed
+  */
+  bool _wait(bool producing, Clock::time_point deadline);
+  /// Sleep until _epoch is no longer epoch or the deadline has passed
+  void _sleep(uint32_t epoch, Clock::time_point deadline);
+  /** Wake the other side if it is sleeping. Called after a seq_cst publish.
+        @param producing true if called by the producer
+  */
+  void _wake(bool producing);
+  SPSCQueue(const SPSCQueue &);            ///< prevent usage
+  SPSCQueue &operator=(const SPSCQueue &); ///< prevent usage
+};
+
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::Closed::Closed(const char *message,
+                                              const char *file,
+                                              int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::Closed::Closed(const std::string &message,
+                                              const char *file,
+                                              int line) throw()
+    : msg::Exception(message, file, line) {}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::Closed::~Closed() throw() {}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::SPSCQueue()
+    : _head(0), _tailCache(0), _tail(0), _headCache(0), _epoch(0),
+      _producerSleeping(false),
+      _consumerSleeping(false), _closed(false), _slots(new Storage[Capacity])
+#if !defined(__linux__)
+      , _sleepLock(), _wakeup()
+#endif
+{
+}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity>::~SPSCQueue() {
+  const size_t end = _tail.load(std::memory_order_relaxed);
+
+  for (size_t position = _head.load(std::memory_order_relaxed);
+       position != end; ++position) {
+    _value(position)->~T();
+  }
+  delete[] _slots;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::empty() {
+  return size() == 0;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::full() {
+  return size() >= static_cast<int>(Capacity);
+}
+template <class T, size_t Capacity> inline int SPSCQueue<T, Capacity>::size() {
+  AssertSPSCQueueNotClosed;
+  const size_t head = _head.load(std::memory_order_acquire);
+  const size_t tail = _tail.load(std::memory_order_acquire);
+
+  return tail > head ? static_cast<int>(tail - head) : 0;
+}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity> &
+SPSCQueue<T, Capacity>::enqueue(const T &value) {
+  _wait(true, Clock::time_point::max());
+
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+
+  new (_value(tail)) T(value);
+  _tail.store(tail + 1, std::memory_order_seq_cst);
+  _wake(true);
+  return *this;
+}
+template <class T, size_t Capacity>
+inline SPSCQueue<T, Capacity> &SPSCQueue<T, Capacity>::enqueue(T &&value) {
+  _wait(true, Clock::time_point::max());
+
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+
+  new (_value(tail)) T(std::move(value));
+  _tail.store(tail + 1, std::memory_order_seq_cst);
+  _wake(true);
+  return *this;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::enqueue(const T &value,
+                                            double timeoutInSeconds) {
+  if (!_wait(true, _deadline(timeoutInSeconds))) {
+    return false;
+  }
+
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+
+  new (_value(tail)) T(value);
+  _tail.store(tail + 1, std::memory_order_seq_cst);
+  _wake(true);
+  return true;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::tryEnqueue(const T &value) {
+  AssertSPSCQueueNotClosed;
+  if (!_hasRoom()) {
+    return false;
+  }
+
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+
+  new (_value(tail)) T(value);
+  _tail.store(tail + 1, std::memory_order_seq_cst);
+  _wake(true);
+  return true;
+}
+template <class T, size_t Capacity> inline T SPSCQueue<T, Capacity>::dequeue() {
+  _wait(false, Clock::time_point::max());
+
+  const size_t head = _head.load(std::memory_order_relaxed);
+  T value(std::move(*_value(head)));
+
+  _value(head)->~T();
+  _head.store(head + 1, std::memory_order_seq_cst);
+  _wake(false);
+  return value;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::dequeue(T &value,
+                                            double timeoutInSeconds) {
+  if (!_wait(false, _deadline(timeoutInSeconds))) {
+    return false;
+  }
+
+  const size_t head = _head.load(std::memory_order_relaxed);
+
+  value = std::move(*_value(head));
+  _value(head)->~T();
+  _head.store(head + 1, std::memory_order_seq_cst);
+  _wake(false);
+  return true;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::tryDequeue(T &value) {
+  AssertSPSCQueueNotClosed;
+  if (!_hasData()) {
+    return false;
+  }
+
+  const size_t head = _head.load(std::memory_order_relaxed);
+
+  value = std::move(*_value(head));
+  _value(head)->~T();
+  _head.store(head + 1, std::memory_order_seq_cst);
+  _wake(false);
+  return true;
+}
+template <class T, size_t Capacity>
+inline void SPSCQueue<T, Capacity>::close() {
+  _closed.store(true, std::memory_order_seq_cst);
+  _epoch.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_epoch),
+            FUTEX_WAKE_PRIVATE, 2, NULL, NULL, 0);
+#else
+  std::lock_guard<std::mutex> lock(_sleepLock);
+
+  _wakeup.notify_all();
+#endif
+}
+template <class T, size_t Capacity>
+inline typename SPSCQueue<T, Capacity>::Clock::time_point
+SPSCQueue<T, Capacity>::_deadline(double timeoutInSeconds) {
+  return Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                            std::chrono::duration<double>(timeoutInSeconds));
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::_hasRoom() {
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+
+  if (tail - _headCache >= Capacity) {
+    _headCache = _head.load(std::memory_order_seq_cst);
+  }
+  return tail - _headCache < Capacity;
+}
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::_hasData() {
+  const size_t head = _head.load(std::memory_order_relaxed);
+
+  if (head == _tailCache) {
+    _tailCache = _tail.load(std::memory_order_seq_cst);
+  }
+  return head != _tailCache;
+}
+/**
+        The sleeper sets its flag before its final check of the queue and the
+   other side publishes before checking the flag, so either the sleeper sees
+   the new element or room, or the other side sees the sleeper and bumps
+   _epoch, which makes the sleep return at once.
+        Spinning only helps if the other side is running on another core.
+*/
+template <class T, size_t Capacity>
+inline bool SPSCQueue<T, Capacity>::_wait(bool producing,
+                                          Clock::time_point deadline) {
+  static const int spins =
+      std::thread::hardware_concurrency() > 1 ? SpinCount : 0;
+  int attempt = 0;
+
+  while (true) {
+    AssertSPSCQueueNotClosed;
+    if (producing ? _hasRoom() : _hasData()) {
+      return true;
+    }
+    if (attempt < spins) {
+      ++attempt;
+      continue;
+    }
+    if (Clock::now() >= deadline) {
+      return false;
+    }
+    std::atomic<bool> &sleeping =
+        producing ? _producerSleeping : _consumerSleeping;
+
+    sleeping.store(true, std::memory_order_seq_cst);
+
+    const uint32_t epoch = _epoch.load(std::memory_order_seq_cst);
+
+    if (!(producing ? _hasRoom() : _hasData()) &&
+        !_closed.load(std::memory_order_seq_cst)) {
+      _sleep(epoch, deadline);
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+template <class T, size_t Capacity>
+inline void SPSCQueue<T, Capacity>::_sleep(uint32_t epoch,
+                                           Clock::time_point deadline) {
+#if defined(__linux__)
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "futex requires a plain 32 bit word");
+  struct timespec timeout, *timeoutPtr = NULL;
+
+  if (deadline != Clock::time_point::max()) {
+    const int64_t nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(deadline -
+                                                             Clock::now())
+            .count();
+
+    if (nanoseconds <= 0) {
+      return;
+    }
+    timeout.tv_sec = nanoseconds / 1000000000;
+    timeout.tv_nsec = nanoseconds % 1000000000;
+    timeoutPtr = &timeout;
+  }
+  // EAGAIN (epoch already moved), EINTR and ETIMEDOUT all mean re-check
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_epoch),
+            FUTEX_WAIT_PRIVATE, epoch, timeoutPtr, NULL, 0);
+#else
+  std::unique_lock<std::mutex> lock(_sleepLock);
+
+  while (_epoch.load(std::memory_order_seq_cst) == epoch) {
+    if (deadline == Clock::time_point::max()) {
+      _wakeup.wait(lock);
+    } else if (std::cv_status::timeout == _wakeup.wait_until(lock, deadline)) {
+      break;
+    }
+  }
+#endif
+}
+template <class T, size_t Capacity>
+inline void SPSCQueue<T, Capacity>::_wake(bool producing) {
+  std::atomic<bool> &sleeping =
+      producing ? _consumerSleeping : _producerSleeping;
+
+  if (sleeping.load(std::memory_order_seq_cst) &&
+      sleeping.exchange(false, std::memory_order_seq_cst)) {
+    _epoch.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t *>(&_epoch),
+              FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    std::lock_guard<std::mutex> lock(_sleepLock);
+
+    _wakeup.notify_all();
+#endif
+  }
+}
+
+#undef AssertSPSCQueueNotClosed // this macro is not valid outside the scope
+                                // of this file
+
+}; // namespace exec
+
+#endif // __SPSCQueue_h__
@@ -10,7 +10,9 @@
 
 #include "CryptoHelpers.h"
 #include "Exception.h"
+#include <algorithm>
 #include <ctype.h>
+#include <stdint.h>
 #include <string.h>
 #include <string>
 
@@ -25,6 +27,61 @@
 
 namespace crypto {
 
+/** Encrypts or decrypts a series of messages with one key.
+        The key schedule is set up once, when the Cipher is made, so each
+   message after that only costs setting the initialization vector.
+        A message may be given in pieces with update() and finish(), like
+   z::Deflater, or all at once with crypt(), which can work in place.
+        Get one from SymmetricKey::cipher().
+*/
+class Cipher {
+public:
+  enum Direction { Encrypt, Decrypt };
+  Cipher() {}
+  virtual ~Cipher() {}
+  virtual Direction direction() const = 0;
+  virtual size_t blockSize() const = 0;
+  virtual size_t ivSize() const = 0;
+  /** Begin a new message, dropping anything left over from the last one.
+          finish() starts the next message with a zero iv.
+          @param iv ivSize() bytes of initialization vector, or NULL for zeros
+  */
+  virtual void start(const void *iv) = 0;
+  /** The most bytes update() or finish() can write for size bytes of input.
+   */
+  size_t maximumOutput(size_t size) const { return size + blockSize(); }
+  /** The most bytes a whole message of size bytes becomes.
+          This is size unless encrypting with padding.
+  */
+  virtual size_t maximumMessageOutput(size_t size) const = 0;
+  /** Add the next piece of the message.
+          @param data The next bytes of the message
+          @param size The number of bytes in data
+          @param output Room for maximumOutput(size) bytes. To work in place,
+   leave each piece where it is in the buffer and pass the end returned by the
+   last update(), or the start of the buffer for the first piece. Output can
+   fall up to a block behind data, since the last block is held back when
+   decrypting with padding.
+          @return The end of what was written to output
+  */
+  virtual uint8_t *update(const void *data, size_t size, void *output) = 0;
+  /** Write the rest of the message.
+          @param output Room for blockSize() bytes
+          @return The end of what was written to output
+          @throws AlignmentError without padding, if the message was not a
+   whole number of blocks
+  */
+  virtual uint8_t *finish(void *output) = 0;
+  size_t crypt(void *buffer, size_t size, size_t capacity,
+               const void *iv = NULL);
+  std::string &crypt(const std::string &data, const std::string &iv,
+                     std::string &result);
+
+private:
+  Cipher(const Cipher &);            ///< Prevent usage
+  Cipher &operator=(const Cipher &); ///< Prevent usage
+};
+
 class SymmetricKey {
 public:
   SymmetricKey() {}
@@ -48,6 +105,11 @@ public:
   virtual void decryptInPlace(const char *encrypted, size_t encryptedSize,
                               const std::string &iv, char *data,
                               size_t &dataSize) const = 0;
+  /** A Cipher to reuse this key for many messages, or very large ones.
+          @param direction Whether the Cipher encrypts or decrypts
+          @return A new Cipher, the caller deletes it
+  */
+  virtual Cipher *cipher(Cipher::Direction direction) const = 0;
 };
 
 template <class SpecificCryptor>
@@ -68,6 +130,7 @@ public:
   void decryptInPlace(const char *encrypted, size_t encryptedSize,
                       const std::string &iv, char *data,
                       size_t &dataSize) const override;
+  Cipher *cipher(Cipher::Direction direction) const override;
 
 private:
   std::string _key;
@@ -96,9 +159,48 @@ inline std::string SymmetricKey::decryptWithIV(const std::string &encrypted,
   return decryptInPlace(encrypted, iv, decrypted);
 }
 
-std::string &SymmetricKey::encryptInPlace(const std::string &data,
-                                          const std::string &iv,
-                                          std::string &encrypted) const {
+/** Encrypt or decrypt a whole message in place.
+        @param buffer In: the message. Out: the result
+        @param size The number of bytes of message in buffer
+        @param capacity The number of bytes buffer can hold, at least
+   maximumMessageOutput(size)
+        @param iv ivSize() bytes of initialization vector, or NULL for zeros
+        @return The number of bytes of result in buffer
+        @throws BufferTooSmallError if capacity is too small
+*/
+inline size_t Cipher::crypt(void *buffer, size_t size, size_t capacity,
+                            const void *iv) {
+  __crypto_EncryptAssert(BufferTooSmall,
+                         capacity >= maximumMessageOutput(size));
+  start(iv);
+
+  uint8_t *const end = update(buffer, size, buffer);
+
+  return finish(end) - reinterpret_cast<uint8_t *>(buffer);
+}
+
+/** Encrypt or decrypt a whole message.
+        @param data The message
+        @param iv The initialization vector, ivSize() bytes or empty for zeros
+        @param result Set to the result, keeping its capacity for next time
+        @return result
+*/
+inline std::string &Cipher::crypt(const std::string &data,
+                                  const std::string &iv, std::string &result) {
+  __crypto_EncryptAssert(IVWrongSize,
+                         (iv.length() == ivSize()) || (iv.length() == 0));
+  start(iv.length() ? iv.data() : NULL);
+  result.resize(maximumOutput(data.size()));
+
+  uint8_t *const begin = reinterpret_cast<uint8_t *>(&result[0]);
+
+  result.resize(finish(update(data.data(), data.size(), begin)) - begin);
+  return result;
+}
+
+inline std::string &SymmetricKey::encryptInPlace(const std::string &data,
+                                                 const std::string &iv,
+                                                 std::string &encrypted) const {
   size_t encryptedSize;
 
   encrypted.assign(data.size() + blockSize(), '\0');
@@ -109,9 +211,9 @@ std::string &SymmetricKey::encryptInPlace(const std::string &data,
   return encrypted;
 }
 
-std::string &SymmetricKey::decryptInPlace(const std::string &encrypted,
-                                          const std::string &iv,
-                                          std::string &data) const {
+inline std::string &SymmetricKey::decryptInPlace(const std::string &encrypted,
+                                                 const std::string &iv,
+                                                 std::string &data) const {
   size_t dataSize;
 
   data.assign(encrypted.size() + blockSize(), '\0');
@@ -171,53 +273,141 @@ inline void SpecificSymmetricKey<SpecificCryptor>::decryptInPlace(
       SpecificCryptor::decrypt(_key.data(), encrypted, encryptedSize, data,
                                dataSize, iv.length() ? iv.data() : NULL);
 }
+template <class SpecificCryptor>
+inline Cipher *SpecificSymmetricKey<SpecificCryptor>::cipher(
+    Cipher::Direction direction) const {
+  return new typename SpecificCryptor::Stream(_key.data(), direction);
+}
 
 #if OpenSSLAvailable
 
+/// A Cipher on one OpenSSL context, which keeps the key schedule
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+class OpenSSLCipher : public Cipher {
+public:
+  OpenSSLCipher(const void *key, Direction direction, const void *iv = NULL);
+  virtual ~OpenSSLCipher() {}
+  Direction direction() const override { return _direction; }
+  size_t blockSize() const override { return blockLength; }
+  size_t ivSize() const override { return ivLength; }
+  void start(const void *iv) override;
+  size_t maximumMessageOutput(size_t size) const override;
+  uint8_t *update(const void *data, size_t size, void *output) override;
+  uint8_t *finish(void *output) override;
+
+private:
+  enum {
+    MostPiece = 1 << 30 ///< EVP_CipherUpdate takes an int size, whole blocks
+  };
+  OpenSSLContext _context; ///< Initialized with the key once
+  Direction _direction;    ///< Encrypt or Decrypt
+  size_t _partial;         ///< Bytes given past the last whole block
+};
+
 template <const EVP_CIPHER *cipher(void), bool padding, int keySize,
           int blockSize, int ivSize>
 struct OpenSSLAES {
   enum { Size = keySize };
   enum { BlockSize = blockSize };
   enum { IVLength = ivSize };
+  typedef OpenSSLCipher<cipher, padding, keySize, blockSize, ivSize> Stream;
   static size_t encrypt(const void *key, const void *data, size_t length,
                         void *out, size_t outBufferSize, const void *iv) {
-    return _crypt(1, key, data, length, out, outBufferSize, iv);
+    return _crypt(Cipher::Encrypt, key, data, length, out, outBufferSize, iv);
   }
   static size_t decrypt(const void *key, const void *data, size_t length,
                         void *out, size_t outBufferSize, const void *iv) {
-    return _crypt(0, key, data, length, out, outBufferSize, iv);
+    return _crypt(Cipher::Decrypt, key, data, length, out, outBufferSize, iv);
   }
 
 private:
-  /**
-          @todo and probably fix
-  */
-  static size_t _crypt(int enc, const void *key, const void *data,
-                       size_t length, void *out, size_t /*outBufferSize*/,
-                       const void *iv) {
-    unsigned char *outBuffer = reinterpret_cast<unsigned char *>(out);
-    int bytesWritten;
-    OpenSSLContext context;
-    const EVP_CIPHER *cipher_type = cipher();
-
-    __crypto_OSSLHandle(
-        EVP_CipherInit_ex(context, cipher_type, NULL,
-                          reinterpret_cast<const unsigned char *>(key),
-                          reinterpret_cast<const unsigned char *>(iv), enc));
-    AssertMessageException(EVP_CIPHER_CTX_key_length(context) == Size);
-    AssertMessageException((NULL == iv) ||
-                           (EVP_CIPHER_CTX_iv_length(context) == IVLength));
-    __crypto_OSSLHandle(EVP_CIPHER_CTX_set_padding(context, padding ? 1 : 0));
-
-    __crypto_OSSLHandle(EVP_CipherUpdate(
-        context, outBuffer, &bytesWritten,
-        reinterpret_cast<const unsigned char *>(data), length));
-    __crypto_OSSLHandle(EVP_CipherFinal_ex(context, outBuffer, &bytesWritten));
-    return bytesWritten;
+  static size_t _crypt(Cipher::Direction direction, const void *key,
+                       const void *data, size_t length, void *out,
+                       size_t outBufferSize, const void *iv) {
+    Stream stream(key, direction, iv);
+
+    __crypto_EncryptAssert(
+        BufferTooSmall, outBufferSize >= stream.maximumMessageOutput(length));
+    return stream.finish(stream.update(data, length, out)) -
+           reinterpret_cast<uint8_t *>(out);
   }
 };
 
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+inline OpenSSLCipher<cipher, padding, keyLength, blockLength,
+                     ivLength>::OpenSSLCipher(const void *key,
+                                              Direction direction,
+                                              const void *iv)
+    : Cipher(), _context(), _direction(direction), _partial(0) {
+  __crypto_OSSLHandle(EVP_CipherInit_ex(
+      _context, cipher(), NULL, reinterpret_cast<const unsigned char *>(key),
+      NULL, Encrypt == direction ? 1 : 0));
+  AssertMessageException(EVP_CIPHER_CTX_key_length(_context) == keyLength);
+  AssertMessageException(EVP_CIPHER_CTX_iv_length(_context) == ivLength);
+  start(iv);
+}
+
+/// Only the iv is set, NULL for the key keeps the key schedule
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+inline void
+OpenSSLCipher<cipher, padding, keyLength, blockLength, ivLength>::start(
+    const void *iv) {
+  static const unsigned char zeros[ivLength] = {0};
+
+  __crypto_OSSLHandle(EVP_CipherInit_ex(
+      _context, NULL, NULL, NULL,
+      NULL == iv ? zeros : reinterpret_cast<const unsigned char *>(iv), -1));
+  __crypto_OSSLHandle(EVP_CIPHER_CTX_set_padding(_context, padding ? 1 : 0));
+  _partial = 0;
+}
+
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+inline size_t OpenSSLCipher<cipher, padding, keyLength, blockLength,
+                            ivLength>::maximumMessageOutput(size_t size) const {
+  return padding && (Encrypt == _direction)
+             ? (size / blockLength + 1) * blockLength
+             : size;
+}
+
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+inline uint8_t *
+OpenSSLCipher<cipher, padding, keyLength, blockLength, ivLength>::update(
+    const void *data, size_t size, void *output) {
+  const unsigned char *in = reinterpret_cast<const unsigned char *>(data);
+  unsigned char *out = reinterpret_cast<unsigned char *>(output);
+
+  _partial = (_partial + size) % blockLength;
+  while (size > 0) {
+    const int piece = int(std::min<size_t>(size, MostPiece));
+    int written;
+
+    __crypto_OSSLHandle(EVP_CipherUpdate(_context, out, &written, in, piece));
+    in += piece;
+    out += written;
+    size -= piece;
+  }
+  return out;
+}
+
+template <const EVP_CIPHER *cipher(void), bool padding, int keyLength,
+          int blockLength, int ivLength>
+inline uint8_t *
+OpenSSLCipher<cipher, padding, keyLength, blockLength, ivLength>::finish(
+    void *output) {
+  unsigned char *out = reinterpret_cast<unsigned char *>(output);
+  int written;
+
+  __crypto_EncryptAssert(Alignment, padding || (0 == _partial));
+  __crypto_OSSLHandle(EVP_CipherFinal_ex(_context, out, &written));
+  start(NULL);
+  return out + written;
+}
+
 typedef OpenSSLAES<EVP_aes_256_cbc, true, 32, AES_BLOCK_SIZE, AES_BLOCK_SIZE>
     OpenSSL_AES256_CBC_Padded_Cryptor;
 typedef OpenSSLAES<EVP_aes_256_cbc, false, 32, AES_BLOCK_SIZE, AES_BLOCK_SIZE>
@@ -249,12 +439,38 @@ typedef AES256_CBC_Padded AES256;
 
 #if defined(__APPLE__)
 
+/// A Cipher on one CommonCrypto cryptor, which keeps the key schedule
+template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
+          size_t blockLength, size_t ivLength>
+class CommonCryptoCipher : public Cipher {
+public:
+  CommonCryptoCipher(const void *key, Direction direction,
+                     const void *iv = NULL);
+  virtual ~CommonCryptoCipher() { CCCryptorRelease(_cryptor); }
+  Direction direction() const override { return _direction; }
+  size_t blockSize() const override { return blockLength; }
+  size_t ivSize() const override { return ivLength; }
+  void start(const void *iv) override {
+    __crypto_CCHandle(CCCryptorReset(_cryptor, iv));
+  }
+  size_t maximumMessageOutput(size_t size) const override;
+  uint8_t *update(const void *data, size_t size, void *output) override;
+  uint8_t *finish(void *output) override;
+
+private:
+  CCCryptorRef _cryptor; ///< Created with the key once
+  Direction _direction;  ///< Encrypt or Decrypt
+};
+
 template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
           size_t blockSize, size_t ivLength>
 struct CommonCryptoKey {
   enum { Size = keyLength };
   enum { BlockSize = blockSize };
   enum { IVLength = ivLength };
+  typedef CommonCryptoCipher<algorithm, options, keyLength, blockSize,
+                             ivLength>
+      Stream;
   static size_t encrypt(const void *key, const void *data, size_t length,
                         void *out, size_t outBufferSize, const void *iv) {
     return _crypt(kCCEncrypt, key, data, length, out, outBufferSize, iv);
@@ -276,6 +492,55 @@ private:
   }
 };
 
+template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
+          size_t blockLength, size_t ivLength>
+inline CommonCryptoCipher<algorithm, options, keyLength, blockLength,
+                          ivLength>::CommonCryptoCipher(const void *key,
+                                                        Direction direction,
+                                                        const void *iv)
+    : Cipher(), _cryptor(NULL), _direction(direction) {
+  __crypto_CCHandle(CCCryptorCreate(Encrypt == direction ? kCCEncrypt
+                                                         : kCCDecrypt,
+                                    algorithm, options, key, keyLength, iv,
+                                    &_cryptor));
+}
+
+template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
+          size_t blockLength, size_t ivLength>
+inline size_t
+CommonCryptoCipher<algorithm, options, keyLength, blockLength,
+                   ivLength>::maximumMessageOutput(size_t size) const {
+  return (options & kCCOptionPKCS7Padding) && (Encrypt == _direction)
+             ? (size / blockLength + 1) * blockLength
+             : size;
+}
+
+template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
+          size_t blockLength, size_t ivLength>
+inline uint8_t *
+CommonCryptoCipher<algorithm, options, keyLength, blockLength,
+                   ivLength>::update(const void *data, size_t size,
+                                     void *output) {
+  size_t written = 0;
+
+  __crypto_CCHandle(CCCryptorUpdate(_cryptor, data, size, output,
+                                    maximumOutput(size), &written));
+  return reinterpret_cast<uint8_t *>(output) + written;
+}
+
+/// CCCryptorReset() with NULL starts the next message with a zero iv
+template <CCAlgorithm algorithm, CCOptions options, size_t keyLength,
+          size_t blockLength, size_t ivLength>
+inline uint8_t *
+CommonCryptoCipher<algorithm, options, keyLength, blockLength,
+                   ivLength>::finish(void *output) {
+  size_t written = 0;
+
+  __crypto_CCHandle(CCCryptorFinal(_cryptor, output, blockLength, &written));
+  start(NULL);
+  return reinterpret_cast<uint8_t *>(output) + written;
+}
+
 typedef CommonCryptoKey<kCCAlgorithmAES, kCCOptionPKCS7Padding,
                         kCCKeySizeAES256, kCCBlockSizeAES128,
                         kCCBlockSizeAES128>
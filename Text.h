@@ -2,14 +2,23 @@
 #define __Text_h__
 
 #include "os/Exception.h"
-#include <codecvt>
-#include <locale>
+#include "os/TextSearch.h"
+#include "os/UTF8.h"
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <string>
+#include <sys/types.h> // off_t
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define __Text_x86__ 1
+#include <immintrin.h>
+#else
+#define __Text_x86__ 0
+#endif
 
-/**
-        @todo Test lowercase on 3 and 4 byte utf8 sequences
-        @todo Test to/from Hex
-*/
 namespace text {
 
 /// @brief Append to output parameter or clear it first
@@ -18,6 +27,34 @@ enum ClearFirst {
   ClearOutputFirst ///< The output parameter will be cleared before appending
 };
 
+/** Convert utf8 text to a wide string.
+        @param utf8 UTF-8 encoded text
+        @param size The number of bytes in utf8
+        @param wide The wide string to receive the converted text
+        @param clear Should we append to wide or clear it first, defaults to
+   clearing first
+        @return wide parameter
+*/
+inline std::wstring &convert(const char *utf8, size_t size, std::wstring &wide,
+                             ClearFirst clear = ClearOutputFirst) {
+  size_t start;
+  wchar_t *end = nullptr;
+
+  if (ClearOutputFirst == clear) {
+    wide.clear(); // not tested
+  }
+  start = wide.size();
+  wide.resize(start + utf8::maximumUnits(size));
+  try {
+    end = utf8::toWide(utf8, size, &wide[0] + start);
+  } catch (const msg::Exception &) {
+    wide.resize(start);
+    throw;
+  }
+  wide.resize(end - &wide[0]);
+  return wide;
+}
+
 /** Convert a utf8 string to a wide string.
         @param utf8 a UTF-8 encoded string
         @param wide The wide string to receive the converted text
@@ -27,13 +64,36 @@ enum ClearFirst {
 */
 inline std::wstring &convert(const std::string &utf8, std::wstring &wide,
                              ClearFirst clear = ClearOutputFirst) {
-  std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> wideconv;
+  return convert(utf8.data(), utf8.size(), wide, clear);
+}
+
+/** Convert wide text to a utf8 string.
+        @param wide The wide text to convert
+        @param size The number of characters in wide
+        @param utf8 receives the UTF-8 encoded string
+        @param clear Should we append to utf8 or clear it first, defaults to
+   clearing first
+        @return utf8 parameter
+*/
+inline std::string &convert(const wchar_t *wide, size_t size,
+                            std::string &utf8,
+                            ClearFirst clear = ClearOutputFirst) {
+  size_t start;
+  char *end = nullptr;
 
   if (ClearOutputFirst == clear) {
-    wide.clear(); // not tested
+    utf8.clear(); // tested in libernet tests
   }
-  wide = wideconv.from_bytes(utf8);
-  return wide;
+  start = utf8.size();
+  utf8.resize(start + utf8::maximumBytes(size));
+  try {
+    end = utf8::toUTF8(wide, size, &utf8[0] + start);
+  } catch (const msg::Exception &) {
+    utf8.resize(start);
+    throw;
+  }
+  utf8.resize(end - &utf8[0]);
+  return utf8;
 }
 
 /** Convert a wide string to a utf8 string.
@@ -45,13 +105,132 @@ inline std::wstring &convert(const std::string &utf8, std::wstring &wide,
 */
 inline std::string &convert(const std::wstring &wide, std::string &utf8,
                             ClearFirst clear = ClearOutputFirst) {
-  std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> wideconv;
+  return convert(wide.data(), wide.size(), utf8, clear);
+}
 
-  if (ClearOutputFirst == clear) {
-    utf8.clear(); // tested in libernet tests
+/// A run of code points that lowercase by adding the same amount
+struct _LowerRange {
+  uint16_t first; ///< The first code point in the run
+  uint16_t last;  ///< The last code point in the run
+  uint16_t delta; ///< Added, modulo 0x10000, to get the lowercase
+  uint16_t step;  ///< 1 for every code point in the run, 2 for every other
+};
+
+/** The simple lowercase of a code point.
+        Covers the Basic Multilingual Plane, from the Unicode 14 case
+   mappings. Other code points are returned unchanged.
+        @param codePoint The code point to lowercase
+        @return The lowercase code point, or codePoint if it has none
+*/
+inline uint32_t _lowercase(uint32_t codePoint) {
+  static const _LowerRange ranges[] = {
+      {0x00C0, 0x00D6, 0x0020, 1}, {0x00D8, 0x00DE, 0x0020, 1},
+      {0x0100, 0x012E, 0x0001, 2}, {0x0130, 0x0130, 0xFF39, 1},
+      {0x0132, 0x0136, 0x0001, 2}, {0x0139, 0x0147, 0x0001, 2},
+      {0x014A, 0x0176, 0x0001, 2}, {0x0178, 0x0178, 0xFF87, 1},
+      {0x0179, 0x017D, 0x0001, 2}, {0x0181, 0x0181, 0x00D2, 1},
+      {0x0182, 0x0184, 0x0001, 2}, {0x0186, 0x0186, 0x00CE, 1},
+      {0x0187, 0x0187, 0x0001, 1}, {0x0189, 0x018A, 0x00CD, 1},
+      {0x018B, 0x018B, 0x0001, 1}, {0x018E, 0x018E, 0x004F, 1},
+      {0x018F, 0x018F, 0x00CA, 1}, {0x0190, 0x0190, 0x00CB, 1},
+      {0x0191, 0x0191, 0x0001, 1}, {0x0193, 0x0193, 0x00CD, 1},
+      {0x0194, 0x0194, 0x00CF, 1}, {0x0196, 0x0196, 0x00D3, 1},
+      {0x0197, 0x0197, 0x00D1, 1}, {0x0198, 0x0198, 0x0001, 1},
+      {0x019C, 0x019C, 0x00D3, 1}, {0x019D, 0x019D, 0x00D5, 1},
+      {0x019F, 0x019F, 0x00D6, 1}, {0x01A0, 0x01A4, 0x0001, 2},
+      {0x01A6, 0x01A6, 0x00DA, 1}, {0x01A7, 0x01A7, 0x0001, 1},
+      {0x01A9, 0x01A9, 0x00DA, 1}, {0x01AC, 0x01AC, 0x0001, 1},
+      {0x01AE, 0x01AE, 0x00DA, 1}, {0x01AF, 0x01AF, 0x0001, 1},
+      {0x01B1, 0x01B2, 0x00D9, 1}, {0x01B3, 0x01B5, 0x0001, 2},
+      {0x01B7, 0x01B7, 0x00DB, 1}, {0x01B8, 0x01B8, 0x0001, 1},
+      {0x01BC, 0x01BC, 0x0001, 1}, {0x01C4, 0x01C4, 0x0002, 1},
+      {0x01C5, 0x01C5, 0x0001, 1}, {0x01C7, 0x01C7, 0x0002, 1},
+      {0x01C8, 0x01C8, 0x0001, 1}, {0x01CA, 0x01CA, 0x0002, 1},
+      {0x01CB, 0x01DB, 0x0001, 2}, {0x01DE, 0x01EE, 0x0001, 2},
+      {0x01F1, 0x01F1, 0x0002, 1}, {0x01F2, 0x01F4, 0x0001, 2},
+      {0x01F6, 0x01F6, 0xFF9F, 1}, {0x01F7, 0x01F7, 0xFFC8, 1},
+      {0x01F8, 0x021E, 0x0001, 2}, {0x0220, 0x0220, 0xFF7E, 1},
+      {0x0222, 0x0232, 0x0001, 2}, {0x023A, 0x023A, 0x2A2B, 1},
+      {0x023B, 0x023B, 0x0001, 1}, {0x023D, 0x023D, 0xFF5D, 1},
+      {0x023E, 0x023E, 0x2A28, 1}, {0x0241, 0x0241, 0x0001, 1},
+      {0x0243, 0x0243, 0xFF3D, 1}, {0x0244, 0x0244, 0x0045, 1},
+      {0x0245, 0x0245, 0x0047, 1}, {0x0246, 0x024E, 0x0001, 2},
+      {0x0370, 0x0372, 0x0001, 2}, {0x0376, 0x0376, 0x0001, 1},
+      {0x037F, 0x037F, 0x0074, 1}, {0x0386, 0x0386, 0x0026, 1},
+      {0x0388, 0x038A, 0x0025, 1}, {0x038C, 0x038C, 0x0040, 1},
+      {0x038E, 0x038F, 0x003F, 1}, {0x0391, 0x03A1, 0x0020, 1},
+      {0x03A3, 0x03AB, 0x0020, 1}, {0x03CF, 0x03CF, 0x0008, 1},
+      {0x03D8, 0x03EE, 0x0001, 2}, {0x03F4, 0x03F4, 0xFFC4, 1},
+      {0x03F7, 0x03F7, 0x0001, 1}, {0x03F9, 0x03F9, 0xFFF9, 1},
+      {0x03FA, 0x03FA, 0x0001, 1}, {0x03FD, 0x03FF, 0xFF7E, 1},
+      {0x0400, 0x040F, 0x0050, 1}, {0x0410, 0x042F, 0x0020, 1},
+      {0x0460, 0x0480, 0x0001, 2}, {0x048A, 0x04BE, 0x0001, 2},
+      {0x04C0, 0x04C0, 0x000F, 1}, {0x04C1, 0x04CD, 0x0001, 2},
+      {0x04D0, 0x052E, 0x0001, 2}, {0x0531, 0x0556, 0x0030, 1},
+      {0x10A0, 0x10C5, 0x1C60, 1}, {0x10C7, 0x10C7, 0x1C60, 1},
+      {0x10CD, 0x10CD, 0x1C60, 1}, {0x13A0, 0x13EF, 0x97D0, 1},
+      {0x13F0, 0x13F5, 0x0008, 1}, {0x1C90, 0x1CBA, 0xF440, 1},
+      {0x1CBD, 0x1CBF, 0xF440, 1}, {0x1E00, 0x1E94, 0x0001, 2},
+      {0x1E9E, 0x1E9E, 0xE241, 1}, {0x1EA0, 0x1EFE, 0x0001, 2},
+      {0x1F08, 0x1F0F, 0xFFF8, 1}, {0x1F18, 0x1F1D, 0xFFF8, 1},
+      {0x1F28, 0x1F2F, 0xFFF8, 1}, {0x1F38, 0x1F3F, 0xFFF8, 1},
+      {0x1F48, 0x1F4D, 0xFFF8, 1}, {0x1F59, 0x1F5F, 0xFFF8, 2},
+      {0x1F68, 0x1F6F, 0xFFF8, 1}, {0x1F88, 0x1F8F, 0xFFF8, 1},
+      {0x1F98, 0x1F9F, 0xFFF8, 1}, {0x1FA8, 0x1FAF, 0xFFF8, 1},
+      {0x1FB8, 0x1FB9, 0xFFF8, 1}, {0x1FBA, 0x1FBB, 0xFFB6, 1},
+      {0x1FBC, 0x1FBC, 0xFFF7, 1}, {0x1FC8, 0x1FCB, 0xFFAA, 1},
+      {0x1FCC, 0x1FCC, 0xFFF7, 1}, {0x1FD8, 0x1FD9, 0xFFF8, 1},
+      {0x1FDA, 0x1FDB, 0xFF9C, 1}, {0x1FE8, 0x1FE9, 0xFFF8, 1},
+      {0x1FEA, 0x1FEB, 0xFF90, 1}, {0x1FEC, 0x1FEC, 0xFFF9, 1},
+      {0x1FF8, 0x1FF9, 0xFF80, 1}, {0x1FFA, 0x1FFB, 0xFF82, 1},
+      {0x1FFC, 0x1FFC, 0xFFF7, 1}, {0x2126, 0x2126, 0xE2A3, 1},
+      {0x212A, 0x212A, 0xDF41, 1}, {0x212B, 0x212B, 0xDFBA, 1},
+      {0x2132, 0x2132, 0x001C, 1}, {0x2160, 0x216F, 0x0010, 1},
+      {0x2183, 0x2183, 0x0001, 1}, {0x24B6, 0x24CF, 0x001A, 1},
+      {0x2C00, 0x2C2F, 0x0030, 1}, {0x2C60, 0x2C60, 0x0001, 1},
+      {0x2C62, 0x2C62, 0xD609, 1}, {0x2C63, 0x2C63, 0xF11A, 1},
+      {0x2C64, 0x2C64, 0xD619, 1}, {0x2C67, 0x2C6B, 0x0001, 2},
+      {0x2C6D, 0x2C6D, 0xD5E4, 1}, {0x2C6E, 0x2C6E, 0xD603, 1},
+      {0x2C6F, 0x2C6F, 0xD5E1, 1}, {0x2C70, 0x2C70, 0xD5E2, 1},
+      {0x2C72, 0x2C72, 0x0001, 1}, {0x2C75, 0x2C75, 0x0001, 1},
+      {0x2C7E, 0x2C7F, 0xD5C1, 1}, {0x2C80, 0x2CE2, 0x0001, 2},
+      {0x2CEB, 0x2CED, 0x0001, 2}, {0x2CF2, 0x2CF2, 0x0001, 1},
+      {0xA640, 0xA66C, 0x0001, 2}, {0xA680, 0xA69A, 0x0001, 2},
+      {0xA722, 0xA72E, 0x0001, 2}, {0xA732, 0xA76E, 0x0001, 2},
+      {0xA779, 0xA77B, 0x0001, 2}, {0xA77D, 0xA77D, 0x75FC, 1},
+      {0xA77E, 0xA786, 0x0001, 2}, {0xA78B, 0xA78B, 0x0001, 1},
+      {0xA78D, 0xA78D, 0x5AD8, 1}, {0xA790, 0xA792, 0x0001, 2},
+      {0xA796, 0xA7A8, 0x0001, 2}, {0xA7AA, 0xA7AA, 0x5ABC, 1},
+      {0xA7AB, 0xA7AB, 0x5AB1, 1}, {0xA7AC, 0xA7AC, 0x5AB5, 1},
+      {0xA7AD, 0xA7AD, 0x5ABF, 1}, {0xA7AE, 0xA7AE, 0x5ABC, 1},
+      {0xA7B0, 0xA7B0, 0x5AEE, 1}, {0xA7B1, 0xA7B1, 0x5AD6, 1},
+      {0xA7B2, 0xA7B2, 0x5AEB, 1}, {0xA7B3, 0xA7B3, 0x03A0, 1},
+      {0xA7B4, 0xA7C2, 0x0001, 2}, {0xA7C4, 0xA7C4, 0xFFD0, 1},
+      {0xA7C5, 0xA7C5, 0x5ABD, 1}, {0xA7C6, 0xA7C6, 0x75C8, 1},
+      {0xA7C7, 0xA7C9, 0x0001, 2}, {0xA7D0, 0xA7D0, 0x0001, 1},
+      {0xA7D6, 0xA7D8, 0x0001, 2}, {0xA7F5, 0xA7F5, 0x0001, 1},
+      {0xFF21, 0xFF3A, 0x0020, 1},
+  };
+  static const _LowerRange *const end =
+      ranges + sizeof(ranges) / sizeof(ranges[0]);
+
+  if (codePoint < 0x80) {
+    return (codePoint >= 'A') && (codePoint <= 'Z') ? codePoint + 0x20
+                                                    : codePoint;
   }
-  utf8 = wideconv.to_bytes(wide);
-  return utf8;
+  if (codePoint > 0xFFFF) {
+    return codePoint;
+  }
+
+  const _LowerRange *range = std::lower_bound(
+      ranges, end, codePoint,
+      [](const _LowerRange &r, uint32_t c) { return r.last < c; });
+
+  if ((range == end) || (codePoint < range->first) ||
+      ((codePoint - range->first) % range->step != 0)) {
+    return codePoint;
+  }
+  return static_cast<uint16_t>(codePoint + range->delta);
 }
 
 /** Convert a wide string to lowercase.
@@ -63,18 +242,223 @@ inline std::string &convert(const std::wstring &wide, std::string &utf8,
 */
 inline std::wstring &tolower(const std::wstring &mixed, std::wstring &lower,
                              ClearFirst clear = ClearOutputFirst) {
-  std::locale utf8Locale("en_US.UTF-8");
-
   if (ClearOutputFirst == clear) {
     lower.clear(); // not tested
   }
   lower.reserve(lower.size() + mixed.size());
   for (auto c : mixed) {
-    lower.append(1, std::tolower(c, utf8Locale));
+    lower.append(1, static_cast<wchar_t>(_lowercase(c)));
   }
   return lower;
 }
 
+/// Which vector instructions the codecs can use, fastest is largest
+enum _SIMDEngine { _SIMDPortable, _SIMDSSSE3, _SIMDAVX2 };
+
+/// The fastest vector instructions this processor supports, found once
+inline _SIMDEngine _simdEngine() {
+#if __Text_x86__
+  static const _SIMDEngine engine = __builtin_cpu_supports("avx2")
+                                        ? _SIMDAVX2
+                                        : __builtin_cpu_supports("ssse3")
+                                              ? _SIMDSSSE3
+                                              : _SIMDPortable;
+
+  return engine;
+#else
+  return _SIMDPortable;
+#endif
+}
+
+/// Lowercase whole blocks of ASCII, returns the number of bytes done
+inline size_t _tolowerASCII(const char *mixed, size_t size, char *lower) {
+  size_t done = 0;
+
+#if __Text_x86__
+  const __m128i beforeA = _mm_set1_epi8('A' - 1);
+  const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+  const __m128i caseBit = _mm_set1_epi8(0x20);
+
+  for (; size - done >= 16; done += 16) {
+    const __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(mixed + done));
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, beforeA),
+                                        _mm_cmplt_epi8(c, afterZ));
+
+    if (_mm_movemask_epi8(c) != 0) {
+      break; // not ASCII
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lower + done),
+                     _mm_or_si128(c, _mm_and_si128(upper, caseBit)));
+  }
+#else
+  (void)mixed;
+  (void)size;
+  (void)lower;
+#endif
+  return done;
+}
+
+#if __Text_x86__
+/// Lowercase 32 bytes of ASCII at a time, returns the number of bytes done
+__attribute__((target("avx2"))) inline size_t
+_tolowerASCIIAVX2(const char *mixed, size_t size, char *lower) {
+  const __m256i beforeA = _mm256_set1_epi8('A' - 1);
+  const __m256i afterZ = _mm256_set1_epi8('Z' + 1);
+  const __m256i caseBit = _mm256_set1_epi8(0x20);
+  size_t done = 0;
+
+  for (; size - done >= 32; done += 32) {
+    const __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(mixed + done));
+    const __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(c, beforeA),
+                                           _mm256_cmpgt_epi8(afterZ, c));
+
+    if (_mm256_movemask_epi8(c) != 0) {
+      break; // not ASCII
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lower + done),
+                        _mm256_or_si256(c, _mm256_and_si256(upper, caseBit)));
+  }
+  return done + _tolowerASCII(mixed + done, size - done, lower + done);
+}
+#endif
+
+/** Lowercase UTF-8.
+        Runs of ASCII are done in blocks, everything else a character at a
+   time.
+        @param mixed Moved past the characters lowercased
+        @param end The end of the text
+        @param lower Receives the lowercase text
+        @param inPlace Stop before a character that would write past the
+   characters read so far
+        @return The byte after the last byte written
+*/
+inline char *_tolower(const char *&mixed, const char *end, char *lower,
+                      bool inPlace) {
+  while (mixed < end) {
+    size_t done;
+    const char *stop;
+
+#if __Text_x86__
+    done = _simdEngine() == _SIMDAVX2
+               ? _tolowerASCIIAVX2(mixed, end - mixed, lower)
+               : _tolowerASCII(mixed, end - mixed, lower);
+#else
+    done = _tolowerASCII(mixed, end - mixed, lower);
+#endif
+    mixed += done;
+    lower += done;
+    stop = end - mixed > 16 ? mixed + 16 : end;
+    while (mixed < stop) {
+      const uint8_t lead = static_cast<uint8_t>(mixed[0]);
+      const size_t left = end - mixed;
+      uint32_t codePoint;
+      size_t length;
+
+      if (lead < 0x80) {
+        *lower++ = static_cast<char>(_lowercase(lead));
+        ++mixed;
+        continue;
+      }
+      if ((lead >= 0xC2) && (lead < 0xE0) && (left >= 2) &&
+          ((mixed[1] & 0xC0) == 0x80)) {
+        codePoint = ((lead & 0x1F) << 6) | (mixed[1] & 0x3F);
+        length = 2;
+      } else if ((lead >= 0xE0) && (lead < 0xF0) && (left >= 3) &&
+                 ((mixed[1] & 0xC0) == 0x80) && ((mixed[2] & 0xC0) == 0x80)) {
+        codePoint = ((lead & 0x0F) << 12) | ((mixed[1] & 0x3F) << 6) |
+                    (mixed[2] & 0x3F);
+        length = codePoint < 0x800 ? 0 : 3; // overlong is not UTF-8
+      } else {
+        length = 0;
+      }
+      if (0 == length) { // not UTF-8 we can lowercase, copy it as is
+        *lower++ = *mixed++;
+        continue;
+      }
+      codePoint = _lowercase(codePoint);
+      if (codePoint < 0x80) {
+        *lower++ = static_cast<char>(codePoint);
+      } else if (codePoint < 0x800) {
+        *lower++ = static_cast<char>(0xC0 | (codePoint >> 6));
+        *lower++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+      } else {
+        if (inPlace && (2 == length)) {
+          return lower; // only U+023A and U+023E get longer
+        }
+        *lower++ = static_cast<char>(0xE0 | (codePoint >> 12));
+        *lower++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *lower++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+      }
+      mixed += length;
+    }
+  }
+  return lower;
+}
+
+/** The most bytes tolower() can write.
+        @param size The number of bytes of UTF-8 to lowercase
+        @return The size of the buffer tolower() needs
+*/
+inline size_t maximumLowerSize(size_t size) { return size + size / 2; }
+
+/** Convert UTF-8 to lowercase into a buffer, with no allocation.
+        Uses the simple case mappings of the Basic Multilingual Plane, and does
+   not depend on the locale. Bytes that are not UTF-8 are copied unchanged.
+        @param mixed The mixed-case UTF-8
+        @param size The number of bytes in mixed
+        @param lower Receives the lowercase UTF-8, maximumLowerSize(size)
+   bytes will always be enough
+        @return The byte after the last byte written
+*/
+inline char *tolower(const char *mixed, size_t size, char *lower) {
+  return _tolower(mixed, mixed + size, lower, false);
+}
+
+/** Convert UTF-8 to lowercase in place.
+        @param utf8 The mixed-case UTF-8, that will be lowercase
+        @return utf8
+*/
+inline std::string &tolowerInPlace(std::string &utf8) {
+  const char *mixed = utf8.data();
+  const char *const end = mixed + utf8.size();
+  char *const start = &utf8[0];
+  char *lower = _tolower(mixed, end, start, true);
+
+  if (mixed < end) { // the rest needs more room than it has
+    std::string rest(maximumLowerSize(end - mixed), '\0');
+
+    rest.resize(tolower(mixed, end - mixed, &rest[0]) - &rest[0]);
+    utf8.replace(lower - start, std::string::npos, rest);
+  } else {
+    utf8.resize(lower - start);
+  }
+  return utf8;
+}
+
+/** Convert utf8 text to lowercase.
+        @param mixedUTF8 the mixed-case text
+        @param size The number of bytes in mixedUTF8
+        @param lower Will contain mixed, but all characters are lower case
+        @param clear Should lower be cleared first or appended with the lower
+   case string. defaults to clear.
+        @return lower parameter
+*/
+inline std::string &tolower(const char *mixedUTF8, size_t size,
+                            std::string &lower,
+                            ClearFirst clear = ClearOutputFirst) {
+  if (ClearOutputFirst == clear) {
+    lower.clear();
+  }
+
+  const size_t start = lower.size();
+
+  lower.resize(start + maximumLowerSize(size));
+  lower.resize(tolower(mixedUTF8, size, &lower[0] + start) - &lower[0]);
+  return lower;
+}
+
 /** Convert a utf8 string to lowercase.
         @param mixedUTF8 the mixed-case string
         @param lower Will contain mixed, but all characters are lower case
@@ -84,11 +468,7 @@ inline std::wstring &tolower(const std::wstring &mixed, std::wstring &lower,
 */
 inline std::string &tolower(const std::string &mixedUTF8, std::string &lower,
                             ClearFirst clear = ClearOutputFirst) {
-  std::wstring wmixed, wlower;
-
-  return convert(tolower(convert(mixedUTF8, wmixed, AppendToOutput), wlower,
-                         AppendToOutput),
-                 lower, clear);
+  return tolower(mixedUTF8.data(), mixedUTF8.size(), lower, clear);
 }
 
 /** Convert a utf8 string to lowercase.
@@ -101,77 +481,314 @@ inline std::string tolower(const std::string &mixedUTF8) {
   return tolower(mixedUTF8, buffer, AppendToOutput);
 }
 
-/** Get the hexadecimal representation of a binary string.
+/// The value of a hex digit, or -1 if c is not a hex digit
+inline int _hexValue(char c) {
+  const unsigned int digit = static_cast<uint8_t>(c) - unsigned('0');
+  const unsigned int letter = (static_cast<uint8_t>(c) | 0x20) - unsigned('a');
+
+  return digit < 10 ? int(digit) : letter < 6 ? int(letter) + 10 : -1;
+}
+
+/// Convert one byte at a time
+inline char *_toHexPortable(const uint8_t *binary, size_t size, char *hex) {
+  const char *const hexDigits = "0123456789abcdef";
+
+  for (size_t byte = 0; byte < size; ++byte) {
+    *hex++ = hexDigits[binary[byte] >> 4];
+    *hex++ = hexDigits[binary[byte] & 0x0F];
+  }
+  return hex;
+}
+
+/// Convert one pair of hex digits at a time
+inline uint8_t *_fromHexPortable(const char *hex, size_t bytes,
+                                 uint8_t *binary) {
+  for (size_t byte = 0; byte < bytes; ++byte) {
+    const int high = _hexValue(hex[2 * byte]);
+    const int low = _hexValue(hex[2 * byte + 1]);
+
+    if ((high | low) < 0) {
+      ThrowMessageException("Invalid hex digit");
+    }
+    *binary++ = static_cast<uint8_t>((high << 4) | low);
+  }
+  return binary;
+}
+
+#if __Text_x86__
+/// Convert 16 bytes at a time, looking up both nibbles with pshufb
+__attribute__((target("ssse3"))) inline char *
+_toHexSSSE3(const uint8_t *binary, size_t size, char *hex) {
+  const __m128i digits =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>("0123456789abcdef"));
+  const __m128i mask = _mm_set1_epi8(0x0F);
+
+  for (; size >= 16; size -= 16, binary += 16, hex += 32) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(binary));
+    const __m128i high = _mm_shuffle_epi8(
+        digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    const __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(hex),
+                     _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(hex + 16),
+                     _mm_unpackhi_epi8(high, low));
+  }
+  return _toHexPortable(binary, size, hex);
+}
+
+/// Convert 32 bytes at a time, looking up both nibbles with vpshufb
+__attribute__((target("avx2"))) inline char *
+_toHexAVX2(const uint8_t *binary, size_t size, char *hex) {
+  const __m256i digits = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>("0123456789abcdef")));
+  const __m256i mask = _mm256_set1_epi8(0x0F);
+
+  for (; size >= 32; size -= 32, binary += 32, hex += 64) {
+    const __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(binary));
+    const __m256i high = _mm256_shuffle_epi8(
+        digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+    const __m256i low =
+        _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, mask));
+    // unpack works within each 128 bit lane, so put the lanes back in order
+    const __m256i first = _mm256_unpacklo_epi8(high, low);
+    const __m256i second = _mm256_unpackhi_epi8(high, low);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(hex),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(hex + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  return _toHexSSSE3(binary, size, hex);
+}
+
+/// Convert 16 hex digits at a time, validating all of them at once
+__attribute__((target("ssse3"))) inline uint8_t *
+_fromHexSSSE3(const char *hex, size_t bytes, uint8_t *binary) {
+  const __m128i zero = _mm_set1_epi8('0'), a = _mm_set1_epi8('a');
+  const __m128i lowercase = _mm_set1_epi8(0x20), nine = _mm_set1_epi8(9);
+  const __m128i five = _mm_set1_epi8(5), ten = _mm_set1_epi8(10);
+  const __m128i weights = _mm_set1_epi16(0x0110); // high * 16 + low * 1
+
+  for (; bytes >= 8; bytes -= 8, hex += 16, binary += 8) {
+    const __m128i chars =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex));
+    const __m128i digit = _mm_sub_epi8(chars, zero);
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, lowercase), a);
+    const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit);
+    const __m128i isLetter =
+        _mm_cmpeq_epi8(_mm_min_epu8(letter, five), letter);
+    const __m128i nibbles =
+        _mm_or_si128(_mm_and_si128(isDigit, digit),
+                     _mm_and_si128(isLetter, _mm_add_epi8(letter, ten)));
+    const __m128i values = _mm_maddubs_epi16(nibbles, weights);
+
+    if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF) {
+      ThrowMessageException("Invalid hex digit");
+    }
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(binary),
+                     _mm_packus_epi16(values, values));
+  }
+  return _fromHexPortable(hex, bytes, binary);
+}
+
+/// Convert 32 hex digits at a time, validating all of them at once
+__attribute__((target("avx2"))) inline uint8_t *
+_fromHexAVX2(const char *hex, size_t bytes, uint8_t *binary) {
+  const __m256i zero = _mm256_set1_epi8('0'), a = _mm256_set1_epi8('a');
+  const __m256i lowercase = _mm256_set1_epi8(0x20);
+  const __m256i nine = _mm256_set1_epi8(9), five = _mm256_set1_epi8(5);
+  const __m256i ten = _mm256_set1_epi8(10);
+  const __m256i weights = _mm256_set1_epi16(0x0110); // high * 16 + low * 1
+
+  for (; bytes >= 16; bytes -= 16, hex += 32, binary += 16) {
+    const __m256i chars =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(hex));
+    const __m256i digit = _mm256_sub_epi8(chars, zero);
+    const __m256i letter =
+        _mm256_sub_epi8(_mm256_or_si256(chars, lowercase), a);
+    const __m256i isDigit =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(digit, nine), digit);
+    const __m256i isLetter =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(letter, five), letter);
+    const __m256i nibbles = _mm256_or_si256(
+        _mm256_and_si256(isDigit, digit),
+        _mm256_and_si256(isLetter, _mm256_add_epi8(letter, ten)));
+    const __m256i values = _mm256_maddubs_epi16(nibbles, weights);
+    // pack works within each 128 bit lane, so gather the low halves
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packus_epi16(values, values), _MM_SHUFFLE(3, 1, 2, 0));
+
+    if (_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) != -1) {
+      ThrowMessageException("Invalid hex digit");
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(binary),
+                     _mm256_castsi256_si128(packed));
+  }
+  return _fromHexSSSE3(hex, bytes, binary);
+}
+#endif
+
+/** Write the hexadecimal representation of binary data into a buffer.
+        Uses AVX2 or SSSE3 when the processor has them.
+        @param binary The data to convert
+        @param size The number of bytes in binary
+        @param hex Receives 2 * size lowercase hex digits, not null terminated
+        @return The character after the last hex digit written
+*/
+inline char *toHex(const void *binary, size_t size, char *hex) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(binary);
+
+  switch (_simdEngine()) {
+#if __Text_x86__
+  case _SIMDAVX2:
+    return _toHexAVX2(bytes, size, hex);
+  case _SIMDSSSE3:
+    return _toHexSSSE3(bytes, size, hex);
+#endif
+  default:
+    return _toHexPortable(bytes, size, hex);
+  }
+}
+
+/** Write the binary represented by hexadecimal digits into a buffer.
+        Uses AVX2 or SSSE3 when the processor has them.
+        @param hex Upper or lower case hex digits
+        @param size The number of characters in hex, must be even
+        @param binary Receives size / 2 bytes. If an exception is thrown, some
+   of binary may have been written.
+        @return The byte after the last byte written
+        @throws msg::Exception if size is odd or hex has a non hex character
+*/
+inline uint8_t *fromHex(const char *hex, size_t size, void *binary) {
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(binary);
+
+  AssertMessageException(size % 2 == 0);
+  switch (_simdEngine()) {
+#if __Text_x86__
+  case _SIMDAVX2:
+    return _fromHexAVX2(hex, size / 2, bytes);
+  case _SIMDSSSE3:
+    return _fromHexSSSE3(hex, size / 2, bytes);
+#endif
+  default:
+    return _fromHexPortable(hex, size / 2, bytes);
+  }
+}
+
+/** Get the hexadecimal representation of binary data.
         @param binary Buffer of binary data
+        @param size The number of bytes in binary
         @param hex receives the hex representation of binary
         @param clear Should hex be cleared first or appended with the hex.
    defaults to clear.
         @return hex parameter
 */
-inline std::string &toHex(const std::string &binary, std::string &hex,
+inline std::string &toHex(const void *binary, size_t size, std::string &hex,
                           ClearFirst clear = ClearOutputFirst) {
-  const char *const hexDigits = "0123456789abcdef";
-
   if (ClearOutputFirst == clear) {
     hex.clear();
   }
-  for (int i = 0; (i < static_cast<int>(binary.size())); ++i) {
-    const int lowerIndex = (binary[i] >> 4) & 0x0F;
-    const int upperIndex = binary[i] & 0x0F;
 
-    hex.append(1, hexDigits[lowerIndex]);
-    hex.append(1, hexDigits[upperIndex]);
-  }
+  const size_t start = hex.size();
+
+  hex.resize(start + 2 * size);
+  toHex(binary, size, &hex[0] + start);
   return hex;
 }
 
-/** Get the hexadecimal representation of a binary string.
+/** Get the hexadecimal representation of binary data.
         @param binary Buffer of binary data
+        @param size The number of bytes in binary
         @return hex representation of binary
 */
-inline std::string toHex(const std::string &binary) {
+inline std::string toHex(const void *binary, size_t size) {
   std::string buffer;
 
-  return toHex(binary, buffer, AppendToOutput);
+  return toHex(binary, size, buffer, AppendToOutput);
 }
 
-/** Get the binary represented by a hexadecimal string.
-        @param hex the hex representation of a binary string
-        @param binary receives the binary represented by hex
+/** Get the hexadecimal representation of a binary string.
+        @param binary Buffer of binary data
+        @param hex receives the hex representation of binary
+        @param clear Should hex be cleared first or appended with the hex.
+   defaults to clear.
+        @return hex parameter
+*/
+inline std::string &toHex(const std::string &binary, std::string &hex,
+                          ClearFirst clear = ClearOutputFirst) {
+  return toHex(binary.data(), binary.size(), hex, clear);
+}
+
+/** Get the hexadecimal representation of a binary string.
+        @param binary Buffer of binary data
+        @return hex representation of binary
+*/
+inline std::string toHex(const std::string &binary) {
+  return toHex(binary.data(), binary.size());
+}
+
+/** Get the binary represented by hexadecimal text.
+        @param hex the hex representation of binary data, upper or lower case
+        @param size The number of characters in hex, must be even
+        @param binary receives the binary represented by hex. Unchanged if an
+   exception is thrown.
         @param clear Should binary be cleared first or appended with the hex.
    defaults to clear.
         @return binary parameter
 */
-inline std::string &fromHex(const std::string &hex, std::string &binary,
+inline std::string &fromHex(const char *hex, size_t size, std::string &binary,
                             ClearFirst clear = ClearOutputFirst) {
-  std::string hexDigits("0123456789abcdef");
-
+  AssertMessageException(size % 2 == 0);
   if (ClearOutputFirst == clear) {
     binary.clear();
   }
-  AssertMessageException(hex.size() % 2 == 0);
-  for (int byte = 0; byte < static_cast<int>(hex.size() / 2); ++byte) {
-    const int nibble1 = byte * 2 + 1;
-    std::string::size_type found1 = hexDigits.find(hex[nibble1]);
 
-    const int nibble2 = nibble1 - 1;
-    std::string::size_type found2 = hexDigits.find(hex[nibble2]);
+  const size_t start = binary.size();
 
-    AssertMessageException(found1 != std::string::npos);
-    AssertMessageException(found2 != std::string::npos);
-    binary.append(1, (found2 << 4) | found1);
+  binary.resize(start + size / 2);
+  try {
+    fromHex(hex, size, &binary[0] + start);
+  } catch (const msg::Exception &) {
+    binary.resize(start);
+    throw;
   }
   return binary;
 }
 
+/** Get the binary represented by hexadecimal text.
+        @param hex the hex representation of binary data
+        @param size The number of characters in hex, must be even
+        @return binary represented by hex
+*/
+inline std::string fromHex(const char *hex, size_t size) {
+  std::string buffer;
+
+  return fromHex(hex, size, buffer, AppendToOutput);
+}
+
+/** Get the binary represented by a hexadecimal string.
+        @param hex the hex representation of a binary string, upper or lower
+   case
+        @param binary receives the binary represented by hex. Unchanged if an
+   exception is thrown.
+        @param clear Should binary be cleared first or appended with the hex.
+   defaults to clear.
+        @return binary parameter
+*/
+inline std::string &fromHex(const std::string &hex, std::string &binary,
+                            ClearFirst clear = ClearOutputFirst) {
+  return fromHex(hex.data(), hex.size(), binary, clear);
+}
+
 /** Get the binary represented by a hexadecimal string.
         @param hex the hex representation of a binary string
         @return binary represented by hexs
 */
 inline std::string fromHex(const std::string &hex) {
-  std::string buffer;
-
-  return fromHex(hex, buffer, AppendToOutput);
+  return fromHex(hex.data(), hex.size());
 }
 
 /// @brief The base characters used in all base64 encodings
@@ -198,8 +815,451 @@ enum CommonSplits {
   SplitBase64ForMIME = 76 ///< Line wrap for MIME wrapper
 };
 
-/** Convert a binary string into base 64 encoding.
+/// Maps each character to its base64 value, standard and url alike
+struct _Base64Values {
+  enum {
+    Whitespace = 64, ///< Skipped
+    Padding = 65,    ///< Fills out the group
+    Invalid = 255    ///< Not allowed in base64
+  };
+  uint8_t value[256]; ///< The value of each character
+  /// Build the table
+  _Base64Values() : value() {
+    const char *const standard = __base_64_base_characters
+        __base_64_standard_extension;
+    const char *const url = __base_64_base_characters __base_64_url_extension;
+
+    memset(value, Invalid, sizeof(value));
+    for (int i = 0; i < 64; ++i) {
+      value[static_cast<uint8_t>(standard[i])] = i;
+      value[static_cast<uint8_t>(url[i])] = i;
+    }
+    for (const char *c = " \t\n\v\f\r"; *c != '\0'; ++c) {
+      value[static_cast<uint8_t>(*c)] = Whitespace;
+    }
+    value[static_cast<uint8_t>(__base_64_standard_trailer[0])] = Padding;
+    value[static_cast<uint8_t>(__base_64_url_trailer[0])] = Padding;
+  }
+};
+
+/// The table of base64 values, built once
+inline const _Base64Values &_base64Values() {
+  static const _Base64Values values;
+
+  return values;
+}
+
+/// Encode whole groups of three bytes one at a time
+inline char *_base64EncodePortable(const uint8_t *binary, size_t groups,
+                                   const char *characters, char *base64) {
+  for (size_t group = 0; group < groups; ++group, binary += 3) {
+    const uint32_t bits = (uint32_t(binary[0]) << 16) |
+                          (uint32_t(binary[1]) << 8) | binary[2];
+
+    *base64++ = characters[bits >> 18];
+    *base64++ = characters[(bits >> 12) & 0x3F];
+    *base64++ = characters[(bits >> 6) & 0x3F];
+    *base64++ = characters[bits & 0x3F];
+  }
+  return base64;
+}
+
+#if __Text_x86__
+/** Encode 24 bytes to 32 characters at a time.
+        The 6 bit fields are split out with multiplies and mapped to
+   characters by adding an offset looked up from the range they fall in.
+*/
+__attribute__((target("avx2"))) inline char *
+_base64EncodeAVX2(const uint8_t *binary, size_t groups, const char *characters,
+                  char *base64) {
+  const __m256i order = _mm256_setr_epi8(
+      1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5,
+      4, 7, 6, 8, 7, 10, 9, 11, 10);
+  const __m128i offsets128 = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, characters[62] - 62,
+      characters[63] - 63, 'A', 0, 0);
+  const __m256i offsets = _mm256_broadcastsi128_si256(offsets128);
+
+  // each step reads 28 bytes, so stop while there are at least 4 left over
+  for (; groups >= 10; groups -= 8, binary += 24, base64 += 32) {
+    const __m256i bytes = _mm256_shuffle_epi8(
+        _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(binary))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(binary + 12)),
+            1),
+        order);
+    const __m256i high = _mm256_mulhi_epu16(
+        _mm256_and_si256(bytes, _mm256_set1_epi32(0x0FC0FC00)),
+        _mm256_set1_epi32(0x04000040));
+    const __m256i low = _mm256_mullo_epi16(
+        _mm256_and_si256(bytes, _mm256_set1_epi32(0x003F03F0)),
+        _mm256_set1_epi32(0x01000010));
+    const __m256i indices = _mm256_or_si256(high, low);
+    // 0-25 -> 13, 26-51 -> 0, 52-61 -> 1-10, 62 -> 11, 63 -> 12
+    const __m256i ranges = _mm256_or_si256(
+        _mm256_subs_epu8(indices, _mm256_set1_epi8(51)),
+        _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                         _mm256_set1_epi8(13)));
+
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(base64),
+        _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, ranges)));
+  }
+  return _base64EncodePortable(binary, groups, characters, base64);
+}
+
+/** Decode 32 characters to 24 bytes at a time.
+        Stops at the first 32 characters that are not all base64 characters,
+   leaving whitespace and padding to the caller.
+        @param base64 Moved past the characters decoded
+        @param end The end of the characters
+        @param binary Receives the bytes
+        @return The byte after the last byte written
+*/
+__attribute__((target("avx2"))) inline uint8_t *
+_base64DecodeAVX2(const char *&base64, const char *end, uint8_t *binary) {
+  for (; end - base64 >= 32; base64 += 32, binary += 24) {
+    const __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(base64));
+    // bytes 0x80 and up are negative, so they are in none of the ranges
+    const __m256i upper =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('A' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), c));
+    const __m256i lower =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('a' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), c));
+    const __m256i digit =
+        _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    const __m256i plus =
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('+')),
+                        _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+    const __m256i slash =
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('/')),
+                        _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+    const __m256i valid = _mm256_or_si256(
+        _mm256_or_si256(upper, lower),
+        _mm256_or_si256(digit, _mm256_or_si256(plus, slash)));
+
+    if (_mm256_movemask_epi8(valid) != -1) {
+      break;
+    }
+
+    const __m256i values = _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_and_si256(upper, _mm256_sub_epi8(c, _mm256_set1_epi8(65))),
+            _mm256_and_si256(lower, _mm256_sub_epi8(c, _mm256_set1_epi8(71)))),
+        _mm256_or_si256(
+            _mm256_and_si256(digit, _mm256_add_epi8(c, _mm256_set1_epi8(4))),
+            _mm256_or_si256(_mm256_and_si256(plus, _mm256_set1_epi8(62)),
+                            _mm256_and_si256(slash, _mm256_set1_epi8(63)))));
+    // merge 4 six bit values into 24 bits in each 32 bit word
+    const __m256i merged = _mm256_madd_epi16(
+        _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)),
+        _mm256_set1_epi32(0x00011000));
+    const __m256i bytes = _mm256_permutevar8x32_epi32(
+        _mm256_shuffle_epi8(merged,
+                            _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14,
+                                             13, 12, -1, -1, -1, -1, 2, 1, 0,
+                                             6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                             -1, -1, -1, -1)),
+        _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(binary),
+                     _mm256_castsi256_si128(bytes));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(binary + 16),
+                     _mm256_extracti128_si256(bytes, 1));
+  }
+  return binary;
+}
+#endif
+
+/** Converts binary to base64 a piece at a time.
+        Feed the binary to update() in pieces of any size and call finish()
+   after the last piece, so data of any size can be encoded with bounded
+   memory. The output is the same as base64Encode of all the pieces at once.
+*/
+class Base64Encoder {
+public:
+  /** Prepare to encode.
+        @param style standard or url-safe base64 encoding
+        @param split how many characters per line. 0 means no line splits.
+        @param eol The characters to use for end of line
+  */
+  explicit Base64Encoder(Base64Style style = Base64,
+                         int split = DoNotSplitBase64,
+                         const std::string &eol = "\n");
+  /** The most characters update() and finish() can write.
+        @param size The number of bytes that will be passed to update()
+        @return The size of buffer needed for update(size) then finish()
+  */
+  size_t maximumOutput(size_t size) const;
+  /** Encode the next piece of binary.
+        Up to two bytes are held back until more binary or finish().
+        @param binary The next bytes to encode
+        @param size The number of bytes in binary
+        @param base64 Receives the base64, not null terminated
+        @return The character after the last character written
+  */
+  char *update(const void *binary, size_t size, char *base64);
+  /** Encode any bytes held back and add the padding.
+        The encoder is then ready to encode a new stream.
+        @param base64 Receives the last base64 characters
+        @return The character after the last character written
+  */
+  char *finish(char *base64);
+
+private:
+  char _characters[64]; ///< The 64 characters for this style
+  char _padding;        ///< The padding character, or 0 for no padding
+  size_t _split;        ///< Characters per line, 0 for one line
+  std::string _eol;     ///< Put between lines
+  size_t _column;       ///< Characters written to the current line
+  uint8_t _pending[3];  ///< Bytes that do not fill a group yet
+  size_t _pendingSize;  ///< The number of bytes in _pending
+
+  /// Copy characters to the output, splitting lines
+  char *_write(const char *characters, size_t count, char *base64);
+  /// Encode whole groups, splitting lines
+  char *_groups(const uint8_t *binary, size_t groups, char *base64);
+};
+
+/** Converts base64 to binary a piece at a time.
+        Feed the base64 to update() in pieces of any size and call finish()
+   after the last piece. The base64 is read as leniently as base64Decode reads
+   it, the pieces can be split anywhere.
+*/
+class Base64Decoder {
+public:
+  /// Prepare to decode
+  Base64Decoder() : _bits(0), _count(0), _padded(0) {}
+  /** The most bytes update() and finish() can write.
+        @param size The number of characters that will be passed to update()
+        @return The size of buffer needed for update(size) then finish()
+  */
+  static size_t maximumOutput(size_t size) { return (size + 3) / 4 * 3 + 3; }
+  /** Decode the next piece of base64.
+        Up to three characters are held back until more base64 or finish().
+        @param base64 The next characters to decode
+        @param size The number of characters in base64
+        @param binary Receives the decoded bytes
+        @return The byte after the last byte written
+        @throws msg::Exception if base64 has a character that is not base64,
+   padding or whitespace
+  */
+  uint8_t *update(const char *base64, size_t size, void *binary);
+  /** Decode any characters held back, as if the padding was there.
+        The decoder is then ready to decode a new stream.
+        @param binary Receives the last decoded bytes
+        @return The byte after the last byte written
+  */
+  uint8_t *finish(void *binary);
+
+private:
+  uint32_t _bits; ///< The values of the characters in the current group
+  int _count;     ///< The number of characters in the current group
+  int _padded;    ///< Where padding started in the group, 0 for not yet
+
+  /// Add one value, or _Base64Values::Padding, to the current group
+  uint8_t *_add(uint8_t value, uint8_t *binary);
+};
+
+inline Base64Encoder::Base64Encoder(Base64Style style, int split,
+                                    const std::string &eol)
+    : _characters(),
+      _padding(Base64 == style      ? __base_64_standard_trailer[0]
+               : Base64URL == style ? __base_64_url_trailer[0]
+                                    : '\0'),
+      _split(split > 0 && eol.size() > 0 ? split : 0), _eol(eol), _column(0),
+      _pending(), _pendingSize(0) {
+  const bool urlStyle = (Base64URL == style) || (Base64URLNoPadding == style);
+
+  memcpy(_characters,
+         urlStyle ? __base_64_base_characters __base_64_url_extension
+                  : __base_64_base_characters __base_64_standard_extension,
+         sizeof(_characters));
+}
+inline size_t Base64Encoder::maximumOutput(size_t size) const {
+  const size_t characters = (_pendingSize + size + 2) / 3 * 4;
+
+  return characters +
+         (_split > 0 ? (_column + characters) / _split * _eol.size() : 0);
+}
+inline char *Base64Encoder::update(const void *binary, size_t size,
+                                   char *base64) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(binary);
+
+  while ((_pendingSize > 0) && (_pendingSize < 3) && (size > 0)) {
+    _pending[_pendingSize++] = *bytes++;
+    --size;
+  }
+  if (3 == _pendingSize) {
+    base64 = _groups(_pending, 1, base64);
+    _pendingSize = 0;
+  }
+  base64 = _groups(bytes, size / 3, base64);
+  bytes += size / 3 * 3;
+  for (size %= 3; size > 0; --size) {
+    _pending[_pendingSize++] = *bytes++;
+  }
+  return base64;
+}
+inline char *Base64Encoder::finish(char *base64) {
+  char last[4];
+
+  if (_pendingSize > 0) {
+    const uint32_t bits =
+        (uint32_t(_pending[0]) << 16) |
+        (_pendingSize > 1 ? uint32_t(_pending[1]) << 8 : 0);
+    size_t count = 0;
+
+    last[count++] = _characters[bits >> 18];
+    last[count++] = _characters[(bits >> 12) & 0x3F];
+    if (_pendingSize > 1) {
+      last[count++] = _characters[(bits >> 6) & 0x3F];
+    }
+    while (_padding != '\0' && count < 4) {
+      last[count++] = _padding;
+    }
+    base64 = _write(last, count, base64);
+  }
+  _pendingSize = 0;
+  _column = 0;
+  return base64;
+}
+inline char *Base64Encoder::_write(const char *characters, size_t count,
+                                   char *base64) {
+  if (0 == _split) {
+    memcpy(base64, characters, count);
+    return base64 + count;
+  }
+  while (count > 0) {
+    size_t line;
+
+    if (_column == _split) {
+      memcpy(base64, _eol.data(), _eol.size());
+      base64 += _eol.size();
+      _column = 0;
+    }
+    line = std::min(count, _split - _column);
+    memcpy(base64, characters, line);
+    base64 += line;
+    characters += line;
+    count -= line;
+    _column += line;
+  }
+  return base64;
+}
+inline char *Base64Encoder::_groups(const uint8_t *binary, size_t groups,
+                                    char *base64) {
+#if __Text_x86__
+  const bool avx2 = _simdEngine() == _SIMDAVX2;
+#endif
+  char buffer[1024];
+
+  while (groups > 0) {
+    const size_t count =
+        0 == _split ? groups : std::min(groups, sizeof(buffer) / 4);
+    char *const out = 0 == _split ? base64 : buffer;
+
+#if __Text_x86__
+    if (avx2) {
+      _base64EncodeAVX2(binary, count, _characters, out);
+    } else {
+      _base64EncodePortable(binary, count, _characters, out);
+    }
+#else
+    _base64EncodePortable(binary, count, _characters, out);
+#endif
+    // every group is 4 characters, so buffer never flows into base64
+    base64 =
+        0 == _split ? base64 + count * 4 : _write(buffer, count * 4, base64);
+    binary += count * 3;
+    groups -= count;
+  }
+  return base64;
+}
+
+inline uint8_t *Base64Decoder::update(const char *base64, size_t size,
+                                      void *binary) {
+  const _Base64Values &values = _base64Values();
+  const char *const end = base64 + size;
+  uint8_t *out = reinterpret_cast<uint8_t *>(binary);
+
+  while (base64 < end) {
+#if __Text_x86__
+    if ((0 == _count) && (_simdEngine() == _SIMDAVX2)) {
+      out = _base64DecodeAVX2(base64, end, out);
+    }
+#endif
+    while ((0 == _count) && (end - base64 >= 4)) {
+      const uint32_t v0 = values.value[static_cast<uint8_t>(base64[0])];
+      const uint32_t v1 = values.value[static_cast<uint8_t>(base64[1])];
+      const uint32_t v2 = values.value[static_cast<uint8_t>(base64[2])];
+      const uint32_t v3 = values.value[static_cast<uint8_t>(base64[3])];
+      const uint32_t bits = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+
+      if ((v0 | v1 | v2 | v3) >= 64) {
+        break; // whitespace, padding or not base64
+      }
+      *out++ = static_cast<uint8_t>(bits >> 16);
+      *out++ = static_cast<uint8_t>(bits >> 8);
+      *out++ = static_cast<uint8_t>(bits);
+      base64 += 4;
+    }
+    // whitespace and padding, until the next group starts
+    while (base64 < end) {
+      const uint8_t value = values.value[static_cast<uint8_t>(*base64++)];
+
+      if (_Base64Values::Invalid == value) {
+        ThrowMessageException("Invalid base64 character");
+      }
+      if (value != _Base64Values::Whitespace) {
+        out = _add(value, out);
+      }
+      if (0 == _count) {
+        break;
+      }
+    }
+  }
+  return out;
+}
+inline uint8_t *Base64Decoder::finish(void *binary) {
+  uint8_t *out = reinterpret_cast<uint8_t *>(binary);
+
+  while (_count > 0) {
+    out = _add(_Base64Values::Padding, out);
+  }
+  return out;
+}
+inline uint8_t *Base64Decoder::_add(uint8_t value, uint8_t *binary) {
+  if (_Base64Values::Padding == value) {
+    if ((_count >= 2) && (0 == _padded)) {
+      _padded = _count; // padding in the first two places just counts as 0
+    }
+    value = 0;
+  }
+  _bits = (_bits << 6) | value;
+  if (++_count == 4) {
+    *binary++ = static_cast<uint8_t>(_bits >> 16);
+    if (_padded != 2) {
+      *binary++ = static_cast<uint8_t>(_bits >> 8);
+      if (_padded != 3) {
+        *binary++ = static_cast<uint8_t>(_bits);
+      }
+    }
+    _bits = 0;
+    _count = 0;
+    _padded = 0;
+  }
+  return binary;
+}
+
+/** Convert binary data into base 64 encoding.
         @param binary a buffer of binary data
+        @param size The number of bytes in binary
         @param base64 string to receive the base64 encoding
         @param style standard or url-safe base64 encoding
         @param split how many characters per line. 0 means no line splits.
@@ -209,73 +1269,66 @@ enum CommonSplits {
    defaults to clear.
         @return base64 parameter
 */
-inline std::string &base64Encode(const std::string &binary, std::string &base64,
+inline std::string &base64Encode(const void *binary, size_t size,
+                                 std::string &base64,
                                  Base64Style style = Base64,
                                  int split = DoNotSplitBase64,
                                  const std::string &eol = "\n",
                                  ClearFirst clear = ClearOutputFirst) {
-  const bool urlStyle = (Base64URL == style) || (Base64URLNoPadding == style);
-  const bool addPadding = (Base64 == style) || (Base64URL == style);
-  const std::string characters(
-      urlStyle ? __base_64_base_characters __base_64_url_extension
-               : __base_64_base_characters __base_64_standard_extension);
-  const char padding =
-      (urlStyle ? __base_64_url_trailer : __base_64_standard_trailer)[0];
-  const int size = binary.size();
+  Base64Encoder encoder(style, split, eol);
 
   if (ClearOutputFirst == clear) {
     base64.clear();
   }
 
-  base64.reserve(base64.size() + (size + 2) / 3 * 4);
-
-  for (int i = 0; i < size; i += 3) {
-    const auto twoOrMoreBytes = i + 1 < size;
-    const auto threeBytes = i + 2 < size;
-    const unsigned char b1 = binary[i];
-    const unsigned char b2 = twoOrMoreBytes ? binary[i + 1] : 0;
-    const unsigned char b3 = threeBytes ? binary[i + 2] : 0;
-    const unsigned char c1 = ((b1 & 0xfc) >> 2);
-    const unsigned char c1_2 = ((b1 & 0x03) << 4);
-    const unsigned char c2 = ((b1 & 0x03) << 4) | ((b2 & 0xf0) >> 4);
-    const unsigned char c2_2 = ((b2 & 0x0f) << 2);
-    const unsigned char c3 = ((b2 & 0x0f) << 2) | ((b3 & 0xc0) >> 6);
-    const unsigned char c4 = (b3 & 0x3f);
-
-    base64.append(1, characters[c1]);
+  const size_t start = base64.size();
+  char *out;
 
-    if (twoOrMoreBytes) {
-      base64.append(1, characters[c2]);
-
-      if (threeBytes) {
-        base64.append(1, characters[c3]);
-        base64.append(1, characters[c4]);
-      } else {
-        base64.append(1, characters[c2_2]);
-        if (addPadding) {
-          base64.append(1, padding);
-        }
-      }
-
-    } else {
-      base64.append(1, characters[c1_2]);
-      if (addPadding) {
-        base64.append(1, padding);
-        base64.append(1, padding);
-      }
-    }
-  }
+  base64.resize(start + encoder.maximumOutput(size));
+  out = encoder.update(binary, size, &base64[0] + start);
+  out = encoder.finish(out);
+  base64.resize(out - &base64[0]);
+  return base64;
+}
 
-  if ((split > 0) && (eol.size() > 0)) {
-    std::string::size_type offset = split;
+/** Convert binary data into base 64 encoding.
+        style has no default, so a string literal followed by a style is never
+   taken for a buffer and its size.
+        @param binary a buffer of binary data
+        @param size The number of bytes in binary
+        @param style standard or url-safe base64 encoding
+        @param split how many characters per line. 0 means no line splits.
+   defaults to 0.
+        @param eol The characters to use for end of line. defaults to \\n
+        @return base64 encoding of binary parameter
+*/
+inline std::string base64Encode(const void *binary, size_t size,
+                                Base64Style style,
+                                int split = DoNotSplitBase64,
+                                const std::string &eol = "\n") {
+  std::string buffer;
 
-    while (offset < base64.size()) {
-      base64.insert(offset, eol);
-      offset += split + eol.size();
-    }
-  }
+  return base64Encode(binary, size, buffer, style, split, eol, AppendToOutput);
+}
 
-  return base64;
+/** Convert a binary string into base 64 encoding.
+        @param binary a buffer of binary data
+        @param base64 string to receive the base64 encoding
+        @param style standard or url-safe base64 encoding
+        @param split how many characters per line. 0 means no line splits.
+   defaults to 0.
+        @param eol The characters to use for end of line. defaults to \\n
+        @param clear Should base64 be cleared first or appended with the hex.
+   defaults to clear.
+        @return base64 parameter
+*/
+inline std::string &base64Encode(const std::string &binary, std::string &base64,
+                                 Base64Style style = Base64,
+                                 int split = DoNotSplitBase64,
+                                 const std::string &eol = "\n",
+                                 ClearFirst clear = ClearOutputFirst) {
+  return base64Encode(binary.data(), binary.size(), base64, style, split, eol,
+                      clear);
 }
 
 /** Convert a binary string into base 64 encoding.
@@ -290,80 +1343,55 @@ inline std::string base64Encode(const std::string &binary,
                                 Base64Style style = Base64,
                                 int split = DoNotSplitBase64,
                                 const std::string &eol = "\n") {
-  std::string buffer;
-
-  return base64Encode(binary, buffer, style, split, eol, AppendToOutput);
+  return base64Encode(binary.data(), binary.size(), style, split, eol);
 }
 
-/** Determine the value of a base64 character.
-        Will return the position of c in standardCharacters or urlCharacters.
-        If c is not in either, it will check if it is in allTrailingCharacters,
-   and return 0. If c is not in any of the three, it will throw an exception.
-        @param c The base64 character to find the value of
-        @param standardCharacters The standard base64 characters, in order
-        @param urlCharacters The url variant base64 characters, in order
-        @param allTrailingCharacters the set of both standard and url base64
-   trailing characters
-        @throws msg::Exception if the character is not a base64 character
+/** Decode a base64 encoded string into a binary string.
+        base64 can be standard or url encoded, or a mix. It can have any line
+   ending or line length. It can have any whitespace dispersed within. It may or
+   may not have the trailing padding characters, or even incomplete trailing
+        characters.
+        @param base64 base64 encoded string
+        @param binary receives the binary version of base64. Unchanged if an
+   exception is thrown.
+        @param clear Should base64 be cleared first or appended with the hex.
+   defaults to clear.
+        @return binary parameter
 */
-inline unsigned char
-_base64CharacterValue(char c, const std::string &standardCharacters,
-                      const std::string &urlCharacters,
-                      const std::string &allTrailingCharacters) {
-  const auto f1 = standardCharacters.find(c);
-
-  if (f1 == std::string::npos) {
-    const auto f2 = urlCharacters.find(c);
-
-    if (f2 == std::string::npos) {
-      AssertMessageException(allTrailingCharacters.find(c) != // not tested
-                             std::string::npos);
+inline std::string &base64Decode(const char *base64, size_t size,
+                                 std::string &binary,
+                                 ClearFirst clear = ClearOutputFirst) {
+  Base64Decoder decoder;
 
-      return 0; // not tested
-    }
-    return f2;
+  if (ClearOutputFirst == clear) {
+    binary.clear();
   }
 
-  return f1;
-}
+  const size_t start = binary.size();
+  uint8_t *out;
 
-/** Find the next whitespace character.
-        @param s the string to search.
-        @param offset the offset in s to start searching for whitespace.
-   defaults to 0
-        @return the offset of the next whitespace character after offset or
-   std::string::npos if no whitespace is found.
-*/
-inline std::string::size_type
-_findWhitespace(const std::string &s, std::string::size_type offset = 0) {
-  while ((offset < s.size()) && !std::isspace(s[offset])) {
-    offset += 1;
+  binary.resize(start + Base64Decoder::maximumOutput(size));
+  try {
+    out = decoder.update(base64, size, &binary[0] + start);
+    out = decoder.finish(out);
+  } catch (const msg::Exception &) {
+    binary.resize(start);
+    throw;
   }
-  return offset < s.size() ? offset : std::string::npos;
+  binary.resize(out - reinterpret_cast<uint8_t *>(&binary[0]));
+  return binary;
 }
 
-/** Strips all whitespace characters from a string.
-        Note: The original string (s) is not modified
-        @param s The string to strip
-        @param buffer A string that may contain s with whitespaces stripped
-        @return If s has no whitespace, s is returned, otherwise, buffer is
-   returned.
+/** Decode a base64 encoded buffer into a binary string.
+        Reads base64 as leniently as the string version does.
+        @param base64 base64 encoded text
+        @param size The number of characters in base64
+        @return binary decoded from base64
 */
-inline const std::string &_stripWhitespace(const std::string &s,
-                                           std::string &buffer) {
-  std::string::size_type offset = _findWhitespace(s);
-
-  if (std::string::npos == offset) {
-    return s;
-  }
-
-  buffer = s;
-
-  do {
-    buffer.erase(offset, 1);
-  } while (std::string::npos != (offset = _findWhitespace(buffer, offset)));
+inline std::string base64Decode(const char *base64, size_t size) {
+  std::string buffer;
 
-  return buffer;
+  return base64Decode(base64, size, buffer, AppendToOutput);
 }
 
 /** Decode a base64 encoded string into a binary string.
@@ -372,59 +1400,15 @@ inline const std::string &_stripWhitespace(const std::string &s,
    may not have the trailing padding characters, or even incomplete trailing
         characters.
         @param base64 base64 encoded string
-        @param binary receives the binary version of base64
+        @param binary receives the binary version of base64. Unchanged if an
+   exception is thrown.
         @param clear Should base64 be cleared first or appended with the hex.
    defaults to clear.
         @return binary parameter
 */
 inline std::string &base64Decode(const std::string &base64, std::string &binary,
                                  ClearFirst clear = ClearOutputFirst) {
-  std::string buffer;
-  const auto &source = _stripWhitespace(base64, buffer);
-  const int size = source.size();
-  const std::string characters(
-      __base_64_base_characters __base_64_standard_extension);
-  const std::string urlCharacters(
-      __base_64_base_characters __base_64_url_extension);
-  const std::string padding(__base_64_standard_trailer __base_64_url_trailer);
-
-  if (ClearOutputFirst == clear) {
-    binary.clear();
-  }
-
-  binary.reserve(size / 4 * 3);
-
-  for (auto i = 0; i < size; i += 4) {
-    const auto has2 = i + 1 < size;
-    const auto has3 = i + 2 < size;
-    const auto has4 = i + 3 < size;
-    const auto c1 =
-        _base64CharacterValue(source[i], characters, urlCharacters, padding);
-    const auto c2 = has2 ? _base64CharacterValue(source[i + 1], characters,
-                                                 urlCharacters, padding)
-                         : 0;
-    const auto c3p =
-        has3 ? std::string::npos != padding.find(source[i + 2]) : true;
-    const auto c3 = c3p ? 0
-                        : _base64CharacterValue(source[i + 2], characters,
-                                                urlCharacters, padding);
-    const auto c4p =
-        has4 ? std::string::npos != padding.find(source[i + 3]) : true;
-    const auto c4 = c4p ? 0
-                        : _base64CharacterValue(source[i + 3], characters,
-                                                urlCharacters, padding);
-
-    binary.append(1, (c1 << 2) | ((c2 & 0x30) >> 4));
-
-    if (!c3p) {
-      binary.append(1, ((c2 & 0x0f) << 4) | ((c3 & 0x3c) >> 2));
-
-      if (!c4p) {
-        binary.append(1, ((c3 & 0x03) << 6) | c4);
-      }
-    }
-  }
-  return binary;
+  return base64Decode(base64.data(), base64.size(), binary, clear);
 }
 
 /** Decode a base64 encoded string into a binary string.
@@ -436,9 +1420,226 @@ inline std::string &base64Decode(const std::string &base64, std::string &binary,
         @return binary decoded from base64
 */
 inline std::string base64Decode(const std::string &base64) {
-  std::string buffer;
+  return base64Decode(base64.data(), base64.size());
+}
+
+/** Converts binary to hex a piece at a time.
+        Has the same update() and finish() as Base64Encoder, so it can be used
+   with Chain, update(), finish() and transform().
+*/
+class HexEncoder {
+public:
+  /// The most characters update(size) and finish() can write
+  static size_t maximumOutput(size_t size) { return 2 * size; }
+  /** Encode the next piece of binary.
+        @param binary The next bytes to encode
+        @param size The number of bytes in binary
+        @param hex Receives 2 * size lowercase hex digits
+        @return The character after the last character written
+  */
+  char *update(const void *binary, size_t size, char *hex) {
+    return toHex(binary, size, hex);
+  }
+  /// Nothing is held back, so there is nothing to write
+  char *finish(char *hex) { return hex; }
+};
+
+/** Converts hex to binary a piece at a time.
+        The pieces may split a pair of hex digits.
+*/
+class HexDecoder {
+public:
+  /// Prepare to decode
+  HexDecoder() : _pending('\0'), _hasPending(false) {}
+  /// The most bytes update(size) and finish() can write
+  static size_t maximumOutput(size_t size) { return (size + 1) / 2; }
+  /** Decode the next piece of hex.
+        @param hex The next upper or lower case hex digits
+        @param size The number of characters in hex
+        @param binary Receives the decoded bytes
+        @return The byte after the last byte written
+        @throws msg::Exception if hex has a character that is not a hex digit
+  */
+  uint8_t *update(const char *hex, size_t size, void *binary);
+  /** Finish the stream.
+        The decoder is then ready to decode a new stream.
+        @param binary Nothing is written
+        @return binary
+        @throws msg::Exception if there were an odd number of hex digits
+  */
+  uint8_t *finish(void *binary);
+
+private:
+  char _pending;    ///< The first digit of a pair split between pieces
+  bool _hasPending; ///< Is there a digit in _pending
+};
+
+/** Runs the output of one codec straight into another.
+        Chain is a codec itself, so chains can be chained. For instance
+   compressing and then base64 encoding, or decoding hex and then base64
+   encoding, in one pass with bounded memory.
+        @tparam First The codec the data goes through first
+        @tparam Second The codec that gets the output of First
+*/
+template <class First, class Second> class Chain {
+public:
+  /** Chain two codecs, both must live longer than the chain.
+        @param first The codec the data goes through first
+        @param second The codec that gets the output of first
+  */
+  Chain(First &first, Second &second)
+      : _first(first), _second(second), _buffer() {}
+  /// The most bytes update(size) and finish() can write
+  size_t maximumOutput(size_t size) const {
+    return _second.maximumOutput(_first.maximumOutput(size));
+  }
+  /** Run the next piece through both codecs.
+        @param data The next bytes
+        @param size The number of bytes in data
+        @param output Receives the output of second
+        @return The byte after the last byte written
+  */
+  char *update(const void *data, size_t size, void *output);
+  /** Finish first, run what it writes through second, and finish second.
+        @param output Receives the last output of second
+        @return The byte after the last byte written
+  */
+  char *finish(void *output);
+
+private:
+  First &_first;             ///< The codec the data goes through first
+  Second &_second;           ///< The codec that gets the output of _first
+  std::vector<char> _buffer; ///< The output of _first
+  Chain(const Chain &);            ///< Prevent usage
+  Chain &operator=(const Chain &); ///< Prevent usage
+};
+
+/** Run a piece through a codec, appending the output to a string.
+        @param codec Base64Encoder, Base64Decoder, HexEncoder, HexDecoder,
+   Chain or anything else with the same update(), finish() and
+   maximumOutput()
+        @param data The next bytes
+        @param size The number of bytes in data
+        @param output Appended with the output of the codec
+        @return output
+*/
+template <class Codec>
+inline std::string &update(Codec &codec, const void *data, size_t size,
+                           std::string &output) {
+  const size_t start = output.size();
+  char *end;
+
+  output.resize(start + codec.maximumOutput(size));
+  end = reinterpret_cast<char *>(
+      codec.update(reinterpret_cast<const char *>(data), size, &output[start]));
+  output.resize(end - &output[0]);
+  return output;
+}
 
-  return base64Decode(base64, buffer, AppendToOutput);
+/** Finish a codec, appending its last output to a string.
+        @param codec The codec to finish
+        @param output Appended with the last output of the codec
+        @return output
+*/
+template <class Codec>
+inline std::string &finish(Codec &codec, std::string &output) {
+  const size_t start = output.size();
+  char *end;
+
+  output.resize(start + codec.maximumOutput(0));
+  end = reinterpret_cast<char *>(codec.finish(&output[start]));
+  output.resize(end - &output[0]);
+  return output;
+}
+
+/** Run the rest of a file through a codec into another file.
+        Only chunkSize bytes of input, and the output for them, are in memory
+   at once, so files of any size can be converted.
+        @tparam Input Has size(), location() and read(buffer, size), ie
+   io::File
+        @tparam Output Has write(buffer, size), ie io::File
+        @param codec The codec to run the file through. It is finished.
+        @param input The file to read, from its current location to its end
+        @param output The file to write the output of codec to
+        @param chunkSize The number of bytes to read at a time
+*/
+template <class Codec, class Input, class Output>
+inline void transform(Codec &codec, const Input &input, Output &output,
+                      size_t chunkSize = 64 * 1024) {
+  std::vector<char> in(chunkSize), out;
+  off_t left = input.size() - input.location();
+  char *end;
+
+  while (left > 0) {
+    const size_t size =
+        left < static_cast<off_t>(chunkSize) ? static_cast<size_t>(left)
+                                              : chunkSize;
+
+    input.read(in.data(), size);
+    out.resize(codec.maximumOutput(size) + 1);
+    end = reinterpret_cast<char *>(codec.update(in.data(), size, out.data()));
+    output.write(out.data(), static_cast<size_t>(end - out.data()));
+    left -= size;
+  }
+  out.resize(codec.maximumOutput(0) + 1);
+  end = reinterpret_cast<char *>(codec.finish(out.data()));
+  output.write(out.data(), static_cast<size_t>(end - out.data()));
+}
+
+inline uint8_t *HexDecoder::update(const char *hex, size_t size,
+                                   void *binary) {
+  uint8_t *out = reinterpret_cast<uint8_t *>(binary);
+
+  if (_hasPending && (size > 0)) {
+    const char pair[] = {_pending, *hex};
+
+    out = fromHex(pair, sizeof(pair), out);
+    _hasPending = false;
+    ++hex;
+    --size;
+  }
+  out = fromHex(hex, size / 2 * 2, out);
+  if (size % 2 != 0) {
+    _pending = hex[size - 1];
+    if (_hexValue(_pending) < 0) {
+      ThrowMessageException("Invalid hex digit");
+    }
+    _hasPending = true;
+  }
+  return out;
+}
+inline uint8_t *HexDecoder::finish(void *binary) {
+  const bool odd = _hasPending;
+
+  _hasPending = false;
+  if (odd) {
+    ThrowMessageException("Odd number of hex digits");
+  }
+  return reinterpret_cast<uint8_t *>(binary);
+}
+
+template <class First, class Second>
+inline char *Chain<First, Second>::update(const void *data, size_t size,
+                                          void *output) {
+  char *middle;
+
+  _buffer.resize(_first.maximumOutput(size) + 1);
+  middle = reinterpret_cast<char *>(_first.update(
+      reinterpret_cast<const char *>(data), size, _buffer.data()));
+  return reinterpret_cast<char *>(
+      _second.update(_buffer.data(), middle - _buffer.data(),
+                     reinterpret_cast<char *>(output)));
+}
+template <class First, class Second>
+inline char *Chain<First, Second>::finish(void *output) {
+  char *middle, *end;
+
+  _buffer.resize(_first.maximumOutput(0) + 1);
+  middle = reinterpret_cast<char *>(_first.finish(_buffer.data()));
+  end = reinterpret_cast<char *>(
+      _second.update(_buffer.data(), middle - _buffer.data(),
+                     reinterpret_cast<char *>(output)));
+  return reinterpret_cast<char *>(_second.finish(end));
 }
 
 /** Counts the number of characters that match from the beginning of two
@@ -448,14 +1649,27 @@ inline std::string base64Decode(const std::string &base64) {
         @return The size of the matching prefix of s1 and s2.
 */
 inline int matching(const std::string &s1, const std::string &s2) {
-  const int shorterLength = int(std::min(s1.size(), s2.size()));
+  return int(matching(s1.data(), s1.size(), s2.data(), s2.size()));
+}
 
-  for (int i = 0; i < shorterLength; ++i) {
-    if (s1[i] != s2[i]) {
-      return i;
-    }
+/** Find the part of a buffer without a character at the beginning or ending.
+        Nothing is copied, text is moved past the leading characters.
+        @param text The start of the text, moved to the first character that
+   is not c
+        @param size The number of characters at text
+        @param c The character to remove from the ends of the text. Defaults
+   to space.
+        @return The number of characters left at text
+*/
+inline size_t trim(const char *&text, size_t size, char c = ' ') {
+  while ((size > 0) && (text[0] == c)) {
+    ++text;
+    --size;
   }
-  return int(shorterLength);
+  while ((size > 0) && (text[size - 1] == c)) {
+    --size;
+  }
+  return size;
 }
 
 /** Remove a character from the beginning and ending of a string.
@@ -465,12 +1679,12 @@ inline int matching(const std::string &s1, const std::string &s2) {
         @return s parameter
 */
 inline std::string &trim(std::string &s, char c = ' ') {
-  while ((s.size() > 0) && (s[0] == c)) {
-    s.erase(0, 1);
-  }
-  while ((s.size() > 0) && (s[s.size() - 1] == c)) {
-    s.erase(s.size() - 1);
-  }
+  const char *start = s.data();
+  const size_t size = trim(start, s.size(), c);
+  const size_t offset = start - s.data();
+
+  s.erase(offset + size);
+  s.erase(0, offset);
   return s;
 }
 
@@ -483,4 +1697,6 @@ inline std::string &trim(std::string &s, char c = ' ') {
 
 } // namespace text
 
+#undef __Text_x86__
+
 #endif // __Text_h__
@@ -0,0 +1,299 @@
+#ifndef __TextSearch_h__
+#define __TextSearch_h__
+
+/** @file TextSearch.h
+        Searching and comparing text in bulk.
+        These use SSE2 on x86-64, and AVX2 when the processor has it, and only
+   depend on the C library so that File.h and Path.h can use them.
+*/
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define __TextSearch_x86__ 1
+#include <immintrin.h>
+#else
+#define __TextSearch_x86__ 0
+#endif
+
+namespace text {
+
+/** Counts the number of characters that match from the beginning of two
+   buffers.
+        @param s1 first text to compare
+        @param size1 The number of characters in s1
+        @param s2 second text to compare
+        @param size2 The number of characters in s2
+        @return The size of the matching prefix of s1 and s2.
+*/
+size_t matching(const char *s1, size_t size1, const char *s2, size_t size2);
+/** Find the first character that is in a set of characters.
+        @param text The text to search
+        @param size The number of characters in text
+        @param set The characters to look for
+        @param setSize The number of characters in set
+        @return The offset of the first character in text that is in set, or
+   size if there are none
+*/
+size_t findFirstOf(const char *text, size_t size, const char *set,
+                   size_t setSize);
+/** Count the times a character is in text.
+        @param text The text to search
+        @param size The number of characters in text
+        @param c The character to count
+        @return The number of times c is in text
+*/
+size_t count(const char *text, size_t size, char c);
+/** Find the end of the first line.
+        @param text The text to search
+        @param size The number of characters in text
+        @return The offset of the first \\r or \\n, or size if there are none
+*/
+inline size_t findLineBreak(const char *text, size_t size) {
+  return findFirstOf(text, size, "\r\n", 2);
+}
+
+/// Can the processor run the AVX2 versions, found once
+inline bool _searchAVX2() {
+#if __TextSearch_x86__
+  static const bool supported = __builtin_cpu_supports("avx2");
+
+  return supported;
+#else
+  return false;
+#endif
+}
+
+/// Compare a word at a time, from offset, until one differs
+inline size_t _matchingPortable(const char *s1, const char *s2, size_t offset,
+                                size_t size) {
+  for (; size - offset >= sizeof(uint64_t); offset += sizeof(uint64_t)) {
+    uint64_t word1, word2;
+
+    ::memcpy(&word1, s1 + offset, sizeof(word1));
+    ::memcpy(&word2, s2 + offset, sizeof(word2));
+    if (word1 != word2) {
+      break;
+    }
+  }
+  for (; offset < size; ++offset) {
+    if (s1[offset] != s2[offset]) {
+      return offset;
+    }
+  }
+  return size;
+}
+
+/// Look up each character in a table of the set, from offset
+inline size_t _findFirstOfPortable(const char *text, size_t offset,
+                                   size_t size, const char *set,
+                                   size_t setSize) {
+  bool inSet[256] = {false};
+
+  for (size_t i = 0; i < setSize; ++i) {
+    inSet[static_cast<uint8_t>(set[i])] = true;
+  }
+  for (; offset < size; ++offset) {
+    if (inSet[static_cast<uint8_t>(text[offset])]) {
+      return offset;
+    }
+  }
+  return size;
+}
+
+#if __TextSearch_x86__
+enum {
+  _MostSIMDSet = 8 ///< Larger sets are searched with a table
+};
+
+/// The offset of the first differing byte, or size
+inline size_t _matchingSSE2(const char *s1, const char *s2, size_t size) {
+  size_t offset = 0;
+
+  for (; size - offset >= 16; offset += 16) {
+    const int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + offset)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + offset))));
+
+    if (equal != 0xFFFF) {
+      return offset + __builtin_ctz(~equal);
+    }
+  }
+  return _matchingPortable(s1, s2, offset, size);
+}
+
+/// The offset of the first differing byte, or size
+__attribute__((target("avx2"))) inline size_t
+_matchingAVX2(const char *s1, const char *s2, size_t size) {
+  size_t offset = 0;
+
+  for (; size - offset >= 32; offset += 32) {
+    const uint32_t equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + offset)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + offset))));
+
+    if (equal != 0xFFFFFFFF) {
+      return offset + __builtin_ctz(~equal);
+    }
+  }
+  return _matchingPortable(s1, s2, offset, size);
+}
+
+/// Compare 16 bytes against every character of a small set
+inline size_t _findFirstOfSSE2(const char *text, size_t size, const char *set,
+                               size_t setSize) {
+  __m128i needles[_MostSIMDSet];
+  size_t offset = 0;
+
+  for (size_t i = 0; i < setSize; ++i) {
+    needles[i] = _mm_set1_epi8(set[i]);
+  }
+  for (; size - offset >= 16; offset += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + offset));
+    __m128i found = _mm_cmpeq_epi8(block, needles[0]);
+
+    for (size_t i = 1; i < setSize; ++i) {
+      found = _mm_or_si128(found, _mm_cmpeq_epi8(block, needles[i]));
+    }
+
+    const int mask = _mm_movemask_epi8(found);
+
+    if (mask != 0) {
+      return offset + __builtin_ctz(mask);
+    }
+  }
+  return _findFirstOfPortable(text, offset, size, set, setSize);
+}
+
+/// Compare 32 bytes against every character of a small set
+__attribute__((target("avx2"))) inline size_t
+_findFirstOfAVX2(const char *text, size_t size, const char *set,
+                 size_t setSize) {
+  __m256i needles[_MostSIMDSet];
+  size_t offset = 0;
+
+  for (size_t i = 0; i < setSize; ++i) {
+    needles[i] = _mm256_set1_epi8(set[i]);
+  }
+  for (; size - offset >= 32; offset += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + offset));
+    __m256i found = _mm256_cmpeq_epi8(block, needles[0]);
+
+    for (size_t i = 1; i < setSize; ++i) {
+      found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, needles[i]));
+    }
+
+    const uint32_t mask = _mm256_movemask_epi8(found);
+
+    if (mask != 0) {
+      return offset + __builtin_ctz(mask);
+    }
+  }
+  return _findFirstOfPortable(text, offset, size, set, setSize);
+}
+
+/** Count 16 bytes at a time.
+        Matches are counted in each byte lane, and the lanes are added up
+   before any can pass 255.
+*/
+inline size_t _countSSE2(const char *text, size_t size, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  const __m128i zero = _mm_setzero_si128();
+  size_t offset = 0, total = 0;
+
+  while (size - offset >= 16) {
+    const size_t blocks = std::min<size_t>((size - offset) / 16, 255);
+    __m128i lanes = zero;
+
+    for (size_t block = 0; block < blocks; ++block, offset += 16) {
+      const __m128i *in = reinterpret_cast<const __m128i *>(text + offset);
+
+      lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128(in), needle));
+    }
+
+    const __m128i sums = _mm_sad_epu8(lanes, zero);
+
+    total += _mm_cvtsi128_si64(sums) +
+             _mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+  }
+  return total + std::count(text + offset, text + size, c);
+}
+
+/// Count 32 bytes at a time, see _countSSE2()
+__attribute__((target("avx2"))) inline size_t
+_countAVX2(const char *text, size_t size, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  const __m256i zero = _mm256_setzero_si256();
+  size_t offset = 0, total = 0;
+
+  while (size - offset >= 32) {
+    const size_t blocks = std::min<size_t>((size - offset) / 32, 255);
+    __m256i lanes = zero;
+
+    for (size_t block = 0; block < blocks; ++block, offset += 32) {
+      const __m256i *in = reinterpret_cast<const __m256i *>(text + offset);
+
+      const __m256i found = _mm256_cmpeq_epi8(_mm256_loadu_si256(in), needle);
+
+      lanes = _mm256_sub_epi8(lanes, found);
+    }
+
+    const __m256i sums = _mm256_sad_epu8(lanes, zero);
+
+    total += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+             _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+  }
+  return total + std::count(text + offset, text + size, c);
+}
+#endif
+
+inline size_t matching(const char *s1, size_t size1, const char *s2,
+                       size_t size2) {
+  const size_t shorterLength = std::min(size1, size2);
+
+#if __TextSearch_x86__
+  return _searchAVX2() ? _matchingAVX2(s1, s2, shorterLength)
+                       : _matchingSSE2(s1, s2, shorterLength);
+#else
+  return _matchingPortable(s1, s2, 0, shorterLength);
+#endif
+}
+
+inline size_t findFirstOf(const char *text, size_t size, const char *set,
+                          size_t setSize) {
+  if (0 == setSize) {
+    return size;
+  }
+  if (1 == setSize) {
+    const void *found = ::memchr(text, set[0], size);
+
+    return nullptr == found ? size
+                            : static_cast<const char *>(found) - text;
+  }
+#if __TextSearch_x86__
+  if (setSize <= _MostSIMDSet) {
+    return _searchAVX2() ? _findFirstOfAVX2(text, size, set, setSize)
+                         : _findFirstOfSSE2(text, size, set, setSize);
+  }
+#endif
+  return _findFirstOfPortable(text, 0, size, set, setSize);
+}
+
+inline size_t count(const char *text, size_t size, char c) {
+#if __TextSearch_x86__
+  return _searchAVX2() ? _countAVX2(text, size, c) : _countSSE2(text, size, c);
+#else
+  return std::count(text, text + size, c);
+#endif
+}
+
+} // namespace text
+
+#undef __TextSearch_x86__
+
+#endif // __TextSearch_h__
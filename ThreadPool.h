@@ -0,0 +1,468 @@
+#ifndef __ThreadPool_h__
+#define __ThreadPool_h__
+
+/** @file ThreadPool.h
+        Work-stealing thread pool.
+*/
+
+#include "Exception.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace exec {
+
+/** A fixed set of threads that run submitted work.
+        Every worker owns a Chase-Lev deque. Work submitted from a worker is
+   pushed on that worker's deque and popped in LIFO order, while idle workers
+   steal the oldest work from the other end of someone else's deque. Work
+   submitted from outside the pool goes on a shared queue.
+        Threads waiting on the pool (parallelFor) run queued work while they
+   wait, so nested parallelism inside a task does not deadlock.
+*/
+class ThreadPool {
+public:
+  /// Exception that is thrown when submitting work to a closed pool
+  class Closed : public msg::Exception {
+  public:
+    /// Get a message
+    explicit Closed(const char *message, const char *file = NULL,
+                    int line = 0) throw();
+    /// Copy constructor
+    Closed(const Closed &other);
+    /// destructs _message
+    virtual ~Closed() throw();
+  };
+  /** Start the worker threads.
+        @param threads The number of workers, 0 means one per hardware thread
+  */
+  explicit ThreadPool(int threads = 0);
+  /// Finishes all queued work and stops the workers.
+  ~ThreadPool();
+  /// The number of worker threads.
+  int threads() const { return static_cast<int>(_workers.size()); }
+  /** Queue a function to be called on a worker.
+        @param function The function to call
+        @param args The arguments to pass to the function
+        @return a future for the return value, or exception, of the function
+        @throws Closed if the pool has been closed
+  */
+  template <class Function, class... Args>
+  std::future<typename std::result_of<Function(Args...)>::type>
+  submit(Function &&function, Args &&...args);
+  /** Call body(index) for every index in [begin, end) across the pool.
+        The calling thread runs work until the whole range is finished.
+        @param begin The first index
+        @param end One past the last index
+        @param body Called once per index, must be safe to call concurrently
+        @param grainSize The number of indexes per task, 0 picks a size that
+     gives each worker a few tasks
+        @throws The first exception thrown by body, after the range finishes
+  */
+  template <class Function>
+  void parallelFor(size_t begin, size_t end, const Function &body,
+                   size_t grainSize = 0);
+  /** Run one piece of queued work on the calling thread, if there is any.
+        @return true if work was run
+  */
+  bool runPending();
+  /** Stops accepting work from outside the pool, finishes all queued work
+     and joins the workers.
+        Work already running may still submit more work while the pool drains.
+        Called from work running in the pool, it only stops accepting work,
+        the workers are joined by the next close() from outside the pool.
+        Concurrent calls are safe, each returns once the workers are joined.
+  */
+  void close();
+
+private:
+  typedef std::function<void()> Task; ///< A unit of work
+  /// Chase-Lev work-stealing deque. Only the owner may push and take.
+  class _Deque {
+  public:
+    _Deque();
+    ~_Deque();
+    /// Owner: add work to the bottom
+    void push(Task *task);
+    /// Owner: remove the newest work from the bottom
+    Task *take();
+    /// Anyone: remove the oldest work from the top
+    Task *steal();
+
+  private:
+    /// Circular array of tasks, replaced by a larger one when full
+    struct _Array {
+      explicit _Array(int64_t size)
+          : capacity(size), slots(new std::atomic<Task *>[size]) {}
+      ~_Array() { delete[] slots; }
+      int64_t capacity;           ///< Power of two number of slots
+      std::atomic<Task *> *slots; ///< The tasks
+      /// Get the task at a position
+      Task *get(int64_t index) {
+        return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
+      }
+      /// Set the task at a position
+      void put(int64_t index, Task *task) {
+        slots[index & (capacity - 1)].store(task, std::memory_order_relaxed);
+      }
+
+    private:
+      _Array(const _Array &);            ///< prevent usage
+      _Array &operator=(const _Array &); ///< prevent usage
+    };
+    std::atomic<int64_t> _top;         ///< Next to steal
+    std::atomic<int64_t> _bottom;      ///< Next to push
+    std::atomic<_Array *> _array;      ///< Current storage
+    std::vector<_Array *> _retired;    ///< Old storage thieves may still read
+    _Deque(const _Deque &);            ///< prevent usage
+    _Deque &operator=(const _Deque &); ///< prevent usage
+  };
+  /// A worker thread and its deque
+  struct _Worker {
+    _Worker() : deque(), thread() {}
+    _Deque deque;       ///< Work pushed by this worker
+    std::thread thread; ///< The thread
+  };
+  /// Tracks completion of a parallelFor
+  struct _Range {
+    explicit _Range(size_t tasks) : remaining(tasks), failure(), lock() {}
+    std::atomic<size_t> remaining; ///< Tasks not yet finished
+    std::exception_ptr failure;    ///< The first exception thrown
+    std::mutex lock;               ///< Protects failure
+  };
+
+  std::vector<_Worker *> _workers; ///< The worker threads
+  std::deque<Task *> _injected;    ///< Work submitted from outside the pool
+  std::mutex _lock;                ///< Protects _injected and _wake
+  std::condition_variable _wake;   ///< Idle workers wait on this
+  std::atomic<int> _pending;       ///< Work queued but not yet started
+  std::atomic<int> _sleeping;      ///< Workers waiting on _wake
+  std::atomic<bool> _closed;       ///< close() has been called
+  std::mutex _joining;             ///< Only one close() joins the workers
+
+  /// The worker running on the current thread, if it is in this pool
+  _Worker *_current();
+  /// The pool and worker running on the current thread
+  static std::pair<ThreadPool *, _Worker *> &_threadWorker();
+  /// Queue a task and wake a worker, deletes task if it cannot be queued
+  void _push(Task *task);
+  /// Run queued work until every task of a parallelFor has finished
+  void _wait(_Range &range);
+  /// Find queued work, preferring the given worker's own deque
+  Task *_find(_Worker *worker, size_t start);
+  /// Run a task and delete it
+  void _run(Task *task);
+  /// The body of every worker thread
+  void _work(_Worker *worker, size_t index);
+  ThreadPool(const ThreadPool &);            ///< prevent usage
+  ThreadPool &operator=(const ThreadPool &); ///< prevent usage
+};
+
+inline ThreadPool::Closed::Closed(const char *message, const char *file,
+                                  int line) throw()
+    : msg::Exception(message, file, line) {}
+inline ThreadPool::Closed::Closed(const Closed &other)
+    : msg::Exception(other) {}
+inline ThreadPool::Closed::~Closed() throw() {}
+
+inline ThreadPool::_Deque::_Deque()
+    : _top(0), _bottom(0), _array(new _Array(64)), _retired() {}
+inline ThreadPool::_Deque::~_Deque() {
+  delete _array.load();
+  for (auto array : _retired) {
+    delete array;
+  }
+}
+inline void ThreadPool::_Deque::push(Task *task) {
+  const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+  const int64_t top = _top.load(std::memory_order_acquire);
+  _Array *array = _array.load(std::memory_order_relaxed);
+
+  if (bottom - top > array->capacity - 1) {
+    _Array *bigger = new _Array(array->capacity * 2);
+
+    for (int64_t i = top; i < bottom; ++i) {
+      bigger->put(i, array->get(i));
+    }
+    _retired.push_back(array);
+    _array.store(bigger, std::memory_order_release);
+    array = bigger;
+  }
+  array->put(bottom, task);
+  _bottom.store(bottom + 1, std::memory_order_release);
+}
+inline ThreadPool::Task *ThreadPool::_Deque::take() {
+  const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+  _Array *array = _array.load(std::memory_order_relaxed);
+  Task *task = nullptr;
+
+  _bottom.store(bottom, std::memory_order_seq_cst);
+
+  int64_t top = _top.load(std::memory_order_seq_cst);
+
+  if (top <= bottom) {
+    task = array->get(bottom);
+    if (top == bottom) {
+      // last one, race the thieves for it
+      if (!_top.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        task = nullptr;
+      }
+      _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+  } else {
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+inline ThreadPool::Task *ThreadPool::_Deque::steal() {
+  int64_t top = _top.load(std::memory_order_seq_cst);
+  const int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+
+  if (top < bottom) {
+    Task *task = _array.load(std::memory_order_acquire)->get(top);
+
+    if (_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+inline ThreadPool::ThreadPool(int threads)
+    : _workers(), _injected(), _lock(), _wake(), _pending(0), _sleeping(0),
+      _closed(false), _joining() {
+  if (threads <= 0) {
+    threads =
+        std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  for (int i = 0; i < threads; ++i) {
+    _workers.push_back(new _Worker());
+  }
+  for (int i = 0; i < threads; ++i) {
+    _workers[i]->thread =
+        std::thread(&ThreadPool::_work, this, _workers[i], size_t(i));
+  }
+}
+inline ThreadPool::~ThreadPool() {
+  try {
+    close();
+  } catch (const std::exception &) {
+    // cannot handle error in destructor
+  }
+  for (auto worker : _workers) {
+    delete worker;
+  }
+}
+template <class Function, class... Args>
+inline std::future<typename std::result_of<Function(Args...)>::type>
+ThreadPool::submit(Function &&function, Args &&...args) {
+  typedef typename std::result_of<Function(Args...)>::type Result;
+  std::shared_ptr<std::packaged_task<Result()>> work(
+      new std::packaged_task<Result()>(std::bind(
+          std::forward<Function>(function), std::forward<Args>(args)...)));
+  std::future<Result> result = work->get_future();
+
+  _push(new Task([work]() { (*work)(); }));
+  return result;
+}
+template <class Function>
+inline void ThreadPool::parallelFor(size_t begin, size_t end,
+                                    const Function &body, size_t grainSize) {
+  if (end <= begin) {
+    return;
+  }
+
+  const size_t count = end - begin;
+
+  if (0 == grainSize) {
+    grainSize = std::max(size_t(1), count / (4 * _workers.size()));
+  }
+
+  const size_t tasks = (count + grainSize - 1) / grainSize;
+  _Range range(tasks);
+  size_t pushed = 0;
+
+  try {
+    for (size_t first = begin; first < end; first += grainSize, ++pushed) {
+      const size_t last = std::min(end, first + grainSize);
+
+      _push(new Task([&range, &body, first, last]() {
+        try {
+          for (size_t index = first; index < last; ++index) {
+            body(index);
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(range.lock);
+
+          if (!range.failure) {
+            range.failure = std::current_exception();
+          }
+        }
+        range.remaining.fetch_sub(1, std::memory_order_acq_rel);
+      }));
+    }
+  } catch (...) {
+    // the queued tasks point at range and body, let them finish first
+    range.remaining.fetch_sub(tasks - pushed, std::memory_order_acq_rel);
+    _wait(range);
+    throw;
+  }
+  _wait(range);
+  if (range.failure) {
+    std::rethrow_exception(range.failure);
+  }
+}
+inline void ThreadPool::_wait(_Range &range) {
+  while (range.remaining.load(std::memory_order_acquire) > 0) {
+    if (!runPending()) {
+      std::this_thread::yield();
+    }
+  }
+}
+inline bool ThreadPool::runPending() {
+  Task *task = _find(_current(), 0);
+
+  if (nullptr == task) {
+    return false;
+  }
+  _run(task);
+  return true;
+}
+inline void ThreadPool::close() {
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _closed.store(true);
+  }
+  _wake.notify_all();
+  if (nullptr != _current()) {
+    return; // a worker cannot join itself
+  }
+
+  std::lock_guard<std::mutex> joining(_joining);
+
+  for (auto worker : _workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+inline ThreadPool::_Worker *ThreadPool::_current() {
+  const std::pair<ThreadPool *, _Worker *> &current = _threadWorker();
+
+  return current.first == this ? current.second : nullptr;
+}
+inline std::pair<ThreadPool *, ThreadPool::_Worker *> &
+ThreadPool::_threadWorker() {
+  static thread_local std::pair<ThreadPool *, _Worker *> current(nullptr,
+                                                                 nullptr);
+
+  return current;
+}
+inline void ThreadPool::_push(Task *task) {
+  _Worker *worker = _current();
+
+  if (nullptr != worker) {
+    try {
+      worker->deque.push(task);
+    } catch (...) {
+      delete task;
+      throw;
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (_closed.load()) {
+      delete task;
+      throw Closed("Thread Pool Already Closed", __FILE__, __LINE__);
+    }
+    try {
+      _injected.push_back(task);
+    } catch (...) {
+      delete task;
+      throw;
+    }
+  }
+  _pending.fetch_add(1);
+  if (_sleeping.load() > 0) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    _wake.notify_one();
+  }
+}
+inline ThreadPool::Task *ThreadPool::_find(_Worker *worker, size_t start) {
+  Task *task = nullptr;
+
+  if (nullptr != worker) {
+    task = worker->deque.take();
+  }
+  if ((nullptr == task) && (_pending.load() > 0)) {
+    std::lock_guard<std::mutex> lock(_lock);
+
+    if (!_injected.empty()) {
+      task = _injected.front();
+      _injected.pop_front();
+    }
+  }
+  for (size_t i = 0; (nullptr == task) && (i < _workers.size()); ++i) {
+    _Worker *victim = _workers[(start + i) % _workers.size()];
+
+    if (victim != worker) {
+      task = victim->deque.steal();
+    }
+  }
+  if (nullptr != task) {
+    _pending.fetch_sub(1);
+  }
+  return task;
+}
+inline void ThreadPool::_run(Task *task) {
+  std::unique_ptr<Task> running(task);
+
+  (*running)();
+}
+inline void ThreadPool::_work(_Worker *worker, size_t index) {
+  _threadWorker() = std::make_pair(this, worker);
+  while (true) {
+    Task *task = _find(worker, index + 1);
+
+    if (nullptr != task) {
+      _run(task);
+      continue;
+    }
+    if (_pending.load() > 0) {
+      std::this_thread::yield(); // lost a race with a thief, try again
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(_lock);
+
+    _sleeping.fetch_add(1);
+    while ((0 == _pending.load()) && !_closed.load()) {
+      _wake.wait(lock);
+    }
+    _sleeping.fetch_sub(1);
+    if (_closed.load() && (0 == _pending.load())) {
+      break;
+    }
+  }
+  _threadWorker() = std::make_pair(nullptr, nullptr);
+}
+
+}; // namespace exec
+
+#endif // __ThreadPool_h__
@@ -0,0 +1,236 @@
+#ifndef __TreeHash_h__
+#define __TreeHash_h__
+
+/** @file TreeHash.h
+        Merkle tree hashes of large data and files calculated in parallel.
+*/
+
+#include "FileHash.h"
+#include "Hash.h"
+#include "MemoryMappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace hash {
+
+/** Hash of data split into fixed size chunks and combined in a binary tree.
+        Each chunk is hashed on its own, so all the chunks of a file can be
+   hashed at once across an exec::ThreadPool, and a range of the file can later
+   be checked by rehashing only the chunks it covers.
+        Leaves are Hash(0x00 + chunk) and nodes are Hash(0x01 + left + right),
+   so a leaf can never be mistaken for a node. Nodes are built by pairing
+   neighbors at each level; an unpaired node at the end of a level is carried
+   up unchanged. Empty data has a single leaf of the empty chunk.
+        @tparam Hasher The Hasher that SpecificHash uses, ie OpenSSLSHA256Hasher
+*/
+template <class Hasher> class TreeHash {
+public:
+  typedef SpecificHash<Hasher> Value; ///< Hash of leaves, nodes and the root
+  typedef std::vector<Value> Leaves;  ///< Hash of each chunk, in order
+  enum {
+    DefaultChunkSize = 4 * 1024 * 1024 ///< Bytes per leaf if not given
+  };
+  /** Hash a file, mapping each chunk into memory as it is hashed.
+        @param path The file to hash
+        @param pool The threads that hash the chunks
+        @param chunkSize The number of bytes in each leaf
+  */
+  TreeHash(const std::string &path, exec::ThreadPool &pool,
+           size_t chunkSize = DefaultChunkSize);
+  /** Hash data in memory.
+        @param data The data to hash
+        @param size The number of bytes in data
+        @param pool The threads that hash the chunks
+        @param chunkSize The number of bytes in each leaf
+  */
+  TreeHash(const void *data, size_t size, exec::ThreadPool &pool,
+           size_t chunkSize = DefaultChunkSize);
+  /// The hash of the whole tree
+  const Value &root() const { return _root; }
+  /// The hash of each chunk
+  const Leaves &leaves() const { return _leaves; }
+  /// The number of bytes that were hashed
+  uint64_t size() const { return _size; }
+  /// The number of bytes in each chunk, the last chunk may be shorter
+  size_t chunkSize() const { return _chunkSize; }
+  /** Rehash the chunks of a file that overlap a range of bytes.
+        Works with any chunk size, including a tree made from memory.
+        @param path The file to check, it must be the same size as was hashed
+        @param offset The first byte of the range
+        @param length The number of bytes in the range
+        @param pool The threads that hash the chunks
+        @return The indexes of the chunks that no longer match their leaf
+  */
+  std::vector<size_t> verify(const std::string &path, uint64_t offset,
+                             uint64_t length, exec::ThreadPool &pool) const;
+  /** Hash a single chunk as a leaf.
+        @param data The chunk
+        @param size The number of bytes in the chunk
+        @return Hash(0x00 + chunk)
+  */
+  static Value leaf(const void *data, size_t size);
+  /** Hash two children as a node.
+        @param left The first child
+        @param right The second child
+        @return Hash(0x01 + left + right)
+  */
+  static Value node(const Value &left, const Value &right);
+  /** Combine leaves into the root of the tree.
+        @param leaves The hash of each chunk, in order. Must not be empty.
+        @return The root of the tree
+  */
+  static Value combine(const Leaves &leaves);
+
+private:
+  uint64_t _size;    ///< Bytes hashed
+  size_t _chunkSize; ///< Bytes per leaf
+  Leaves _leaves;    ///< Hash of each chunk
+  Value _root;       ///< Hash of the tree
+
+  /// The number of chunks needed for size bytes, at least one
+  static size_t _chunks(uint64_t size, size_t chunkSize);
+  /// Map a chunk of a file and hash it
+  static Value _leaf(const io::FileDescriptor &file, uint64_t fileSize,
+                     size_t chunkSize, size_t index);
+};
+
+template <class Hasher>
+inline TreeHash<Hasher>::TreeHash(const std::string &path,
+                                  exec::ThreadPool &pool, size_t chunkSize)
+    : _size(0), _chunkSize(chunkSize), _leaves(), _root() {
+  io::FileDescriptor file(path, O_RDONLY);
+
+  AssertMessageException(chunkSize > 0);
+  _size = file.size();
+  _leaves.resize(_chunks(_size, chunkSize));
+  pool.parallelFor(
+      0, _leaves.size(),
+      [this, &file](size_t index) {
+        _leaves[index] = _leaf(file, _size, _chunkSize, index);
+      },
+      1);
+  _root = combine(_leaves);
+}
+template <class Hasher>
+inline TreeHash<Hasher>::TreeHash(const void *data, size_t size,
+                                  exec::ThreadPool &pool, size_t chunkSize)
+    : _size(size), _chunkSize(chunkSize), _leaves(), _root() {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+  AssertMessageException(chunkSize > 0);
+  _leaves.resize(_chunks(size, chunkSize));
+  pool.parallelFor(
+      0, _leaves.size(),
+      [this, bytes](size_t index) {
+        const uint64_t start = uint64_t(index) * _chunkSize;
+        const uint64_t left = _size - start;
+
+        _leaves[index] =
+            leaf(bytes + start, left < _chunkSize ? left : _chunkSize);
+      },
+      1);
+  _root = combine(_leaves);
+}
+template <class Hasher>
+inline std::vector<size_t>
+TreeHash<Hasher>::verify(const std::string &path, uint64_t offset,
+                         uint64_t length, exec::ThreadPool &pool) const {
+  io::FileDescriptor file(path, O_RDONLY);
+  std::vector<size_t> mismatched;
+  std::vector<char> matches;
+  size_t first, last;
+
+  AssertMessageException(static_cast<uint64_t>(file.size()) == _size);
+  if ((0 == length) || (offset >= _size)) {
+    return mismatched;
+  }
+  first = offset / _chunkSize;
+  last = (offset + length - 1) / _chunkSize;
+  if (last >= _leaves.size()) {
+    last = _leaves.size() - 1;
+  }
+  matches.resize(last - first + 1);
+  pool.parallelFor(
+      first, last + 1,
+      [this, &file, &matches, first](size_t index) {
+        matches[index - first] =
+            _leaf(file, _size, _chunkSize, index) == _leaves[index];
+      },
+      1);
+  for (size_t index = first; index <= last; ++index) {
+    if (!matches[index - first]) {
+      mismatched.push_back(index);
+    }
+  }
+  return mismatched;
+}
+template <class Hasher>
+inline typename TreeHash<Hasher>::Value
+TreeHash<Hasher>::leaf(const void *data, size_t size) {
+  const uint8_t prefix = 0x00;
+  typename Value::Incremental hasher;
+
+  hasher.update(&prefix, sizeof(prefix)).update(data, size);
+  return hasher.finish();
+}
+template <class Hasher>
+inline typename TreeHash<Hasher>::Value
+TreeHash<Hasher>::node(const Value &left, const Value &right) {
+  const uint8_t prefix = 0x01;
+  typename Value::Incremental hasher;
+
+  hasher.update(&prefix, sizeof(prefix))
+      .update(left.buffer(), left.size())
+      .update(right.buffer(), right.size());
+  return hasher.finish();
+}
+template <class Hasher>
+inline typename TreeHash<Hasher>::Value
+TreeHash<Hasher>::combine(const Leaves &leaves) {
+  Leaves level(leaves);
+
+  AssertMessageException(!level.empty());
+  while (level.size() > 1) {
+    size_t count = 0;
+
+    for (size_t index = 0; index < level.size(); index += 2) {
+      level[count++] = index + 1 < level.size()
+                           ? node(level[index], level[index + 1])
+                           : level[index];
+    }
+    level.resize(count);
+  }
+  return level[0];
+}
+template <class Hasher>
+inline size_t TreeHash<Hasher>::_chunks(uint64_t size, size_t chunkSize) {
+  return size == 0 ? 1
+                   : static_cast<size_t>((size + chunkSize - 1) / chunkSize);
+}
+template <class Hasher>
+inline typename TreeHash<Hasher>::Value
+TreeHash<Hasher>::_leaf(const io::FileDescriptor &file, uint64_t fileSize,
+                        size_t chunkSize, size_t index) {
+  const uint64_t start = uint64_t(index) * chunkSize;
+  const uint64_t left = fileSize - start;
+  const size_t size = left < chunkSize ? left : chunkSize;
+  // mmap offsets must be page aligned, a tree from memory may have any chunk
+  const size_t skip = static_cast<size_t>(start % ::sysconf(_SC_PAGESIZE));
+
+  if (0 == size) {
+    return leaf("", 0); // mmap cannot map nothing
+  }
+
+  io::MemoryMappedFile chunk(file, skip + size, start - skip, PROT_READ,
+                             MAP_SHARED);
+
+  return leaf(chunk.address<uint8_t>() + skip, size);
+}
+
+} // namespace hash
+
+#endif // __TreeHash_h__
@@ -0,0 +1,528 @@
+#ifndef __UTF8_h__
+#define __UTF8_h__
+
+/** @file UTF8.h
+        Validating UTF-8 and converting it to and from UTF-16 and UTF-32.
+        Everything writes into buffers the caller provides, so nothing is
+   allocated. Runs of ASCII, and validation of any text, use AVX2 when the
+   processor has it.
+*/
+
+#include "os/Exception.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define __UTF8_x86__ 1
+#include <immintrin.h>
+#else
+#define __UTF8_x86__ 0
+#endif
+
+namespace text {
+
+namespace utf8 {
+
+/** Thrown when text is not valid UTF-8, UTF-16 or UTF-32.
+ */
+class Invalid : public msg::Exception {
+public:
+  typedef msg::Exception Super; ///< The parent exception class
+  /** Report where the text stops being valid.
+        @param offset The code unit where the text stops being valid
+        @param file Set to __FILE__
+        @param line Set to __LINE__
+  */
+  explicit Invalid(size_t offset, const char *file = nullptr,
+                   int line = 0) throw();
+  /// Copy constructor
+  Invalid(const Invalid &other);
+  /// Assignment operator
+  Invalid &operator=(const Invalid &other);
+  /// Nothing to do in destructor
+  virtual ~Invalid() throw();
+  /// The code unit (byte for UTF-8) where the text stops being valid
+  size_t offset() const { return _offset; }
+
+private:
+  size_t _offset; ///< The code unit where the text stops being valid
+};
+
+/** Find how much of a buffer is valid UTF-8.
+        Overlong forms, surrogates, code points past U+10FFFF and sequences
+   cut short are not valid.
+        @param utf8 The text to check
+        @param size The number of bytes in utf8
+        @return The number of bytes before the first one that is not valid,
+   size if all of utf8 is valid
+*/
+size_t validate(const char *utf8, size_t size);
+/** Is a buffer valid UTF-8.
+        @param utf8 The text to check
+        @param size The number of bytes in utf8
+        @return true if all of utf8 is valid UTF-8
+*/
+inline bool valid(const char *utf8, size_t size) {
+  return validate(utf8, size) == size;
+}
+/** Is a string valid UTF-8.
+        @param utf8 The text to check
+        @return true if all of utf8 is valid UTF-8
+*/
+inline bool valid(const std::string &utf8) {
+  return valid(utf8.data(), utf8.size());
+}
+/// The most UTF-16 or UTF-32 code units that size bytes of UTF-8 can become
+inline size_t maximumUnits(size_t size) { return size; }
+/// The most bytes of UTF-8 that units UTF-16 or UTF-32 code units can become
+inline size_t maximumBytes(size_t units) { return 4 * units; }
+/** Convert UTF-8 to UTF-16.
+        @param utf8 The text to convert
+        @param size The number of bytes in utf8
+        @param utf16 Receives up to maximumUnits(size) code units
+        @return The code unit after the last one written
+        @throws Invalid with the offset of the first byte that is not UTF-8
+*/
+char16_t *toUTF16(const char *utf8, size_t size, char16_t *utf16);
+/** Convert UTF-8 to UTF-32.
+        @param utf8 The text to convert
+        @param size The number of bytes in utf8
+        @param utf32 Receives up to maximumUnits(size) code points
+        @return The code point after the last one written
+        @throws Invalid with the offset of the first byte that is not UTF-8
+*/
+char32_t *toUTF32(const char *utf8, size_t size, char32_t *utf32);
+/** Convert UTF-8 to wide characters, UTF-16 or UTF-32 by the size of wchar_t.
+        @param utf8 The text to convert
+        @param size The number of bytes in utf8
+        @param wide Receives up to maximumUnits(size) characters
+        @return The character after the last one written
+        @throws Invalid with the offset of the first byte that is not UTF-8
+*/
+wchar_t *toWide(const char *utf8, size_t size, wchar_t *wide);
+/** Convert UTF-16 to UTF-8.
+        @param utf16 The text to convert
+        @param size The number of code units in utf16
+        @param utf8 Receives up to maximumBytes(size) bytes
+        @return The byte after the last one written
+        @throws Invalid with the offset of a surrogate that is not paired
+*/
+char *toUTF8(const char16_t *utf16, size_t size, char *utf8);
+/** Convert UTF-32 to UTF-8.
+        @param utf32 The text to convert
+        @param size The number of code points in utf32
+        @param utf8 Receives up to maximumBytes(size) bytes
+        @return The byte after the last one written
+        @throws Invalid with the offset of a surrogate or a value past
+   U+10FFFF
+*/
+char *toUTF8(const char32_t *utf32, size_t size, char *utf8);
+/** Convert wide characters, UTF-16 or UTF-32 by the size of wchar_t, to UTF-8.
+        @param wide The text to convert
+        @param size The number of characters in wide
+        @param utf8 Receives up to maximumBytes(size) bytes
+        @return The byte after the last one written
+        @throws Invalid with the offset of the first character that is not
+   valid
+*/
+char *toUTF8(const wchar_t *wide, size_t size, char *utf8);
+
+inline Invalid::Invalid(size_t offset, const char *file, int line) throw()
+    : Super(std::string("Invalid Unicode at code unit ") +
+                std::to_string(offset),
+            file, line),
+      _offset(offset) {}
+inline Invalid::Invalid(const Invalid &other)
+    : Super(other), _offset(other._offset) {}
+inline Invalid &Invalid::operator=(const Invalid &other) {
+  Super::operator=(other);
+  _offset = other._offset;
+  return *this;
+}
+inline Invalid::~Invalid() throw() {}
+
+/// Can the processor run the AVX2 versions, found once
+inline bool _avx2() {
+#if __UTF8_x86__
+  static const bool supported = __builtin_cpu_supports("avx2");
+
+  return supported;
+#else
+  return false;
+#endif
+}
+
+/** Decode one UTF-8 sequence.
+        @param utf8 The sequence
+        @param left The number of bytes available at utf8
+        @param codePoint Receives the code point
+        @return The number of bytes in the sequence, or 0 if it is not valid
+*/
+inline size_t _decode(const uint8_t *utf8, size_t left, uint32_t &codePoint) {
+  const uint32_t lead = utf8[0];
+
+  if (lead < 0x80) {
+    codePoint = lead;
+    return 1;
+  }
+  if ((lead < 0xC2) || (lead > 0xF4)) {
+    return 0; // continuation, overlong two byte or past U+10FFFF
+  }
+  if (lead < 0xE0) {
+    if ((left < 2) || ((utf8[1] & 0xC0) != 0x80)) {
+      return 0;
+    }
+    codePoint = ((lead & 0x1F) << 6) | (utf8[1] & 0x3F);
+    return 2;
+  }
+  if (lead < 0xF0) {
+    if ((left < 3) || ((utf8[1] & 0xC0) != 0x80) ||
+        ((utf8[2] & 0xC0) != 0x80)) {
+      return 0;
+    }
+    codePoint =
+        ((lead & 0x0F) << 12) | ((utf8[1] & 0x3F) << 6) | (utf8[2] & 0x3F);
+    if ((codePoint < 0x800) ||
+        ((codePoint >= 0xD800) && (codePoint < 0xE000))) {
+      return 0; // overlong or surrogate
+    }
+    return 3;
+  }
+  if ((left < 4) || ((utf8[1] & 0xC0) != 0x80) ||
+      ((utf8[2] & 0xC0) != 0x80) || ((utf8[3] & 0xC0) != 0x80)) {
+    return 0;
+  }
+  codePoint = ((lead & 0x07) << 18) | ((utf8[1] & 0x3F) << 12) |
+              ((utf8[2] & 0x3F) << 6) | (utf8[3] & 0x3F);
+  return (codePoint < 0x10000) || (codePoint > 0x10FFFF) ? 0 : 4;
+}
+
+/** Encode one code point as UTF-8.
+        @param codePoint A valid code point
+        @param utf8 Receives 1 to 4 bytes
+        @return The byte after the last one written
+*/
+inline char *_encode(uint32_t codePoint, char *utf8) {
+  if (codePoint < 0x80) {
+    *utf8++ = static_cast<char>(codePoint);
+  } else if (codePoint < 0x800) {
+    *utf8++ = static_cast<char>(0xC0 | (codePoint >> 6));
+    *utf8++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else if (codePoint < 0x10000) {
+    *utf8++ = static_cast<char>(0xE0 | (codePoint >> 12));
+    *utf8++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    *utf8++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+  } else {
+    *utf8++ = static_cast<char>(0xF0 | (codePoint >> 18));
+    *utf8++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    *utf8++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    *utf8++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+  }
+  return utf8;
+}
+
+/// Validate a sequence at a time, from a sequence boundary
+inline size_t _validatePortable(const uint8_t *utf8, size_t offset,
+                                size_t size) {
+  uint32_t codePoint;
+
+  while (offset < size) {
+    const size_t length = _decode(utf8 + offset, size - offset, codePoint);
+
+    if (0 == length) {
+      return offset;
+    }
+    offset += length;
+  }
+  return size;
+}
+
+#if __UTF8_x86__
+/** Check 32 bytes at a time with the lookup algorithm of Keiser and Lemire.
+        Each byte, with the byte before it, is looked up in three tables of
+   error bits, and any bit left in all three is an error. Sequences that must
+   have two or three continuation bytes are checked separately.
+        @return The number of bytes checked. Everything before that is valid
+   except maybe the last sequence, which may continue past it.
+*/
+__attribute__((target("avx2"))) inline size_t
+_validateAVX2(const uint8_t *utf8, size_t size) {
+  const int tooShort = 1 << 0, tooLong = 1 << 1, overlong3 = 1 << 2,
+            tooLarge = 1 << 3, surrogate = 1 << 4, overlong2 = 1 << 5,
+            tooLarge1000 = 1 << 6, overlong4 = 1 << 6, twoContinues = 1 << 7,
+            carry = tooShort | tooLong | twoContinues;
+  const __m256i firstHigh = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+      twoContinues, twoContinues, twoContinues, twoContinues,
+      tooShort | overlong2, tooShort, tooShort | overlong3 | surrogate,
+      tooShort | tooLarge | tooLarge1000 | overlong4));
+  const __m256i firstLow = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      carry | overlong3 | overlong2 | overlong4, carry | overlong2, carry,
+      carry, carry | tooLarge, carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000 | surrogate,
+      carry | tooLarge | tooLarge1000, carry | tooLarge | tooLarge1000));
+  const __m256i secondHigh = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+      tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+      tooShort,
+      tooLong | overlong2 | twoContinues | overlong3 | tooLarge1000 |
+          overlong4,
+      tooLong | overlong2 | twoContinues | overlong3 | tooLarge,
+      tooLong | overlong2 | twoContinues | surrogate | tooLarge,
+      tooLong | overlong2 | twoContinues | surrogate | tooLarge, tooShort,
+      tooShort, tooShort, tooShort));
+  // a lead byte in the last three places needs bytes from the next block
+  const __m256i lastLeads = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, char(0xF0 - 1),
+      char(0xE0 - 1), char(0xC0 - 1));
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i previous = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  size_t offset = 0;
+
+  for (; size - offset >= 32; offset += 32) {
+    const __m256i input =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(utf8 + offset));
+
+    if (_mm256_movemask_epi8(input) == 0) { // ASCII
+      if (!_mm256_testz_si256(incomplete, incomplete)) {
+        break;
+      }
+      previous = input;
+      continue;
+    }
+
+    const __m256i before = _mm256_permute2x128_si256(previous, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, before, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(input, before, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, before, 13);
+    const __m256i special = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(
+                firstHigh,
+                _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+            _mm256_shuffle_epi8(firstLow, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(
+            secondHigh, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    const __m256i mustContinue = _mm256_and_si256(
+        _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+                        _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80))),
+        _mm256_set1_epi8(char(0x80)));
+    const __m256i error = _mm256_xor_si256(mustContinue, special);
+
+    if (!_mm256_testz_si256(error, error)) {
+      break;
+    }
+    previous = input;
+    incomplete = _mm256_subs_epu8(input, lastLeads);
+  }
+  return offset;
+}
+
+/// Widen ASCII to 16 or 32 bit code units, returns the number of bytes done
+__attribute__((target("avx2"))) inline size_t
+_widenAVX2(const uint8_t *utf8, size_t size, void *units, size_t unitSize) {
+  size_t done = 0;
+
+  for (; size - done >= 16; done += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(utf8 + done));
+
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+    if (2 == unitSize) {
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i *>(reinterpret_cast<uint16_t *>(units) +
+                                      done),
+          _mm256_cvtepu8_epi16(bytes));
+    } else {
+      __m256i *const out = reinterpret_cast<__m256i *>(
+          reinterpret_cast<uint32_t *>(units) + done);
+
+      _mm256_storeu_si256(out, _mm256_cvtepu8_epi32(bytes));
+      _mm256_storeu_si256(out + 1,
+                          _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+    }
+  }
+  return done;
+}
+
+/// Narrow ASCII 16 or 32 bit code units, returns the number of units done
+__attribute__((target("avx2"))) inline size_t
+_narrowAVX2(const void *units, size_t size, char *utf8, size_t unitSize) {
+  size_t done = 0;
+
+  for (; size - done >= 16; done += 16) {
+    __m128i bytes;
+
+    if (2 == unitSize) {
+      const __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+          reinterpret_cast<const uint16_t *>(units) + done));
+
+      if (!_mm256_testz_si256(in, _mm256_set1_epi16(int16_t(0xFF80)))) {
+        break;
+      }
+      bytes = _mm_packus_epi16(_mm256_castsi256_si128(in),
+                               _mm256_extracti128_si256(in, 1));
+    } else {
+      const __m256i *const in = reinterpret_cast<const __m256i *>(
+          reinterpret_cast<const uint32_t *>(units) + done);
+      const __m256i first = _mm256_loadu_si256(in);
+      const __m256i second = _mm256_loadu_si256(in + 1);
+
+      if (!_mm256_testz_si256(_mm256_or_si256(first, second),
+                              _mm256_set1_epi32(int32_t(0xFFFFFF80)))) {
+        break;
+      }
+      // pack works within each 128 bit lane, so put the halves back in order
+      const __m256i shorts = _mm256_permute4x64_epi64(
+          _mm256_packus_epi32(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+
+      bytes = _mm_packus_epi16(_mm256_castsi256_si128(shorts),
+                               _mm256_extracti128_si256(shorts, 1));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(utf8 + done), bytes);
+  }
+  return done;
+}
+#endif
+
+inline size_t validate(const char *utf8, size_t size) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(utf8);
+  size_t offset = 0;
+
+#if __UTF8_x86__
+  if (_avx2()) {
+    offset = _validateAVX2(bytes, size);
+    // back up to the start of the sequence that may continue past offset
+    for (size_t back = 0;
+         (offset > 0) && (back < 3) && ((bytes[offset - 1] & 0xC0) == 0x80);
+         ++back) {
+      --offset;
+    }
+    if ((offset > 0) && (bytes[offset - 1] >= 0xC0)) {
+      --offset;
+    }
+  }
+#endif
+  return _validatePortable(bytes, offset, size);
+}
+
+/** Decode UTF-8 into 16 or 32 bit code units.
+        @tparam Unit char16_t, char32_t or wchar_t
+*/
+template <class Unit>
+inline Unit *_toUnits(const char *utf8, size_t size, Unit *units) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(utf8);
+  size_t offset = 0;
+
+  while (offset < size) {
+    size_t stop;
+
+#if __UTF8_x86__
+    if ((bytes[offset] < 0x80) && _avx2()) {
+      const size_t done =
+          _widenAVX2(bytes + offset, size - offset, units, sizeof(Unit));
+
+      offset += done;
+      units += done;
+    }
+#endif
+    stop = size - offset > 16 ? offset + 16 : size;
+    while (offset < stop) {
+      uint32_t codePoint;
+      const size_t length = _decode(bytes + offset, size - offset, codePoint);
+
+      if (0 == length) {
+        throw Invalid(offset, __FILE__, __LINE__);
+      }
+      if ((sizeof(Unit) == 2) && (codePoint >= 0x10000)) {
+        codePoint -= 0x10000;
+        *units++ = static_cast<Unit>(0xD800 | (codePoint >> 10));
+        *units++ = static_cast<Unit>(0xDC00 | (codePoint & 0x3FF));
+      } else {
+        *units++ = static_cast<Unit>(codePoint);
+      }
+      offset += length;
+    }
+  }
+  return units;
+}
+
+/** Encode 16 or 32 bit code units as UTF-8.
+        @tparam Unit char16_t, char32_t or wchar_t
+*/
+template <class Unit>
+inline char *_fromUnits(const Unit *units, size_t size, char *utf8) {
+  size_t offset = 0;
+
+  while (offset < size) {
+    size_t stop;
+
+#if __UTF8_x86__
+    if ((static_cast<uint32_t>(units[offset]) < 0x80) && _avx2()) {
+      const size_t done =
+          _narrowAVX2(units + offset, size - offset, utf8, sizeof(Unit));
+
+      offset += done;
+      utf8 += done;
+    }
+#endif
+    stop = size - offset > 16 ? offset + 16 : size;
+    while (offset < stop) {
+      uint32_t codePoint = static_cast<uint32_t>(units[offset]);
+
+      if (sizeof(Unit) == 2) {
+        codePoint &= 0xFFFF;
+        if ((codePoint >= 0xD800) && (codePoint < 0xDC00) &&
+            (offset + 1 < size) &&
+            ((static_cast<uint32_t>(units[offset + 1]) & 0xFC00) == 0xDC00)) {
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                      ((static_cast<uint32_t>(units[offset + 1]) & 0xFFFF) -
+                       0xDC00);
+          ++offset;
+        }
+      }
+      if (((codePoint >= 0xD800) && (codePoint < 0xE000)) ||
+          (codePoint > 0x10FFFF)) {
+        throw Invalid(offset, __FILE__, __LINE__);
+      }
+      utf8 = _encode(codePoint, utf8);
+      ++offset;
+    }
+  }
+  return utf8;
+}
+
+inline char16_t *toUTF16(const char *utf8, size_t size, char16_t *utf16) {
+  return _toUnits(utf8, size, utf16);
+}
+inline char32_t *toUTF32(const char *utf8, size_t size, char32_t *utf32) {
+  return _toUnits(utf8, size, utf32);
+}
+inline wchar_t *toWide(const char *utf8, size_t size, wchar_t *wide) {
+  return _toUnits(utf8, size, wide);
+}
+inline char *toUTF8(const char16_t *utf16, size_t size, char *utf8) {
+  return _fromUnits(utf16, size, utf8);
+}
+inline char *toUTF8(const char32_t *utf32, size_t size, char *utf8) {
+  return _fromUnits(utf32, size, utf8);
+}
+inline char *toUTF8(const wchar_t *wide, size_t size, char *utf8) {
+  return _fromUnits(wide, size, utf8);
+}
+
+} // namespace utf8
+
+} // namespace text
+
+#undef __UTF8_x86__
+
+#endif // __UTF8_h__
@@ -0,0 +1,635 @@
+#ifndef __ZCodecs_h__
+#define __ZCodecs_h__
+
+/** @file ZCodecs.h
+        LZ4 and Zstandard codecs for z::Codec, loaded at runtime.
+        Including this header anywhere in a program lets Codec::get(),
+   Codec::find() and z::uncompress() use them.
+*/
+
+#include "Library.h"
+#include "ZCompression.h"
+#include <mutex>
+#include <vector>
+
+namespace z {
+
+/// The first library in a NULL terminated list that can be loaded
+inline const char *_loadable(const char *const *names) {
+  for (; NULL != names[1]; ++names) {
+    try {
+      sys::Library library(names[0]);
+
+      return names[0];
+    } catch (const std::exception &) {
+      // try the next one
+    }
+  }
+  return names[0]; // the last one, to throw the error
+}
+
+/** LZ4 frames, loaded from liblz4 at runtime.
+        Frames have the content size and a checksum of the content, and can be
+   read with the lz4 command.
+*/
+class LZ4Codec : public Codec {
+public:
+  /// @throws sys::Library::Exception if liblz4 cannot be loaded
+  LZ4Codec();
+  Type type() const override { return LZ4; }
+  const char *name() const override { return "lz4"; }
+  /// Negative are faster, 0 = default, 3 to 12 are slower and smaller
+  int defaultLevel() const override { return 0; }
+  size_t maxCompressedSize(size_t sourceSize) const override;
+  size_t maxUncompressedSize(size_t compressedSize) const override;
+  size_t compress(const void *source, size_t sourceSize, void *destination,
+                  size_t destinationSize, int level) const override;
+  size_t uncompress(const void *source, size_t sourceSize, void *destination,
+                    size_t destinationSize) const override;
+  Compressor *compressor(int level) const override;
+  Decompressor *decompressor() const override;
+
+private:
+  enum {
+    Version = 100,        ///< LZ4F_VERSION
+    MostHeader = 19,      ///< LZ4F_HEADER_SIZE_MAX
+    ContentChecksum = 1,  ///< LZ4F_contentChecksumEnabled
+    LevelInvalid = 5,     ///< LZ4F_ERROR_compressionLevel_invalid
+    AllocationFailed = 9, ///< LZ4F_ERROR_allocation_failed
+    TooSmall = 11         ///< LZ4F_ERROR_dstMaxSize_tooSmall
+  };
+  /// LZ4F_preferences_t, as lz4frame.h lays it out
+  struct _Preferences {
+    int blockSize;                 ///< maximum block size, 0 = default
+    int blockMode;                 ///< linked or independent blocks
+    int contentChecksum;           ///< add a checksum of the content
+    int frameType;                 ///< frame or skippable frame
+    unsigned long long size;       ///< content size, 0 = unknown
+    unsigned dictionaryID;         ///< dictionary used, 0 = none
+    int blockChecksum;             ///< add a checksum to each block
+    int level;                     ///< compression level
+    unsigned autoFlush;            ///< do not buffer between updates
+    unsigned favorDecompressSpeed; ///< for high levels
+    unsigned reserved[3];          ///< must be zero
+  };
+  typedef unsigned (*_IsError)(size_t);
+  typedef size_t (*_CompressFrameBound)(size_t, const _Preferences *);
+  typedef size_t (*_CompressFrame)(void *, size_t, const void *, size_t,
+                                   const _Preferences *);
+  typedef size_t (*_CreateContext)(void **, unsigned);
+  typedef size_t (*_FreeContext)(void *);
+  typedef size_t (*_CompressBegin)(void *, void *, size_t,
+                                   const _Preferences *);
+  typedef size_t (*_CompressBound)(size_t, const _Preferences *);
+  typedef size_t (*_CompressUpdate)(void *, void *, size_t, const void *,
+                                    size_t, const void *);
+  typedef size_t (*_CompressEnd)(void *, void *, size_t, const void *);
+  typedef size_t (*_Decompress)(void *, void *, size_t *, const void *,
+                                size_t *, const void *);
+  typedef void (*_ResetContext)(void *);
+  class _Compressor;
+  class _Decompressor;
+  sys::Library _library;                   ///< liblz4
+  _IsError _isError;                       ///< LZ4F_isError
+  _CompressFrameBound _compressFrameBound; ///< LZ4F_compressFrameBound
+  _CompressFrame _compressFrame;           ///< LZ4F_compressFrame
+  _CreateContext _createCompressor;        ///< LZ4F_createCompressionContext
+  _FreeContext _freeCompressor;            ///< LZ4F_freeCompressionContext
+  _CompressBegin _compressBegin;           ///< LZ4F_compressBegin
+  _CompressBound _compressBound;           ///< LZ4F_compressBound
+  _CompressUpdate _compressUpdate;         ///< LZ4F_compressUpdate
+  _CompressEnd _compressEnd;               ///< LZ4F_compressEnd
+  _CreateContext _createDecompressor;      ///< LZ4F_createDecompressionContext
+  _FreeContext _freeDecompressor;          ///< LZ4F_freeDecompressionContext
+  _Decompress _decompress;                 ///< LZ4F_decompress
+  _ResetContext _resetDecompressor;        ///< LZ4F_resetDecompressionContext
+
+  /// The name of liblz4 to load
+  static const char *_path();
+  /// The frame settings for a level and content size
+  static _Preferences _preferences(int level, size_t size);
+  /// Throw a z::Exception if an LZ4F function returned an error
+  size_t _check(size_t result) const;
+  LZ4Codec(const LZ4Codec &);            ///< Prevent usage
+  LZ4Codec &operator=(const LZ4Codec &); ///< Prevent usage
+};
+
+/** Zstandard frames, loaded from libzstd at runtime.
+        Frames have the content size and a checksum of the content, and can be
+   read with the zstd command. compress() reuses contexts left by earlier
+   calls, so there is one for each thread compressing at once.
+*/
+class ZstdCodec : public Codec {
+public:
+  /// @throws sys::Library::Exception if libzstd cannot be loaded
+  ZstdCodec();
+  /// Free the contexts kept for compress()
+  ~ZstdCodec() override;
+  Type type() const override { return Zstd; }
+  const char *name() const override { return "zstd"; }
+  /// Negative are faster, 1 to 19 (22) are slower and smaller, default = 3
+  int defaultLevel() const override { return 3; }
+  size_t maxCompressedSize(size_t sourceSize) const override;
+  size_t maxUncompressedSize(size_t compressedSize) const override;
+  /// Frames from compress() record their size, streamed frames may not
+  bool contentSize(const void *compressed, size_t compressedSize,
+                   size_t &size) const override;
+  size_t compress(const void *source, size_t sourceSize, void *destination,
+                  size_t destinationSize, int level) const override;
+  size_t uncompress(const void *source, size_t sourceSize, void *destination,
+                    size_t destinationSize) const override;
+  Compressor *compressor(int level) const override;
+  Decompressor *decompressor() const override;
+
+private:
+  enum {
+    CompressionLevel = 100, ///< ZSTD_c_compressionLevel
+    ChecksumFlag = 201,     ///< ZSTD_c_checksumFlag
+    Continue = 0,           ///< ZSTD_e_continue
+    End = 2,                ///< ZSTD_e_end
+    SessionOnly = 1,        ///< ZSTD_reset_session_only
+    HeldBack = 128 * 1024,  ///< ZSTD_BLOCKSIZE_MAX, the most held back
+    ParameterFirst = 40,    ///< ZSTD_error_parameter_unsupported
+    ParameterLast = 42,     ///< ZSTD_error_parameter_outOfBound
+    MemoryAllocation = 64,  ///< ZSTD_error_memory_allocation
+    TooSmall = 70           ///< ZSTD_error_dstSize_tooSmall
+  };
+  /// ZSTD_inBuffer and ZSTD_outBuffer
+  struct _Buffer {
+    const void *data; ///< The start of the buffer
+    size_t size;      ///< The bytes in the buffer
+    size_t position;  ///< The bytes used so far
+  };
+  typedef unsigned (*_IsError)(size_t);
+  typedef int (*_GetErrorCode)(size_t);
+  typedef size_t (*_CompressBound)(size_t);
+  typedef void *(*_CreateContext)();
+  typedef size_t (*_FreeContext)(void *);
+  typedef size_t (*_SetParameter)(void *, int, int);
+  typedef size_t (*_Compress2)(void *, void *, size_t, const void *, size_t);
+  typedef size_t (*_Decompress)(void *, size_t, const void *, size_t);
+  typedef unsigned long long (*_GetFrameContentSize)(const void *, size_t);
+  typedef size_t (*_CompressStream2)(void *, _Buffer *, _Buffer *, int);
+  typedef size_t (*_DecompressStream)(void *, _Buffer *, _Buffer *);
+  typedef size_t (*_Reset)(void *, int);
+  class _Compressor;
+  class _Decompressor;
+  sys::Library _library;               ///< libzstd
+  _IsError _isError;                   ///< ZSTD_isError
+  _GetErrorCode _getErrorCode;         ///< ZSTD_getErrorCode
+  _CompressBound _compressBound;       ///< ZSTD_compressBound
+  _CreateContext _createCompressor;    ///< ZSTD_createCCtx
+  _FreeContext _freeCompressor;        ///< ZSTD_freeCCtx
+  _SetParameter _setParameter;         ///< ZSTD_CCtx_setParameter
+  _Compress2 _compress2;               ///< ZSTD_compress2
+  _Decompress _decompress;             ///< ZSTD_decompress
+  _GetFrameContentSize _contentSize;   ///< ZSTD_getFrameContentSize
+  _CompressStream2 _compressStream2;   ///< ZSTD_compressStream2
+  _CreateContext _createDecompressor;  ///< ZSTD_createDCtx
+  _FreeContext _freeDecompressor;      ///< ZSTD_freeDCtx
+  _DecompressStream _decompressStream; ///< ZSTD_decompressStream
+  _Reset _resetDecompressor;           ///< ZSTD_DCtx_reset
+  mutable std::mutex _idleLock;        ///< Guards _idle
+  mutable std::vector<void *> _idle;   ///< ZSTD_CCtx not in use by compress()
+
+  /// The name of libzstd to load
+  static const char *_path();
+  /// A compression context set up for level, freed by the caller
+  void *_compressor(int level) const;
+  /// An idle context from _idle or a new one, set up for level
+  void *_reuse(int level) const;
+  /// Keep a context for the next compress()
+  void _release(void *context) const;
+  /// Throw a z::Exception if a ZSTD function returned an error
+  size_t _check(size_t result) const;
+  ZstdCodec(const ZstdCodec &);            ///< Prevent usage
+  ZstdCodec &operator=(const ZstdCodec &); ///< Prevent usage
+};
+
+/// The codecs this header adds, for Codec::get()
+inline const Codec &_codec(Codec::Type type) {
+  switch (type) {
+  case Codec::LZ4: {
+    static const LZ4Codec codec;
+
+    return codec;
+  }
+  case Codec::Zstd: {
+    static const ZstdCodec codec;
+
+    return codec;
+  }
+  default:
+    return Codec::get(type);
+  }
+}
+
+/// Installed before main(), in every program that includes this header
+static const bool _codecsInstalled = Codec::install(_codec);
+
+/// An LZ4F compression context
+class LZ4Codec::_Compressor : public Compressor {
+public:
+  _Compressor(const LZ4Codec &codec, int level)
+      : _codec(codec), _preferences(LZ4Codec::_preferences(level, 0)),
+        _context(NULL), _started(false) {
+    _codec._check(_codec._createCompressor(&_context, Version));
+  }
+  ~_Compressor() override { _codec._freeCompressor(_context); }
+  size_t maximumOutput(size_t size) const override {
+    return _codec._compressBound(size, &_preferences) + MostHeader;
+  }
+  uint8_t *update(const void *data, size_t size, void *compressed) override {
+    uint8_t *out = _begin(reinterpret_cast<uint8_t *>(compressed));
+
+    return out + _codec._check(_codec._compressUpdate(
+                     _context, out, maximumOutput(size), data, size, NULL));
+  }
+  uint8_t *finish(void *compressed) override {
+    uint8_t *out = _begin(reinterpret_cast<uint8_t *>(compressed));
+
+    _started = false;
+    return out + _codec._check(_codec._compressEnd(_context, out,
+                                                   maximumOutput(0), NULL));
+  }
+
+private:
+  const LZ4Codec &_codec;    ///< The library functions
+  _Preferences _preferences; ///< The frame settings
+  void *_context;            ///< The LZ4F_cctx
+  bool _started;             ///< Has the frame header been written
+
+  /// Write the frame header, if it has not been written yet
+  uint8_t *_begin(uint8_t *compressed) {
+    if (_started) {
+      return compressed;
+    }
+    _started = true;
+    return compressed + _codec._check(_codec._compressBegin(
+                            _context, compressed, MostHeader, &_preferences));
+  }
+  _Compressor(const _Compressor &);            ///< Prevent usage
+  _Compressor &operator=(const _Compressor &); ///< Prevent usage
+};
+
+/// An LZ4F decompression context
+class LZ4Codec::_Decompressor : public Decompressor {
+public:
+  explicit _Decompressor(const LZ4Codec &codec)
+      : _codec(codec), _context(NULL), _finished(false) {
+    _codec._check(_codec._createDecompressor(&_context, Version));
+  }
+  ~_Decompressor() override { _codec._freeDecompressor(_context); }
+  uint8_t *update(const void *&compressed, size_t &size, void *data,
+                  size_t available) override {
+    size_t used = size;
+
+    if (_finished) {
+      return reinterpret_cast<uint8_t *>(data);
+    }
+    _finished = 0 == _codec._check(_codec._decompress(
+                         _context, data, &available, compressed, &used, NULL));
+    compressed = reinterpret_cast<const uint8_t *>(compressed) + used;
+    size -= used;
+    return reinterpret_cast<uint8_t *>(data) + available;
+  }
+  bool finished() const override { return _finished; }
+  void finish() override {
+    if (!_finished) {
+      ThrowMessageException("Compressed stream ended early");
+    }
+    _codec._resetDecompressor(_context);
+    _finished = false;
+  }
+
+private:
+  const LZ4Codec &_codec; ///< The library functions
+  void *_context;         ///< The LZ4F_dctx
+  bool _finished;         ///< Has the end of the frame been reached
+
+  _Decompressor(const _Decompressor &);            ///< Prevent usage
+  _Decompressor &operator=(const _Decompressor &); ///< Prevent usage
+};
+
+inline LZ4Codec::LZ4Codec()
+    : _library(_path()), _isError(NULL), _compressFrameBound(NULL),
+      _compressFrame(NULL), _createCompressor(NULL), _freeCompressor(NULL),
+      _compressBegin(NULL), _compressBound(NULL), _compressUpdate(NULL),
+      _compressEnd(NULL), _createDecompressor(NULL), _freeDecompressor(NULL),
+      _decompress(NULL), _resetDecompressor(NULL) {
+  _isError = _library.function<_IsError>("LZ4F_isError");
+  _compressFrameBound =
+      _library.function<_CompressFrameBound>("LZ4F_compressFrameBound");
+  _compressFrame = _library.function<_CompressFrame>("LZ4F_compressFrame");
+  _createCompressor =
+      _library.function<_CreateContext>("LZ4F_createCompressionContext");
+  _freeCompressor =
+      _library.function<_FreeContext>("LZ4F_freeCompressionContext");
+  _compressBegin = _library.function<_CompressBegin>("LZ4F_compressBegin");
+  _compressBound = _library.function<_CompressBound>("LZ4F_compressBound");
+  _compressUpdate = _library.function<_CompressUpdate>("LZ4F_compressUpdate");
+  _compressEnd = _library.function<_CompressEnd>("LZ4F_compressEnd");
+  _createDecompressor =
+      _library.function<_CreateContext>("LZ4F_createDecompressionContext");
+  _freeDecompressor =
+      _library.function<_FreeContext>("LZ4F_freeDecompressionContext");
+  _decompress = _library.function<_Decompress>("LZ4F_decompress");
+  _resetDecompressor =
+      _library.function<_ResetContext>("LZ4F_resetDecompressionContext");
+}
+inline size_t LZ4Codec::maxCompressedSize(size_t sourceSize) const {
+  const _Preferences preferences = _preferences(defaultLevel(), sourceSize);
+
+  return _compressFrameBound(sourceSize, &preferences);
+}
+/// Each byte after a match can add at most 255 to its length
+inline size_t LZ4Codec::maxUncompressedSize(size_t compressedSize) const {
+  return _expanded(compressedSize, 255);
+}
+inline size_t LZ4Codec::compress(const void *source, size_t sourceSize,
+                                 void *destination, size_t destinationSize,
+                                 int level) const {
+  const _Preferences preferences = _preferences(level, sourceSize);
+
+  AssertMessageException(destinationSize >= maxCompressedSize(sourceSize));
+  return _check(_compressFrame(destination, destinationSize, source,
+                               sourceSize, &preferences));
+}
+inline size_t LZ4Codec::uncompress(const void *source, size_t sourceSize,
+                                   void *destination,
+                                   size_t destinationSize) const {
+  _Decompressor decompressor(*this);
+  uint8_t *const start = reinterpret_cast<uint8_t *>(destination);
+  uint8_t *const end =
+      decompressor.update(source, sourceSize, destination, destinationSize);
+
+  if (!decompressor.finished()) {
+    // with source left over the destination filled up, otherwise the frame
+    // is truncated or corrupt and a bigger destination will not help
+    const bool full = static_cast<size_t>(end - start) == destinationSize;
+
+    throw Exception(full && (sourceSize > 0) ? Z_BUF_ERROR : Z_DATA_ERROR,
+                    __FILE__, __LINE__);
+  }
+  return end - start;
+}
+inline Compressor *LZ4Codec::compressor(int level) const {
+  return new _Compressor(*this, level);
+}
+inline Decompressor *LZ4Codec::decompressor() const {
+  return new _Decompressor(*this);
+}
+inline const char *LZ4Codec::_path() {
+  static const char *const names[] = {"lz4", "liblz4.so.1", "liblz4.1.dylib",
+                                      NULL};
+
+  return _loadable(names);
+}
+inline LZ4Codec::_Preferences LZ4Codec::_preferences(int level, size_t size) {
+  _Preferences preferences = _Preferences();
+
+  preferences.contentChecksum = ContentChecksum;
+  preferences.size = size;
+  preferences.level = level;
+  return preferences;
+}
+inline size_t LZ4Codec::_check(size_t result) const {
+  if (_isError(result)) {
+    const size_t error = 0 - result;
+
+    throw Exception(TooSmall == error           ? Z_BUF_ERROR
+                    : AllocationFailed == error ? Z_MEM_ERROR
+                    : LevelInvalid == error     ? Z_STREAM_ERROR
+                                                : Z_DATA_ERROR,
+                    __FILE__, __LINE__);
+  }
+  return result;
+}
+
+/// A ZSTD_CCtx
+class ZstdCodec::_Compressor : public Compressor {
+public:
+  _Compressor(const ZstdCodec &codec, int level)
+      : _codec(codec), _context(codec._compressor(level)) {}
+  ~_Compressor() override { _codec._freeCompressor(_context); }
+  size_t maximumOutput(size_t size) const override {
+    return _codec._compressBound(size + HeldBack);
+  }
+  uint8_t *update(const void *data, size_t size, void *compressed) override {
+    return _compress(data, size, compressed, Continue);
+  }
+  uint8_t *finish(void *compressed) override {
+    return _compress("", 0, compressed, End);
+  }
+
+private:
+  const ZstdCodec &_codec; ///< The library functions
+  void *_context;          ///< The ZSTD_CCtx
+
+  /// Compress all of data, and if ending, the end of the frame
+  uint8_t *_compress(const void *data, size_t size, void *compressed,
+                     int directive) {
+    _Buffer in = {data, size, 0};
+    _Buffer out = {compressed, maximumOutput(size), 0};
+    size_t left;
+
+    do {
+      left = _codec._check(
+          _codec._compressStream2(_context, &out, &in, directive));
+      AssertMessageException(out.position < out.size);
+    } while ((in.position < in.size) || ((End == directive) && (left > 0)));
+    return reinterpret_cast<uint8_t *>(compressed) + out.position;
+  }
+  _Compressor(const _Compressor &);            ///< Prevent usage
+  _Compressor &operator=(const _Compressor &); ///< Prevent usage
+};
+
+/// A ZSTD_DCtx
+class ZstdCodec::_Decompressor : public Decompressor {
+public:
+  explicit _Decompressor(const ZstdCodec &codec)
+      : _codec(codec), _context(codec._createDecompressor()),
+        _finished(false) {
+    if (NULL == _context) {
+      throw Exception(Z_MEM_ERROR, __FILE__, __LINE__);
+    }
+  }
+  ~_Decompressor() override { _codec._freeDecompressor(_context); }
+  uint8_t *update(const void *&compressed, size_t &size, void *data,
+                  size_t available) override {
+    _Buffer in = {compressed, size, 0};
+    _Buffer out = {data, available, 0};
+
+    if (_finished) {
+      return reinterpret_cast<uint8_t *>(data);
+    }
+    _finished = 0 == _codec._check(
+                         _codec._decompressStream(_context, &out, &in));
+    compressed = reinterpret_cast<const uint8_t *>(compressed) + in.position;
+    size -= in.position;
+    return reinterpret_cast<uint8_t *>(data) + out.position;
+  }
+  bool finished() const override { return _finished; }
+  void finish() override {
+    if (!_finished) {
+      ThrowMessageException("Compressed stream ended early");
+    }
+    _codec._check(_codec._resetDecompressor(_context, SessionOnly));
+    _finished = false;
+  }
+
+private:
+  const ZstdCodec &_codec; ///< The library functions
+  void *_context;          ///< The ZSTD_DCtx
+  bool _finished;          ///< Has the end of the frame been reached
+
+  _Decompressor(const _Decompressor &);            ///< Prevent usage
+  _Decompressor &operator=(const _Decompressor &); ///< Prevent usage
+};
+
+inline ZstdCodec::ZstdCodec()
+    : _library(_path()), _isError(NULL), _getErrorCode(NULL),
+      _compressBound(NULL), _createCompressor(NULL), _freeCompressor(NULL),
+      _setParameter(NULL), _compress2(NULL), _decompress(NULL),
+      _contentSize(NULL), _compressStream2(NULL), _createDecompressor(NULL),
+      _freeDecompressor(NULL), _decompressStream(NULL),
+      _resetDecompressor(NULL), _idleLock(), _idle() {
+  _isError = _library.function<_IsError>("ZSTD_isError");
+  _getErrorCode = _library.function<_GetErrorCode>("ZSTD_getErrorCode");
+  _compressBound = _library.function<_CompressBound>("ZSTD_compressBound");
+  _createCompressor = _library.function<_CreateContext>("ZSTD_createCCtx");
+  _freeCompressor = _library.function<_FreeContext>("ZSTD_freeCCtx");
+  _setParameter = _library.function<_SetParameter>("ZSTD_CCtx_setParameter");
+  _compress2 = _library.function<_Compress2>("ZSTD_compress2");
+  _decompress = _library.function<_Decompress>("ZSTD_decompress");
+  _contentSize =
+      _library.function<_GetFrameContentSize>("ZSTD_getFrameContentSize");
+  _compressStream2 =
+      _library.function<_CompressStream2>("ZSTD_compressStream2");
+  _createDecompressor = _library.function<_CreateContext>("ZSTD_createDCtx");
+  _freeDecompressor = _library.function<_FreeContext>("ZSTD_freeDCtx");
+  _decompressStream =
+      _library.function<_DecompressStream>("ZSTD_decompressStream");
+  _resetDecompressor = _library.function<_Reset>("ZSTD_DCtx_reset");
+}
+inline ZstdCodec::~ZstdCodec() {
+  for (void *context : _idle) {
+    _freeCompressor(context);
+  }
+}
+inline size_t ZstdCodec::maxCompressedSize(size_t sourceSize) const {
+  return _compressBound(sourceSize);
+}
+/// An RLE block is 4 bytes for up to HeldBack bytes
+inline size_t ZstdCodec::maxUncompressedSize(size_t compressedSize) const {
+  return _expanded(compressedSize, HeldBack / 4);
+}
+/// ZSTD_CONTENTSIZE_UNKNOWN and ZSTD_CONTENTSIZE_ERROR are the largest values
+inline bool ZstdCodec::contentSize(const void *compressed,
+                                   size_t compressedSize, size_t &size) const {
+  const unsigned long long recorded = _contentSize(compressed, compressedSize);
+
+  if ((recorded >= 0ULL - 2) ||
+      (recorded > std::numeric_limits<size_t>::max())) {
+    throw Exception(Z_DATA_ERROR, __FILE__, __LINE__);
+  }
+  size = static_cast<size_t>(recorded);
+  return true;
+}
+inline size_t ZstdCodec::compress(const void *source, size_t sourceSize,
+                                  void *destination, size_t destinationSize,
+                                  int level) const {
+  AssertMessageException(destinationSize >= maxCompressedSize(sourceSize));
+
+  void *const context = _reuse(level);
+  // ZSTD_compress2 starts a new frame, the last one's session is dropped
+  const size_t result =
+      _compress2(context, destination, destinationSize, source, sourceSize);
+
+  if (_isError(result)) {
+    _freeCompressor(context);
+  } else {
+    _release(context);
+  }
+  return _check(result);
+}
+inline size_t ZstdCodec::uncompress(const void *source, size_t sourceSize,
+                                    void *destination,
+                                    size_t destinationSize) const {
+  return _check(_decompress(destination, destinationSize, source, sourceSize));
+}
+inline Compressor *ZstdCodec::compressor(int level) const {
+  return new _Compressor(*this, level);
+}
+inline Decompressor *ZstdCodec::decompressor() const {
+  return new _Decompressor(*this);
+}
+inline const char *ZstdCodec::_path() {
+  static const char *const names[] = {"zstd", "libzstd.so.1",
+                                      "libzstd.1.dylib", NULL};
+
+  return _loadable(names);
+}
+inline void *ZstdCodec::_compressor(int level) const {
+  void *const context = _createCompressor();
+
+  if (NULL == context) {
+    throw Exception(Z_MEM_ERROR, __FILE__, __LINE__);
+  }
+  try {
+    _check(_setParameter(context, CompressionLevel, level));
+    _check(_setParameter(context, ChecksumFlag, 1));
+  } catch (const std::exception &) {
+    _freeCompressor(context);
+    throw;
+  }
+  return context;
+}
+inline void *ZstdCodec::_reuse(int level) const {
+  void *context = NULL;
+
+  {
+    std::lock_guard<std::mutex> lock(_idleLock);
+
+    if (!_idle.empty()) {
+      context = _idle.back();
+      _idle.pop_back();
+    }
+  }
+  if (NULL == context) {
+    return _compressor(level);
+  }
+  try {
+    _check(_setParameter(context, CompressionLevel, level));
+  } catch (const std::exception &) {
+    _freeCompressor(context);
+    throw;
+  }
+  return context;
+}
+inline void ZstdCodec::_release(void *context) const {
+  std::lock_guard<std::mutex> lock(_idleLock);
+
+  try {
+    _idle.push_back(context);
+  } catch (const std::exception &) {
+    _freeCompressor(context);
+  }
+}
+inline size_t ZstdCodec::_check(size_t result) const {
+  if (_isError(result)) {
+    const int error = _getErrorCode(result);
+
+    throw Exception(TooSmall == error           ? Z_BUF_ERROR
+                    : MemoryAllocation == error ? Z_MEM_ERROR
+                    : (error >= ParameterFirst) && (error <= ParameterLast)
+                        ? Z_STREAM_ERROR
+                        : Z_DATA_ERROR,
+                    __FILE__, __LINE__);
+  }
+  return result;
+}
+
+}; // namespace z
+
+#endif // __ZCodecs_h__
@@ -2,6 +2,14 @@
 #define __ZCompression_h__
 
 #include "Exception.h"
+#include "File.h"
+#include <algorithm>
+#include <atomic>
+#include <limits.h>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
 #include <zlib.h>
 
 /** Handle standard zlib return codes and convert errors to exceptions.
@@ -87,6 +95,199 @@ inline const char *Exception::_codestring(int code) {
   return "";
 }
 
+/** Compresses a stream a piece at a time.
+        The interface Deflater and the Codec compressors share.
+*/
+class Compressor {
+public:
+  virtual ~Compressor() {}
+  /// The most bytes update(size) or finish() can write
+  virtual size_t maximumOutput(size_t size) const = 0;
+  /** Compress the next piece of the stream.
+        Some of the data may be held back until later pieces or finish().
+        @param data The next bytes to compress
+        @param size The number of bytes in data
+        @param compressed Receives up to maximumOutput(size) bytes
+        @return The byte after the last byte written
+  */
+  virtual uint8_t *update(const void *data, size_t size, void *compressed) = 0;
+  /** Write whatever is held back and the end of the stream.
+        The Compressor is then ready to compress a new stream.
+        @param compressed Receives up to maximumOutput(0) bytes
+        @return The byte after the last byte written
+  */
+  virtual uint8_t *finish(void *compressed) = 0;
+};
+
+/** Decompresses a stream a piece at a time.
+        The interface Inflater and the Codec decompressors share.
+*/
+class Decompressor {
+public:
+  virtual ~Decompressor() {}
+  /** Decompress as much of the next piece as fits.
+        @param compressed In: the next compressed bytes. Out: moved past the
+   bytes that were used
+        @param size In: the number of bytes at compressed. Out: the number of
+   bytes not used
+        @param data Receives the decompressed bytes
+        @param available The number of bytes that fit in data
+        @return The byte after the last byte written
+  */
+  virtual uint8_t *update(const void *&compressed, size_t &size, void *data,
+                          size_t available) = 0;
+  /// Has the end of the compressed stream been reached
+  virtual bool finished() const = 0;
+  /** Check that the whole stream was decompressed.
+        The Decompressor is then ready to decompress a new stream.
+        @throws msg::Exception if the end of the stream was not reached
+  */
+  virtual void finish() = 0;
+};
+
+/** A compression format, picked at runtime.
+        zlib is always available. LZ4 and Zstandard are much faster, especially
+   to decompress. Including ZCodecs.h anywhere in the program adds them, and
+   they are loaded with sys::Library when first used, so they are only needed
+   on machines that use them.
+        Each codec writes its own self-describing frame (zlib header, LZ4
+   frame, Zstandard frame), so find() can tell which codec wrote compressed
+   data, and uncompress() reads all of them.
+        Errors are thrown as z::Exception with the closest zlib code:
+   Z_BUF_ERROR if the destination is too small, Z_DATA_ERROR for corrupt data.
+*/
+class Codec {
+public:
+  /// The codecs
+  enum Type {
+    Zlib, ///< zlib (deflate), what compress() writes
+    LZ4,  ///< LZ4 frames, fastest
+    Zstd  ///< Zstandard frames, fast with a ratio better than zlib
+  };
+  virtual ~Codec() {}
+  /// Which codec this is
+  virtual Type type() const = 0;
+  /// The name of the codec, for logging
+  virtual const char *name() const = 0;
+  /// The level used when one is not given
+  virtual int defaultLevel() const = 0;
+  /** Gets the largest size a compressed source size can be.
+        @param sourceSize The size of the uncompressed data.
+        @return The maximum size of the compressed data.
+  */
+  virtual size_t maxCompressedSize(size_t sourceSize) const = 0;
+  /** Gets the largest size compressed data can uncompress to.
+        @param compressedSize The size of the compressed data.
+        @return The most bytes the codec can expand compressedSize bytes to.
+  */
+  virtual size_t maxUncompressedSize(size_t compressedSize) const = 0;
+  /** Gets the uncompressed size recorded in the frame header.
+        @param compressed The compressed data
+        @param compressedSize The number of bytes in compressed
+        @param size Receives the recorded size
+        @return false if the codec's frames do not record their size
+        @throws z::Exception Z_DATA_ERROR if the codec's frames record their
+   size, but this header is corrupt or does not have it
+  */
+  virtual bool contentSize(const void * /*compressed*/,
+                           size_t /*compressedSize*/, size_t & /*size*/) const {
+    return false;
+  }
+  /** Compresses data.
+        @param source Pointer to the data to compress
+        @param sourceSize The number of bytes to compress
+        @param destination The location to write the compressed data
+        @param destinationSize The maximum number of bytes that can be written
+   to destination, at least maxCompressedSize(sourceSize)
+        @param level The compression level, which depends on the codec
+        @return The number of bytes written to destination.
+        @throws z::Exception if there is a problem compressing
+  */
+  virtual size_t compress(const void *source, size_t sourceSize,
+                          void *destination, size_t destinationSize,
+                          int level) const = 0;
+  /** Uncompresses data.
+        @param source Pointer to the data to uncompress
+        @param sourceSize The number of bytes to uncompress
+        @param destination The location to write the uncompressed data
+        @param destinationSize The maximum number of bytes that can be written
+   to destination
+        @return The number of bytes written to destination.
+        @throws z::Exception if there is a problem uncompressing.
+                        If destinationSize is too small, the code in the
+   exception will be Z_BUF_ERROR
+  */
+  virtual size_t uncompress(const void *source, size_t sourceSize,
+                            void *destination,
+                            size_t destinationSize) const = 0;
+  /** Start compressing a stream.
+        @param level The compression level, which depends on the codec
+        @return A new Compressor, which the caller deletes
+  */
+  virtual Compressor *compressor(int level) const = 0;
+  /** Start decompressing a stream.
+        @return A new Decompressor, which the caller deletes
+  */
+  virtual Decompressor *decompressor() const = 0;
+  /** Compress data at the default level.
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @return a reference to destination
+  */
+  std::string &compress(const std::string &source,
+                        std::string &destination) const {
+    return compress(source, destination, defaultLevel());
+  }
+  /** Compress data.
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @param level The compression level, which depends on the codec
+        @return a reference to destination
+  */
+  std::string &compress(const std::string &source, std::string &destination,
+                        int level) const;
+  /** Uncompress data of any size.
+        @param source The compressed data
+        @param destination Will receive the uncompressed data
+        @return a reference to destination
+        @throws msg::Exception if source ends before the compressed stream
+        @throws z::Exception if the compressed data is corrupt
+  */
+  std::string &uncompress(const std::string &source,
+                          std::string &destination) const;
+  /** Can a codec be used on this machine.
+        @param type The codec
+        @return true if its library can be loaded
+  */
+  static bool available(Type type);
+  /** Get a codec.
+        @param type The codec
+        @return The codec, shared by all threads
+        @throws sys::Library::Exception if its library cannot be loaded
+        @throws msg::Exception if it is not zlib and ZCodecs.h was not included
+  */
+  static const Codec &get(Type type);
+  /** Find the codec that wrote compressed data from its header.
+        @param compressed The compressed data
+        @param size The number of bytes in compressed
+        @return The codec, or NULL if the data is not recognized
+        @throws sys::Library::Exception if its library cannot be loaded
+        @throws msg::Exception if it is not zlib and ZCodecs.h was not included
+  */
+  static const Codec *find(const void *compressed, size_t size);
+  /// Gets a codec other than zlib, throwing if it cannot be loaded
+  typedef const Codec &(*Loader)(Type type);
+  /** Let get() return codecs other than zlib. ZCodecs.h calls this.
+        @param loader Gets the codec for a type
+        @return true, so it can initialize a static
+  */
+  static bool install(Loader loader);
+
+private:
+  /// The loader install() was given, or NULL
+  static std::atomic<Loader> &_loader();
+};
+
 /** Gets the larges size a compressed source size can be.
         This can be used to preallocate buffers before compressing data.
         @param sourceSize The size of the uncompressed data.
@@ -152,7 +353,124 @@ inline std::string compress(const std::string &source, int level = 6) {
   return compress(source, buffer, level);
 }
 
+enum {
+  SizedMagic = 0xFA,   ///< The first byte of compressSized() data
+  MostSizedHeader = 15 ///< The magic, up to 10 size bytes and a crc32
+};
+
+/** Write a size the way compactNumber::write() in 2clean/CompactNumber.h does.
+        7 bits a byte, most significant first, with the high bit set on all
+   but the last byte. Each length starts where the shorter lengths end, so 0
+   to 127 is 1 byte, 128 to 16,511 is 2 bytes, and so on.
+        @param size The size to write
+        @param out Receives up to 10 bytes
+        @return The byte after the last byte written
+*/
+inline uint8_t *_writeSize(uint64_t size, uint8_t *out) {
+  uint64_t base = 0x80;
+  int bytes = 1;
+
+  for (; (bytes < 10) && (size >= base); ++bytes) {
+    size -= base;
+    base = uint64_t(0x80) << (7 * bytes);
+  }
+  for (int byte = bytes - 1; byte >= 0; --byte) {
+    *out++ = uint8_t(((size >> (7 * byte)) & 0x7F) | (byte > 0 ? 0x80 : 0));
+  }
+  return out;
+}
+
+/** Read a size written by _writeSize().
+        @param in In: the first byte of the size. Out: the byte after it
+        @param end No bytes are read from here on
+        @param size Receives the size
+        @return false if the size did not end before end or 10 bytes
+*/
+inline bool _readSize(const uint8_t *&in, const uint8_t *end, uint64_t &size) {
+  uint64_t base = 0;
+
+  size = 0;
+  for (int byte = 0; (in < end) && (byte < 10); ++byte) {
+    const uint8_t value = *in++;
+
+    size = size << 7 | (value & 0x7F);
+    if ((value & 0x80) == 0) {
+      size += base;
+      return true;
+    }
+    base += uint64_t(0x80) << (7 * byte);
+  }
+  return false;
+}
+
+/// crc32 of any number of bytes, zlib takes a uInt at a time
+inline uLong _crc32(uLong crc, const uint8_t *data, size_t size) {
+  while (size > 0) {
+    const size_t piece = std::min<size_t>(size, 1 << 30);
+
+    crc = ::crc32(crc, data, static_cast<uInt>(piece));
+    data += piece;
+    size -= piece;
+  }
+  return crc;
+}
+
+/// size * factor, or the largest size_t if that overflows
+inline size_t _expanded(size_t size, size_t factor) {
+  return size > std::numeric_limits<size_t>::max() / factor
+             ? std::numeric_limits<size_t>::max()
+             : size * factor;
+}
+
+/** Read the header compressSized() writes and check the compressed data.
+        @param source The data that may have been written by compressSized()
+        @param sourceSize The number of bytes in source
+        @param size Receives the uncompressed size
+        @return The compressed data after the header, or NULL if source does
+   not start with a compressSized() header
+        @throws z::Exception Z_DATA_ERROR if the header or checksum is wrong
+*/
+inline const uint8_t *_sized(const void *source, size_t sourceSize,
+                             size_t &size) {
+  const uint8_t *const start = reinterpret_cast<const uint8_t *>(source);
+  const uint8_t *const end = start + sourceSize;
+  const uint8_t *next = start + 1;
+  uint64_t recorded;
+  uLong crc = 0;
+
+  if ((sourceSize == 0) || (SizedMagic != start[0])) {
+    return NULL;
+  }
+  if (!_readSize(next, end, recorded) || (end - next < 4) ||
+      (recorded > std::numeric_limits<size_t>::max())) {
+    throw Exception(Z_DATA_ERROR, __FILE__, __LINE__);
+  }
+  for (int byte = 3; byte >= 0; --byte) {
+    crc = crc << 8 | next[byte];
+  }
+  if (_crc32(_crc32(::crc32(0, Z_NULL, 0), start + 1, next - start - 1),
+             next + 4, end - next - 4) != crc) {
+    throw Exception(Z_DATA_ERROR, __FILE__, __LINE__);
+  }
+  size = static_cast<size_t>(recorded);
+  return next + 4;
+}
+
+/** The uncompressed size of data from compressSized().
+        @param source The compressed data
+        @param sourceSize The number of bytes in source
+        @param size Receives the uncompressed size
+        @return false if source was not written by compressSized()
+        @throws z::Exception Z_DATA_ERROR if the header or checksum is wrong
+*/
+inline bool uncompressedSize(const void *source, size_t sourceSize,
+                             size_t &size) {
+  return NULL != _sized(source, sourceSize, size);
+}
+
 /** Uncompresses data.
+        Data from any Codec or compressSized() is uncompressed, found from its
+   header.
         @param source Pointer to the data to uncompress
         @param sourceSize The number of bytes to uncompress
         @param destination The location to write the uncompressed data
@@ -162,9 +480,33 @@ inline std::string compress(const std::string &source, int level = 6) {
         @throws zlib::Exception if there is a problem uncompressing.
                         If destinationSize is too small, the code in the
    exception will be Z_BUF_ERROR
+        @throws sys::Library::Exception if the codec cannot be loaded
 */
 inline size_t uncompress(const void *source, size_t sourceSize,
                          void *destination, size_t destinationSize) {
+  size_t size;
+  const uint8_t *const sized = _sized(source, sourceSize, size);
+
+  if (NULL != sized) {
+    const size_t compressedSize =
+        sourceSize - (sized - reinterpret_cast<const uint8_t *>(source));
+    const Codec *const payload = Codec::find(sized, compressedSize);
+
+    if (size > destinationSize) {
+      throw Exception(Z_BUF_ERROR, __FILE__, __LINE__);
+    }
+    if ((NULL == payload) || (payload->uncompress(sized, compressedSize,
+                                                  destination, size) != size)) {
+      throw Exception(Z_DATA_ERROR, __FILE__, __LINE__);
+    }
+    return size;
+  }
+
+  const Codec *const codec = Codec::find(source, sourceSize);
+
+  if ((NULL != codec) && (codec->type() != Codec::Zlib)) {
+    return codec->uncompress(source, sourceSize, destination, destinationSize);
+  }
   zlib_handle_error(
       ::uncompress(reinterpret_cast<Bytef *>(destination),
                    static_cast<uLong *>(&destinationSize),
@@ -174,19 +516,47 @@ inline size_t uncompress(const void *source, size_t sourceSize,
 }
 
 /** Uncompresses data.
-        @todo retry with bigger buffer
+        Data from compressSized() is uncompressed into exactly its size, and
+   maxDestination is not used. Otherwise use Inflater when the uncompressed
+   size is not known. destination is never grown past what the codec can
+   expand source to.
         @param source The compressed data
         @param destination Will receive the uncompressed data
         @param maxDestination the maximum number of bytes. default = 512k
         @return a reference to destination
         @throws zlib::Exception if there is a problem uncompressing.
                         If maxDestination is too small, the code in the
-   exception will be Z_BUF_ERROR
+   exception will be Z_BUF_ERROR. A compressSized() header with a size the
+   data cannot hold is Z_DATA_ERROR.
 */
 inline std::string &
 uncompress(const std::string &source, std::string &destination,
            std::string::size_type maxDestination = 512 * 1024) {
-  destination.assign(maxDestination, '\0');
+  const uint8_t *const start = reinterpret_cast<const uint8_t *>(source.data());
+  size_t size;
+  const uint8_t *const sized = _sized(start, source.size(), size);
+  const uint8_t *const payload = NULL == sized ? start : sized;
+  const size_t compressedSize = source.size() - (payload - start);
+  const Codec *const codec = Codec::find(payload, compressedSize);
+  const size_t most = NULL == codec
+                          ? std::numeric_limits<size_t>::max()
+                          : codec->maxUncompressedSize(compressedSize);
+
+  if (NULL != sized) {
+    size_t recorded;
+
+    // the header is only checked by a crc32, do not trust it for the
+    // allocation unless the frame records the same size
+    if ((NULL == codec) ||
+        (codec->contentSize(payload, compressedSize, recorded)
+             ? recorded != size
+             : size > most)) {
+      throw Exception(Z_DATA_ERROR, __FILE__, __LINE__);
+    }
+    maxDestination = size;
+  }
+  // resize() zeros every new byte, so keep it to what source can fill
+  destination.resize(std::min<size_t>(maxDestination, most));
 
   const size_t actualDestination =
       uncompress(source.data(), source.size(),
@@ -197,7 +567,8 @@ uncompress(const std::string &source, std::string &destination,
 }
 
 /** Uncompresses data.
-        @todo retry with bigger buffer
+        Data from compressSized() is uncompressed into exactly its size.
+   Otherwise use Inflater when the uncompressed size is not known.
         @param source The compressed data
         @param maxDestination the maximum number of bytes. default = 512k
         @return The uncompressed data.
@@ -218,6 +589,941 @@ inline std::string uncompress(const std::string &source,
   return results;
 }
 
+/** Gets the largest size compressSized() can write.
+        @param sourceSize The size of the uncompressed data.
+        @param codec The codec that compresses the data
+        @return The maximum size of the compressed data and its header.
+*/
+inline size_t maxSizedCompressedSize(size_t sourceSize, const Codec &codec) {
+  return MostSizedHeader + codec.maxCompressedSize(sourceSize);
+}
+
+/** Compresses data with its size and a checksum in front.
+        uncompress() then allocates exactly the uncompressed size, and rejects
+   corrupt data before uncompressing it. The header is the SizedMagic byte,
+   the uncompressed size in 1 to 10 bytes, and the crc32 of the size bytes and
+   the compressed data.
+        @param source Pointer to the data to compress
+        @param sourceSize The number of bytes to compress
+        @param destination The location to write the compressed data
+        @param destinationSize The maximum number of bytes that can be written
+   to destination, at least maxSizedCompressedSize(sourceSize, codec)
+        @param codec The codec that compresses the data
+        @param level The compression level, which depends on the codec
+        @return The number of bytes written to destination.
+        @throws z::Exception if there is a problem compressing
+*/
+inline size_t compressSized(const void *source, size_t sourceSize,
+                            void *destination, size_t destinationSize,
+                            const Codec &codec, int level) {
+  uint8_t *const start = reinterpret_cast<uint8_t *>(destination);
+  uint8_t *const sizeEnd = _writeSize(sourceSize, start + 1);
+  const size_t header = sizeEnd + 4 - start;
+
+  AssertMessageException(destinationSize >=
+                         maxSizedCompressedSize(sourceSize, codec));
+  start[0] = SizedMagic;
+
+  const size_t compressed = codec.compress(
+      source, sourceSize, sizeEnd + 4, destinationSize - header, level);
+  const uLong crc = _crc32(_crc32(::crc32(0, Z_NULL, 0), start + 1,
+                                  sizeEnd - start - 1),
+                           sizeEnd + 4, compressed);
+
+  for (int byte = 0; byte < 4; ++byte) {
+    sizeEnd[byte] = static_cast<uint8_t>(crc >> (8 * byte));
+  }
+  return header + compressed;
+}
+
+/** Compresses data with its size and a checksum in front.
+        See compressSized(const void*, size_t, void*, size_t, const Codec&,
+   int).
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @param codec The codec that compresses the data
+        @param level The compression level, which depends on the codec
+        @return a reference to destination
+        @throws z::Exception if there is a problem compressing
+*/
+inline std::string &compressSized(const std::string &source,
+                                  std::string &destination, const Codec &codec,
+                                  int level) {
+  destination.resize(maxSizedCompressedSize(source.size(), codec));
+  destination.resize(compressSized(source.data(), source.size(),
+                                   &destination[0], destination.size(), codec,
+                                   level));
+  return destination;
+}
+
+/** Compresses data with its size and a checksum in front.
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @param codec The codec that compresses the data, at its default level,
+   default = zlib
+        @return a reference to destination
+        @throws z::Exception if there is a problem compressing
+*/
+inline std::string &
+compressSized(const std::string &source, std::string &destination,
+              const Codec &codec = Codec::get(Codec::Zlib)) {
+  return compressSized(source, destination, codec, codec.defaultLevel());
+}
+
+/// The header and trailer around deflate data
+enum Framing {
+  ZlibFraming, ///< zlib header and adler32 trailer, as compress() writes
+  GzipFraming, ///< gzip header and crc32 trailer, as in .gz files
+  RawFraming,  ///< deflate data with no header or trailer
+  AutoFraming  ///< Inflater only: zlib or gzip, found from the header
+};
+
+enum {
+  _MostAtOnce = 1 << 30 ///< zlib counts bytes in a uInt, so pass at most this
+};
+
+/// The windowBits that deflateInit2() and inflateInit2() take for framing
+inline int _windowBits(Framing framing) {
+  switch (framing) {
+  case GzipFraming:
+    return MAX_WBITS + 16;
+  case RawFraming:
+    return -MAX_WBITS;
+  case AutoFraming:
+    return MAX_WBITS + 32;
+  default:
+    return MAX_WBITS;
+  }
+}
+
+/** Compresses a stream a piece at a time in constant memory.
+        Has the same maximumOutput(), update() and finish() as
+   text::Base64Encoder, so it can be used with text::Chain, text::update(),
+   text::finish() and text::transform().
+*/
+class Deflater : public Compressor {
+public:
+  /** Start a compressed stream.
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param framing The header and trailer to write, default is zlib
+        @throws z::Exception if level is not valid
+  */
+  explicit Deflater(int level = 6, Framing framing = ZlibFraming);
+  /// Releases the zlib stream
+  ~Deflater() override;
+  /// The most bytes update(size) or finish() can write
+  size_t maximumOutput(size_t size) const override;
+  /** Compress the next piece of the stream.
+        Some of the data may be held back until later pieces or finish().
+        @param data The next bytes to compress
+        @param size The number of bytes in data
+        @param compressed Receives up to maximumOutput(size) bytes
+        @return The byte after the last byte written
+        @throws z::Exception if there is a problem compressing
+  */
+  uint8_t *update(const void *data, size_t size, void *compressed) override;
+  /** Write whatever is held back and the trailer.
+        The Deflater is then ready to compress a new stream.
+        @param compressed Receives up to maximumOutput(0) bytes
+        @return The byte after the last byte written
+        @throws z::Exception if there is a problem compressing
+  */
+  uint8_t *finish(void *compressed) override;
+
+private:
+  enum {
+    /** More than the bytes deflate can hold back from earlier pieces:
+       a block of up to 16K symbols at up to 31 bits each, plus lookahead. */
+    HeldBack = 80 * 1024
+  };
+  z_stream _stream; ///< The zlib state
+
+  /// Run deflate over data until it is all used
+  uint8_t *_deflate(const void *data, size_t size, void *compressed,
+                    int flush);
+  Deflater(const Deflater &);            ///< Prevent usage
+  Deflater &operator=(const Deflater &); ///< Prevent usage
+};
+
+/** Decompresses a stream a piece at a time in constant memory.
+        Deflated data can grow over a thousand times, so instead of bounding
+   the output by the input, update() decompresses as much as fits in the
+   output and reports how much of the input it used.
+*/
+class Inflater : public Decompressor {
+public:
+  /** Start decompressing a stream.
+        @param framing The header and trailer to expect, defaults to zlib or
+   gzip found from the header
+  */
+  explicit Inflater(Framing framing = AutoFraming);
+  /// Releases the zlib stream
+  ~Inflater() override;
+  /** Decompress as much of the next piece as fits.
+        @param compressed In: the next compressed bytes. Out: moved past the
+   bytes that were used
+        @param size In: the number of bytes at compressed. Out: the number of
+   bytes not used
+        @param data Receives the decompressed bytes
+        @param available The number of bytes that fit in data
+        @return The byte after the last byte written
+        @throws z::Exception if the compressed data is corrupt
+  */
+  uint8_t *update(const void *&compressed, size_t &size, void *data,
+                  size_t available) override;
+  /// Has the end of the compressed stream been reached
+  bool finished() const override { return _finished; }
+  /** Check that the whole stream was decompressed.
+        The Inflater is then ready to decompress a new stream.
+        @throws msg::Exception if the end of the stream was not reached
+  */
+  void finish() override;
+
+private:
+  z_stream _stream; ///< The zlib state
+  bool _finished;   ///< Was Z_STREAM_END returned
+
+  Inflater(const Inflater &);            ///< Prevent usage
+  Inflater &operator=(const Inflater &); ///< Prevent usage
+};
+
+/** How DeflateWriter and InflateReader move bytes through a Stream.
+        Defined here for io::File, and in ZSocket.h for net::Socket.
+*/
+template <class Stream> struct Channel;
+
+/// Files are read from and written to their current location
+template <> struct Channel<io::File> {
+  /// Read up to size bytes of what is left in a file, empty at the end
+  static std::string &receive(const io::File &file, size_t size,
+                              std::string &buffer) {
+    const off_t left = file.size() - file.location();
+
+    return file.read(buffer, left < off_t(size) ? size_t(left) : size);
+  }
+  /// Write size bytes of buffer to a file
+  static void send(io::File &file, const std::string &buffer, size_t size) {
+    file.write(buffer.data(), size);
+  }
+};
+
+/// Files that are only read
+template <> struct Channel<const io::File> : Channel<io::File> {};
+
+/** Compresses everything written to it into an io::File or net::Socket.
+        Call finish() to write the end of the stream, it is not written when
+   destroyed.
+        @tparam Stream io::File, or net::Socket with ZSocket.h
+*/
+template <class Stream> class DeflateWriter {
+public:
+  /** Start a compressed stream.
+        @param stream Where the compressed stream is written
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param framing The header and trailer to write, default is zlib
+        @param chunkSize The most bytes compressed at once
+  */
+  explicit DeflateWriter(Stream &stream, int level = 6,
+                         Framing framing = ZlibFraming,
+                         size_t chunkSize = 64 * 1024);
+  /** Compress data into the stream.
+        @param data The bytes to compress
+        @param size The number of bytes in data
+  */
+  void write(const void *data, size_t size);
+  /// Compress data into the stream
+  void write(const std::string &data) { write(data.data(), data.size()); }
+  /// Write the end of the compressed stream
+  void finish();
+
+private:
+  Stream &_stream;     ///< Where the compressed stream is written
+  Deflater _deflater;  ///< The compressor
+  size_t _chunkSize;   ///< The most bytes compressed at once
+  std::string _buffer; ///< Compressed bytes on their way to the stream
+};
+
+/** Reads and decompresses a compressed stream from an io::File or net::Socket.
+        Bytes after the end of the compressed stream are read but not used.
+        @tparam Stream io::File, or net::Socket with ZSocket.h
+*/
+template <class Stream> class InflateReader {
+public:
+  /** Start reading a compressed stream.
+        @param stream Where the compressed stream is read from
+        @param framing The header and trailer to expect, defaults to zlib or
+   gzip found from the header
+        @param chunkSize The most compressed bytes read at once
+  */
+  explicit InflateReader(Stream &stream, Framing framing = AutoFraming,
+                         size_t chunkSize = 64 * 1024);
+  /** Read the next decompressed bytes.
+        @param data Receives the decompressed bytes
+        @param size The most bytes to read
+        @return The number of bytes read, only 0 at the end of the stream
+        @throws msg::Exception if the stream ends before the compressed data
+        @throws z::Exception if the compressed data is corrupt
+  */
+  size_t read(void *data, size_t size);
+  /** Read the next decompressed bytes.
+        @param size The most bytes to read
+        @param buffer Receives the decompressed bytes, empty at the end
+        @return buffer
+  */
+  std::string &read(size_t size, std::string &buffer);
+
+private:
+  Stream &_stream;     ///< Where the compressed stream is read from
+  Inflater _inflater;  ///< The decompressor
+  size_t _chunkSize;   ///< The most compressed bytes read at once
+  std::string _buffer; ///< Compressed bytes read but not used yet
+  size_t _used;        ///< The bytes at the start of _buffer already used
+};
+
+/** Compress the rest of a file into another file.
+        @param input The file to compress, from its current location
+        @param output Receives the compressed stream at its current location
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param framing The header and trailer to write, default is zlib
+        @param chunkSize The most bytes compressed at once
+*/
+inline void compress(const io::File &input, io::File &output, int level = 6,
+                     Framing framing = ZlibFraming,
+                     size_t chunkSize = 64 * 1024) {
+  DeflateWriter<io::File> writer(output, level, framing, chunkSize);
+  std::string buffer;
+
+  while (Channel<io::File>::receive(input, chunkSize, buffer).size() > 0) {
+    writer.write(buffer);
+  }
+  writer.finish();
+}
+
+/** Decompress a file into another file.
+        @param input The compressed stream, from its current location
+        @param output Receives the decompressed data at its current location
+        @param framing The header and trailer to expect, defaults to zlib or
+   gzip found from the header
+        @param chunkSize The most bytes decompressed at once
+*/
+inline void uncompress(const io::File &input, io::File &output,
+                       Framing framing = AutoFraming,
+                       size_t chunkSize = 64 * 1024) {
+  InflateReader<const io::File> reader(input, framing, chunkSize);
+  std::string buffer;
+
+  while (reader.read(chunkSize, buffer).size() > 0) {
+    output.write(buffer);
+  }
+}
+
+/** Compresses many messages with one deflate state.
+        z::compress() builds and frees about 256K of deflate state for every
+   call, which is most of the time spent on small records. A CompressContext
+   keeps the state, and resets it between messages. A preset dictionary of
+   text the messages are likely to have, see trainDictionary(), lets even
+   small messages refer back to it.
+        A context is not thread safe. Keep one per thread, for example
+   thread_local, or one per worker in a std::vector, since it can be moved.
+        The output is zlib data, which uncompress() reads if there is no
+   dictionary, and DecompressContext reads with the same dictionary.
+*/
+class CompressContext {
+public:
+  /** Set up the deflate state.
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param dictionary Text the messages are likely to have, at most 32K is
+   used, default is none
+        @throws z::Exception if level is not valid
+  */
+  explicit CompressContext(int level = 6,
+                           const std::string &dictionary = std::string());
+  /// Take over the deflate state of another context
+  CompressContext(CompressContext &&other);
+  /// Releases the deflate state
+  ~CompressContext();
+  /// The dictionary given to the constructor, or empty
+  const std::string &dictionary() const { return _dictionary; }
+  /** Gets the largest size a compressed source size can be.
+        @param sourceSize The size of the uncompressed data.
+        @return The maximum size of the compressed data.
+  */
+  size_t maxCompressedSize(size_t sourceSize) const;
+  /** Compresses a message.
+        @param source Pointer to the data to compress
+        @param sourceSize The number of bytes to compress
+        @param destination The location to write the compressed data
+        @param destinationSize The maximum number of bytes that can be written
+   to destination, at least maxCompressedSize(sourceSize)
+        @return The number of bytes written to destination.
+        @throws z::Exception if there is a problem compressing
+  */
+  size_t compress(const void *source, size_t sourceSize, void *destination,
+                  size_t destinationSize);
+  /** Compresses a message.
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @return a reference to destination
+        @throws z::Exception if there is a problem compressing
+  */
+  std::string &compress(const std::string &source, std::string &destination);
+
+private:
+  std::unique_ptr<z_stream> _stream; ///< The deflate state, at a fixed address
+  std::string _dictionary;           ///< Preset at the start of each message
+
+  CompressContext(const CompressContext &);            ///< Prevent usage
+  CompressContext &operator=(const CompressContext &); ///< Prevent usage
+};
+
+/** Uncompresses many messages with one inflate state.
+        Reads zlib data, from CompressContext with the same dictionary, or from
+   compress(). Like CompressContext, keep one per thread.
+*/
+class DecompressContext {
+public:
+  /** Set up the inflate state.
+        @param dictionary The dictionary the messages were compressed with,
+   default is none
+  */
+  explicit DecompressContext(const std::string &dictionary = std::string());
+  /// Take over the inflate state of another context
+  DecompressContext(DecompressContext &&other);
+  /// Releases the inflate state
+  ~DecompressContext();
+  /// The dictionary given to the constructor, or empty
+  const std::string &dictionary() const { return _dictionary; }
+  /** Uncompresses a message.
+        @param source Pointer to the data to uncompress
+        @param sourceSize The number of bytes to uncompress
+        @param destination The location to write the uncompressed data
+        @param destinationSize The maximum number of bytes that can be written
+   to destination
+        @return The number of bytes written to destination.
+        @throws z::Exception if there is a problem uncompressing.
+                        If destinationSize is too small, the code in the
+   exception will be Z_BUF_ERROR. If the message needs a different
+   dictionary, the code will be Z_DATA_ERROR.
+  */
+  size_t uncompress(const void *source, size_t sourceSize, void *destination,
+                    size_t destinationSize);
+  /** Uncompresses a message.
+        @param source The compressed data
+        @param destination Will receive the uncompressed data
+        @param maxDestination the maximum number of bytes. default = 512k
+        @return a reference to destination
+        @throws z::Exception if there is a problem uncompressing.
+  */
+  std::string &uncompress(const std::string &source, std::string &destination,
+                          size_t maxDestination = 512 * 1024);
+
+private:
+  std::unique_ptr<z_stream> _stream; ///< The inflate state, at a fixed address
+  std::string _dictionary;           ///< Given when a message asks for it
+
+  DecompressContext(const DecompressContext &);            ///< Prevent usage
+  DecompressContext &operator=(const DecompressContext &); ///< Prevent usage
+};
+
+/** Build a preset dictionary for CompressContext from sample messages.
+        Sections of 8 bytes are counted by how many samples have them. Each
+   part of the samples gives the 32 byte segment with the most common sections,
+   and those sections no longer count for later segments. The segments are
+   put in order of how common they were, the most common last, where they are
+   closest to the message and cheapest to refer to.
+        Each message starts by loading the dictionary, so a larger dictionary
+   costs more for each message. For records of a few hundred bytes, 2K gets
+   most of the ratio of 32K, and is faster than no dictionary.
+        @param samples Messages like the ones that will be compressed
+        @param size The most bytes in the dictionary, deflate only uses 32K
+        @return The dictionary, which may be shorter than size
+*/
+std::string trainDictionary(const std::vector<std::string> &samples,
+                            size_t size = 2048);
+
+/// zlib as a Codec, the same data compress() and uncompress() use
+class ZlibCodec : public Codec {
+public:
+  ZlibCodec() {}
+  Type type() const override { return Zlib; }
+  const char *name() const override { return "zlib"; }
+  /// 0 = none, 9 = maximum, default = 6
+  int defaultLevel() const override { return 6; }
+  size_t maxCompressedSize(size_t sourceSize) const override;
+  size_t maxUncompressedSize(size_t compressedSize) const override;
+  size_t compress(const void *source, size_t sourceSize, void *destination,
+                  size_t destinationSize, int level) const override;
+  size_t uncompress(const void *source, size_t sourceSize, void *destination,
+                    size_t destinationSize) const override;
+  Compressor *compressor(int level) const override;
+  Decompressor *decompressor() const override;
+};
+
+inline Deflater::Deflater(int level, Framing framing) : _stream() {
+  AssertMessageException(framing != AutoFraming);
+  zlib_handle_error(::deflateInit2(&_stream, level, Z_DEFLATED,
+                                   _windowBits(framing), 8,
+                                   Z_DEFAULT_STRATEGY));
+}
+inline Deflater::~Deflater() { ::deflateEnd(&_stream); }
+inline size_t Deflater::maximumOutput(size_t size) const {
+  return ::deflateBound(const_cast<z_stream *>(&_stream), size) + HeldBack;
+}
+inline uint8_t *Deflater::update(const void *data, size_t size,
+                                 void *compressed) {
+  return _deflate(data, size, compressed, Z_NO_FLUSH);
+}
+inline uint8_t *Deflater::finish(void *compressed) {
+  uint8_t *const end = _deflate("", 0, compressed, Z_FINISH);
+
+  zlib_handle_error(::deflateReset(&_stream));
+  return end;
+}
+inline uint8_t *Deflater::_deflate(const void *data, size_t size,
+                                   void *compressed, int flush) {
+  const Bytef *next = reinterpret_cast<const Bytef *>(data);
+  uint8_t *out = reinterpret_cast<uint8_t *>(compressed);
+  int result = Z_OK;
+
+  do {
+    const size_t piece = std::min<size_t>(size, _MostAtOnce);
+
+    _stream.next_in = const_cast<Bytef *>(next);
+    _stream.avail_in = static_cast<uInt>(piece);
+    _stream.next_out = out;
+    _stream.avail_out = static_cast<uInt>(
+        std::min<size_t>(maximumOutput(piece), _MostAtOnce));
+    result = ::deflate(&_stream, piece == size ? flush : Z_NO_FLUSH);
+    if ((result < 0) && (result != Z_BUF_ERROR)) {
+      throw Exception(result, __FILE__, __LINE__);
+    }
+    AssertMessageException((_stream.avail_in == 0) &&
+                           (_stream.avail_out > 0));
+    out = _stream.next_out;
+    next += piece;
+    size -= piece;
+  } while (size > 0);
+  AssertMessageException((flush != Z_FINISH) || (Z_STREAM_END == result));
+  return out;
+}
+
+inline Inflater::Inflater(Framing framing) : _stream(), _finished(false) {
+  zlib_handle_error(::inflateInit2(&_stream, _windowBits(framing)));
+}
+inline Inflater::~Inflater() { ::inflateEnd(&_stream); }
+inline uint8_t *Inflater::update(const void *&compressed, size_t &size,
+                                 void *data, size_t available) {
+  const size_t piece = std::min<size_t>(size, _MostAtOnce);
+  int result;
+
+  if (_finished) {
+    return reinterpret_cast<uint8_t *>(data);
+  }
+  _stream.next_in =
+      const_cast<Bytef *>(reinterpret_cast<const Bytef *>(compressed));
+  _stream.avail_in = static_cast<uInt>(piece);
+  _stream.next_out = reinterpret_cast<Bytef *>(data);
+  _stream.avail_out =
+      static_cast<uInt>(std::min<size_t>(available, _MostAtOnce));
+  result = ::inflate(&_stream, Z_NO_FLUSH);
+  if (Z_NEED_DICT == result) {
+    result = Z_DATA_ERROR; // a preset dictionary was not given
+  }
+  if ((result < 0) && (result != Z_BUF_ERROR)) {
+    throw Exception(result, __FILE__, __LINE__);
+  }
+  _finished = (Z_STREAM_END == result);
+  compressed = reinterpret_cast<const uint8_t *>(compressed) +
+               (piece - _stream.avail_in);
+  size -= piece - _stream.avail_in;
+  return _stream.next_out;
+}
+inline void Inflater::finish() {
+  if (!_finished) {
+    ThrowMessageException("Compressed stream ended early");
+  }
+  zlib_handle_error(::inflateReset(&_stream));
+  _finished = false;
+}
+
+template <class Stream>
+inline DeflateWriter<Stream>::DeflateWriter(Stream &stream, int level,
+                                            Framing framing, size_t chunkSize)
+    : _stream(stream), _deflater(level, framing), _chunkSize(chunkSize),
+      _buffer() {
+  AssertMessageException(chunkSize > 0);
+}
+template <class Stream>
+inline void DeflateWriter<Stream>::write(const void *data, size_t size) {
+  const uint8_t *next = reinterpret_cast<const uint8_t *>(data);
+
+  _buffer.resize(_deflater.maximumOutput(std::min(size, _chunkSize)));
+  while (size > 0) {
+    const size_t piece = std::min(size, _chunkSize);
+    uint8_t *const start = reinterpret_cast<uint8_t *>(&_buffer[0]);
+
+    Channel<Stream>::send(_stream, _buffer,
+                          _deflater.update(next, piece, start) - start);
+    next += piece;
+    size -= piece;
+  }
+}
+template <class Stream> inline void DeflateWriter<Stream>::finish() {
+  _buffer.resize(_deflater.maximumOutput(0));
+
+  uint8_t *const start = reinterpret_cast<uint8_t *>(&_buffer[0]);
+
+  Channel<Stream>::send(_stream, _buffer, _deflater.finish(start) - start);
+}
+
+template <class Stream>
+inline InflateReader<Stream>::InflateReader(Stream &stream, Framing framing,
+                                            size_t chunkSize)
+    : _stream(stream), _inflater(framing), _chunkSize(chunkSize), _buffer(),
+      _used(0) {
+  AssertMessageException(chunkSize > 0);
+}
+template <class Stream>
+inline size_t InflateReader<Stream>::read(void *data, size_t size) {
+  uint8_t *const start = reinterpret_cast<uint8_t *>(data);
+  uint8_t *end = start;
+
+  while ((end == start) && (size > 0) && !_inflater.finished()) {
+    if (_used == _buffer.size()) {
+      _used = 0;
+      if (Channel<Stream>::receive(_stream, _chunkSize, _buffer).empty()) {
+        ThrowMessageException("Compressed stream ended early");
+      }
+    }
+
+    const void *next = _buffer.data() + _used;
+    size_t left = _buffer.size() - _used;
+
+    end = _inflater.update(next, left, data, size);
+    _used = _buffer.size() - left;
+  }
+  return end - start;
+}
+template <class Stream>
+inline std::string &InflateReader<Stream>::read(size_t size,
+                                                std::string &buffer) {
+  buffer.resize(size);
+  buffer.resize(read(&buffer[0], size));
+  return buffer;
+}
+
+inline CompressContext::CompressContext(int level,
+                                        const std::string &dictionary)
+    : _stream(new z_stream()),
+      _dictionary(dictionary.size() > 32 * 1024
+                      ? dictionary.substr(dictionary.size() - 32 * 1024)
+                      : dictionary) {
+  zlib_handle_error(::deflateInit2(_stream.get(), level, Z_DEFLATED,
+                                   MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+}
+inline CompressContext::CompressContext(CompressContext &&other)
+    : _stream(std::move(other._stream)),
+      _dictionary(std::move(other._dictionary)) {}
+inline CompressContext::~CompressContext() {
+  if (_stream) {
+    ::deflateEnd(_stream.get());
+  }
+}
+inline size_t CompressContext::maxCompressedSize(size_t sourceSize) const {
+  return ::deflateBound(_stream.get(), sourceSize) +
+         (_dictionary.empty() ? 0 : 4); // the dictionary id
+}
+inline size_t CompressContext::compress(const void *source, size_t sourceSize,
+                                        void *destination,
+                                        size_t destinationSize) {
+  z_stream &stream = *_stream;
+  size_t inLeft = sourceSize, outLeft = destinationSize;
+  int result;
+
+  AssertMessageException(destinationSize >= maxCompressedSize(sourceSize));
+  zlib_handle_error(::deflateReset(&stream));
+  if (!_dictionary.empty()) {
+    zlib_handle_error(::deflateSetDictionary(
+        &stream, reinterpret_cast<const Bytef *>(_dictionary.data()),
+        static_cast<uInt>(_dictionary.size())));
+  }
+  stream.next_in =
+      const_cast<Bytef *>(reinterpret_cast<const Bytef *>(source));
+  stream.next_out = reinterpret_cast<Bytef *>(destination);
+  do {
+    const size_t in = std::min<size_t>(inLeft, _MostAtOnce);
+    const size_t out = std::min<size_t>(outLeft, _MostAtOnce);
+
+    stream.avail_in = static_cast<uInt>(in);
+    stream.avail_out = static_cast<uInt>(out);
+    result = ::deflate(&stream, in == inLeft ? Z_FINISH : Z_NO_FLUSH);
+    if ((result < 0) && ((result != Z_BUF_ERROR) || (out == 0))) {
+      throw Exception(result, __FILE__, __LINE__);
+    }
+    inLeft -= in - stream.avail_in;
+    outLeft -= out - stream.avail_out;
+  } while (Z_STREAM_END != result);
+  return destinationSize - outLeft;
+}
+inline std::string &CompressContext::compress(const std::string &source,
+                                              std::string &destination) {
+  destination.resize(maxCompressedSize(source.size()));
+  destination.resize(compress(source.data(), source.size(), &destination[0],
+                              destination.size()));
+  return destination;
+}
+
+inline DecompressContext::DecompressContext(const std::string &dictionary)
+    : _stream(new z_stream()),
+      _dictionary(dictionary.size() > 32 * 1024
+                      ? dictionary.substr(dictionary.size() - 32 * 1024)
+                      : dictionary) {
+  zlib_handle_error(::inflateInit(_stream.get()));
+}
+inline DecompressContext::DecompressContext(DecompressContext &&other)
+    : _stream(std::move(other._stream)),
+      _dictionary(std::move(other._dictionary)) {}
+inline DecompressContext::~DecompressContext() {
+  if (_stream) {
+    ::inflateEnd(_stream.get());
+  }
+}
+inline size_t DecompressContext::uncompress(const void *source,
+                                            size_t sourceSize,
+                                            void *destination,
+                                            size_t destinationSize) {
+  z_stream &stream = *_stream;
+  size_t inLeft = sourceSize, outLeft = destinationSize;
+  int result;
+
+  zlib_handle_error(::inflateReset(&stream));
+  stream.next_in =
+      const_cast<Bytef *>(reinterpret_cast<const Bytef *>(source));
+  stream.next_out = reinterpret_cast<Bytef *>(destination);
+  do {
+    const size_t in = std::min<size_t>(inLeft, _MostAtOnce);
+    const size_t out = std::min<size_t>(outLeft, _MostAtOnce);
+
+    stream.avail_in = static_cast<uInt>(in);
+    stream.avail_out = static_cast<uInt>(out);
+    result = ::inflate(&stream, Z_NO_FLUSH);
+    inLeft -= in - stream.avail_in;
+    outLeft -= out - stream.avail_out;
+    if (Z_NEED_DICT == result) {
+      // Z_DATA_ERROR if it is not the dictionary the message was made with
+      result = _dictionary.empty()
+                   ? Z_DATA_ERROR
+                   : ::inflateSetDictionary(
+                         &stream,
+                         reinterpret_cast<const Bytef *>(_dictionary.data()),
+                         static_cast<uInt>(_dictionary.size()));
+    }
+    if ((Z_BUF_ERROR == result) || ((Z_OK == result) && (inLeft == 0))) {
+      // out of room, or the message ended early
+      result = outLeft == 0 ? Z_BUF_ERROR : inLeft == 0 ? Z_DATA_ERROR : Z_OK;
+    }
+    if (result < 0) {
+      throw Exception(result, __FILE__, __LINE__);
+    }
+  } while (Z_STREAM_END != result);
+  return destinationSize - outLeft;
+}
+inline std::string &DecompressContext::uncompress(const std::string &source,
+                                                  std::string &destination,
+                                                  size_t maxDestination) {
+  destination.resize(maxDestination);
+  destination.resize(uncompress(source.data(), source.size(), &destination[0],
+                                destination.size()));
+  return destination;
+}
+
+inline std::string trainDictionary(const std::vector<std::string> &samples,
+                                   size_t size) {
+  enum {
+    Section = 8,     ///< bytes counted together
+    Segment = 32,    ///< bytes put into the dictionary together
+    TableBits = 20   ///< sections are counted in a table of 2^TableBits
+  };
+  std::vector<uint32_t> counts(1 << TableBits), lastSample(1 << TableBits);
+  std::vector<uint32_t> scores;
+  std::vector<std::pair<uint64_t, size_t>> chosen;
+  std::string all, dictionary;
+  // the table entry for the section at offset of all
+  auto entry = [&all](size_t offset) {
+    uint64_t section;
+
+    ::memcpy(&section, all.data() + offset, sizeof(section));
+    return (section * 0x9E3779B97F4A7C15ULL) >> (64 - TableBits);
+  };
+
+  for (size_t sample = 0; sample < samples.size(); ++sample) {
+    const size_t start = all.size();
+
+    all += samples[sample];
+    for (size_t at = start; at + Section <= all.size(); ++at) {
+      const uint64_t index = entry(at);
+
+      if (lastSample[index] != sample + 1) { // once for each sample
+        lastSample[index] = static_cast<uint32_t>(sample + 1);
+        ++counts[index];
+      }
+    }
+  }
+
+  const size_t parts = std::min(size / Segment, all.size() / Segment);
+
+  for (size_t part = 0; part < parts; ++part) {
+    const size_t begin = part * all.size() / parts;
+    const size_t end = (part + 1) * all.size() / parts;
+    uint64_t score = 0, best = 0;
+    size_t bestStart = begin;
+
+    // a section that only one sample has does not help the others
+    scores.resize(end - begin);
+    for (size_t at = begin; at < end; ++at) {
+      const uint32_t count =
+          at + Section <= all.size() ? counts[entry(at)] : 0;
+
+      scores[at - begin] = count > 1 ? count : 0;
+    }
+    for (size_t at = begin; at < end; ++at) {
+      score += scores[at - begin];
+      if (at >= begin + Segment - Section + 1) {
+        score -= scores[at - begin - (Segment - Section + 1)];
+      }
+      // the window holds the sections at - (Segment - Section) to at
+      if ((at >= begin + Segment - Section) && (at + Section <= end) &&
+          (score > best)) {
+        best = score;
+        bestStart = at - (Segment - Section);
+      }
+    }
+    if (best > 0) {
+      chosen.push_back(std::make_pair(best, bestStart));
+      for (size_t at = bestStart; at + Section <= bestStart + Segment; ++at) {
+        counts[entry(at)] = 0;
+      }
+    }
+  }
+  std::stable_sort(chosen.begin(), chosen.end());
+  for (const auto &segment : chosen) {
+    dictionary.append(all, segment.second, Segment);
+  }
+  return dictionary;
+}
+
+inline std::string &Codec::compress(const std::string &source,
+                                    std::string &destination,
+                                    int level) const {
+  destination.resize(maxCompressedSize(source.size()));
+  destination.resize(compress(source.data(), source.size(), &destination[0],
+                              destination.size(), level));
+  return destination;
+}
+inline std::string &Codec::uncompress(const std::string &source,
+                                      std::string &destination) const {
+  std::unique_ptr<Decompressor> decompressor(this->decompressor());
+  const void *next = source.data();
+  size_t left = source.size();
+  size_t used = 0;
+
+  destination.resize(std::max<size_t>(2 * source.size(), 4096));
+  while (!decompressor->finished()) {
+    const size_t leftBefore = left, usedBefore = used;
+
+    if (used == destination.size()) {
+      destination.resize(2 * destination.size());
+    }
+    uint8_t *const start = reinterpret_cast<uint8_t *>(&destination[0]);
+
+    used = decompressor->update(next, left, start + used,
+                                destination.size() - used) -
+           start;
+    if ((leftBefore == left) && (usedBefore == used) &&
+        !decompressor->finished()) {
+      ThrowMessageException("Compressed stream ended early");
+    }
+  }
+  decompressor->finish();
+  destination.resize(used);
+  return destination;
+}
+inline bool Codec::available(Type type) {
+  try {
+    get(type);
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+inline const Codec &Codec::get(Type type) {
+  static const ZlibCodec zlib;
+  const Loader loader = _loader().load();
+
+  if (Zlib == type) {
+    return zlib;
+  }
+  if (NULL == loader) {
+    ThrowMessageException("Include ZCodecs.h to use LZ4 or Zstandard");
+  }
+  return loader(type);
+}
+inline const Codec *Codec::find(const void *compressed, size_t size) {
+  const uint8_t *const bytes = reinterpret_cast<const uint8_t *>(compressed);
+  const uint32_t magic = size < 4 ? 0
+                                  : uint32_t(bytes[0]) | bytes[1] << 8 |
+                                        bytes[2] << 16 | uint32_t(bytes[3])
+                                                             << 24;
+
+  if (0xFD2FB528 == magic) {
+    return &get(Zstd);
+  }
+  if (0x184D2204 == magic) {
+    return &get(LZ4);
+  }
+  // deflate with a window of at most 32K, and a header that checks
+  if ((size >= 2) && ((bytes[0] & 0x0F) == Z_DEFLATED) &&
+      ((bytes[0] >> 4) <= MAX_WBITS - 8) &&
+      ((bytes[0] << 8 | bytes[1]) % 31 == 0)) {
+    return &get(Zlib);
+  }
+  return NULL;
+}
+
+inline bool Codec::install(Loader loader) {
+  _loader().store(loader);
+  return true;
+}
+inline std::atomic<Codec::Loader> &Codec::_loader() {
+  static std::atomic<Loader> loader(NULL);
+
+  return loader;
+}
+
+inline size_t ZlibCodec::maxCompressedSize(size_t sourceSize) const {
+  return z::maxCompressedSize(sourceSize);
+}
+/// A deflate length and distance take at least 2 bits for 258 bytes
+inline size_t ZlibCodec::maxUncompressedSize(size_t compressedSize) const {
+  return _expanded(compressedSize, 1032);
+}
+inline size_t ZlibCodec::compress(const void *source, size_t sourceSize,
+                                  void *destination, size_t destinationSize,
+                                  int level) const {
+  return z::compress(source, sourceSize, destination, destinationSize, level);
+}
+inline size_t ZlibCodec::uncompress(const void *source, size_t sourceSize,
+                                    void *destination,
+                                    size_t destinationSize) const {
+  return z::uncompress(source, sourceSize, destination, destinationSize);
+}
+inline Compressor *ZlibCodec::compressor(int level) const {
+  return new Deflater(level, ZlibFraming);
+}
+inline Decompressor *ZlibCodec::decompressor() const {
+  return new Inflater(ZlibFraming);
+}
+
 #undef zlib_handle_error // clean up global preprocessor namespace
 
 }; // namespace z
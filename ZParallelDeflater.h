@@ -0,0 +1,358 @@
+#ifndef __ZParallelDeflater_h__
+#define __ZParallelDeflater_h__
+
+/** @file ZParallelDeflater.h
+        Deflate a stream on several threads, pigz style.
+*/
+
+#include "ThreadPool.h"
+#include "ZCompression.h"
+#include <string>
+#include <vector>
+
+namespace z {
+
+/** Compresses blocks of a stream at the same time across an exec::ThreadPool.
+        Each block is deflated on its own, primed with the 32K before it so
+   the ratio stays close to Deflater's. Every block but the last ends with a
+   sync flush, which ends it on a byte boundary, so the blocks can simply be
+   joined into one stream. The adler32 or crc32 of each block is combined into
+   the trailer. The output can be read by Inflater, gzip or zlib.
+        Small updates are held until there is a block for every thread. Whole
+   blocks of larger ones are compressed straight from the caller's buffer, and
+   only the last 32K and any partial block are kept, so memory use is about
+   threads * blockSize. Has the same maximumOutput(), update() and finish() as
+   Deflater.
+*/
+class ParallelDeflater : public Compressor {
+public:
+  enum {
+    DefaultBlockSize = 128 * 1024 ///< Bytes in each block if not given
+  };
+  /** Start a compressed stream.
+        @param pool The threads that compress the blocks
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param framing The header and trailer to write, default is gzip
+        @param blockSize The number of bytes compressed on their own
+  */
+  explicit ParallelDeflater(exec::ThreadPool &pool, int level = 6,
+                            Framing framing = GzipFraming,
+                            size_t blockSize = DefaultBlockSize);
+  /// The most bytes update(size) or finish() can write
+  size_t maximumOutput(size_t size) const override;
+  /** Compress the next piece of the stream.
+        Data is held back until there is a block for every thread.
+        data is only read during the call.
+        @param data The next bytes to compress
+        @param size The number of bytes in data
+        @param compressed Receives up to maximumOutput(size) bytes
+        @return The byte after the last byte written
+        @throws z::Exception if there is a problem compressing
+  */
+  uint8_t *update(const void *data, size_t size, void *compressed) override;
+  /** Compress whatever is held back and write the trailer.
+        The ParallelDeflater is then ready to compress a new stream.
+        @param compressed Receives up to maximumOutput(0) bytes
+        @return The byte after the last byte written
+        @throws z::Exception if there is a problem compressing
+  */
+  uint8_t *finish(void *compressed) override;
+
+private:
+  enum {
+    Window = 32 * 1024, ///< The most bytes back a deflate match can reach
+    MostFraming = 18    ///< More than the bytes in any header and trailer
+  };
+  /// A block compressed on a worker thread
+  struct _Block {
+    _Block()
+        : window(NULL), windowSize(0), data(NULL), size(0), compressed(),
+          check(0) {}
+    _Block(const _Block &other)
+        : window(other.window), windowSize(other.windowSize),
+          data(other.data), size(other.size), compressed(other.compressed),
+          check(other.check) {}
+    _Block &operator=(const _Block &other) {
+      window = other.window;
+      windowSize = other.windowSize;
+      data = other.data;
+      size = other.size;
+      compressed = other.compressed;
+      check = other.check;
+      return *this;
+    }
+    const uint8_t *window;  ///< Bytes of the stream just before data
+    size_t windowSize;      ///< The number of bytes in window
+    const uint8_t *data;    ///< The bytes to compress
+    size_t size;            ///< The number of bytes in data
+    std::string compressed; ///< The raw deflate data
+    uLong check;            ///< The adler32 or crc32 of the block
+  };
+  exec::ThreadPool &_pool; ///< The threads that compress the blocks
+  int _level;              ///< The compression level
+  Framing _framing;        ///< The header and trailer to write
+  size_t _blockSize;       ///< Bytes in each block
+  std::string _pending;    ///< The window already compressed, then held data
+  size_t _window;          ///< Bytes at the start of _pending in the window
+  uLong _check;            ///< The adler32 or crc32 so far
+  uint64_t _size;          ///< The number of bytes compressed so far
+  bool _started;           ///< Has the header been written
+  std::vector<_Block> _blocks; ///< Blocks being compressed
+
+  /// The check value of nothing, for the framing
+  uLong _emptyCheck() const;
+  /// Write the header, if it has not been written yet
+  uint8_t *_header(uint8_t *compressed);
+  /// Queue a block, with up to Window bytes that come right before it
+  void _add(const uint8_t *data, size_t size, const uint8_t *before,
+            size_t beforeSize);
+  /// Compress the queued blocks, the last one ends the stream if last
+  uint8_t *_compress(bool last, uint8_t *compressed);
+  /// Deflate one block, primed with the window before it
+  static void _deflate(const uint8_t *window, size_t windowSize,
+                       const uint8_t *data, size_t size, bool last, int level,
+                       std::string &compressed);
+  ParallelDeflater(const ParallelDeflater &);            ///< Prevent usage
+  ParallelDeflater &operator=(const ParallelDeflater &); ///< Prevent usage
+};
+
+/** Compress data on several threads.
+        @param source the data to compress.
+        @param destination Will receive the compressed data
+        @param pool The threads that compress the blocks
+        @param level The compression level. 0 = none, 9 = maximum, default = 6
+        @param framing The header and trailer to write, default is zlib so
+   uncompress() can read it
+        @return a reference to destination
+        @throws zlib::Exception if there is a problem compressing
+*/
+inline std::string &compress(const std::string &source,
+                             std::string &destination, exec::ThreadPool &pool,
+                             int level = 6, Framing framing = ZlibFraming) {
+  ParallelDeflater deflater(pool, level, framing);
+  uint8_t *end;
+
+  destination.resize(deflater.maximumOutput(source.size()));
+  end = deflater.update(source.data(), source.size(), &destination[0]);
+  destination.resize(reinterpret_cast<char *>(end) - &destination[0]);
+
+  const size_t start = destination.size();
+
+  destination.resize(start + deflater.maximumOutput(0));
+  end = deflater.finish(&destination[0] + start);
+  destination.resize(reinterpret_cast<char *>(end) - &destination[0]);
+  return destination;
+}
+
+inline ParallelDeflater::ParallelDeflater(exec::ThreadPool &pool, int level,
+                                          Framing framing, size_t blockSize)
+    : _pool(pool), _level(level), _framing(framing), _blockSize(blockSize),
+      _pending(), _window(0), _check(0), _size(0), _started(false),
+      _blocks() {
+  AssertMessageException((framing != AutoFraming) && (blockSize > 0) &&
+                         (blockSize < _MostAtOnce));
+  if ((level < Z_DEFAULT_COMPRESSION) || (level > Z_BEST_COMPRESSION)) {
+    throw Exception(Z_STREAM_ERROR, __FILE__, __LINE__);
+  }
+  _check = _emptyCheck();
+}
+inline size_t ParallelDeflater::maximumOutput(size_t size) const {
+  const size_t total = _pending.size() - _window + size;
+  const size_t blocks = total / _blockSize + 1;
+  const size_t perBlock = ::compressBound(_blockSize) - _blockSize + 16;
+
+  return total + blocks * perBlock + MostFraming;
+}
+inline uint8_t *ParallelDeflater::update(const void *data, size_t size,
+                                         void *compressed) {
+  const size_t threads = std::max(1, _pool.threads());
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(data);
+  uint8_t *out = _header(reinterpret_cast<uint8_t *>(compressed));
+  const size_t held = _pending.size() - _window;
+
+  if (held + size < _blockSize * threads) {
+    _pending.append(reinterpret_cast<const char *>(in), size);
+    return out;
+  }
+
+  // finish the partial block held back, then read whole blocks in place
+  const size_t fill = (_blockSize - held % _blockSize) % _blockSize;
+
+  _pending.append(reinterpret_cast<const char *>(in), fill);
+  in += fill;
+  size -= fill;
+
+  const uint8_t *const pending =
+      reinterpret_cast<const uint8_t *>(_pending.data());
+  const size_t whole = size / _blockSize * _blockSize;
+
+  for (size_t start = _window; start < _pending.size(); start += _blockSize) {
+    _add(pending + start, _blockSize, pending, start);
+    if (_blocks.size() == threads) {
+      out = _compress(false, out);
+    }
+  }
+  for (size_t start = 0; start < whole; start += _blockSize) {
+    if (0 == start) {
+      _add(in, _blockSize, pending, _pending.size());
+    } else {
+      _add(in + start, _blockSize, in, start);
+    }
+    if (_blocks.size() == threads) {
+      out = _compress(false, out);
+    }
+  }
+  if (!_blocks.empty()) {
+    out = _compress(false, out);
+  }
+
+  // keep the last Window bytes compressed and the partial block after them
+  std::string rest;
+
+  if (whole >= Window) {
+    rest.assign(reinterpret_cast<const char *>(in) + whole - Window, Window);
+  } else {
+    const size_t kept = std::min<size_t>(_pending.size(), Window - whole);
+
+    rest.assign(_pending, _pending.size() - kept, kept);
+    rest.append(reinterpret_cast<const char *>(in), whole);
+  }
+  _window = rest.size();
+  rest.append(reinterpret_cast<const char *>(in) + whole, size - whole);
+  _pending.swap(rest);
+  return out;
+}
+inline uint8_t *ParallelDeflater::finish(void *compressed) {
+  const uint8_t *const pending =
+      reinterpret_cast<const uint8_t *>(_pending.data());
+  size_t start = _window;
+  uint8_t *out = _header(reinterpret_cast<uint8_t *>(compressed));
+
+  do { // an empty stream still needs a final block
+    const size_t size = std::min(_blockSize, _pending.size() - start);
+
+    _add(pending + start, size, pending, start);
+    start += size;
+  } while (start < _pending.size());
+  out = _compress(true, out);
+  if (GzipFraming == _framing) {
+    for (int byte = 0; byte < 4; ++byte) {
+      *out++ = static_cast<uint8_t>(_check >> (8 * byte));
+    }
+    for (int byte = 0; byte < 4; ++byte) {
+      *out++ = static_cast<uint8_t>(_size >> (8 * byte));
+    }
+  } else if (ZlibFraming == _framing) {
+    for (int byte = 3; byte >= 0; --byte) {
+      *out++ = static_cast<uint8_t>(_check >> (8 * byte));
+    }
+  }
+  _pending.clear();
+  _window = 0;
+  _check = _emptyCheck();
+  _size = 0;
+  _started = false;
+  return out;
+}
+inline uLong ParallelDeflater::_emptyCheck() const {
+  return GzipFraming == _framing ? ::crc32(0, Z_NULL, 0)
+                                 : ::adler32(0, Z_NULL, 0);
+}
+inline uint8_t *ParallelDeflater::_header(uint8_t *compressed) {
+  if (_started) {
+    return compressed;
+  }
+  _started = true;
+  if (GzipFraming == _framing) {
+    const uint8_t header[] = {0x1F, 0x8B, Z_DEFLATED, 0, 0, 0, 0, 0,
+                              uint8_t(9 == _level ? 2 : 1 == _level ? 4 : 0),
+                              3 /* unix */};
+
+    ::memcpy(compressed, header, sizeof(header));
+    return compressed + sizeof(header);
+  }
+  if (ZlibFraming == _framing) {
+    const int method = (MAX_WBITS - 8) << 4 | Z_DEFLATED;
+    const int speed = _level < 0    ? 2
+                      : _level < 2  ? 0
+                      : _level < 6  ? 1
+                      : _level == 6 ? 2
+                                    : 3;
+    int flags = speed << 6;
+
+    flags += 31 - (method << 8 | flags) % 31;
+    *compressed++ = static_cast<uint8_t>(method);
+    *compressed++ = static_cast<uint8_t>(flags);
+  }
+  return compressed;
+}
+inline void ParallelDeflater::_add(const uint8_t *data, size_t size,
+                                   const uint8_t *before, size_t beforeSize) {
+  const size_t window = std::min<size_t>(beforeSize, Window);
+
+  _blocks.push_back(_Block());
+  _blocks.back().window = before + beforeSize - window;
+  _blocks.back().windowSize = window;
+  _blocks.back().data = data;
+  _blocks.back().size = size;
+}
+inline uint8_t *ParallelDeflater::_compress(bool last, uint8_t *compressed) {
+  const size_t count = _blocks.size();
+
+  _pool.parallelFor(
+      0, count,
+      [this, count, last](size_t index) {
+        _Block &block = _blocks[index];
+        const uInt size = static_cast<uInt>(block.size);
+
+        block.check = GzipFraming == _framing
+                          ? ::crc32(0, block.data, size)
+                          : ::adler32(1, block.data, size);
+        _deflate(block.window, block.windowSize, block.data, block.size,
+                 last && (index + 1 == count), _level, block.compressed);
+      },
+      1);
+  for (const _Block &block : _blocks) {
+    ::memcpy(compressed, block.compressed.data(), block.compressed.size());
+    compressed += block.compressed.size();
+    _check = GzipFraming == _framing
+                 ? ::crc32_combine(_check, block.check, block.size)
+                 : ::adler32_combine(_check, block.check, block.size);
+    _size += block.size;
+  }
+  _blocks.clear();
+  return compressed;
+}
+inline void ParallelDeflater::_deflate(const uint8_t *window,
+                                       size_t windowSize, const uint8_t *data,
+                                       size_t size, bool last, int level,
+                                       std::string &compressed) {
+  z_stream stream = z_stream();
+  int result;
+
+  result = ::deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                          Z_DEFAULT_STRATEGY);
+  if (Z_OK != result) {
+    throw Exception(result, __FILE__, __LINE__);
+  }
+  if (windowSize > 0) {
+    ::deflateSetDictionary(&stream, window, static_cast<uInt>(windowSize));
+  }
+  compressed.resize(::deflateBound(&stream, size) + 16);
+  stream.next_in = const_cast<Bytef *>(data);
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  result = ::deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  compressed.resize(compressed.size() - stream.avail_out);
+  ::deflateEnd(&stream);
+  if ((result < 0) && (result != Z_BUF_ERROR)) {
+    throw Exception(result, __FILE__, __LINE__);
+  }
+  AssertMessageException((last ? Z_STREAM_END == result : Z_OK == result) &&
+                         (stream.avail_out > 0));
+}
+
+}; // namespace z
+
+#endif // __ZParallelDeflater_h__
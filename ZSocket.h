@@ -0,0 +1,32 @@
+#ifndef __ZSocket_h__
+#define __ZSocket_h__
+
+/** @file ZSocket.h
+        Lets z::DeflateWriter and z::InflateReader stream over a net::Socket.
+*/
+
+#include "Socket.h"
+#include "ZCompression.h"
+#include <string>
+
+namespace z {
+
+/// Sockets are read until they are closed
+template <> struct Channel<net::Socket> {
+  /// Read up to size bytes from a socket, empty when it is closed
+  static std::string &receive(net::Socket &socket, size_t size,
+                              std::string &buffer) {
+    return socket.read(size, buffer);
+  }
+  /// Write size bytes of buffer to a socket, which may take several writes
+  static void send(net::Socket &socket, const std::string &buffer,
+                   size_t size) {
+    for (size_t sent = 0; sent < size;) {
+      sent += socket.write(buffer, size - sent, sent);
+    }
+  }
+};
+
+}; // namespace z
+
+#endif // __ZSocket_h__
@@ -0,0 +1,47 @@
+#ifndef __Benchmark_h__
+#define __Benchmark_h__
+
+/** @file Benchmark.h
+        Timing and sample data shared by the tests that report throughput.
+*/
+
+#include <chrono>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string>
+
+/** Gigabytes handled per second.
+        @param bytes The bytes function handles each call
+        @param repeat The number of times to call function
+        @param function What to time
+        @return The gigabytes handled per second
+*/
+template <class Function>
+double speed(size_t bytes, int repeat, Function function) {
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < repeat; ++i) {
+    function();
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return double(bytes) * repeat / elapsed.count() / 1e9;
+}
+
+/** Text that compresses about as well as prose.
+        @param size The least number of bytes to return
+        @return A sentence repeated with a random number after each one
+*/
+inline std::string sampleText(size_t size) {
+  std::string text;
+
+  while (text.size() < size) {
+    text += "Nobody inspects the spammish repetition. ";
+    text += std::to_string(rand());
+  }
+  return text;
+}
+
+#endif // __Benchmark_h__
@@ -0,0 +1,178 @@
+#include "os/BoundedQueue.h"
+#include "os/Queue.h"
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestIterations 400
+#else
+#define TestIterations 40000
+#endif
+
+typedef exec::BoundedQueue<int, 1024> IntQueue;
+
+/// An element whose copies can be made to fail
+struct Fragile {
+  explicit Fragile(int v = 0) : value(v) {}
+  Fragile(const Fragile &other) : value(other.value) {
+    if (failCopies) {
+      throw std::runtime_error("copy failed");
+    }
+  }
+  Fragile(Fragile &&other) noexcept : value(other.value) {}
+  Fragile &operator=(const Fragile &other) = default;
+  int value;
+  static bool failCopies;
+};
+bool Fragile::failCopies = false;
+
+template <class Q> void produce(Q &queue, int count, int start) {
+  for (int value = start; value < start + count; ++value) {
+    queue.enqueue(value);
+  }
+}
+
+template <class Q> void consume(Q &queue, int count, long long &sum) {
+  for (int i = 0; i < count; ++i) {
+    sum += queue.dequeue();
+  }
+}
+
+/// Runs producers and consumers against a queue and returns items/second
+template <class Q> double contention(Q &queue, int threadsPerSide) {
+  std::vector<std::thread> threads;
+  std::vector<long long> sums(threadsPerSide, 0);
+  const auto start = std::chrono::steady_clock::now();
+  long long total = 0;
+  long long expected = 0;
+
+  for (int t = 0; t < threadsPerSide; ++t) {
+    threads.push_back(std::thread(produce<Q>, std::ref(queue), TestIterations,
+                                  t * TestIterations));
+    threads.push_back(std::thread(consume<Q>, std::ref(queue), TestIterations,
+                                  std::ref(sums[t])));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  for (int t = 0; t < threadsPerSide; ++t) {
+    total += sums[t];
+  }
+  for (long long value = 0; value < TestIterations * threadsPerSide; ++value) {
+    expected += value;
+  }
+  dotest(total == expected);
+  return seconds > 0.0 ? TestIterations * threadsPerSide / seconds : 0.0;
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  IntQueue queue;
+  exec::BoundedQueue<std::string, 4> strings;
+  std::string value;
+  int number;
+
+  dotest(queue.empty());
+  dotest(!queue.full());
+  dotest(queue.size() == 0);
+  queue.enqueue(5);
+  dotest(!queue.empty());
+  dotest(queue.size() == 1);
+  dotest(queue.dequeue() == 5);
+  dotest(!queue.tryDequeue(number));
+  dotest(!queue.dequeue(number, 0.01));
+
+  for (int i = 0; i < 4; ++i) {
+    dotest(strings.tryEnqueue(std::to_string(i)));
+  }
+  dotest(strings.full());
+  dotest(!strings.tryEnqueue("full"));
+  dotest(!strings.enqueue("full", 0.01));
+  dotest(strings.dequeue(value, 0.01));
+  dotest(value == "0");
+  dotest(strings.enqueue("4", 0.01));
+  for (int i = 1; i < 5; ++i) {
+    dotest(strings.tryDequeue(value));
+    dotest(value == std::to_string(i));
+  }
+  strings.enqueue("left behind");
+
+  std::string moved(100, 'm');
+
+  dotest(strings.tryEnqueue(std::move(moved)));
+  dotest(moved.empty());
+  moved.assign(100, 'm');
+  strings.enqueue(std::move(moved));
+  dotest(moved.empty());
+  moved.assign(100, 'm');
+  strings.enqueue("fill");
+  dotest(!strings.tryEnqueue(std::move(moved)));
+  dotest(moved.size() == 100 /* not taken when full */);
+
+  // a failed copy must not claim a slot
+  exec::BoundedQueue<Fragile, 2> fragile;
+  Fragile element(7);
+
+  Fragile::failCopies = true;
+  for (int i = 0; i < 5; ++i) {
+    try {
+      fragile.tryEnqueue(element);
+      dotest(false /* copy should throw */);
+    } catch (const std::runtime_error &) {
+    }
+  }
+  Fragile::failCopies = false;
+  for (int i = 0; i < 5; ++i) {
+    Fragile out;
+
+    dotest(fragile.tryEnqueue(Fragile(i)));
+    dotest(fragile.tryDequeue(out));
+    dotest(out.value == i);
+  }
+  dotest(fragile.empty());
+
+  for (int threads = 1; threads <= 16; threads *= 4) {
+    IntQueue lockFree;
+    exec::Queue<int> locked(1024);
+    const double lockFreeRate = contention(lockFree, threads);
+    const double lockedRate = contention(locked, threads);
+
+    printf("%2d producers/consumers: BoundedQueue %12.0f items/s Queue "
+           "%12.0f items/s\n",
+           threads, lockFreeRate, lockedRate);
+    dotest(lockFree.empty());
+  }
+
+  queue.close();
+  try {
+    queue.enqueue(1);
+    dotest(false /* enqueue after close */);
+  } catch (const IntQueue::Closed &) {
+  }
+  try {
+    queue.dequeue();
+    dotest(false /* dequeue after close */);
+  } catch (const IntQueue::Closed &) {
+  }
+  try {
+    queue.empty();
+    dotest(false /* empty after close */);
+  } catch (const IntQueue::Closed &exception) {
+    IntQueue::Closed copy(exception);
+
+    dotest(std::string(copy.what()).find("Closed") != std::string::npos);
+  }
+  return 0;
+}
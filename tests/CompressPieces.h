@@ -0,0 +1,69 @@
+#ifndef __CompressPieces_h__
+#define __CompressPieces_h__
+
+/** @file CompressPieces.h
+        Compression driven in random sized pieces, shared by the z tests.
+*/
+
+#include "os/Text.h"
+#include "os/ZCompression.h"
+#include <stdlib.h>
+#include <string>
+
+/// Compress in random sized pieces
+inline std::string compressPieces(z::Compressor &compressor,
+                                  const std::string &data) {
+  std::string compressed;
+
+  for (size_t offset = 0; offset < data.size();) {
+    const size_t piece = std::min<size_t>(rand() % 5000, data.size() - offset);
+
+    text::update(compressor, data.data() + offset, piece, compressed);
+    offset += piece;
+  }
+  return text::finish(compressor, compressed);
+}
+
+/// Decompress in random sized pieces into a small buffer
+inline std::string uncompressPieces(z::Decompressor &decompressor,
+                                    const std::string &compressed) {
+  std::string data;
+  char buffer[97];
+
+  for (size_t offset = 0; offset < compressed.size();) {
+    const size_t piece =
+        std::min<size_t>(rand() % 3000, compressed.size() - offset);
+    const void *next = compressed.data() + offset;
+    size_t left = piece;
+
+    do {
+      const uint8_t *end =
+          decompressor.update(next, left, buffer, sizeof(buffer));
+
+      data.append(buffer, reinterpret_cast<const char *>(end) - buffer);
+    } while ((left > 0) && !decompressor.finished());
+    offset += piece - left;
+    if (decompressor.finished()) {
+      break;
+    }
+  }
+  decompressor.finish();
+  return data;
+}
+
+/// Compress in random sized pieces
+inline std::string deflate(const std::string &data, z::Framing framing) {
+  z::Deflater deflater(6, framing);
+
+  return compressPieces(deflater, data);
+}
+
+/// Decompress in random sized pieces into a small buffer
+inline std::string inflate(const std::string &compressed,
+                           z::Framing framing) {
+  z::Inflater inflater(framing);
+
+  return uncompressPieces(inflater, compressed);
+}
+
+#endif // __CompressPieces_h__
@@ -0,0 +1,34 @@
+#include "os/File.h"
+#include "os/FileHash.h"
+#include <stdio.h>
+#include <string>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+int main(int argc, char *argv[]) {
+  const std::string path(argc < 2 ? "bin/logs/testFileHash.bin" : argv[1]);
+  const std::string empty = path + ".empty";
+  std::string contents;
+
+  for (int i = 0; contents.size() < 3 * 1024 * 1024; ++i) {
+    contents += std::to_string(i * 7919);
+  }
+  {
+    io::File file(path, io::File::Binary, io::File::ReadWrite);
+
+    file.write(contents);
+  }
+  dotest(hash::hashFile<hash::sha256>(path) == hash::sha256(contents));
+  dotest(hash::hashFile<hash::sha256>(path, 4096) == hash::sha256(contents));
+  dotest(hash::hashFile<hash::sha256>(path, 7) == hash::sha256(contents));
+  {
+    io::File file(empty, io::File::Binary, io::File::ReadWrite);
+  }
+  dotest(hash::hashFile<hash::sha256>(empty) == hash::sha256("", 0));
+  ::remove(path.c_str());
+  ::remove(empty.c_str());
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include "os/HashMany.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestBlobs 100
+#else
+#define TestBlobs 20000
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+/// Does hashMany treat a hash as SHA-256
+template <class Hasher> bool isSHA256(const hash::SpecificHash<Hasher> &) {
+  return hash::IsSHA256<Hasher>::value;
+}
+
+/// The fastest of a few runs, in seconds, so a busy machine skews less
+template <class Function> double fastest(Function function) {
+  double best = 0.0;
+
+  for (int run = 0; run < 3; ++run) {
+    const Clock::time_point start = Clock::now();
+
+    function();
+
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    best = (0 == run) || (seconds < best) ? seconds : best;
+  }
+  return best;
+}
+
+const char *engineName(hash::SHA256Engine engine) {
+  switch (engine) {
+  case hash::SHA256Automatic:
+    return "automatic";
+  case hash::SHA256Portable:
+    return "portable";
+  case hash::SHA256AVX2:
+    return "avx2";
+  case hash::SHA256Extensions:
+    return "sha-ni";
+  }
+  return "unknown";
+}
+
+int main(int /*argc*/, char * /*argv*/[]) {
+  const hash::SHA256Engine engines[] = {
+      hash::SHA256Portable, hash::SHA256AVX2, hash::SHA256Extensions,
+      hash::SHA256Automatic};
+  std::vector<std::string> blobs;
+  std::vector<hash::Span> spans;
+  std::vector<hash::sha256> expected, digests;
+  std::vector<hash::md5> md5s;
+  size_t bytes = 0;
+  double fastestSpeed = 0.0, automaticSpeed = 0.0;
+
+  // every length around the one and two block padding boundaries
+  for (size_t size = 0; size < 300; ++size) {
+    blobs.push_back(std::string(size, static_cast<char>('a' + size % 26)));
+  }
+  for (int i = 0; blobs.size() < TestBlobs; ++i) {
+    blobs.push_back(std::string(1024 + (i * 7919) % 3072,
+                                static_cast<char>(i)));
+  }
+  for (size_t i = 0; i < blobs.size(); ++i) {
+    hash::Span span = {blobs[i].data(), blobs[i].size()};
+
+    spans.push_back(span);
+    bytes += blobs[i].size();
+  }
+
+  dotest(isSHA256(hash::sha256()));
+  dotest(!isSHA256(hash::md5()));
+
+  double seconds = fastest([&]() {
+    expected.clear();
+    for (size_t i = 0; i < blobs.size(); ++i) {
+      expected.push_back(hash::sha256(blobs[i].data(), blobs[i].size()));
+    }
+  });
+
+  fastestSpeed = bytes / seconds / 1048576.0;
+  printf("%-10s %8.1f MiB/s\n", "one-by-one", fastestSpeed);
+  dotest(hash::supported(hash::SHA256Portable));
+  for (auto engine : engines) {
+    if (!hash::supported(engine)) {
+      printf("%-10s not supported\n", engineName(engine));
+      continue;
+    }
+    seconds = fastest([&]() {
+      digests.clear();
+      hash::hashMany(spans, digests, engine);
+    });
+    const double speed = bytes / seconds / 1048576.0;
+
+    printf("%-10s %8.1f MiB/s\n", engineName(engine), speed);
+    if (hash::SHA256Automatic == engine) {
+      automaticSpeed = speed;
+    } else if (hash::SHA256Portable != engine) {
+      fastestSpeed = std::max(fastestSpeed, speed);
+    }
+    dotest(digests.size() == expected.size());
+    for (size_t i = 0; i < expected.size() && i < digests.size(); ++i) {
+      if (digests[i] != expected[i]) {
+        fprintf(stderr, "FAIL: %s size %d\n", engineName(engine),
+                static_cast<int>(blobs[i].size()));
+        break;
+      }
+    }
+    hash::hashMany(spans.data(), 3, digests.data(), engine);
+    dotest(digests[2] == expected[2]);
+    hash::hashMany(spans.data(), 0, digests.data(), engine);
+  }
+
+  // automatic must keep up with the fastest engine it could have picked
+  dotest(automaticSpeed >= 0.75 * fastestSpeed);
+
+  hash::hashMany(spans, md5s);
+  dotest(md5s.size() == spans.size());
+  dotest(md5s[299] == hash::md5(blobs[299]));
+  return 0;
+}
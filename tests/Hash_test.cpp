@@ -1,5 +1,8 @@
 #include "os/Hash.h"
+#include <set>
 #include <stdio.h>
+#include <type_traits>
+#include <unordered_set>
 
 #define dotest(condition)                                                      \
   if (!(condition)) {                                                          \
@@ -16,7 +19,168 @@ void testConstness(const T &hash, const std::string &valueToHash) {
   dotest(rawHash == valueHashRaw);
 }
 
+void testIncremental() {
+  std::string contents;
+  hash::sha256::Incremental hasher;
+
+  for (int i = 0; i < 100000; ++i) {
+    contents += std::to_string(i);
+  }
+  for (size_t offset = 0; offset < contents.size(); offset += 1000) {
+    hasher.update(contents.data() + offset,
+                  std::min(size_t(1000), contents.size() - offset));
+  }
+  dotest(hasher.finish() == hash::sha256(contents));
+  dotest(hasher.finish() == hash::sha256("", 0));
+  dotest(hasher.update(std::string("te")).update("st", 2).finish() ==
+         hash::sha256("test"));
+#if OpenSSLAvailable
+  hash::openssl_md5::Incremental md5;
+
+  dotest(md5.update(contents).finish() == hash::openssl_md5(contents));
+#endif
+}
+
+void testFastHashes() {
+  typedef hash::siphash24<0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL>
+      siphash;
+  std::string bytes, large, hex;
+
+  for (int i = 0; i < 15; ++i) {
+    bytes += static_cast<char>(i);
+  }
+  for (int i = 0; i < 100000; ++i) {
+    large += std::to_string(i);
+  }
+
+  dotest(hash::xxh64("", 0).hex(hex) == "ef46db3751d8e999");
+  dotest(hash::xxh64("abc", 3).hex(hex) == "44bc2cf5ad770999");
+  dotest(hash::xxh64("abc", 3).size() == 8);
+  dotest(std::string(hash::xxh64().name()) == "xxh64");
+  dotest(hash::crc32c("123456789", 9).hex(hex) == "e3069283");
+  dotest(hash::crc32c("", 0).hex(hex) == "00000000");
+  dotest(hash::crc32c("", 0).size() == 4);
+  dotest(siphash("", 0).hex(hex) == "310e0edd47db6f72");
+  dotest(siphash(bytes).hex(hex) == "e545be4961ca29a1");
+  dotest(siphash(bytes).hex() != (hash::siphash24<1, 2>(bytes).hex()));
+  dotest(hash::SipHash24::hash(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL,
+                               bytes.data(),
+                               bytes.size()) == 0xa129ca6149be45e5ULL);
+  dotest(hash::siphash24random(bytes) == hash::siphash24random(bytes));
+  dotest(hash::siphash24random(bytes).hex() != siphash(bytes).hex());
+  dotest((hash::SipHash24RandomHasher::key()[0] != 0) ||
+         (hash::SipHash24RandomHasher::key()[1] != 0));
+  { // a runtime key hashes the same as that key fixed at compile time
+    hash::SipHash24 keyed(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL);
+    uint8_t value[8];
+
+    keyed.update(bytes.data(), bytes.size());
+    keyed.finish(value);
+    dotest(siphash::fromData(value, sizeof(value)) == siphash(bytes));
+  }
+
+  // a CRC can be continued, and pieces hash the same as the whole
+  dotest(hash::CRC32CHasher::update(~0u, large.data(), large.size()) ==
+         hash::CRC32CHasher::update(
+             hash::CRC32CHasher::update(~0u, large.data(), 7), large.data() + 7,
+             large.size() - 7));
+  for (size_t piece = 1; piece < 70; piece += 3) {
+    hash::xxh64::Incremental xxh;
+    hash::crc32c::Incremental crc;
+    siphash::Incremental sip;
+    hash::siphash24random::Incremental random;
+
+    for (size_t offset = 0; offset < 10000; offset += piece) {
+      const size_t count = std::min(piece, size_t(10000) - offset);
+
+      xxh.update(large.data() + offset, count);
+      crc.update(large.data() + offset, count);
+      sip.update(large.data() + offset, count);
+      random.update(large.data() + offset, count);
+    }
+    dotest(xxh.finish() == hash::xxh64(large.data(), 10000));
+    dotest(crc.finish() == hash::crc32c(large.data(), 10000));
+    dotest(sip.finish() == siphash(large.data(), 10000));
+    dotest(random.finish() == hash::siphash24random(large.data(), 10000));
+  }
+}
+
+void testDigest() {
+  typedef hash::sha256::Digest Digest;
+  const text::Base64Style styles[] = {text::Base64, text::Base64URL,
+                                      text::Base64NoPadding,
+                                      text::Base64URLNoPadding};
+  std::unordered_set<Digest> hashed;
+  std::set<Digest> ordered;
+  char hex[Digest::HexSize + 1], base64[Digest::Base64Size + 1];
+
+  dotest(std::is_trivially_copyable<Digest>::value);
+  dotest(sizeof(Digest) == 32);
+  dotest(Digest::size() == 32);
+  dotest(sizeof(hash::Digest<5>) == 5);
+  for (int i = 0; i < 100; ++i) {
+    const std::string value = std::to_string(i);
+    const hash::sha256 expected(value);
+    const Digest digest = hash::sha256::digest(value.data(), value.size());
+    hash::sha256::Incremental hasher;
+    Digest incremental;
+
+    hasher.update(value.data(), value.size());
+    dotest(hasher.finish(incremental) == digest);
+    dotest(digest == expected.value());
+    dotest(digest.valid());
+    dotest(expected.hex() == digest.toHex(hex));
+    dotest(Digest::fromHex(hex) == digest);
+    dotest(hash::sha256::fromData(digest.bytes, digest.size()) == expected);
+    for (auto style : styles) {
+      dotest(expected.base64(style) == digest.toBase64(base64, style));
+    }
+    hashed.insert(digest);
+    ordered.insert(digest);
+  }
+  dotest(hashed.size() == 100);
+  dotest(ordered.size() == 100);
+  for (auto i = ordered.begin(), last = i++; i != ordered.end(); last = i++) {
+    const std::string lastHex = last->toHex(hex);
+
+    dotest(*last < *i);
+    dotest(*i > *last);
+    dotest(*last <= *i);
+    dotest(*last != *i);
+    dotest(lastHex < i->toHex(hex));
+  }
+
+  const hash::Digest<5> small = {{1, 2, 3, 4, 0xff}};
+  const hash::Digest<5> empty = {{0}};
+
+  dotest(std::string(small.toHex(hex)) == "01020304ff");
+  dotest(std::string(small.toBase64(base64, text::Base64)) == "AQIDBP8=");
+  dotest(!empty.valid());
+  dotest(empty < small);
+  dotest(std::hash<hash::Digest<5>>()(small) !=
+         std::hash<hash::Digest<5>>()(empty));
+  try {
+    Digest::fromHex(std::string(Digest::HexSize, 'g').c_str());
+    dotest(false /* fromHex should have thrown */);
+  } catch (const msg::Exception &) {
+  }
+  try {
+    Digest::fromHex(std::string(Digest::HexSize + 1, 'a').c_str());
+    dotest(false /* fromHex should have rejected the extra digit */);
+  } catch (const msg::Exception &) {
+  }
+  try {
+    Digest::fromHex(std::string(Digest::HexSize - 1, 'a').c_str());
+    dotest(false /* fromHex should have rejected the missing digit */);
+  } catch (const msg::Exception &) {
+  }
+}
+
 int main(int /*argc*/, char * /*argv*/[]) {
+  testFastHashes();
+  testDigest();
+  testIncremental();
+
   int iterations = 13000;
 #ifdef __Tracer_h__
   iterations = 1;
@@ -0,0 +1,155 @@
+#include "os/NonBlockingQueue.h"
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestIterations 400
+#else
+#define TestIterations 40000
+#endif
+
+typedef exec::NonBlockingQueue<int> IntQueue;
+
+/// An element whose copy can be made to throw
+struct Fragile {
+  explicit Fragile(int v = 0) : value(v) {}
+  Fragile(const Fragile &other) : value(other.value) {
+    if (failCopies) {
+      throw std::runtime_error("copy failed");
+    }
+  }
+  Fragile &operator=(const Fragile &other) = default;
+  int value;
+  static bool failCopies;
+};
+bool Fragile::failCopies = false;
+
+void produce(IntQueue &queue, int start) {
+  for (int value = start; value < start + TestIterations; ++value) {
+    queue.enqueue(value);
+  }
+}
+
+void consume(IntQueue &queue, long long &sum) {
+  for (int i = 0; i < TestIterations; ++i) {
+    sum += queue.dequeue();
+  }
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  IntQueue queue;
+  exec::NonBlockingQueue<std::string> strings;
+  std::string value;
+  int number;
+
+  dotest(queue.empty());
+  dotest(!queue.dequeue(number));
+  dotest(!queue.dequeue(number, 0.01));
+  queue.enqueue(1).enqueue(2);
+  dotest(!queue.empty());
+  dotest(queue.dequeue() == 1);
+  dotest(queue.dequeue(number));
+  dotest(number == 2);
+  dotest(queue.empty());
+
+  for (int i = 0; i < 100; ++i) {
+    strings.enqueue(std::to_string(i));
+  }
+  for (int i = 0; i < 50; ++i) {
+    dotest(strings.dequeue(value, 0.01));
+    dotest(value == std::to_string(i));
+  }
+  { // a throwing copy leaves nothing behind and the queue still works
+    exec::NonBlockingQueue<Fragile> fragile;
+    Fragile element(7), out;
+
+    Fragile::failCopies = true;
+    for (int i = 0; i < 5; ++i) {
+      try {
+        fragile.enqueue(element);
+        dotest(false /* copy should throw */);
+      } catch (const std::runtime_error &) {
+      }
+    }
+    Fragile::failCopies = false;
+    dotest(fragile.empty());
+    fragile.enqueue(element);
+    dotest(fragile.dequeue(out) && (out.value == 7));
+    dotest(fragile.empty());
+    // Fragile has no move constructor, so taking it out copies
+    for (int i = 0; i < 5; ++i) {
+      fragile.enqueue(element);
+      Fragile::failCopies = true;
+      try {
+        if (i % 2 == 0) {
+          fragile.dequeue(out);
+        } else {
+          fragile.dequeue();
+        }
+        dotest(false /* move should throw */);
+      } catch (const std::runtime_error &) {
+      }
+      Fragile::failCopies = false;
+      dotest(fragile.empty());
+    }
+    dotest(fragile.empty());
+    fragile.enqueue(element);
+    dotest(fragile.dequeue().value == 7);
+  }
+
+  for (int threadsPerSide = 1; threadsPerSide <= 8; threadsPerSide *= 2) {
+    std::vector<std::thread> threads;
+    std::vector<long long> sums(threadsPerSide, 0);
+    long long total = 0, expected = 0;
+
+    for (int t = 0; t < threadsPerSide; ++t) {
+      threads.push_back(
+          std::thread(produce, std::ref(queue), t * TestIterations));
+      threads.push_back(
+          std::thread(consume, std::ref(queue), std::ref(sums[t])));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (int t = 0; t < threadsPerSide; ++t) {
+      total += sums[t];
+    }
+    for (long long v = 0; v < TestIterations * threadsPerSide; ++v) {
+      expected += v;
+    }
+    printf("%d producers/consumers moved %d items\n", threadsPerSide,
+           TestIterations * threadsPerSide);
+    dotest(total == expected);
+    dotest(queue.empty());
+  }
+
+  queue.enqueue(3);
+  queue.close();
+  try {
+    queue.enqueue(1);
+    dotest(false /* enqueue after close */);
+  } catch (const IntQueue::Closed &) {
+  }
+  try {
+    queue.dequeue();
+    dotest(false /* dequeue after close */);
+  } catch (const IntQueue::Closed &) {
+  }
+  try {
+    queue.empty();
+    dotest(false /* empty after close */);
+  } catch (const IntQueue::Closed &exception) {
+    IntQueue::Closed copy(exception);
+
+    dotest(std::string(copy.what()).find("Closed") != std::string::npos);
+  }
+  return 0;
+}
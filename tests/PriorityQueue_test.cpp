@@ -0,0 +1,118 @@
+#include "os/PriorityQueue.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestIterations 100
+#else
+#define TestIterations 10000
+#endif
+
+typedef exec::PriorityQueue<int> IntQueue;
+
+void Consume(IntQueue &queue, int count, std::vector<int> &out) {
+  for (int i = 0; i < count; ++i) {
+    out.push_back(queue.dequeue());
+  }
+}
+
+void Retry(exec::DelayQueue<std::string> &queue, std::string &out) {
+  out = queue.dequeue();
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  IntQueue queue;
+  exec::PriorityQueue<int, std::greater<int>> smallest(4);
+  exec::DelayQueue<std::string> delayed;
+  std::vector<int> values, received;
+  std::string text;
+  int value;
+
+  srand(42);
+  for (int i = 0; i < TestIterations; ++i) {
+    values.push_back(rand());
+    queue.enqueue(values.back());
+  }
+  dotest(queue.size() == TestIterations);
+  std::sort(values.rbegin(), values.rend());
+  for (int i = 0; i < TestIterations; ++i) {
+    dotest(queue.dequeue() == values[i]);
+  }
+  dotest(queue.empty());
+  dotest(!queue.dequeue(value, 0.01));
+
+  for (int i = 4; i > 0; --i) {
+    dotest(smallest.enqueue(i, 0.01));
+  }
+  dotest(smallest.full());
+  dotest(!smallest.enqueue(0, 0.01));
+  dotest(smallest.dequeue(value, 0.01));
+  dotest(value == 1);
+  dotest(smallest.dequeue() == 2);
+
+  std::thread consumer(Consume, std::ref(queue), TestIterations,
+                       std::ref(received));
+  for (int i = 0; i < TestIterations; ++i) {
+    queue.enqueue(i);
+  }
+  consumer.join();
+  dotest(received.size() == TestIterations);
+  std::sort(received.begin(), received.end());
+  for (int i = 0; i < TestIterations; ++i) {
+    dotest(received[i] == i);
+  }
+
+  const dt::DateTime start;
+
+  delayed.enqueue("later", 0.2);
+  delayed.enqueue("sooner", 0.1);
+  delayed.enqueue("now", dt::DateTime() - 1.0);
+  delayed.enqueue("now too", dt::DateTime() - 1.0);
+  dotest(delayed.size() == 4);
+  dotest(delayed.ready());
+  dotest(delayed.dequeue() == "now");
+  dotest(delayed.dequeue(text, 0.01));
+  dotest(text == "now too");
+  dotest(!delayed.ready());
+  dotest(!delayed.dequeue(text, 0.01));
+  dotest(delayed.dequeue() == "sooner");
+  dotest(dt::DateTime() - start >= 0.1);
+  dotest(delayed.dequeue(text, 1.0));
+  dotest(text == "later");
+  dotest(dt::DateTime() - start >= 0.2);
+  dotest(delayed.empty());
+
+  std::thread retry(Retry, std::ref(delayed), std::ref(text));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  delayed.enqueue("retry", 0.05); // wakes the sleeping consumer early
+  retry.join();
+  dotest(text == "retry");
+
+  smallest.close();
+  delayed.close();
+  queue.close();
+  try {
+    queue.enqueue(1);
+    dotest(false /* enqueue after close */);
+  } catch (const IntQueue::Closed &exception) {
+    IntQueue::Closed copy(exception);
+
+    dotest(std::string(copy.what()).find("Closed") != std::string::npos);
+  }
+  try {
+    delayed.dequeue();
+    dotest(false /* dequeue after close */);
+  } catch (const exec::DelayQueue<std::string>::Closed &exception) {
+    exec::DelayQueue<std::string>::Closed copy(exception);
+  }
+  return 0;
+}
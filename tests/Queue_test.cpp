@@ -1,6 +1,10 @@
 #include "os/Queue.h"
+#include <iterator>
+#include <memory>
 #include <stdio.h>
+#include <string>
 #include <thread>
+#include <vector>
 
 #define dotest(condition)                                                      \
   if (!(condition)) {                                                          \
@@ -26,7 +30,126 @@ void PassTheBuck(exec::Queue<int> &in, exec::Queue<int> &out) {
   }
 }
 
+void BatchConsumer(exec::Queue<std::string> &in, int expected,
+                   std::vector<std::string> &out) {
+  std::vector<std::string> batch;
+
+  while (static_cast<int>(out.size()) < expected) {
+    batch.clear();
+    in.dequeueBatch(std::back_inserter(batch), 64, 0.01);
+    out.insert(out.end(), batch.begin(), batch.end());
+  }
+}
+
+void TestBatchesAndMoves() {
+  exec::Queue<std::unique_ptr<int>> pointers;
+  exec::Queue<std::string> strings(10);
+  std::vector<std::string> records, received;
+  std::unique_ptr<int> pointer(new int(5));
+
+  pointers.enqueue(std::move(pointer));
+  dotest(!pointer);
+  pointers.emplace(new int(6));
+  dotest(*pointers.dequeue() == 5);
+  dotest(pointers.dequeue(pointer, 0.01));
+  dotest(*pointer == 6);
+  dotest(!pointers.dequeue(pointer, 0.01));
+
+  for (int i = 0; i < TestIterations; ++i) {
+    records.push_back(std::string(100, 'a' + i % 26) + std::to_string(i));
+  }
+  std::thread consumer(BatchConsumer, std::ref(strings),
+                       static_cast<int>(records.size()), std::ref(received));
+  strings.enqueueBatch(records.begin(), records.end());
+  consumer.join();
+  dotest(received == records);
+  dotest(strings.empty());
+
+  strings.emplace(3, 'x');
+  dotest(strings.dequeue() == "xxx");
+  strings.enqueueBatch(std::make_move_iterator(records.begin()),
+                       std::make_move_iterator(records.begin() + 5));
+  dotest(records[0].size() == 0);
+  received.clear();
+  dotest(strings.dequeueBatch(std::back_inserter(received), 3, 0.01) == 3);
+  dotest(strings.dequeueBatch(std::back_inserter(received), 3, 0.01) == 2);
+  dotest(strings.dequeueBatch(std::back_inserter(received), 3, 0.01) == 0);
+  dotest(received.size() == 5);
+  dotest(received[4] == std::string(100, 'e') + "4");
+  try {
+    strings.dequeueBatch(std::back_inserter(received), 0, 0.01);
+    dotest(false /* dequeueBatch with no room for values */);
+  } catch (const msg::Exception &) {
+  }
+  strings.close();
+  try {
+    strings.dequeueBatch(std::back_inserter(received), 3, 0.01);
+    dotest(false /* dequeueBatch after close */);
+  } catch (const exec::Queue<std::string>::Closed &) {
+  }
+}
+
+void TestTimeoutsAndStats() {
+  exec::Queue<int> queue(2);
+  auto start = std::chrono::steady_clock::now();
+  int value = 0;
+
+  dotest(!queue.dequeue(value, 0.05));
+  dotest(std::chrono::steady_clock::now() - start >=
+         std::chrono::milliseconds(50));
+  dotest(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+  queue.enqueue(1).enqueue(2);
+  start = std::chrono::steady_clock::now();
+  dotest(!queue.enqueue(3, 0.05));
+  dotest(std::chrono::steady_clock::now() - start >=
+         std::chrono::milliseconds(50));
+  dotest(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+  exec::Queue<int>::Stats stats = queue.stats(true);
+  uint64_t enqueueWaits = 0, dequeueWaits = 0;
+
+  for (int bucket = 0; bucket < exec::Queue<int>::Stats::Buckets; ++bucket) {
+    enqueueWaits += stats.enqueueWaits[bucket];
+    dequeueWaits += stats.dequeueWaits[bucket];
+  }
+  dotest(stats.enqueues == 2);
+  dotest(stats.dequeues == 0);
+  dotest(stats.size == 2);
+  dotest(stats.highWaterMark == 2);
+  dotest(enqueueWaits == 1);
+  dotest(dequeueWaits == 1);
+  dotest(stats.enqueueWaits[exec::Queue<int>::Stats::Buckets - 1] == 0);
+  dotest(stats.enqueueWaitSeconds >= 0.05);
+  dotest(stats.dequeueWaitSeconds >= 0.05);
+  dotest(stats.lockHeldSeconds >= 0.0);
+  dotest(stats.enqueueRate() > 0.0);
+
+  stats = queue.stats();
+  dotest(stats.enqueues == 0);
+  dotest(stats.highWaterMark == 2);
+  dotest(queue.dequeue(value, 0.01));
+  dotest(value == 1);
+  dotest(queue.dequeue() == 2);
+  stats = queue.stats();
+  dotest(stats.dequeues == 2);
+  dotest(stats.size == 0);
+  dotest(stats.dequeueRate() > 0.0);
+
+  uint64_t lockWaits = 0;
+
+  for (int bucket = 0; bucket < exec::Queue<int>::Stats::Buckets; ++bucket) {
+    lockWaits += stats.lockWaits[bucket];
+  }
+  dotest(lockWaits == 2 /* every call since the reset took the lock once */);
+  dotest(stats.lockWaitSeconds >= 0.0);
+  queue.close();
+  dotest(queue.stats().dequeues == 2);
+}
+
 int main(const int /*argc*/, const char *const /*argv*/[]) {
+  TestBatchesAndMoves();
+  TestTimeoutsAndStats();
+
   exec::Queue<int> in(3), out(0, 300);
   std::thread threads[] = {
       std::thread(PassTheBuck, std::ref(in), std::ref(out)),
@@ -62,6 +185,14 @@ int main(const int /*argc*/, const char *const /*argv*/[]) {
     printf("in.size()=%d full=%s\n", in.size(), in.full() ? "true" : "false");
   }
   printf("in queue empty %d times and full %d times\n", emptyCount, fullCount);
+
+  const exec::Queue<int>::Stats stats = in.stats();
+
+  printf("in: %0.0f enqueues/s, high water %d, lock held %0.6fs, lock "
+         "waited %0.6fs, producer waited %0.3fs, consumers waited %0.3fs\n",
+         stats.enqueueRate(), stats.highWaterMark, stats.lockHeldSeconds,
+         stats.lockWaitSeconds, stats.enqueueWaitSeconds,
+         stats.dequeueWaitSeconds);
   while (in.size() > 0) {
     printf("Queue not empty\n");
     std::this_thread::sleep_for(std::chrono::milliseconds(5));
@@ -0,0 +1,135 @@
+#include "os/Queue.h"
+#include "os/SPSCQueue.h"
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestIterations 1000
+#else
+#define TestIterations 200000
+#endif
+
+typedef exec::SPSCQueue<int64_t, 1024> TimeQueue;
+typedef std::chrono::steady_clock Clock;
+
+int64_t nanosecondsNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+/// Sends send-times so the consumer can measure handoff latency
+template <class Q> void produce(Q &queue, int count) {
+  for (int i = 0; i < count; ++i) {
+    queue.enqueue(nanosecondsNow());
+  }
+}
+
+/// Receives send-times and records how long each one took to arrive
+template <class Q> void consume(Q &queue, std::vector<int64_t> &latencies) {
+  for (size_t i = 0; i < latencies.size(); ++i) {
+    const int64_t sent = queue.dequeue();
+
+    latencies[i] = nanosecondsNow() - sent;
+  }
+}
+
+/// Runs a producer and a consumer and prints items/second and p99 latency
+template <class Q> double benchmark(Q &queue, const char *name) {
+  std::vector<int64_t> latencies(TestIterations);
+  const Clock::time_point start = Clock::now();
+  std::thread consumer(consume<Q>, std::ref(queue), std::ref(latencies));
+
+  produce(queue, TestIterations);
+  consumer.join();
+
+  const double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  const double rate = seconds > 0.0 ? TestIterations / seconds : 0.0;
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%-9s %12.0f items/s p50 %8.1fus p99 %8.1fus\n", name, rate,
+         latencies[latencies.size() / 2] / 1000.0,
+         latencies[latencies.size() * 99 / 100] / 1000.0);
+  dotest(latencies.front() >= 0);
+  return rate;
+}
+
+void slowProducer(exec::SPSCQueue<std::string, 4> &queue) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.enqueue("late");
+}
+
+void closer(exec::SPSCQueue<std::string, 4> &queue) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.close();
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  exec::SPSCQueue<std::string, 4> strings;
+  exec::SPSCQueue<std::unique_ptr<int>, 2> pointers;
+  std::unique_ptr<int> pointer(new int(7));
+  std::string value;
+
+  dotest(strings.empty());
+  dotest(!strings.full());
+  dotest(!strings.tryDequeue(value));
+  dotest(!strings.dequeue(value, 0.01));
+  for (int i = 0; i < 4; ++i) {
+    dotest(strings.tryEnqueue(std::to_string(i)));
+  }
+  dotest(strings.full());
+  dotest(strings.size() == 4);
+  dotest(!strings.tryEnqueue("full"));
+  dotest(!strings.enqueue("full", 0.01));
+  for (int i = 0; i < 4; ++i) {
+    dotest(strings.dequeue() == std::to_string(i));
+  }
+  dotest(strings.empty());
+
+  pointers.enqueue(std::move(pointer));
+  dotest(!pointer);
+  dotest(pointers.tryDequeue(pointer));
+  dotest(*pointer == 7);
+  pointers.enqueue(std::unique_ptr<int>(new int(8))); // left for destructor
+
+  std::thread late(slowProducer, std::ref(strings));
+  dotest(strings.dequeue(value, 5.0)); // sleeps until woken
+  dotest(value == "late");
+  late.join();
+
+  for (int i = 0; i < 3; ++i) {
+    TimeQueue spsc;
+    exec::Queue<int64_t> locked(1024);
+
+    benchmark(spsc, "SPSCQueue");
+    benchmark(locked, "Queue");
+    dotest(spsc.empty());
+  }
+
+  std::thread closing(closer, std::ref(strings));
+  try {
+    strings.dequeue();
+    dotest(false /* dequeue woken by close */);
+  } catch (const exec::SPSCQueue<std::string, 4>::Closed &exception) {
+    exec::SPSCQueue<std::string, 4>::Closed copy(exception);
+
+    dotest(std::string(copy.what()).find("Closed") != std::string::npos);
+  }
+  closing.join();
+  try {
+    strings.enqueue("closed");
+    dotest(false /* enqueue after close */);
+  } catch (const exec::SPSCQueue<std::string, 4>::Closed &) {
+  }
+  return 0;
+}
@@ -1,12 +1,202 @@
 #include "os/Hash.h"
 #include "os/SymmetricEncrypt.h"
+#include <chrono>
+#include <memory>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
 
 #define dotest(condition)                                                      \
   if (!(condition)) {                                                          \
     fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
   }
 
+std::string randomData(size_t size) {
+  std::string data(size, '\0');
+
+  for (auto &c : data) {
+    c = static_cast<char>(rand());
+  }
+  return data;
+}
+
+/// Run buffer through a Cipher in place, in random sized pieces
+size_t cryptPiecesInPlace(crypto::Cipher &cipher, std::string &buffer,
+                          size_t size, const std::string &iv) {
+  uint8_t *const begin = reinterpret_cast<uint8_t *>(&buffer[0]);
+  uint8_t *end = begin;
+  size_t offset = 0;
+
+  cipher.start(iv.empty() ? NULL : iv.data());
+  while (offset < size) {
+    const size_t piece = std::min<size_t>(rand() % 40, size - offset);
+
+    end = cipher.update(begin + offset, piece, end);
+    offset += piece;
+  }
+  return cipher.finish(end) - begin;
+}
+
+/// Run data through a Cipher in random sized pieces
+std::string cryptPieces(crypto::Cipher &cipher, const std::string &data,
+                        const std::string &iv) {
+  std::string result(cipher.maximumOutput(data.size()), '\0');
+  uint8_t *const begin = reinterpret_cast<uint8_t *>(&result[0]);
+  uint8_t *end = begin;
+  size_t offset = 0;
+
+  cipher.start(iv.empty() ? NULL : iv.data());
+  while (offset < data.size()) {
+    const size_t piece = std::min<size_t>(rand() % 40, data.size() - offset);
+
+    end = cipher.update(data.data() + offset, piece, end);
+    offset += piece;
+  }
+  result.erase(cipher.finish(end) - begin);
+  return result;
+}
+
+void testCipher(const std::string &key) {
+  crypto::AES256 padded(key);
+  crypto::AES256_CBC unpadded(key);
+  std::unique_ptr<crypto::Cipher> encrypt(
+      padded.cipher(crypto::Cipher::Encrypt));
+  std::unique_ptr<crypto::Cipher> decrypt(
+      padded.cipher(crypto::Cipher::Decrypt));
+  std::unique_ptr<crypto::Cipher> rawEncrypt(
+      unpadded.cipher(crypto::Cipher::Encrypt));
+  std::unique_ptr<crypto::Cipher> rawDecrypt(
+      unpadded.cipher(crypto::Cipher::Decrypt));
+  std::string result;
+
+  dotest(encrypt->direction() == crypto::Cipher::Encrypt);
+  dotest(decrypt->direction() == crypto::Cipher::Decrypt);
+  dotest(16 == encrypt->blockSize());
+  dotest(16 == encrypt->ivSize());
+  dotest(encrypt->maximumMessageOutput(15) == 16);
+  dotest(encrypt->maximumMessageOutput(16) == 32);
+  dotest(decrypt->maximumMessageOutput(32) == 32);
+  dotest(rawEncrypt->maximumMessageOutput(32) == 32);
+  // the same cipher for many messages, in pieces and whole, in place or not
+  for (int message = 0; message < 300; ++message) {
+    const std::string data = randomData(rand() % 200);
+    const std::string aligned = data.substr(0, data.size() / 16 * 16);
+    const std::string iv = rand() % 3 == 0 ? "" : randomData(16);
+    const std::string expected = padded.encryptWithIV(data, iv);
+
+    dotest(cryptPieces(*encrypt, data, iv) == expected);
+    dotest(cryptPieces(*decrypt, expected, iv) == data);
+    dotest(encrypt->crypt(data, iv, result) == expected);
+    dotest(decrypt->crypt(expected, iv, result) == data);
+    dotest(cryptPieces(*rawEncrypt, aligned, iv) ==
+           unpadded.encryptWithIV(aligned, iv));
+    dotest(cryptPieces(*rawDecrypt, rawEncrypt->crypt(aligned, iv, result),
+                       iv) == aligned);
+
+    std::string buffer = data + std::string(16, '\0');
+    const char *const ivData = iv.empty() ? NULL : iv.data();
+    size_t size = encrypt->crypt(&buffer[0], data.size(), buffer.size(),
+                                 ivData);
+
+    dotest(buffer.substr(0, size) == expected);
+    size = decrypt->crypt(&buffer[0], size, size, ivData);
+    dotest(buffer.substr(0, size) == data);
+    buffer = expected;
+    size = cryptPiecesInPlace(*decrypt, buffer, buffer.size(), iv);
+    dotest(buffer.substr(0, size) == data);
+    buffer = data + std::string(16, '\0');
+    size = cryptPiecesInPlace(*encrypt, buffer, data.size(), iv);
+    dotest(buffer.substr(0, size) == expected);
+    buffer = aligned;
+    size =
+        rawEncrypt->crypt(&buffer[0], aligned.size(), aligned.size(), ivData);
+    dotest(size == aligned.size());
+    dotest(rawDecrypt->crypt(&buffer[0], size, size, ivData) == size);
+    dotest(buffer == aligned);
+  }
+  // finish() leaves the cipher ready for a message with no iv
+  cryptPieces(*encrypt, "abandoned", "1234567890123456");
+  dotest(encrypt->crypt("test", "", result) == padded.encrypt("test"));
+
+  std::string buffer(20, 'x');
+
+  try {
+    encrypt->crypt(&buffer[0], 16, 20);
+    dotest(false);
+  } catch (const crypto::BufferTooSmallError &) {
+  }
+  try {
+    rawEncrypt->crypt(&buffer[0], 20, 20);
+    dotest(false);
+  } catch (const crypto::AlignmentError &) {
+  }
+  try {
+    encrypt->crypt("test", " ", result);
+    dotest(false);
+  } catch (const crypto::IVWrongSizeError &) {
+  }
+  try {
+    decrypt->crypt(randomData(32), "", result);
+    dotest(false);
+  } catch (const crypto::Exception &) {
+  }
+  dotest(decrypt->crypt(padded.encrypt("after"), "", result) == "after");
+
+  // decrypting only needs room for the message, not another block
+  const std::string message = randomData(32);
+  const std::string encrypted = padded.encrypt(message);
+  size_t decryptedSize = encrypted.size();
+
+  buffer.assign(encrypted.size(), '\0');
+  padded.decryptInPlace(encrypted.data(), encrypted.size(), "", &buffer[0],
+                        decryptedSize);
+  dotest(buffer.substr(0, decryptedSize) == message);
+}
+
+void benchmarkCipher(const std::string &key) {
+#ifdef __Tracer_h__
+  const int messages = 1000, repeat = 1;
+#else
+  const int messages = 200000, repeat = 100;
+#endif
+  crypto::AES256 aes(key);
+  std::unique_ptr<crypto::Cipher> cipher(aes.cipher(crypto::Cipher::Encrypt));
+  const std::string message = randomData(64), iv = randomData(16);
+  std::string large = randomData(1024 * 1024 + 16), result;
+  size_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < messages; ++i) {
+    total += aes.encryptWithIV(message, iv).size();
+  }
+
+  std::chrono::duration<double> oneShot =
+      std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; ++i) {
+    total += cipher->crypt(message, iv, result).size();
+  }
+
+  std::chrono::duration<double> reused =
+      std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; ++i) {
+    total += cipher->crypt(&large[0], large.size() - 16, large.size(),
+                           iv.data());
+  }
+
+  std::chrono::duration<double> inPlace =
+      std::chrono::steady_clock::now() - start;
+
+  printf("64 byte messages: %0.0f/s encryptWithIV %0.0f/s Cipher "
+         "1 MB in place: %0.2f GB/s\n",
+         messages / oneShot.count(), messages / reused.count(),
+         double(large.size() - 16) * repeat / inPlace.count() / 1e9);
+  dotest(total > 0);
+}
+
 int main(int /*argc*/, char * /*argv*/[]) {
   int iterations = 75;
 #ifdef __Tracer_h__
@@ -167,5 +357,15 @@ int main(int /*argc*/, char * /*argv*/[]) {
       fprintf(stderr, "FAILED: Exception: %s\n", exception.what());
     }
   }
+  try {
+    hash::sha256 keyData("key");
+    std::string key(reinterpret_cast<const char *>(keyData.buffer()),
+                    keyData.size());
+
+    testCipher(key);
+    benchmarkCipher(key);
+  } catch (const std::exception &exception) {
+    fprintf(stderr, "FAILED: Exception: %s\n", exception.what());
+  }
   return 0;
 }
@@ -0,0 +1,117 @@
+#include "Benchmark.h"
+#include "os/TextSearch.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+std::string randomText(size_t size, const char *alphabet) {
+  const size_t letters = strlen(alphabet);
+  std::string text(size, ' ');
+
+  for (auto &c : text) {
+    c = alphabet[rand() % letters];
+  }
+  return text;
+}
+
+void testMatching() {
+  const std::string base = randomText(300, "abcdefghijklmnop");
+
+  dotest(text::matching("", 0, "", 0) == 0);
+  dotest(text::matching("abc", 3, "abd", 3) == 2);
+  dotest(text::matching("abc", 3, "ab", 2) == 2);
+  for (size_t size = 0; size < base.size(); ++size) {
+    std::string other = base.substr(0, size);
+
+    dotest(text::matching(base.data(), base.size(), other.data(),
+                          other.size()) == size);
+    for (size_t at = 0; at < size; at += 5) {
+      std::string changed = other;
+
+      changed[at] = 'z';
+      dotest(text::matching(changed.data(), changed.size(), base.data(),
+                            base.size()) == at);
+    }
+  }
+}
+
+void testFind() {
+  const char *const sets[] = {"", "z", "\r\n", "xyz", "qrstuvwx",
+                              "0123456789xyz"};
+
+  dotest(text::findLineBreak("line\r\n", 6) == 4);
+  dotest(text::findLineBreak("line\n", 5) == 4);
+  dotest(text::findLineBreak("line", 4) == 4);
+  for (int repeat = 0; repeat < 500; ++repeat) {
+    const std::string haystack =
+        randomText(rand() % 200, "abcdefghijklmnopqrstuvwxyz0123456789\r\n");
+
+    for (auto set : sets) {
+      const std::string::size_type expected =
+          haystack.find_first_of(set, 0, strlen(set));
+
+      dotest(text::findFirstOf(haystack.data(), haystack.size(), set,
+                               strlen(set)) ==
+             (expected == std::string::npos ? haystack.size() : expected));
+    }
+  }
+}
+
+void testCount() {
+  for (int repeat = 0; repeat < 200; ++repeat) {
+    const std::string haystack = randomText(rand() % 20000, "ab\n");
+
+    dotest(text::count(haystack.data(), haystack.size(), '\n') ==
+           size_t(std::count(haystack.begin(), haystack.end(), '\n')));
+    dotest(text::count(haystack.data(), haystack.size(), 'c') == 0);
+  }
+
+  const std::string all(100000, 'x');
+
+  dotest(text::count(all.data(), all.size(), 'x') == all.size());
+}
+
+void testSpeed() {
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 200;
+#endif
+  const std::string text = randomText(1024 * 1024, "abcdefghijklmnop") + "\n";
+  const std::string same = text.substr(0, text.size() - 1) + "x";
+  size_t total = 0;
+
+  printf("matching: %0.2f GB/s ", speed(text.size(), repeat, [&]() {
+           total += text::matching(text.data(), text.size(), same.data(),
+                                   same.size());
+         }));
+  printf("findLineBreak: %0.2f GB/s ", speed(text.size(), repeat, [&]() {
+           total += text::findLineBreak(text.data(), text.size());
+         }));
+  printf("findFirstOf(4): %0.2f GB/s ", speed(text.size(), repeat, [&]() {
+           total += text::findFirstOf(text.data(), text.size(), "\n\r\t ", 4);
+         }));
+  printf("count: %0.2f GB/s\n", speed(text.size(), repeat, [&]() {
+           total += text::count(text.data(), text.size(), 'a');
+         }));
+  dotest(total > 0);
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  try {
+    testMatching();
+    testFind();
+    testCount();
+    testSpeed();
+  } catch (const std::exception &exception) {
+    printf("FAIL: Exception not caught: %s\n", exception.what());
+  }
+  return 0;
+}
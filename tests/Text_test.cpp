@@ -1,12 +1,421 @@
+#include "Benchmark.h"
+#include "os/File.h"
+#include "os/MemoryMappedFile.h"
 #include "os/Text.h"
+#include <algorithm>
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <vector>
 
 #define dotest(condition)                                                      \
   if (!(condition)) {                                                          \
     fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
   }
 
-int main(const int /*argc*/, const char *const /*argv*/[]) {
+std::string referenceHex(const std::string &binary) {
+  std::string hex;
+
+  for (auto c : binary) {
+    char digits[3];
+
+    snprintf(digits, sizeof(digits), "%02x", static_cast<uint8_t>(c));
+    hex += digits;
+  }
+  return hex;
+}
+
+void TestHex() {
+  std::string binary, hex;
+  std::vector<char> buffer;
+
+  for (size_t size = 0; size < 200; ++size) {
+    binary.assign(size, '\0');
+    for (auto &c : binary) {
+      c = static_cast<char>(rand());
+    }
+    hex = referenceHex(binary);
+    dotest(text::toHex(binary) == hex);
+    dotest(text::fromHex(hex) == binary);
+    for (auto &c : hex) {
+      c = static_cast<char>(toupper(c));
+    }
+    dotest(text::fromHex(hex) == binary);
+    dotest(text::toHex(binary, hex, text::AppendToOutput) ==
+           hex.substr(0, 2 * size) + referenceHex(binary));
+    for (size_t bad = 0; bad < 2 * size; bad += 7) {
+      std::string invalid = text::toHex(binary), decoded("kept");
+
+      invalid[bad] = "g/:@G`\xff"[(bad / 7) % 7];
+      try {
+        text::fromHex(invalid, decoded, text::AppendToOutput);
+        dotest(false /* invalid hex digit not found */);
+      } catch (const msg::Exception &) {
+        dotest(decoded == "kept");
+      }
+    }
+  }
+  try {
+    text::fromHex("abc");
+    dotest(false /* odd number of hex digits not found */);
+  } catch (const msg::Exception &) {
+  }
+
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 200;
+#endif
+  const size_t digest = 32, blob = 4 * 1024 * 1024;
+  std::vector<uint8_t> decoded(blob);
+
+  binary.assign(blob, 'x');
+  buffer.resize(2 * blob);
+  text::toHex(binary.data(), blob, buffer.data());
+  printf("hex encode: %0.2f GB/s for 32 bytes, %0.2f GB/s for 4 MiB\n",
+         speed(digest, repeat * 10000,
+                  [&]() { text::toHex(binary.data(), digest, &buffer[0]); }),
+         speed(blob, repeat / 10 + 1, [&]() {
+           text::toHex(binary.data(), blob, &buffer[0]);
+         }));
+  printf("hex decode: %0.2f GB/s for 32 bytes, %0.2f GB/s for 4 MiB\n",
+         speed(digest, repeat * 10000,
+                  [&]() {
+                    text::fromHex(&buffer[0], 2 * digest, &decoded[0]);
+                  }),
+         speed(blob, repeat / 10 + 1, [&]() {
+           text::fromHex(&buffer[0], 2 * blob, &decoded[0]);
+         }));
+  dotest(std::string(decoded.begin(), decoded.end()) == binary);
+}
+
+std::string referenceBase64(const std::string &binary, text::Base64Style style,
+                            size_t split, const std::string &eol) {
+  const bool url =
+      (text::Base64URL == style) || (text::Base64URLNoPadding == style);
+  const bool pad = (text::Base64 == style) || (text::Base64URL == style);
+  const std::string characters =
+      std::string("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz") +
+      "0123456789" + (url ? "-_" : "+/");
+  std::string encoded, result;
+
+  for (size_t i = 0; i < binary.size(); i += 3) {
+    uint32_t bits = uint32_t(uint8_t(binary[i])) << 16;
+
+    if (i + 1 < binary.size()) {
+      bits |= uint32_t(uint8_t(binary[i + 1])) << 8;
+    }
+    if (i + 2 < binary.size()) {
+      bits |= uint8_t(binary[i + 2]);
+    }
+    for (size_t c = 0; c < 4; ++c) {
+      if (c <= binary.size() - i) {
+        encoded += characters[(bits >> (18 - 6 * c)) & 0x3F];
+      } else if (pad) {
+        encoded += url ? '.' : '=';
+      }
+    }
+  }
+  for (size_t i = 0; i < encoded.size(); ++i) {
+    if ((split > 0) && (i > 0) && (i % split == 0)) {
+      result += eol;
+    }
+    result += encoded[i];
+  }
+  return result;
+}
+
+void TestBase64() {
+  const text::Base64Style styles[] = {text::Base64, text::Base64URL,
+                                      text::Base64NoPadding,
+                                      text::Base64URLNoPadding};
+  const int splits[] = {text::DoNotSplitBase64, 3, text::SplitBase64ForPEM,
+                        text::SplitBase64ForMIME};
+  std::string binary;
+
+  for (size_t size = 0; size < 300; size += 1 + size / 20) {
+    binary.assign(size, '\0');
+    for (auto &c : binary) {
+      c = static_cast<char>(rand());
+    }
+    for (auto style : styles) {
+      for (auto split : splits) {
+        const std::string expected =
+            referenceBase64(binary, style, split, "\r\n");
+        text::Base64Encoder encoder(style, split, "\r\n");
+        text::Base64Decoder decoder;
+        std::vector<char> encoded(encoder.maximumOutput(size));
+        std::vector<uint8_t> decoded(text::Base64Decoder::maximumOutput(
+            expected.size()));
+        char *out = &encoded[0];
+        uint8_t *in = &decoded[0];
+
+        dotest(text::base64Encode(binary, style, split, "\r\n") == expected);
+        dotest(text::base64Decode(expected) == binary);
+        for (size_t offset = 0; offset < size;) {
+          const size_t piece = std::min<size_t>(rand() % 70, size - offset);
+
+          out = encoder.update(binary.data() + offset, piece, out);
+          offset += piece;
+        }
+        out = encoder.finish(out);
+        dotest(std::string(&encoded[0], out) == expected);
+        for (size_t offset = 0; offset < expected.size();) {
+          const size_t piece =
+              std::min<size_t>(rand() % 70, expected.size() - offset);
+
+          in = decoder.update(expected.data() + offset, piece, in);
+          offset += piece;
+        }
+        in = decoder.finish(in);
+        dotest(std::string(&decoded[0], in) == binary);
+      }
+    }
+
+    std::string encoded = text::base64Encode(binary), decoded("kept");
+
+    for (size_t bad = 0; bad < encoded.size(); bad += 5) {
+      std::string invalid = encoded;
+
+      invalid[bad] = "!*~\x80\0"[(bad / 5) % 5];
+      try {
+        text::base64Decode(invalid, decoded, text::AppendToOutput);
+        dotest(false /* invalid base64 character not found */);
+      } catch (const msg::Exception &) {
+        dotest(decoded == "kept");
+      }
+    }
+  }
+
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 20;
+#endif
+  const size_t blob = 4 * 1024 * 1024;
+  std::string encoded, wrapped, decoded;
+
+  binary.assign(blob, '\0');
+  for (auto &c : binary) {
+    c = static_cast<char>(rand());
+  }
+  text::base64Encode(binary, encoded);
+  printf("base64 encode: %0.2f GB/s, %0.2f GB/s split for MIME\n",
+         speed(blob, repeat, [&]() { text::base64Encode(binary, encoded); }),
+         speed(blob, repeat, [&]() {
+           text::base64Encode(binary, wrapped, text::Base64,
+                              text::SplitBase64ForMIME, "\r\n");
+         }));
+  printf("base64 decode: %0.2f GB/s, %0.2f GB/s split for MIME\n",
+         speed(blob, repeat, [&]() { text::base64Decode(encoded, decoded); }),
+         speed(blob, repeat, [&]() { text::base64Decode(wrapped, decoded); }));
+  dotest(decoded == binary);
+}
+
+void TestStreaming(const std::string &path) {
+  std::string binary(100000, '\0'), hex, base64, decoded;
+  text::HexEncoder hexEncoder;
+  text::HexDecoder hexDecoder;
+  text::Base64Encoder base64Encoder(text::Base64, text::SplitBase64ForPEM);
+  text::Base64Decoder base64Decoder;
+
+  for (auto &c : binary) {
+    c = static_cast<char>(rand());
+  }
+  for (size_t offset = 0; offset < binary.size();) {
+    const size_t piece =
+        std::min<size_t>(rand() % 1000, binary.size() - offset);
+
+    text::update(hexEncoder, binary.data() + offset, piece, hex);
+    offset += piece;
+  }
+  text::finish(hexEncoder, hex);
+  dotest(hex == text::toHex(binary));
+  for (size_t offset = 0; offset < hex.size();) {
+    const size_t piece = std::min<size_t>(rand() % 1001, hex.size() - offset);
+
+    text::update(hexDecoder, hex.data() + offset, piece, decoded);
+    offset += piece;
+  }
+  text::finish(hexDecoder, decoded);
+  dotest(decoded == binary);
+
+  text::update(hexDecoder, "abc", 3, decoded);
+  try {
+    text::finish(hexDecoder, decoded);
+    dotest(false /* odd number of hex digits not found */);
+  } catch (const msg::Exception &) {
+  }
+  try {
+    text::update(hexDecoder, "a", 1, decoded);
+    text::update(hexDecoder, "g", 1, decoded);
+    dotest(false /* invalid hex digit not found */);
+  } catch (const msg::Exception &) {
+  }
+
+  { // hex to base64 in one pass
+    text::HexDecoder decoder;
+    text::Chain<text::HexDecoder, text::Base64Encoder> chain(decoder,
+                                                             base64Encoder);
+
+    base64.clear();
+    for (size_t offset = 0; offset < hex.size(); offset += 777) {
+      text::update(chain, hex.data() + offset,
+                   std::min<size_t>(777, hex.size() - offset), base64);
+    }
+    text::finish(chain, base64);
+    dotest(base64 ==
+           text::base64Encode(binary, text::Base64, text::SplitBase64ForPEM));
+  }
+
+  ::remove(path.c_str());
+  ::remove((path + ".base64").c_str());
+  ::remove((path + ".hex").c_str());
+  {
+    io::File input(path, io::File::Binary, io::File::ReadWrite);
+
+    input.write(binary);
+  }
+  {
+    io::File input(path, io::File::Binary, io::File::ReadOnly);
+    io::File output(path + ".base64", io::File::Text, io::File::ReadWrite);
+
+    text::transform(base64Encoder, input, output, 1000);
+  }
+  {
+    io::File input(path + ".base64", io::File::Text, io::File::ReadOnly);
+    io::File output(path + ".hex", io::File::Text, io::File::ReadWrite);
+    text::Chain<text::Base64Decoder, text::HexEncoder> chain(base64Decoder,
+                                                             hexEncoder);
+
+    dotest(input.read(decoded) == base64);
+    input.moveto(0);
+    text::transform(chain, input, output, 999);
+  }
+  {
+    io::File output(path + ".hex", io::File::Text, io::File::ReadOnly);
+
+    dotest(output.read(decoded) == hex);
+  }
+  ::remove(path.c_str());
+  ::remove((path + ".base64").c_str());
+  ::remove((path + ".hex").c_str());
+}
+
+void TestLowercase() {
+  const char *strings[] = {
+      "\xc8\xba", "\xe2\xb1\xa5",                 // grows
+      "AB\xc8\xbe" "CD", "ab\xe2\xb1\xa6" "cd",       // grows in the middle
+      "\xc4\xb0", "i",                             // shrinks
+      "\xe2\x84\xaa", "k",                         // Kelvin shrinks
+      "\xe1\xba\x9e", "\xc3\x9f",                 // capital sharp s
+      "\xef\xbc\xa1", "\xef\xbd\x81",             // full width A
+      "\xf0\x90\x90\x80", "\xf0\x90\x90\x80",     // outside the BMP
+      "\xff\xc3Z\xe2\x84", "\xff\xc3z\xe2\x84",   // not UTF-8
+      "\xc1\x81", "\xc1\x81",                     // overlong A
+  };
+  std::string mixed, expected, lower;
+  std::wstring wide;
+
+  for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i += 2) {
+    lower = strings[i];
+    dotest(text::tolower(strings[i]) == strings[i + 1]);
+    dotest(text::tolowerInPlace(lower) == strings[i + 1]);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    const char c = static_cast<char>(0x20 + rand() % 0x5F);
+
+    mixed += c;
+    expected += static_cast<char>(::tolower(c));
+    if (i % 100 == 99) {
+      mixed += "\xce\xa3\xd0\x96\xc8\xba";
+      expected += "\xcf\x83\xd0\xb6\xe2\xb1\xa5";
+    }
+  }
+  dotest(text::tolower(mixed) == expected);
+  lower = mixed;
+  dotest(text::tolowerInPlace(lower) == expected);
+  lower = "prefix ";
+  dotest(text::tolower(mixed, lower, text::AppendToOutput) ==
+         "prefix " + expected);
+  dotest(text::tolower(std::wstring(L"\u00c4\u03a3Z"), wide) ==
+         L"\u00e4\u03c3z");
+
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 20;
+#endif
+  const size_t blob = 4 * 1024 * 1024;
+  std::vector<char> buffer(text::maximumLowerSize(blob));
+
+  mixed.clear();
+  while (mixed.size() < blob) {
+    mixed += "Content-Type: Text/HTML; Charset=UTF-8\r\n";
+  }
+  mixed.resize(blob);
+  expected = mixed;
+  for (size_t i = 0; i < 40; ++i) {
+    expected[i] = static_cast<char>(::tolower(expected[i]));
+  }
+  printf("tolower: %0.2f GB/s ASCII\n", speed(blob, repeat, [&]() {
+           text::tolower(mixed.data(), blob, &buffer[0]);
+         }));
+  dotest(std::string(&buffer[0], 40) == expected.substr(0, 40));
+}
+
+void TestBuffers(const std::string &path) {
+  const char text[] = "  Caf\xC3\xA9 MENU  |rest";
+  const size_t size = sizeof(text) - 6; // stop before the |
+  const std::string copy(text, size);
+  const char *start = text;
+  std::string output, binary(1000, '\0');
+  std::wstring wide;
+
+  dotest(text::toHex(text, size) == text::toHex(copy));
+  dotest(text::fromHex("41426a", 4) == "AB");
+  dotest(text::tolower(text, size, output) == text::tolower(copy));
+  dotest(text::convert(text, size, wide) == text::convert(copy, wide));
+  dotest(text::convert(wide.data(), wide.size(), output) == copy);
+  dotest(text::base64Encode(text, size, text::Base64URL) ==
+         text::base64Encode(copy, text::Base64URL));
+  dotest(text::base64Decode("QUJD|", 4) == "ABC");
+  dotest(text::matching(text, size, "  Caf\xC3\xA9 menu", 12) == 8);
+  dotest(text::matching(text, size, text, size - 1) == size - 1);
+  dotest(text::trim(start, size) == 10);
+  dotest(std::string(start, 10) == "Caf\xC3\xA9 MENU");
+  output = copy;
+  dotest(text::trim(output) == "Caf\xC3\xA9 MENU");
+  output = "xxxx";
+  dotest(text::trim(output, 'x').empty());
+
+  for (auto &c : binary) {
+    c = static_cast<char>(rand());
+  }
+  ::remove(path.c_str());
+  {
+    io::File file(path, io::File::Binary, io::File::ReadWrite);
+
+    file.write(binary);
+  }
+  { // encode straight from the mapped file
+    io::MemoryMappedFile mapped(path, 0, 0, PROT_READ);
+
+    dotest(text::toHex(mapped.address<char>(), mapped.size()) ==
+           text::toHex(binary));
+    dotest(text::base64Encode(mapped.address<char>(), mapped.size(),
+                              text::Base64) == text::base64Encode(binary));
+  }
+  ::remove(path.c_str());
+}
+
+int main(const int argc, const char *const argv[]) {
+  TestLowercase();
+  TestHex();
+  TestBase64();
+  TestStreaming(argc < 2 ? "bin/logs/testText.bin" : argv[1]);
+  TestBuffers(argc < 2 ? "bin/logs/testText.bin" : argv[1]);
+
   int iterations = 200;
 #ifdef __Tracer_h__
   iterations = 1;
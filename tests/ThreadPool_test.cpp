@@ -0,0 +1,157 @@
+#include "os/ThreadPool.h"
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestIterations 10
+#else
+#define TestIterations 200
+#endif
+
+int square(int value) { return value * value; }
+
+int fail(int) { throw std::runtime_error("failed"); }
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  for (int iteration = 0; iteration < TestIterations; ++iteration) {
+    exec::ThreadPool pool(4);
+    std::vector<std::future<int>> results;
+    std::vector<int> values(10000, 0);
+    std::atomic<long long> sum(0);
+
+    dotest(pool.threads() == 4);
+    for (int i = 0; i < 100; ++i) {
+      results.push_back(pool.submit(square, i));
+    }
+    for (int i = 0; i < 100; ++i) {
+      dotest(results[i].get() == i * i);
+    }
+
+    std::future<int> failure = pool.submit(fail, 1);
+
+    try {
+      failure.get();
+      dotest(false /* exception should propagate through the future */);
+    } catch (const std::runtime_error &) {
+    }
+
+    pool.parallelFor(0, values.size(),
+                     [&values](size_t index) { values[index] = int(index); });
+    for (size_t i = 0; i < values.size(); ++i) {
+      dotest(values[i] == int(i));
+    }
+
+    // nested parallelism: tasks that fan out again on the same pool
+    pool.parallelFor(
+        0, 16,
+        [&pool, &sum](size_t outer) {
+          pool.parallelFor(0, 100, [&sum, outer](size_t inner) {
+            sum.fetch_add(outer * 100 + inner);
+          });
+        },
+        1);
+    dotest(sum.load() == 1599 * 1600 / 2);
+
+    std::future<std::string> text =
+        pool.submit([](const std::string &s) { return s + s; }, "ab");
+
+    dotest(text.get() == "abab");
+
+    try {
+      pool.parallelFor(0, 100, [](size_t index) {
+        if (index == 50) {
+          throw std::runtime_error("stop");
+        }
+      });
+      dotest(false /* exception should propagate from parallelFor */);
+    } catch (const std::runtime_error &) {
+    }
+
+    pool.parallelFor(5, 5, [](size_t) { dotest(false /* empty range */); });
+    for (int i = 0; i < 1000; ++i) {
+      pool.submit([&sum]() { sum.fetch_add(1); });
+    }
+    pool.close();
+    dotest(sum.load() == 1599 * 1600 / 2 + 1000);
+    dotest(!pool.runPending());
+    try {
+      pool.submit(square, 3);
+      dotest(false /* submit after close */);
+    } catch (const exec::ThreadPool::Closed &exception) {
+      exec::ThreadPool::Closed copy(exception);
+
+      dotest(std::string(copy.what()).find("Closed") != std::string::npos);
+    }
+    try {
+      pool.parallelFor(0, 10, [](size_t) { dotest(false /* closed */); });
+      dotest(false /* parallelFor after close */);
+    } catch (const exec::ThreadPool::Closed &) {
+    }
+  }
+  for (int i = 0; i < 20; ++i) {
+    // close while parallelFor is queueing, the queued tasks still finish
+    exec::ThreadPool pool(4);
+    std::atomic<size_t> ran(0);
+    std::thread closer([&pool]() { pool.close(); });
+
+    try {
+      pool.parallelFor(
+          0, 100000, [&ran](size_t) { ran.fetch_add(1); }, 1);
+      dotest(ran.load() == 100000);
+    } catch (const exec::ThreadPool::Closed &) {
+      dotest(ran.load() < 100000);
+    }
+    closer.join();
+  }
+  for (int i = 0; i < 20; ++i) {
+    // close from work in the pool, the destructor joins the workers
+    exec::ThreadPool pool(4);
+    std::atomic<int> ran(0);
+
+    std::future<void> closed = pool.submit([&pool, &ran]() {
+      pool.close();
+      ran.fetch_add(1);
+    });
+
+    closed.get();
+    dotest(ran.load() == 1);
+    try {
+      pool.submit(square, 3);
+      dotest(false /* submit after close from a worker */);
+    } catch (const exec::ThreadPool::Closed &) {
+    }
+  }
+  for (int i = 0; i < 20; ++i) {
+    // several threads closing at once each wait for the workers
+    exec::ThreadPool pool(4);
+    std::atomic<int> ran(0);
+    std::vector<std::thread> closers;
+
+    for (int task = 0; task < 100; ++task) {
+      pool.submit([&ran]() { ran.fetch_add(1); });
+    }
+    for (int closer = 0; closer < 4; ++closer) {
+      closers.push_back(std::thread([&pool, &ran]() {
+        pool.close();
+        dotest(ran.load() == 100);
+      }));
+    }
+    pool.close();
+    dotest(ran.load() == 100);
+    for (auto &closer : closers) {
+      closer.join();
+    }
+  }
+  exec::ThreadPool defaultPool;
+
+  dotest(defaultPool.threads() >= 1);
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include "os/File.h"
+#include "os/TreeHash.h"
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+#ifdef __Tracer_h__
+#define TestSize (256 * 1024)
+#else
+#define TestSize (32 * 1024 * 1024)
+#endif
+
+typedef hash::TreeHash<hash::OpenSSLSHA256Hasher> Tree;
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  const std::string path(argc < 2 ? "bin/logs/testTreeHash.bin" : argv[1]);
+  const size_t chunk = 64 * 1024;
+  exec::ThreadPool pool;
+  std::string contents;
+
+  for (int i = 0; static_cast<int>(contents.size()) < TestSize; ++i) {
+    contents += std::to_string(i * 7919);
+  }
+  {
+    io::File file(path, io::File::Binary, io::File::ReadWrite);
+
+    file.write(contents);
+  }
+
+  // Hand built tree of three leaves: node(node(l0, l1), l2)
+  const std::string small(2 * chunk + 5, 'x');
+  Tree::Leaves leaves;
+
+  leaves.push_back(Tree::leaf(small.data(), chunk));
+  leaves.push_back(Tree::leaf(small.data() + chunk, chunk));
+  leaves.push_back(Tree::leaf(small.data() + 2 * chunk, 5));
+  dotest(Tree(small.data(), small.size(), pool, chunk).leaves() == leaves);
+  dotest(Tree(small.data(), small.size(), pool, chunk).root() ==
+         Tree::node(Tree::node(leaves[0], leaves[1]), leaves[2]));
+  dotest(Tree::combine(Tree::Leaves(1, leaves[2])) == leaves[2]);
+  dotest(Tree::leaf("", 0) != hash::sha256("", 0));
+  dotest(Tree::leaf("", 0) == hash::sha256(std::string(1, '\0')));
+  dotest(Tree("", 0, pool).leaves().size() == 1);
+  dotest(Tree("", 0, pool).root() == Tree::leaf("", 0));
+
+  Clock::time_point start = Clock::now();
+  const hash::sha256 flat(contents);
+  const double flatSeconds = seconds(start);
+
+  start = Clock::now();
+
+  const Tree tree(path, pool, chunk);
+  const double treeSeconds = seconds(start);
+
+  printf("%d bytes: sha256 %0.3fs, tree hash on %d threads %0.3fs\n",
+         TestSize, flatSeconds, pool.threads(), treeSeconds);
+  dotest(tree.size() == contents.size());
+  dotest(tree.chunkSize() == chunk);
+  dotest(tree.leaves().size() == (contents.size() + chunk - 1) / chunk);
+  dotest(tree.root() == Tree(contents.data(), contents.size(), pool, chunk)
+                            .root());
+  dotest(tree.root() != Tree(contents.data(), contents.size(), pool, 2 * chunk)
+                            .root());
+  dotest(tree.leaves()[1] == Tree::leaf(contents.data() + chunk, chunk));
+  dotest(tree.verify(path, 0, contents.size(), pool).empty());
+
+  {
+    io::File file(path, io::File::Binary, io::File::ReadWrite);
+
+    file.write("!", 1, 3 * chunk + 10);
+  }
+  std::vector<size_t> bad = tree.verify(path, 0, contents.size(), pool);
+
+  dotest(bad.size() == 1);
+  dotest(bad.size() == 1 && bad[0] == 3);
+  dotest(tree.verify(path, 0, 3 * chunk, pool).empty());
+  dotest(tree.verify(path, 3 * chunk + 10, 1, pool).size() == 1);
+  dotest(tree.verify(path, 4 * chunk, 10 * chunk, pool).empty());
+  dotest(tree.verify(path, contents.size(), 10, pool).empty());
+  dotest(Tree(path, pool, chunk).root() != tree.root());
+
+  { // a tree from memory can verify a file with any chunk size
+    const Tree odd(contents.data(), contents.size(), pool, 1000);
+
+    io::File(path, io::File::Binary, io::File::ReadWrite).write(contents);
+    dotest(odd.verify(path, 0, contents.size(), pool).empty());
+    dotest(Tree(path, pool, 1000).root() == odd.root());
+    io::File(path, io::File::Binary, io::File::ReadWrite)
+        .write("?", 1, 5 * 1000 + 7);
+    bad = odd.verify(path, 0, contents.size(), pool);
+    dotest(bad.size() == 1 && bad[0] == 5);
+  }
+  try {
+    Tree(path, pool, 0);
+    dotest(false /* chunk size must not be zero */);
+  } catch (const msg::Exception &) {
+  }
+  ::remove(path.c_str());
+  return 0;
+}
@@ -0,0 +1,302 @@
+#include "Benchmark.h"
+#include "os/UTF8.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+/// The length of the valid prefix, from the table of well formed sequences
+size_t referenceValidate(const std::string &text) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(text.data());
+  size_t offset = 0;
+
+  while (offset < text.size()) {
+    const uint8_t lead = bytes[offset];
+    const size_t left = text.size() - offset;
+    uint8_t low = 0x80, high = 0xBF;
+    size_t length;
+
+    if (lead <= 0x7F) {
+      length = 1;
+    } else if ((lead >= 0xC2) && (lead <= 0xDF)) {
+      length = 2;
+    } else if ((lead >= 0xE0) && (lead <= 0xEF)) {
+      length = 3;
+      low = lead == 0xE0 ? 0xA0 : low;
+      high = lead == 0xED ? 0x9F : high;
+    } else if ((lead >= 0xF0) && (lead <= 0xF4)) {
+      length = 4;
+      low = lead == 0xF0 ? 0x90 : low;
+      high = lead == 0xF4 ? 0x8F : high;
+    } else {
+      return offset;
+    }
+    if ((length > 1) && ((left < 2) || (bytes[offset + 1] < low) ||
+                         (bytes[offset + 1] > high))) {
+      return offset;
+    }
+    for (size_t i = 2; i < length; ++i) {
+      if ((left <= i) || ((bytes[offset + i] & 0xC0) != 0x80)) {
+        return offset;
+      }
+    }
+    offset += length;
+  }
+  return text.size();
+}
+
+std::string encode(uint32_t codePoint) {
+  char buffer[4];
+
+  return std::string(buffer, text::utf8::_encode(codePoint, buffer));
+}
+
+uint32_t randomCodePoint() {
+  switch (rand() % 4) {
+  case 0:
+    return rand() % 0x80;
+  case 1:
+    return 0x80 + rand() % (0x800 - 0x80);
+  case 2: {
+    const uint32_t value = 0x800 + rand() % (0x10000 - 0x800);
+
+    return (value >= 0xD800) && (value < 0xE000) ? value - 0x1000 : value;
+  }
+  default:
+    return 0x10000 + rand() % (0x110000 - 0x10000);
+  }
+}
+
+void testValidate() {
+  const char *const invalid[] = {
+      "\x80",             // lone continuation
+      "\xBF",             // lone continuation
+      "\xC0\x80",         // overlong NUL
+      "\xC1\xBF",         // overlong 2 byte
+      "\xE0\x80\x80",     // overlong 3 byte
+      "\xE0\x9F\xBF",     // overlong 3 byte
+      "\xED\xA0\x80",     // surrogate
+      "\xED\xBF\xBF",     // surrogate
+      "\xF0\x80\x80\x80", // overlong 4 byte
+      "\xF0\x8F\xBF\xBF", // overlong 4 byte
+      "\xF4\x90\x80\x80", // past U+10FFFF
+      "\xF5\x80\x80\x80", // past U+10FFFF
+      "\xFF",             // never in UTF-8
+      "\xC3",             // cut short
+      "\xE2\x82",         // cut short
+      "\xF0\x9F\x98",     // cut short
+      "\xC3\x28",         // not a continuation
+      "\xE2\x28\xA1",     // not a continuation
+      "\xF0\x9F\x28\x80", // not a continuation
+  };
+  const char *const valid[] = {
+      "",
+      "hello",
+      "\xC2\x80",
+      "\xDF\xBF",
+      "\xE0\xA0\x80",
+      "\xED\x9F\xBF",
+      "\xEE\x80\x80",
+      "\xEF\xBF\xBF",
+      "\xF0\x90\x80\x80",
+      "\xF4\x8F\xBF\xBF",
+      "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80",
+  };
+  const std::string padding(100, 'a');
+
+  for (auto text : valid) {
+    dotest(text::utf8::valid(std::string(text)));
+    for (size_t at = 0; at < padding.size(); at += 7) {
+      dotest(text::utf8::valid(padding.substr(0, at) + text + padding));
+    }
+  }
+  for (auto text : invalid) {
+    dotest(!text::utf8::valid(std::string(text)));
+    dotest(text::utf8::validate(text, strlen(text)) == 0);
+    // every position across the 32 byte blocks, followed by more text or not
+    for (size_t at = 0; at < padding.size(); ++at) {
+      const std::string before = padding.substr(0, at) + text;
+      const std::string after = before + padding;
+
+      dotest(text::utf8::validate(before.data(), before.size()) == at);
+      dotest(text::utf8::validate(after.data(), after.size()) == at);
+    }
+  }
+  for (int repeat = 0; repeat < 2000; ++repeat) {
+    std::string text;
+
+    while (text.size() < size_t(rand() % 300)) {
+      text += encode(rand() % 3 == 0 ? randomCodePoint() : rand() % 0x80);
+    }
+    dotest(text::utf8::valid(text));
+    for (int i = rand() % 3; i > 0 && !text.empty(); --i) {
+      text[rand() % text.size()] = static_cast<char>(rand());
+    }
+    dotest(text::utf8::validate(text.data(), text.size()) ==
+           referenceValidate(text));
+  }
+}
+
+void testTranscode() {
+  const char16_t pair[] = {u'a', 0xD83D, 0xDE00, u'b'};
+  const char32_t smile[] = {U'a', 0x1F600, U'b'};
+  char buffer[16];
+  char16_t utf16[16];
+  char32_t utf32[16];
+
+  dotest(std::string(buffer, text::utf8::toUTF8(pair, 4, buffer)) ==
+         "a\xF0\x9F\x98\x80"
+         "b");
+  dotest(std::string(buffer, text::utf8::toUTF8(smile, 3, buffer)) ==
+         "a\xF0\x9F\x98\x80"
+         "b");
+  dotest(text::utf8::toUTF16("a\xF0\x9F\x98\x80", 5, utf16) - utf16 == 3);
+  dotest((utf16[1] == 0xD83D) && (utf16[2] == 0xDE00));
+  dotest(text::utf8::toUTF32("a\xF0\x9F\x98\x80", 5, utf32) - utf32 == 2);
+  dotest(utf32[1] == 0x1F600);
+
+  // errors report the offset in the code units being converted
+  const std::string invalid = std::string(40, 'x') + "\xE2\x28";
+  const char16_t lonely[] = {u'a', u'b', 0xDC00, u'c'};
+  const char16_t unpaired[] = {u'a', 0xD800};
+  const char32_t tooLarge[] = {U'a', U'b', U'c', 0x110000};
+  std::vector<char16_t> units(invalid.size());
+
+  try {
+    text::utf8::toUTF16(invalid.data(), invalid.size(), units.data());
+    dotest(false);
+  } catch (const text::utf8::Invalid &exception) {
+    dotest(exception.offset() == 40);
+  }
+  try {
+    text::utf8::toUTF8(lonely, 4, buffer);
+    dotest(false);
+  } catch (const text::utf8::Invalid &exception) {
+    dotest(exception.offset() == 2);
+  }
+  try {
+    text::utf8::toUTF8(unpaired, 2, buffer);
+    dotest(false);
+  } catch (const text::utf8::Invalid &exception) {
+    dotest(exception.offset() == 1);
+  }
+  try {
+    text::utf8::toUTF8(tooLarge, 4, buffer);
+    dotest(false);
+  } catch (const text::utf8::Invalid &exception) {
+    dotest(exception.offset() == 3);
+  }
+
+  for (int repeat = 0; repeat < 1000; ++repeat) {
+    std::string text;
+    std::vector<char32_t> expected;
+
+    while (text.size() < size_t(rand() % 300)) {
+      const uint32_t codePoint =
+          rand() % 2 == 0 ? randomCodePoint() : rand() % 0x80;
+
+      text += encode(codePoint);
+      expected.push_back(codePoint);
+    }
+
+    std::vector<char16_t> sixteen(text::utf8::maximumUnits(text.size()));
+    std::vector<char32_t> thirtyTwo(text::utf8::maximumUnits(text.size()));
+    std::vector<wchar_t> wide(text::utf8::maximumUnits(text.size()));
+    std::vector<char> back(text::utf8::maximumBytes(text.size()));
+    const size_t count16 =
+        text::utf8::toUTF16(text.data(), text.size(), sixteen.data()) -
+        sixteen.data();
+    const size_t count32 =
+        text::utf8::toUTF32(text.data(), text.size(), thirtyTwo.data()) -
+        thirtyTwo.data();
+    const size_t countWide =
+        text::utf8::toWide(text.data(), text.size(), wide.data()) -
+        wide.data();
+
+    dotest(count32 == expected.size());
+    dotest(std::equal(expected.begin(), expected.end(), thirtyTwo.begin()));
+    dotest(countWide >= count32);
+    dotest(std::string(back.data(), text::utf8::toUTF8(sixteen.data(), count16,
+                                                       back.data())) == text);
+    dotest(std::string(back.data(), text::utf8::toUTF8(thirtyTwo.data(),
+                                                       count32, back.data())) ==
+           text);
+    dotest(std::string(back.data(), text::utf8::toUTF8(wide.data(), countWide,
+                                                       back.data())) == text);
+  }
+}
+
+void testSpeed() {
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 200;
+#endif
+  std::string ascii, mixed;
+
+  while (ascii.size() < 1024 * 1024) {
+    ascii += "The quick brown fox jumps over the lazy dog. ";
+    mixed += "Gr\xC3\xBC\xC3\x9F"
+             "e \xE2\x82\xAC 12 \xE6\x97\xA5\xE6\x9C\xAC \xF0\x9F\x98\x80 ";
+  }
+
+  std::vector<char16_t> utf16(
+      text::utf8::maximumUnits(std::max(ascii.size(), mixed.size())));
+  std::vector<char32_t> utf32(text::utf8::maximumUnits(ascii.size()));
+  std::vector<char> utf8(text::utf8::maximumBytes(ascii.size()));
+  size_t valid = 0;
+
+  printf("validate: %0.2f GB/s ASCII %0.2f GB/s mixed\n",
+         speed(ascii.size(), repeat,
+               [&]() {
+                 valid += text::utf8::validate(ascii.data(), ascii.size());
+               }),
+         speed(mixed.size(), repeat, [&]() {
+           valid += text::utf8::validate(mixed.data(), mixed.size());
+         }));
+  dotest(valid == (ascii.size() + mixed.size()) * repeat);
+  printf("ASCII: %0.2f GB/s to UTF-16 %0.2f GB/s to UTF-32 ",
+         speed(ascii.size(), repeat,
+               [&]() {
+                 text::utf8::toUTF16(ascii.data(), ascii.size(), utf16.data());
+               }),
+         speed(ascii.size(), repeat, [&]() {
+           text::utf8::toUTF32(ascii.data(), ascii.size(), utf32.data());
+         }));
+  printf("%0.2f GB/s from UTF-16 %0.2f GB/s from UTF-32\n",
+         speed(ascii.size(), repeat,
+               [&]() {
+                 text::utf8::toUTF8(utf16.data(), ascii.size(), utf8.data());
+               }),
+         speed(ascii.size(), repeat, [&]() {
+           text::utf8::toUTF8(utf32.data(), ascii.size(), utf8.data());
+         }));
+  printf("mixed: %0.2f GB/s to UTF-16\n",
+         speed(mixed.size(), repeat / 10 + 1, [&]() {
+           text::utf8::toUTF16(mixed.data(), mixed.size(), utf16.data());
+         }));
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  int iterations = 1;
+#ifdef __Tracer_h__
+  iterations = 1;
+#endif
+  for (int i = 0; i < iterations; ++i) {
+    try {
+      testValidate();
+      testTranscode();
+      testSpeed();
+    } catch (const std::exception &exception) {
+      printf("FAIL: Exception not caught: %s\n", exception.what());
+    }
+  }
+  return 0;
+}
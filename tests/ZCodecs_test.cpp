@@ -0,0 +1,144 @@
+#include "Benchmark.h"
+#include "CompressPieces.h"
+#include "os/ZCodecs.h"
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+void testCodecs() {
+  const z::Codec::Type types[] = {z::Codec::Zlib, z::Codec::LZ4,
+                                  z::Codec::Zstd};
+  const size_t sizes[] = {0, 1, 1000, 100000, 1000000};
+  const std::string data = sampleText(1000000);
+  std::string compressed, decompressed;
+
+  dotest(z::Codec::find("garbage", 7) == NULL);
+  dotest(z::Codec::available(z::Codec::Zlib));
+  for (auto type : types) {
+    if (!z::Codec::available(type)) {
+      printf("codec %d not available\n", type);
+      continue;
+    }
+
+    const z::Codec &codec = z::Codec::get(type);
+
+    dotest(codec.type() == type);
+    for (auto size : sizes) {
+      const std::string piece = data.substr(0, size);
+      std::unique_ptr<z::Compressor> compressor(codec.compressor(1));
+      std::unique_ptr<z::Decompressor> decompressor(codec.decompressor());
+
+      codec.compress(piece, compressed);
+      dotest(z::Codec::find(compressed.data(), compressed.size()) == &codec);
+      dotest(codec.uncompress(compressed, decompressed) == piece);
+      // existing callers read every codec
+      dotest(z::uncompress(compressed, decompressed, size) == piece);
+      compressed = compressPieces(*compressor, piece);
+      dotest(z::Codec::find(compressed.data(), compressed.size()) == &codec);
+      dotest(uncompressPieces(*decompressor, compressed) == piece);
+      // both can be used again
+      compressed = compressPieces(*compressor, piece);
+      dotest(uncompressPieces(*decompressor, compressed) == piece);
+    }
+    codec.compress(data, compressed);
+    try {
+      z::uncompress(compressed, decompressed, data.size() - 1);
+      dotest(false /* destination too small */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_BUF_ERROR);
+    }
+    try {
+      codec.uncompress(compressed.substr(0, compressed.size() / 2),
+                       decompressed);
+      dotest(false /* truncated */);
+    } catch (const msg::Exception &) {
+    }
+    if (type != z::Codec::Zlib) { // zlib's uncompress() cannot tell them apart
+      decompressed.resize(data.size());
+      try {
+        codec.uncompress(compressed.data(), compressed.size() / 2,
+                         &decompressed[0], decompressed.size());
+        dotest(false /* truncated with room to spare */);
+      } catch (z::Exception &exception) {
+        dotest(exception.code() == Z_DATA_ERROR);
+      }
+    }
+    compressed[compressed.size() / 2] ^= 0x10;
+    try {
+      codec.uncompress(compressed, decompressed);
+      dotest(false /* corrupt */);
+    } catch (const z::Exception &) {
+    }
+  }
+  if (z::Codec::available(z::Codec::Zstd)) {
+    // contexts kept between calls are shared safely, and take a new level
+    const z::Codec &codec = z::Codec::get(z::Codec::Zstd);
+    std::vector<std::thread> threads;
+    std::string fast, small;
+
+    for (int thread = 0; thread < 4; ++thread) {
+      threads.push_back(std::thread([&codec, &data, thread]() {
+        std::string packed, unpacked;
+
+        for (int i = 0; i < 20; ++i) {
+          const std::string piece = data.substr(0, 1000 * (thread + i));
+
+          codec.compress(piece, packed, 1 + i % 9);
+          dotest(codec.uncompress(packed, unpacked) == piece);
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    codec.compress(data, fast, 1);
+    codec.compress(data, small, 19);
+    dotest(small.size() < fast.size());
+    dotest(codec.compress(data, compressed, 1) == fast);
+  }
+}
+
+void benchmarkCodecs() {
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 20;
+#endif
+  const z::Codec::Type types[] = {z::Codec::Zlib, z::Codec::LZ4,
+                                  z::Codec::Zstd};
+  const std::string data = sampleText(1024 * 1024);
+  std::string compressed, decompressed;
+
+  decompressed.resize(data.size());
+  for (auto type : types) {
+    if (!z::Codec::available(type)) {
+      continue;
+    }
+
+    const z::Codec &codec = z::Codec::get(type);
+    const double compressing = speed(
+        data.size(), repeat, [&]() { codec.compress(data, compressed); });
+    const double uncompressing = speed(data.size(), repeat, [&]() {
+      codec.uncompress(compressed.data(), compressed.size(), &decompressed[0],
+                       decompressed.size());
+    });
+
+    dotest(decompressed == data);
+    printf("%s: compress %0.2f GB/s uncompress %0.2f GB/s ratio %0.3f\n",
+           codec.name(), compressing, uncompressing,
+           double(compressed.size()) / data.size());
+  }
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  testCodecs();
+  benchmarkCodecs();
+  return 0;
+}
@@ -1,9 +1,449 @@
+#include "Benchmark.h"
+#include "CompressPieces.h"
+#include "os/Text.h"
+#include "os/ThreadPool.h"
+#include "os/ZCodecs.h"
 #include "os/ZCompression.h"
 #include <stdio.h>
+#include <memory>
+#include <stdlib.h>
 #include <string.h> // strlen
+#include <vector>
 
-int main(const int, const char *const[]) {
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+/// A compressSized() header with a good crc32 for any size
+std::string forgeSized(uint64_t size, const std::string &payload) {
+  uint8_t header[z::MostSizedHeader];
+  uint8_t *const sizeEnd = z::_writeSize(size, header + 1);
+  uLong crc = ::crc32(0, header + 1, sizeEnd - header - 1);
+  std::string forged;
+
+  header[0] = z::SizedMagic;
+  crc = ::crc32(crc, reinterpret_cast<const Bytef *>(payload.data()),
+                payload.size());
+  for (int byte = 0; byte < 4; ++byte) {
+    sizeEnd[byte] = static_cast<uint8_t>(crc >> (8 * byte));
+  }
+  forged.assign(reinterpret_cast<char *>(header), sizeEnd + 4 - header);
+  return forged + payload;
+}
+
+void testSized() {
+  const uint64_t sizes[] = {0,      127,     128,        16511,
+                            16512,  2113663, 2113664,    270549119,
+                            1 << 30, ~uint64_t(0) >> 1, ~uint64_t(0)};
+  const size_t lengths[] = {1, 1, 2, 2, 3, 3, 4, 4, 5, 9, 10};
+  const z::Codec::Type types[] = {z::Codec::Zlib, z::Codec::LZ4,
+                                  z::Codec::Zstd};
+  const std::string data = sampleText(2000000);
+  std::string compressed, decompressed;
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    uint8_t buffer[10];
+    const uint8_t *next = buffer;
+    uint64_t size;
+
+    dotest(size_t(z::_writeSize(sizes[i], buffer) - buffer) == lengths[i]);
+    dotest(z::_readSize(next, buffer + lengths[i], size) && (size == sizes[i]));
+    dotest(next == buffer + lengths[i]);
+    next = buffer;
+    dotest(!z::_readSize(next, buffer + lengths[i] - 1, size));
+  }
+  { // the same bytes as compactNumber::write()
+    uint8_t buffer[10];
+
+    dotest(z::_writeSize(128, buffer) - buffer == 2);
+    dotest((buffer[0] == 0x80) && (buffer[1] == 0x00));
+    dotest(z::_writeSize(16511, buffer) - buffer == 2);
+    dotest((buffer[0] == 0xFF) && (buffer[1] == 0x7F));
+  }
+  for (auto type : types) {
+    if (!z::Codec::available(type)) {
+      continue;
+    }
+
+    const z::Codec &codec = z::Codec::get(type);
+
+    for (size_t size = 0; size < data.size(); size = size * 3 + 1) {
+      const std::string piece = data.substr(0, size);
+      size_t recorded;
+
+      z::compressSized(piece, compressed, codec);
+      dotest(z::uncompressedSize(compressed.data(), compressed.size(),
+                                 recorded) &&
+             (recorded == size));
+      // 512K is not a limit, the size is known
+      dotest(z::uncompress(compressed) == piece);
+      dotest(z::uncompress(compressed, decompressed, 1) == piece);
+      dotest(decompressed.size() == size);
+    }
+    z::compressSized(data, compressed, codec, 1);
+    decompressed.resize(data.size() - 1);
+    try {
+      z::uncompress(compressed.data(), compressed.size(), &decompressed[0],
+                    decompressed.size());
+      dotest(false /* destination too small */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_BUF_ERROR);
+    }
+    for (size_t at = 1; at < compressed.size(); at += compressed.size() / 7) {
+      std::string corrupt = compressed;
+
+      corrupt[at] ^= 0x04;
+      try {
+        z::uncompress(corrupt);
+        dotest(false /* corrupt */);
+      } catch (z::Exception &exception) {
+        dotest(exception.code() == Z_DATA_ERROR);
+      }
+    }
+    try {
+      z::uncompress(compressed.substr(0, compressed.size() - 1));
+      dotest(false /* truncated */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+  }
+  size_t unknown = 0;
+
+  dotest(!z::uncompressedSize("x", 1, unknown) && (unknown == 0));
+  { // a header with a good crc32 but a size the data cannot hold
+    const std::string forged =
+        forgeSized(uint64_t(1) << 40, z::compress("abc"));
+
+    dotest(z::uncompressedSize(forged.data(), forged.size(), unknown) &&
+           (unknown == uint64_t(1) << 40));
+    try {
+      z::uncompress(forged, decompressed);
+      dotest(false /* size larger than zlib can expand to */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+  }
+  if (z::Codec::available(z::Codec::Zstd)) {
+    // zstd can expand enough to hold the forged size, but its frame disagrees
+    const z::Codec &zstd = z::Codec::get(z::Codec::Zstd);
+    std::unique_ptr<z::Compressor> compressor(zstd.compressor(1));
+    std::string payload;
+    size_t recorded = 0;
+
+    zstd.compress(std::string(1000, 'a'), payload);
+    dotest(zstd.contentSize(payload.data(), payload.size(), recorded) &&
+           (recorded == 1000));
+    for (auto size : {uint64_t(1000 * 1000), uint64_t(999)}) {
+      try {
+        z::uncompress(forgeSized(size, payload), decompressed);
+        dotest(false /* size the zstd frame does not record */);
+      } catch (z::Exception &exception) {
+        dotest(exception.code() == Z_DATA_ERROR);
+      }
+    }
+    // a streamed frame does not know its size
+    payload = compressPieces(*compressor, std::string(1000, 'a'));
+    try {
+      z::uncompress(forgeSized(1000, payload), decompressed);
+      dotest(false /* zstd frame without a size */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+  }
+  { // only what the data can expand to is allocated, not 512K
+    std::string small;
+
+    z::compress("abc", compressed);
+    dotest(z::uncompress(compressed, small) == "abc");
+    dotest(small.capacity() < 512 * 1024);
+  }
+}
+
+void benchmarkSized() {
+#ifdef __Tracer_h__
+  const int repeat = 1;
+#else
+  const int repeat = 20000;
+#endif
+  std::string record, compressed, sized, decompressed;
+
+  while (record.size() < 2000) {
+    record += "Nobody inspects the spammish repetition. ";
+  }
+  z::compress(record, compressed);
+  z::compressSized(record, sized);
+
+  const double guessed = speed(record.size(), repeat, [&]() {
+    z::uncompress(compressed, decompressed = std::string());
+  });
+
+  dotest(decompressed == record);
+
+  const double exact = speed(record.size(), repeat, [&]() {
+    z::uncompress(sized, decompressed = std::string());
+  });
+
+  dotest(decompressed == record);
+  printf("2K records into new strings: %0.2f GB/s, sized %0.2f GB/s\n",
+         guessed, exact);
+}
+
+/// A small record, like the ones a service stores millions of
+std::string record(int id) {
+  const char *const states[] = {"active", "suspended", "pending"};
+
+  return "{\"id\":" + std::to_string(id) + ",\"name\":\"user" +
+         std::to_string(id * 7919 % 100000) + "\",\"email\":\"user" +
+         std::to_string(id) + "@example.com\",\"state\":\"" +
+         states[id % 3] + "\",\"score\":" + std::to_string(rand() % 1000) +
+         ",\"tags\":[\"alpha\",\"beta\"],\"created\":\"2024-0" +
+         std::to_string(1 + id % 9) + "-1" + std::to_string(id % 10) + "\"}";
+}
+
+void testContexts() {
+  std::vector<std::string> samples;
+  std::string compressed, decompressed;
+
+  for (int id = 0; id < 1000; ++id) {
+    samples.push_back(record(id));
+  }
+  dotest(z::trainDictionary(std::vector<std::string>()).empty());
+
+  const std::string dictionary = z::trainDictionary(samples, 4096);
+  const std::string other = z::trainDictionary(samples, 1024);
+
+  dotest((dictionary.size() > 0) && (dictionary.size() <= 4096));
+  dotest(dictionary.find("@example.com") != std::string::npos);
+  dotest(z::trainDictionary(samples).size() <= 2048);
+
+  { // a run every sample shares is taken whole, not shifted
+    const std::string token = "ABCDEFGHIJKLMNOPQRSTUVWXYZ012345";
+    std::vector<std::string> shared;
+
+    for (int sample = 0; sample < 50; ++sample) {
+      std::string text;
+
+      for (int letter = rand() % 200 + 50; letter > 0; --letter) {
+        text += static_cast<char>('a' + rand() % 26);
+      }
+      text.insert(rand() % text.size(), token);
+      shared.push_back(text);
+    }
+    dotest(z::trainDictionary(shared, 32) == token);
+    dotest(z::trainDictionary(shared, 1024).find(token) != std::string::npos);
+  }
+  dotest(z::CompressContext(6, z::trainDictionary(samples, 100000))
+             .dictionary()
+             .size() == 32 * 1024);
+
+  z::CompressContext plain, primed(6, dictionary);
+  z::DecompressContext unprimed, reader(dictionary), wrong(other);
+
+  for (int id = 5000; id < 5100; ++id) {
+    const std::string message = record(id);
+
+    dotest(z::uncompress(plain.compress(message, compressed)) == message);
+    dotest(unprimed.uncompress(compressed, decompressed) == message);
+    dotest(reader.uncompress(compressed, decompressed) == message);
+    primed.compress(message, compressed);
+    dotest(compressed.size() < z::compress(message).size());
+    dotest(reader.uncompress(compressed, decompressed) == message);
+    try {
+      unprimed.uncompress(compressed, decompressed);
+      dotest(false /* no dictionary */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+    try {
+      wrong.uncompress(compressed, decompressed);
+      dotest(false /* wrong dictionary */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+    try {
+      reader.uncompress(compressed, decompressed, message.size() - 1);
+      dotest(false /* too small */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_BUF_ERROR);
+    }
+    try {
+      reader.uncompress(compressed.substr(0, compressed.size() - 1),
+                        decompressed);
+      dotest(false /* truncated */);
+    } catch (z::Exception &exception) {
+      dotest(exception.code() == Z_DATA_ERROR);
+    }
+  }
+  try {
+    z::CompressContext bad(10);
+    dotest(false /* bad level */);
+  } catch (const z::Exception &) {
+  }
+
+  // one per worker, moved into place or thread_local
+  exec::ThreadPool pool(4);
+  std::vector<z::CompressContext> contexts;
+  std::vector<std::string> results(samples.size());
+
+  contexts.push_back(z::CompressContext(6, dictionary));
+  contexts.push_back(std::move(contexts[0]));
+  dotest(contexts[1].dictionary() == dictionary);
+  contexts[1].compress(samples[0], compressed);
+  dotest(reader.uncompress(compressed, decompressed) == samples[0]);
+  pool.parallelFor(0, samples.size(), [&](size_t index) {
+    thread_local z::CompressContext context(6, dictionary);
+
+    context.compress(samples[index], results[index]);
+  });
+  for (size_t index = 0; index < samples.size(); ++index) {
+    dotest(reader.uncompress(results[index], decompressed) == samples[index]);
+  }
+}
+
+void benchmarkContexts() {
+#ifdef __Tracer_h__
+  const int count = 1000;
+#else
+  const int count = 100000;
+#endif
+  std::vector<std::string> records, samples;
+  std::string compressed, decompressed;
+
+  for (int id = 0; id < count; ++id) {
+    records.push_back(record(id + 1000000));
+  }
+  for (int id = 0; id < 2000; ++id) {
+    samples.push_back(record(id));
+  }
+
+  const std::string dictionary = z::trainDictionary(samples);
+  z::CompressContext plain, primed(6, dictionary);
+  z::DecompressContext reader(dictionary);
+  size_t raw = 0, each = 0, reused = 0, withDictionary = 0;
+
+  for (const auto &message : records) {
+    raw += message.size();
+  }
+
+  const double eachSpeed = speed(raw, 1, [&]() {
+    for (const auto &message : records) {
+      each += z::compress(message, compressed).size();
+    }
+  });
+  const double reusedSpeed = speed(raw, 1, [&]() {
+    for (const auto &message : records) {
+      reused += plain.compress(message, compressed).size();
+    }
+  });
+  const double dictionarySpeed = speed(raw, 1, [&]() {
+    for (const auto &message : records) {
+      withDictionary += primed.compress(message, compressed).size();
+    }
+  });
+  const double roundSpeed = speed(raw, 1, [&]() {
+    for (const auto &message : records) {
+      primed.compress(message, compressed);
+      dotest(reader.uncompress(compressed, decompressed, message.size()) ==
+             message);
+    }
+  });
+
+  printf("%d records of %0.0f bytes: compress() %0.3f GB/s ratio %0.3f, "
+         "CompressContext %0.3f GB/s ratio %0.3f, with a %d byte dictionary "
+         "%0.3f GB/s ratio %0.3f, and back %0.3f GB/s\n",
+         count, double(raw) / count, eachSpeed, double(each) / raw,
+         reusedSpeed, double(reused) / raw, int(dictionary.size()),
+         dictionarySpeed, double(withDictionary) / raw, roundSpeed);
+}
+
+void testStreaming(const std::string &path) {
+  const std::string data = sampleText(300000);
+  std::string compressed, decompressed;
+  const z::Framing framings[] = {z::ZlibFraming, z::GzipFraming,
+                                 z::RawFraming};
+
+  for (auto framing : framings) {
+    compressed = deflate(data, framing);
+    dotest(compressed.size() < data.size() / 2);
+    dotest(inflate(compressed, framing) == data);
+    if (framing != z::RawFraming) {
+      dotest(inflate(compressed, z::AutoFraming) == data);
+    }
+    try {
+      inflate(compressed.substr(0, compressed.size() / 2), framing);
+      dotest(false /* truncated stream not found */);
+    } catch (const msg::Exception &) {
+    }
+  }
+  compressed = deflate(data, z::ZlibFraming);
+  dotest(z::uncompress(compressed, decompressed, data.size()) == data);
+  compressed = deflate(data, z::GzipFraming);
+  dotest((compressed[0] == '\x1f') && (compressed[1] == '\x8b'));
+  compressed[compressed.size() / 2] ^= 0x55;
+  try {
+    inflate(compressed, z::GzipFraming);
+    dotest(false /* corrupt stream not found */);
+  } catch (const z::Exception &) {
+  }
+
+  { // one Deflater can compress several streams
+    z::Deflater deflater;
+    std::string first, second;
+
+    dotest(z::uncompress(text::finish(deflater, first)) == "");
+    text::update(deflater, "test", 4, second);
+    dotest(z::uncompress(text::finish(deflater, second)) == "test");
+  }
+
+  ::remove(path.c_str());
+  ::remove((path + ".gz").c_str());
+  ::remove((path + ".out").c_str());
+  {
+    io::File file(path, io::File::Binary, io::File::ReadWrite);
+
+    file.write(data);
+  }
+  {
+    io::File input(path, io::File::Binary, io::File::ReadOnly);
+    io::File output(path + ".gz", io::File::Binary, io::File::ReadWrite);
+
+    z::compress(input, output, 9, z::GzipFraming, 10000);
+  }
+  {
+    io::File input(path + ".gz", io::File::Binary, io::File::ReadOnly);
+    io::File output(path + ".out", io::File::Binary, io::File::ReadWrite);
+
+    dotest(inflate(input.read(compressed), z::GzipFraming) == data);
+    input.moveto(0);
+    z::uncompress(input, output, z::AutoFraming, 999);
+    output.moveto(0);
+    dotest(output.read(decompressed) == data);
+  }
+  { // the same chain as text::transform to hex
+    io::File input(path + ".gz", io::File::Binary, io::File::ReadOnly);
+    io::File output(path + ".out", io::File::Binary, io::File::ReadWrite);
+    z::Deflater deflater(1, z::RawFraming);
+
+    text::transform(deflater, input, output);
+    output.moveto(0);
+    input.moveto(0);
+    dotest(inflate(output.read(compressed), z::RawFraming) ==
+           input.read(decompressed));
+  }
+  ::remove(path.c_str());
+  ::remove((path + ".gz").c_str());
+  ::remove((path + ".out").c_str());
+}
+
+int main(const int argc, const char *const argv[]) {
   int iterations = 100;
+
+  testStreaming(argc < 2 ? "bin/logs/testZCompression.bin" : argv[1]);
+  testSized();
+  benchmarkSized();
+  testContexts();
+  benchmarkContexts();
 #ifdef __Tracer_h__
   iterations = 1;
 #endif
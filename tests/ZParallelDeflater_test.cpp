@@ -0,0 +1,107 @@
+#include "Benchmark.h"
+#include "CompressPieces.h"
+#include "os/Text.h"
+#include "os/ZParallelDeflater.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+/// Compress with several threads in random sized pieces
+std::string parallelDeflate(const std::string &data, exec::ThreadPool &pool,
+                            z::Framing framing, size_t blockSize) {
+  z::ParallelDeflater deflater(pool, 6, framing, blockSize);
+  std::string compressed;
+
+  for (size_t offset = 0; offset < data.size();) {
+    const size_t piece = std::min<size_t>(rand() % 50000, data.size() - offset);
+
+    text::update(deflater, data.data() + offset, piece, compressed);
+    offset += piece;
+  }
+  return text::finish(deflater, compressed);
+}
+
+void testParallel() {
+  exec::ThreadPool pool(4);
+  const std::string data = sampleText(1000000);
+  std::string compressed, decompressed;
+  const z::Framing framings[] = {z::ZlibFraming, z::GzipFraming,
+                                 z::RawFraming};
+  const size_t sizes[] = {0, 1, 1000, 32768, 100000, 1000000};
+
+  for (auto framing : framings) {
+    for (auto size : sizes) {
+      const std::string piece = data.substr(0, size);
+
+      // the trailer check is verified by inflate
+      compressed = parallelDeflate(piece, pool, framing, 1000 + rand() % 40000);
+      dotest(inflate(compressed, framing) == piece);
+    }
+  }
+  z::compress(data, compressed, pool);
+  dotest(z::uncompress(compressed, decompressed, data.size()) == data);
+  dotest(compressed.size() < z::compress(data).size() * 11 / 10);
+  compressed = parallelDeflate(data, pool, z::GzipFraming, 65536);
+  dotest((compressed[0] == '\x1f') && (compressed[1] == '\x8b'));
+  compressed[compressed.size() - 5] ^= 0x01; // crc32 of the data
+  try {
+    inflate(compressed, z::GzipFraming);
+    dotest(false /* bad crc32 not found */);
+  } catch (const z::Exception &) {
+  }
+
+  { // one ParallelDeflater can compress several streams
+    z::ParallelDeflater deflater(pool, 6, z::ZlibFraming, 100);
+    std::string first, second;
+
+    text::update(deflater, data.data(), 1000, first);
+    dotest(z::uncompress(text::finish(deflater, first)) ==
+           data.substr(0, 1000));
+    text::update(deflater, "test", 4, second);
+    dotest(z::uncompress(text::finish(deflater, second)) == "test");
+  }
+  { // large updates are read in place, after a held partial block
+    z::ParallelDeflater deflater(pool, 6, z::GzipFraming, 8192);
+
+    compressed.clear();
+    text::update(deflater, data.data(), 5000, compressed);
+    text::update(deflater, data.data() + 5000, data.size() - 5000, compressed);
+    dotest(inflate(text::finish(deflater, compressed), z::GzipFraming) ==
+           data);
+    dotest(compressed.size() < z::compress(data).size() * 11 / 10);
+  }
+}
+
+void benchmarkParallel() {
+#ifdef __Tracer_h__
+  const size_t megabytes = 1;
+#else
+  const size_t megabytes = 16;
+#endif
+  const std::string data = sampleText(megabytes * 1024 * 1024);
+  std::string compressed;
+
+  printf("compress: %0.2f GB/s ", speed(data.size(), 1, [&]() {
+           z::compress(data, compressed);
+         }));
+  printf("ratio %0.3f\n", double(compressed.size()) / data.size());
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    exec::ThreadPool pool(threads);
+
+    printf("ParallelDeflater %d threads: %0.2f GB/s ", threads,
+           speed(data.size(), 1,
+                 [&]() { z::compress(data, compressed, pool); }));
+    printf("ratio %0.3f\n", double(compressed.size()) / data.size());
+  }
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  testParallel();
+  benchmarkParallel();
+  return 0;
+}
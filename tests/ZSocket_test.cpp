@@ -0,0 +1,63 @@
+#include "Benchmark.h"
+#include "os/AddressIPv4.h"
+#include "os/SocketServer.h"
+#include "os/ZSocket.h"
+#include <stdio.h>
+#include <string>
+#include <thread>
+
+#define dotest(condition)                                                      \
+  if (!(condition)) {                                                          \
+    fprintf(stderr, "FAIL(%s:%d): %s\n", __FILE__, __LINE__, #condition);      \
+  }
+
+/// Compress across a socket
+void testSocket() {
+  const std::string data = sampleText(300000);
+  std::string decompressed;
+
+  try {
+    const in_port_t port = 8084;
+    net::AddressIPv4 address(port);
+    net::SocketServer server(address.family());
+
+    server.reuseAddress();
+    server.reusePort();
+    server.bind(address);
+    server.listen(1);
+
+    std::thread sender([&server, &data]() {
+      net::AddressIPv4 remote;
+      net::Socket connection;
+
+      server.accept(remote, connection);
+
+      z::DeflateWriter<net::Socket> writer(connection, 6, z::GzipFraming,
+                                           7777);
+
+      writer.write(data);
+      writer.finish();
+      connection.close();
+    });
+    net::AddressIPv4 local(port);
+    net::Socket connection(local.family());
+    std::string buffer;
+
+    connection.connect(local);
+
+    z::InflateReader<net::Socket> reader(connection, z::AutoFraming, 1000);
+
+    while (reader.read(5000, buffer).size() > 0) {
+      decompressed += buffer;
+    }
+    sender.join();
+    dotest(decompressed == data);
+  } catch (const std::exception &exception) {
+    printf("FAIL: socket: %s\n", exception.what());
+  }
+}
+
+int main(const int /*argc*/, const char *const /*argv*/[]) {
+  testSocket();
+  return 0;
+}